@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * level_generator.cpp -- this simple benchmark is used to compare times of
+ * insert and find, and memory usage of concurrent_map with different
+ * probabilities of promoting nodes to the next level.
+ */
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include "../measure.hpp"
+
+#ifndef _WIN32
+
+#include <unistd.h>
+#define CREATE_MODE_RW (S_IWUSR | S_IRUSR)
+
+#else
+
+#include <windows.h>
+#define CREATE_MODE_RW (S_IWRITE | S_IREAD)
+
+#endif
+
+static const std::string LAYOUT = "level_generator";
+
+using key_type = pmem::obj::p<long>;
+using value_type = pmem::obj::p<long>;
+
+using allocator_type =
+	pmem::obj::allocator<pmem::detail::pair<const key_type, value_type>>;
+
+template <typename Probability>
+using persistent_map_type =
+	pmem::obj::experimental::concurrent_map<key_type, value_type,
+						std::less<key_type>,
+						allocator_type, Probability>;
+
+using map_half_type = persistent_map_type<std::ratio<1, 2>>;
+using map_quarter_type = persistent_map_type<std::ratio<1, 4>>;
+using map_e_type = persistent_map_type<std::ratio<36788, 100000>>;
+
+struct root {
+	pmem::obj::persistent_ptr<map_half_type> half;
+	pmem::obj::persistent_ptr<map_quarter_type> quarter;
+	pmem::obj::persistent_ptr<map_e_type> e;
+};
+
+/* returns number of bytes allocated in the pool */
+size_t
+pool_usage(pmem::obj::pool_base &pop)
+{
+	size_t ret = 0;
+
+	for (PMEMoid oid = pmemobj_first(pop.handle()); !OID_IS_NULL(oid);
+	     oid = pmemobj_next(oid))
+		ret += pmemobj_alloc_usable_size(oid);
+
+	return ret;
+}
+
+template <typename MapType>
+void
+run(pmem::obj::pool<root> &pop, pmem::obj::persistent_ptr<MapType> &map,
+    const char *name, size_t count, size_t n_threads)
+{
+	pmem::obj::transaction::run(pop, [&] {
+		map = pmem::obj::make_persistent<MapType>();
+	});
+	map->runtime_initialize();
+
+	size_t usage = pool_usage(pop);
+
+	auto insert_time = measure<std::chrono::milliseconds>([&] {
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < n_threads; t++) {
+			threads.emplace_back([&, t] {
+				for (size_t i = t; i < count; i += n_threads) {
+					long k = static_cast<long>(
+						(i * 2654435761U) % count);
+					map->emplace(k, k);
+				}
+			});
+		}
+
+		for (auto &t : threads)
+			t.join();
+	});
+
+	assert(map->size() == count);
+
+	auto find_time = measure<std::chrono::milliseconds>([&] {
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < n_threads; t++) {
+			threads.emplace_back([&, t] {
+				for (size_t i = t; i < count; i += n_threads) {
+					auto it = map->find(
+						static_cast<long>(i));
+					(void)it;
+					assert(it != map->end());
+				}
+			});
+		}
+
+		for (auto &t : threads)
+			t.join();
+	});
+
+	usage = pool_usage(pop) - usage;
+
+	std::cout << name << ": insert " << insert_time << "ms, find "
+		  << find_time << "ms, " << usage / count
+		  << " bytes per element" << std::endl;
+
+	pmem::obj::transaction::run(pop, [&] {
+		pmem::obj::delete_persistent<MapType>(map);
+		map = nullptr;
+	});
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "usage: " << argv[0]
+			  << " file-name [count] [n_threads]" << std::endl;
+		return 1;
+	}
+
+	const char *path = argv[1];
+	size_t count = argc > 2 ? std::stoull(argv[2]) : 1000000;
+	size_t n_threads = argc > 3 ? std::stoull(argv[3]) : 1;
+
+	if (count * n_threads == 0) {
+		std::cerr << "count and n_threads must be > 0" << std::endl;
+		return 1;
+	}
+
+	pmem::obj::pool<root> pop;
+	try {
+		pop = pmem::obj::pool<root>::create(
+			path, LAYOUT, count * 1024 + 20 * PMEMOBJ_MIN_POOL,
+			CREATE_MODE_RW);
+	} catch (pmem::pool_error &pe) {
+		std::cerr << "!pool::create: " << pe.what() << std::endl;
+		return 1;
+	}
+
+	try {
+		auto r = pop.root();
+
+		run(pop, r->half, "p = 1/2", count, n_threads);
+		run(pop, r->quarter, "p = 1/4", count, n_threads);
+		run(pop, r->e, "p = 1/e", count, n_threads);
+
+		pop.close();
+	} catch (const std::exception &e) {
+		std::cerr << "!exception: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -11,6 +11,7 @@
 
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/life.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/persistent_ptr.hpp>
 #include <libpmemobj++/pexceptions.hpp>
 #include <libpmemobj++/pext.hpp>
@@ -264,6 +265,8 @@ public:
 			}
 		}
 
+		detail::telemetry_on_alloc(*ptr.raw_ptr());
+
 		return ptr;
 	}
 
@@ -281,6 +284,7 @@ public:
 			throw pmem::transaction_scope_error(
 				"refusing to free memory outside of transaction scope");
 
+		detail::telemetry_on_free(*p.raw_ptr());
 		if (pmemobj_tx_free(*p.raw_ptr()) != 0)
 			throw detail::exception_with_errormsg<
 				pmem::transaction_free_error>(
@@ -379,6 +383,8 @@ public:
 			}
 		}
 
+		detail::telemetry_on_alloc(ptr.raw());
+
 		return ptr;
 	}
 
@@ -396,6 +402,7 @@ public:
 			throw pmem::transaction_scope_error(
 				"refusing to free memory outside of transaction scope");
 
+		detail::telemetry_on_free(p.raw());
 		if (pmemobj_tx_free(p.raw()) != 0)
 			throw detail::exception_with_errormsg<
 				pmem::transaction_free_error>(
@@ -13,6 +13,7 @@
 #include <libpmemobj++/detail/atomic_backoff.hpp>
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/pair.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/detail/template_helpers.hpp>
 
 #include <libpmemobj++/defrag.hpp>
@@ -27,15 +28,21 @@
 
 #include <libpmemobj++/detail/enumerable_thread_specific.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <initializer_list>
 #include <iterator> // for std::distance
 #include <memory>
 #include <mutex>
+#include <new>
+#include <stdexcept>
 #include <thread>
 #include <type_traits>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -749,6 +756,255 @@ private:
 	segment_index_t my_seg;
 }; /* End of class segment_facade_impl */
 
+/**
+ * Volatile bitmap of buckets which might be non-empty, used to skip empty
+ * buckets during iteration. A set bit is only a hint (the bucket might have
+ * been emptied in the meantime), a cleared bit means that the bucket is
+ * empty. Bits are grouped by segments (see segment_traits), bits of
+ * a segment are allocated on the first insert into it.
+ */
+class bucket_occupancy {
+public:
+	using size_type = size_t;
+
+	bucket_occupancy() : valid(true)
+	{
+		for (auto &s : segments)
+			s.store(nullptr, std::memory_order_relaxed);
+	}
+
+	~bucket_occupancy()
+	{
+		for (auto &s : segments)
+			delete[] s.load(std::memory_order_relaxed);
+	}
+
+	bucket_occupancy(const bucket_occupancy &) = delete;
+	bucket_occupancy &operator=(const bucket_occupancy &) = delete;
+
+	/**
+	 * Marks the bucket as (possibly) non-empty. Must be called with the
+	 * bucket locked.
+	 */
+	void
+	set(size_type idx)
+	{
+		size_type s = segment_index_of(idx);
+		size_type off = idx - segment_base(s);
+
+		word_type *w = get_words(s, true);
+		if (!w)
+			return;
+
+		uint64_t bit = uint64_t(1) << (off % word_bits);
+		if (!(w[off / word_bits].load(std::memory_order_relaxed) & bit))
+			w[off / word_bits].fetch_or(bit,
+						    std::memory_order_release);
+	}
+
+	/**
+	 * Marks the bucket as empty. Must be called with the bucket locked,
+	 * after the last node was removed from it.
+	 */
+	void
+	reset(size_type idx)
+	{
+		size_type s = segment_index_of(idx);
+		size_type off = idx - segment_base(s);
+
+		word_type *w = get_words(s, false);
+		if (w)
+			w[off / word_bits].fetch_and(
+				~(uint64_t(1) << (off % word_bits)),
+				std::memory_order_release);
+	}
+
+	/**
+	 * Marks all buckets as empty. Not thread-safe.
+	 */
+	void
+	reset()
+	{
+		for (size_type s = 0; s < max_segments; ++s) {
+			word_type *w = get_words(s, false);
+			for (size_type i = 0; w && i < segment_words(s); ++i)
+				w[i].store(0, std::memory_order_relaxed);
+		}
+
+		valid.store(true, std::memory_order_release);
+	}
+
+	/**
+	 * Sets bits of all buckets marked in other. Not thread-safe.
+	 */
+	void
+	merge(const bucket_occupancy &other)
+	{
+		if (!other.valid.load(std::memory_order_acquire))
+			valid.store(false, std::memory_order_release);
+
+		for (size_type s = 0; s < max_segments; ++s) {
+			const word_type *src = other.get_words(s);
+			if (!src)
+				continue;
+
+			for (size_type i = 0; i < segment_words(s); ++i) {
+				uint64_t bits =
+					src[i].load(std::memory_order_relaxed);
+				if (!bits)
+					continue;
+
+				word_type *w = get_words(s, true);
+				if (!w)
+					break;
+
+				w[i].fetch_or(bits, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * Exchanges bits with other. Not thread-safe.
+	 */
+	void
+	swap(bucket_occupancy &other)
+	{
+		for (size_type s = 0; s < max_segments; ++s) {
+			word_type *w = other.segments[s].exchange(
+				segments[s].load(std::memory_order_relaxed),
+				std::memory_order_relaxed);
+			segments[s].store(w, std::memory_order_relaxed);
+		}
+
+		bool v = other.valid.exchange(
+			valid.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		valid.store(v, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @returns index of the first bucket in range [idx, last] which might
+	 * be non-empty, or last + 1 if all of them are empty.
+	 */
+	size_type
+	find_next(size_type idx, size_type last) const
+	{
+		/* some bits could not be allocated, check every bucket */
+		if (!valid.load(std::memory_order_acquire))
+			return idx;
+
+		while (idx <= last) {
+			size_type s = segment_index_of(idx);
+			size_type base = segment_base(s);
+			const word_type *w = get_words(s);
+
+			for (size_type i = (idx - base) / word_bits;
+			     w && i < segment_words(s); ++i) {
+				uint64_t bits =
+					w[i].load(std::memory_order_acquire);
+
+				/* skip buckets before idx in the first word */
+				if (base + i * word_bits < idx)
+					bits &= ~uint64_t(0)
+						<< ((idx - base) % word_bits);
+
+				if (bits) {
+					size_type found = base +
+						i * word_bits +
+						detail::lssb_index64(bits);
+
+					return found <= last ? found
+							     : last + 1;
+				}
+
+				/* no more buckets in range */
+				if (base + (std::min)((i + 1) * word_bits,
+						      segment_size(s)) >
+				    last)
+					return last + 1;
+			}
+
+			idx = base + segment_size(s);
+		}
+
+		return last + 1;
+	}
+
+private:
+	using word_type = std::atomic<uint64_t>;
+
+	static constexpr size_type word_bits = 64;
+	static constexpr size_type max_segments = 8 * sizeof(size_type);
+
+	/* Same layout as segment_traits, segment 0 holds 2 buckets. */
+	static size_type
+	segment_index_of(size_type idx)
+	{
+		return size_type(detail::Log2(idx | 1));
+	}
+
+	static constexpr size_type
+	segment_base(size_type s)
+	{
+		return (size_type(1) << s) & ~size_type(1);
+	}
+
+	static constexpr size_type
+	segment_size(size_type s)
+	{
+		return s ? size_type(1) << s : 2;
+	}
+
+	static constexpr size_type
+	segment_words(size_type s)
+	{
+		return (segment_size(s) + word_bits - 1) / word_bits;
+	}
+
+	const word_type *
+	get_words(size_type s) const
+	{
+		return segments[s].load(std::memory_order_acquire);
+	}
+
+	/*
+	 * Returns bits of the segment s, allocates them if create is true.
+	 * If the allocation fails, the bitmap is marked as invalid (and
+	 * nullptr is returned), so that find_next() does not skip anything.
+	 */
+	word_type *
+	get_words(size_type s, bool create)
+	{
+		word_type *w = segments[s].load(std::memory_order_acquire);
+		if (w || !create)
+			return w;
+
+		size_type n = segment_words(s);
+		word_type *new_words = new (std::nothrow) word_type[n];
+		if (!new_words) {
+			valid.store(false, std::memory_order_release);
+			return nullptr;
+		}
+
+		for (size_type i = 0; i < n; ++i)
+			new_words[i].store(0, std::memory_order_relaxed);
+
+		if (segments[s].compare_exchange_strong(
+			    w, new_words, std::memory_order_acq_rel,
+			    std::memory_order_acquire))
+			return new_words;
+
+		/* other thread allocated the bits in the meantime */
+		delete[] new_words;
+
+		return w;
+	}
+
+	std::atomic<word_type *> segments[max_segments];
+
+	std::atomic<bool> valid;
+}; /* End of class bucket_occupancy */
+
 /**
  * Base class of concurrent_hash_map.
  * Implements logic not dependent to Key/Value types.
@@ -858,7 +1114,24 @@ public:
 
 	using tls_t = detail::enumerable_thread_specific<tls_data_t>;
 
-	enum feature_flags : uint32_t { FEATURE_CONSISTENT_SIZE = 1 };
+	/** Per-thread lists of nodes erased by erase_deferred() */
+	using retired_t = detail::enumerable_thread_specific<node_ptr_t>;
+
+	enum feature_flags : uint32_t {
+		FEATURE_CONSISTENT_SIZE = 1,
+		FEATURE_CLEAR_CURSOR = 2,
+		FEATURE_RETIRED_NODES = 4
+	};
+
+	/**
+	 * Incompat features. A map with any of them set cannot be opened by
+	 * a version of the library which does not know them.
+	 */
+	enum incompat_feature_flags : uint32_t {
+		/** clear(size_type, size_t) is in progress, some buckets
+		 * are already cleared but size is not updated yet */
+		INCOMPAT_FEATURE_CLEAR_IN_PROGRESS = 1
+	};
 
 	/** Compat and incompat features of a layout */
 	struct features {
@@ -914,8 +1187,21 @@ public:
 	 */
 	p<size_t> on_init_size;
 
+	/**
+	 * Progress of an interrupted clear(size_type, size_t): 0 if no clear is
+	 * in progress, otherwise 1 + index of the first bucket which might not
+	 * be cleared yet. Valid only if FEATURE_CLEAR_CURSOR is set.
+	 */
+	p<uint64_t> my_clear_cursor;
+
+	/**
+	 * Nodes erased by erase_deferred() which might still be in use.
+	 * Valid only if FEATURE_RETIRED_NODES is set.
+	 */
+	persistent_ptr<retired_t> my_retired;
+
 	/** Reserved for future use */
-	std::aligned_storage<40, 8>::type reserved;
+	std::aligned_storage<16, 8>::type reserved;
 
 	/** Segment mutex used to enable new segment. */
 	segment_enable_mutex_t my_segment_enable_mutex;
@@ -929,7 +1215,9 @@ public:
 	static constexpr features
 	header_features()
 	{
-		return {FEATURE_CONSISTENT_SIZE, 0};
+		return {FEATURE_CONSISTENT_SIZE | FEATURE_CLEAR_CURSOR |
+				FEATURE_RETIRED_NODES,
+			INCOMPAT_FEATURE_CLEAR_IN_PROGRESS};
 	}
 
 	const std::atomic<hashcode_type> &
@@ -1023,6 +1311,13 @@ public:
 
 		value_size = 0;
 
+		my_clear_cursor = 0;
+
+		my_retired = nullptr;
+
+		/* drop the bitmap of a map which lived here before */
+		release_occupancy();
+
 		this->tls_ptr = nullptr;
 	}
 
@@ -1043,6 +1338,14 @@ public:
 				tls_ptr = nullptr;
 			});
 		}
+
+		if ((layout_features.compat & FEATURE_RETIRED_NODES) &&
+		    my_retired) {
+			flat_transaction::run(pop, [&] {
+				delete_persistent<retired_t>(my_retired);
+				my_retired = nullptr;
+			});
+		}
 	}
 
 	/**
@@ -1070,7 +1373,128 @@ public:
 			++segment;
 		}
 
-		mask().store(m, std::memory_order_relaxed);
+		/* do not write to the pool if the mask is up to date, e.g. in
+		 * a pool opened with pool_base::open_read_only() */
+		if (mask().load(std::memory_order_relaxed) != m)
+			mask().store(m, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @returns bitmap of non-empty buckets or nullptr if it was not built
+	 * (then every bucket is visited by the iterators). The bitmap is owned
+	 * by the volatile data of the pool, so it is rebuilt by
+	 * runtime_initialize() after each process restart.
+	 */
+	bucket_occupancy *
+	occupancy() const
+	{
+		return detail::get_volatile_object<bucket_occupancy>(this);
+	}
+
+	/**
+	 * Build bitmap of non-empty buckets, if it does not exist yet. It is
+	 * called by runtime_initialize(), which is not thread safe, so no
+	 * bucket can be modified during the scan. If called inside
+	 * a transaction, the bitmap is dropped when the transaction aborts
+	 * (and restores erased nodes or frees a newly constructed map).
+	 */
+	void
+	build_occupancy() const
+	{
+		if (occupancy())
+			return;
+
+		std::unique_ptr<bucket_occupancy> occupancy(
+			new bucket_occupancy);
+
+		hashcode_type m = mask().load(std::memory_order_relaxed);
+		for (hashcode_type i = 0; i <= m; ++i) {
+			if (get_bucket(i)->node_list)
+				occupancy->set(i);
+		}
+
+		PMEMobjpool *pop = pmemobj_pool_by_ptr(this);
+		const void *key = this;
+
+		if (!detail::emplace_volatile_object(pop, this,
+						     std::move(occupancy)))
+			return;
+
+		if (pmemobj_tx_stage() == TX_STAGE_WORK) {
+			flat_transaction::register_callback(
+				flat_transaction::stage::onabort, [pop, key] {
+					detail::erase_volatile_object(pop, key);
+				});
+		}
+	}
+
+	/**
+	 * Detach and free the bitmap of non-empty buckets. If called inside
+	 * a transaction, it is freed when the transaction commits.
+	 */
+	void
+	release_occupancy()
+	{
+		if (!occupancy())
+			return;
+
+		PMEMobjpool *pop = get_pool_base().handle();
+		const void *key = this;
+
+		if (pmemobj_tx_stage() == TX_STAGE_WORK) {
+			flat_transaction::register_callback(
+				flat_transaction::stage::oncommit, [pop, key] {
+					detail::erase_volatile_object(pop, key);
+				});
+		} else {
+			detail::erase_volatile_object(pop, key);
+		}
+	}
+
+	/**
+	 * Mark bucket with index h as non-empty.
+	 * @pre the bucket must be locked.
+	 */
+	void
+	mark_occupied(hashcode_type h)
+	{
+		if (auto *o = occupancy())
+			o->set(h);
+	}
+
+	/**
+	 * Mark bucket with index h as empty.
+	 * @pre the bucket must be locked and must not be modified by an
+	 * outer transaction (which could be aborted).
+	 */
+	void
+	mark_empty(hashcode_type h)
+	{
+		if (auto *o = occupancy())
+			o->reset(h);
+	}
+
+	/**
+	 * @returns index of the first bucket in range [h, m] which might be
+	 * non-empty or m + 1 if there is no such bucket.
+	 */
+	hashcode_type
+	next_occupied(hashcode_type h, hashcode_type m) const
+	{
+		auto *o = occupancy();
+
+		return o ? o->find_next(h, m) : h;
+	}
+
+	/**
+	 * @returns true if the pool was opened with
+	 * pool_base::open_read_only(). The map cannot be modified then and
+	 * lookups can skip locking.
+	 */
+	bool
+	is_read_only() const noexcept
+	{
+		return detail::in_read_only_pool(this);
 	}
 
 	/**
@@ -1347,6 +1771,7 @@ public:
 
 			/* Swap consistent size */
 			std::swap(this->tls_ptr, table.tls_ptr);
+			std::swap(this->my_retired, table.my_retired);
 
 			for (size_type i = 0; i < embedded_buckets; ++i)
 				this->my_embedded_segment[i].node_list.swap(
@@ -1358,6 +1783,21 @@ public:
 
 			flat_transaction::commit();
 		}
+
+		bucket_occupancy *o1 = occupancy();
+		bucket_occupancy *o2 = table.occupancy();
+
+		if (!o1 || !o2) {
+			this->release_occupancy();
+			table.release_occupancy();
+		} else if (pmemobj_tx_stage() == TX_STAGE_WORK) {
+			/* outer transaction can be aborted, both bitmaps must
+			 * cover the buckets of both maps */
+			o1->merge(*o2);
+			o2->merge(*o1);
+		} else {
+			o1->swap(*o2);
+		}
 	}
 
 	/**
@@ -1530,7 +1970,8 @@ private:
 
 		assert(my_bucket);
 
-		while (k <= my_map->mask()) {
+		while ((k = my_map->next_occupied(k, my_map->mask())) <=
+		       my_map->mask()) {
 			bucket_accessor acc(my_map, k);
 			my_bucket = acc.get();
 
@@ -1588,6 +2029,12 @@ operator!=(const hash_map_iterator<Container, M> &i,
  * find(), insert(), erase() (and all overloads) are guaranteed to be
  * thread-safe.
  *
+ * If the pool was opened with pool_base::open_read_only(), find() and count()
+ * do not acquire bucket nor item locks and const accessors do not hold any
+ * lock. All modifying operations, including find() with a non-const accessor,
+ * throw pmem::transaction_scope_error in such a pool before accessing any
+ * bucket. size() is then calculated on each call.
+ *
  * When a thread holds accessor to an element with a certain key, it is not
  * allowed to call find, insert nor erase with that key.
  *
@@ -1663,19 +2110,27 @@ protected:
 		concurrent_hash_map_internal::hash_map_base<Key, T, mutex_t,
 							    scoped_t>;
 	using hash_map_base::calculate_mask;
+	using hash_map_base::build_occupancy;
 	using hash_map_base::check_growth;
 	using hash_map_base::check_mask_race;
 	using hash_map_base::embedded_buckets;
+	using hash_map_base::FEATURE_CLEAR_CURSOR;
 	using hash_map_base::FEATURE_CONSISTENT_SIZE;
+	using hash_map_base::FEATURE_RETIRED_NODES;
 	using hash_map_base::get_bucket;
 	using hash_map_base::get_pool_base;
 	using hash_map_base::header_features;
+	using hash_map_base::INCOMPAT_FEATURE_CLEAR_IN_PROGRESS;
 	using hash_map_base::insert_new_node;
 	using hash_map_base::internal_swap;
+	using hash_map_base::is_read_only;
 	using hash_map_base::layout_features;
+	using hash_map_base::mark_empty;
+	using hash_map_base::mark_occupied;
 	using hash_map_base::mask;
 	using hash_map_base::reserve;
 	using tls_t = typename hash_map_base::tls_t;
+	using retired_t = typename hash_map_base::retired_t;
 	using node = typename hash_map_base::node;
 	using node_mutex_t = typename node::mutex_t;
 	using node_ptr_t = typename hash_map_base::node_ptr_t;
@@ -1898,6 +2353,8 @@ protected:
 		if (*p_new != nullptr) {
 			assert(!b_new->is_rehashed(std::memory_order_relaxed));
 
+			mark_occupied(h);
+
 			b_new->set_rehashed(std::memory_order_relaxed);
 			pop.persist(b_new->rehashed);
 
@@ -1956,15 +2413,56 @@ protected:
 			*p_new = nullptr;
 		});
 
+		if (b_new->node_list)
+			mark_occupied(h);
+
 		/* mark rehashed */
 		b_new->set_rehashed(std::memory_order_release);
 		pop.persist(b_new->rehashed);
 	}
 
+	/**
+	 * Calculates size of the map in a pool opened with
+	 * pool_base::open_read_only(), without writing to the pool.
+	 */
+	size_type
+	read_only_size() const
+	{
+		if (layout_features.compat & FEATURE_CONSISTENT_SIZE) {
+			assert(this->tls_ptr != nullptr);
+
+			int64_t last_run_size = 0;
+			for (auto &data : *this->tls_ptr)
+				last_run_size += data.size_diff;
+
+			return this->on_init_size +
+				static_cast<size_type>(last_run_size);
+		}
+
+		auto actual_size = std::distance(this->begin(), this->end());
+		assert(actual_size >= 0);
+
+		return static_cast<size_type>(actual_size);
+	}
+
+	/**
+	 * Called by all modifying operations, before any bucket is accessed.
+	 *
+	 * @throw pmem::transaction_scope_error if the pool was opened with
+	 * pool_base::open_read_only().
+	 */
+	void
+	check_writable() const
+	{
+		if (is_read_only())
+			throw pmem::transaction_scope_error(
+				"Cannot modify concurrent_hash_map in a read-only pool");
+	}
+
 	void
 	check_incompat_features()
 	{
-		if (layout_features.incompat != header_features().incompat)
+		if (layout_features.incompat & ~header_features().incompat)
 			throw pmem::layout_error(
 				"Incompat flags mismatch, for more details go to: https://pmem.io/libpmemobj-cpp\n");
 
@@ -2013,6 +2511,13 @@ public:
 		void
 		release()
 		{
+			/* No lock is held on elements of a read-only map */
+			if (my_unlocked) {
+				my_node = OID_NULL;
+				my_unlocked = false;
+				return;
+			}
+
 			concurrent_hash_map_internal::check_outside_tx();
 
 			if (my_node) {
@@ -2044,7 +2549,8 @@ public:
 		 *
 		 * Cannot be used in a transaction.
 		 */
-		const_accessor() : my_node(OID_NULL), my_hash()
+		const_accessor()
+		    : my_node(OID_NULL), my_hash(), my_unlocked(false)
 		{
 			concurrent_hash_map_internal::check_outside_tx();
 		}
@@ -2062,6 +2568,10 @@ public:
 		node_ptr_t my_node;
 
 		hashcode_type my_hash;
+
+		/* True if my_node was found in a read-only map without
+		 * acquiring the item lock */
+		bool my_unlocked;
 	};
 
 	/**
@@ -2160,7 +2670,8 @@ public:
 	 * Not thread safe.
 	 *
 	 * @throw pmem::layout_error if hashmap was created using incompatible
-	 * version of libpmemobj-cpp
+	 * version of libpmemobj-cpp or if the pool is read-only and
+	 * clear(size_type, size_t) was interrupted.
 	 */
 	void
 	runtime_initialize()
@@ -2169,6 +2680,13 @@ public:
 
 		calculate_mask();
 
+		/* the size is calculated on demand, see size() */
+		if (is_read_only()) {
+			recover_clear();
+			build_occupancy();
+			return;
+		}
+
 		/*
 		 * Handle case where hash_map was created without
 		 * FEATURE_CONSISTENT_SIZE.
@@ -2192,9 +2710,40 @@ public:
 			});
 		} else {
 			assert(this->tls_ptr != nullptr);
+
+			/* no accessors exist yet, retired nodes can be freed */
+			if (layout_features.compat & FEATURE_RETIRED_NODES)
+				free_retired();
+
 			this->tls_restore();
 		}
 
+		/*
+		 * Handle case where hash_map was created without
+		 * FEATURE_RETIRED_NODES.
+		 */
+		if (!(layout_features.compat & FEATURE_RETIRED_NODES)) {
+			auto pop = get_pool_base();
+			flat_transaction::run(pop, [&] {
+				this->my_retired = make_persistent<retired_t>();
+
+				layout_features.compat |= FEATURE_RETIRED_NODES;
+			});
+		}
+
+		if (!(layout_features.compat & FEATURE_CLEAR_CURSOR)) {
+			auto pop = get_pool_base();
+			flat_transaction::run(pop, [&] {
+				this->my_clear_cursor = 0;
+
+				layout_features.compat |= FEATURE_CLEAR_CURSOR;
+			});
+		} else {
+			recover_clear();
+		}
+
+		build_occupancy();
+
 		assert(this->size() ==
 		       size_type(std::distance(this->begin(), this->end())));
 	}
@@ -2207,7 +2756,11 @@ public:
 
 		calculate_mask();
 
-		if (!graceful_shutdown) {
+		recover_clear();
+
+		if (is_read_only()) {
+			/* the size is calculated on demand, see size() */
+		} else if (!graceful_shutdown) {
 			auto actual_size =
 				std::distance(this->begin(), this->end());
 			assert(actual_size >= 0);
@@ -2217,6 +2770,8 @@ public:
 			       size_type(std::distance(this->begin(),
 						       this->end())));
 		}
+
+		build_occupancy();
 	}
 
 	/**
@@ -2264,6 +2819,55 @@ public:
 		return *this;
 	}
 
+	/**
+	 * Replaces the content of the map with a copy of source, using
+	 * concurrency threads.
+	 *
+	 * Unlike operator=, which inserts the elements one by one, the
+	 * buckets of source are split into chunks of buckets_per_tx buckets
+	 * and each chunk is copied to the presized map in a separate
+	 * transaction. Chunks are processed by the calling thread and
+	 * concurrency - 1 additional threads.
+	 *
+	 * If it fails with an exception, the map contains a subset of the
+	 * elements of source.
+	 *
+	 * Not thread safe, source must not be modified concurrently.
+	 *
+	 * @param[in] source map to be copied.
+	 * @param[in] buckets_per_tx number of buckets of source copied in
+	 * a single transaction.
+	 * @param[in] concurrency number of threads copying the buckets.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 * @throw pmem::transaction_error in case of PMDK transaction failure
+	 * @throw pmem::transaction_alloc_error when allocating new memory
+	 * failed.
+	 * @throw rethrows constructor's exception.
+	 */
+	void assign(const concurrent_hash_map &source, size_type buckets_per_tx,
+		    size_t concurrency = 1);
+
+	/**
+	 * Moves elements of other, which keys are not present in *this, to
+	 * *this. Elements with keys present in both maps are left in other.
+	 *
+	 * Nodes are relinked between the maps, no element is copied nor
+	 * reallocated, so both maps must reside in the same pool. Buckets of
+	 * other are processed in chunks, each in a separate transaction. If
+	 * the operation is interrupted, every element is in exactly one of
+	 * the maps.
+	 *
+	 * Not thread safe.
+	 *
+	 * @param[in,out] other map whose elements are moved.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 * @throw std::invalid_argument if the maps reside in different pools.
+	 * @throw pmem::transaction_error in case of PMDK transaction failure
+	 */
+	void merge(concurrent_hash_map &other);
+
 	/**
 	 * Rehashes and optionally resizes the whole table.
 	 * Useful to optimize performance before or after concurrent
@@ -2283,10 +2887,39 @@ public:
 	void clear();
 
 	/**
-	 * Destroys the concurrent_hash_map. Unlike destructor it will throw
-	 * an exception in case of any failure (e.g. not enough space for a
-	 * transactional data). If that happens, it might be necessary to free
-	 * some other data in the pool.
+	 * Clear hash map content in bounded transactions.
+	 *
+	 * Unlike clear(), which frees all nodes in a single transaction, the
+	 * buckets are cleared in chunks of buckets_per_tx buckets, each in a
+	 * separate transaction, so the size of the undo log does not depend
+	 * on the size of the map. Chunks are processed by the calling thread
+	 * and concurrency - 1 additional threads.
+	 *
+	 * The progress is stored in the map. If the operation is interrupted
+	 * (e.g. by a crash), it is resumed by runtime_initialize() instead of
+	 * being rolled back. Until the clear is finished, the map is marked
+	 * with an incompat feature, so it cannot be opened by older versions
+	 * of the library nor in a read-only pool. If it fails with an
+	 * exception, the map must be cleared again (by any of the clear
+	 * functions) before it is used.
+	 *
+	 * Not thread safe.
+	 *
+	 * @param[in] buckets_per_tx number of buckets cleared in a single
+	 * transaction.
+	 * @param[in] concurrency number of threads clearing the buckets.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 * @throw pmem::transaction_error in case of PMDK transaction failure
+	 * @throw pmem::transaction_free_error when freeing memory failed.
+	 */
+	void clear(size_type buckets_per_tx, size_t concurrency = 1);
+
+	/**
+	 * Destroys the concurrent_hash_map. Unlike destructor it will throw
+	 * an exception in case of any failure (e.g. not enough space for a
+	 * transactional data). If that happens, it might be necessary to free
+	 * some other data in the pool.
 	 *
 	 * Should be called before concurrent_hash_map destructor is called.
 	 * Otherwise, program can terminate if an exception occurs while freeing
@@ -2310,9 +2943,37 @@ public:
 		flat_transaction::run(pop, [&] {
 			clear();
 			this->free_tls();
+			this->release_occupancy();
 		});
 	}
 
+	/**
+	 * Frees the content of the concurrent_hash_map in bounded
+	 * transactions, see clear(size_type, size_t). Must be called outside
+	 * of a transaction, before the map is deleted.
+	 *
+	 * Hash map can NOT be used after free_data() was called.
+	 *
+	 * @param[in] buckets_per_tx number of buckets cleared in a single
+	 * transaction.
+	 * @param[in] concurrency number of threads clearing the buckets.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 * @throw pmem::transaction_error in case of PMDK transaction failure
+	 * @throw pmem::transaction_free_error when freeing underlying memory
+	 * failed.
+	 */
+	void
+	free_data(size_type buckets_per_tx, size_t concurrency = 1)
+	{
+		if (!this->tls_ptr)
+			return;
+
+		clear(buckets_per_tx, concurrency);
+		this->free_tls();
+		this->release_occupancy();
+	}
+
 	/**
 	 * free_data should be called before concurrent_hash_map
 	 * destructor is called. Otherwise, program can terminate if
@@ -2382,6 +3043,9 @@ public:
 	size_type
 	size() const
 	{
+		if (is_read_only())
+			return read_only_size();
+
 		return hash_map_base::size();
 	}
 
@@ -2516,6 +3180,7 @@ public:
 	find(accessor &result, const Key &key)
 	{
 		concurrent_hash_map_internal::check_outside_tx();
+		check_writable();
 
 		result.release();
 
@@ -2544,6 +3209,7 @@ public:
 	find(accessor &result, const K &key)
 	{
 		concurrent_hash_map_internal::check_outside_tx();
+		check_writable();
 
 		result.release();
 
@@ -2817,6 +3483,126 @@ public:
 		return internal_erase(key);
 	}
 
+	/**
+	 * Remove element with corresponding key without waiting for the
+	 * accessors which hold the element.
+	 *
+	 * The element is unlinked from the map immediately. If it is held by
+	 * an accessor, it is moved to a persistent list of elements retired by
+	 * the calling thread instead of being freed. The accessor can still
+	 * use the element until it is released.
+	 *
+	 * The memory of a retired element is not freed when the accessor is
+	 * released, but only by the first of the following calls made after
+	 * that: erase_deferred() or reclaim_retired() in the same thread,
+	 * reclaim_all_retired() in any thread, clear(), free_data() or
+	 * runtime_initialize() after a restart. If the retiring thread stops
+	 * erasing elements, reclaim_all_retired() should be called
+	 * periodically.
+	 *
+	 * @return true if element was deleted by this call
+	 * @throw pmem::transaction_free_error in case of PMDK unable to free
+	 * the memory
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 */
+	bool
+	erase_deferred(const Key &key)
+	{
+		concurrent_hash_map_internal::check_outside_tx();
+
+		reclaim_retired();
+
+		return internal_erase(key, true);
+	}
+
+	/**
+	 * Remove element with corresponding key without waiting for the
+	 * accessors which hold the element, see erase_deferred(const Key &).
+	 *
+	 * This overload only participates in overload resolution if the
+	 * qualified-id Hash::transparent_key_equal is valid and denotes a type.
+	 * This assumes that such Hash is callable with both K and Key type, and
+	 * that its key_equal is transparent, which, together, allows calling
+	 * this function without constructing an instance of Key.
+	 *
+	 * @return true if element was deleted by this call
+	 * @throw pmem::transaction_free_error in case of PMDK unable to free
+	 * the memory
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 */
+	template <typename K,
+		  typename = typename std::enable_if<
+			  concurrent_hash_map_internal::
+				  has_transparent_key_equal<hasher>::value,
+			  K>::type>
+	bool
+	erase_deferred(const K &key)
+	{
+		concurrent_hash_map_internal::check_outside_tx();
+
+		reclaim_retired();
+
+		return internal_erase(key, true);
+	}
+
+	/**
+	 * Free the elements retired by erase_deferred() in the calling thread
+	 * which are no longer held by any accessor.
+	 *
+	 * @return number of freed elements.
+	 * @throw pmem::transaction_free_error in case of PMDK unable to free
+	 * the memory
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 */
+	size_type
+	reclaim_retired()
+	{
+		concurrent_hash_map_internal::check_outside_tx();
+		check_writable();
+
+		assert(this->my_retired != nullptr);
+		node_ptr_t &retired = this->my_retired->local();
+		if (!retired)
+			return 0;
+
+		size_type freed = 0;
+		pool_base pop = get_pool_base();
+		flat_transaction::run(
+			pop, [&] { freed = reclaim_retired_list(retired); });
+
+		return freed;
+	}
+
+	/**
+	 * Free the elements retired by erase_deferred() in all threads which
+	 * are no longer held by any accessor.
+	 *
+	 * Can be called concurrently with lookups, inserts, erase() and
+	 * accessors, but not with erase_deferred() or reclaim_retired().
+	 *
+	 * @return number of freed elements.
+	 * @throw pmem::transaction_free_error in case of PMDK unable to free
+	 * the memory
+	 * @throw pmem::transaction_scope_error if called inside transaction
+	 */
+	size_type
+	reclaim_all_retired()
+	{
+		concurrent_hash_map_internal::check_outside_tx();
+		check_writable();
+
+		assert(this->my_retired != nullptr);
+
+		size_type freed = 0;
+		pool_base pop = get_pool_base();
+		flat_transaction::run(pop, [&] {
+			for (auto &retired : *this->my_retired)
+				freed += reclaim_retired_list(retired);
+		});
+
+		return freed;
+	}
+
 	/**
 	 * Defragment the given (by 'start_percent' and 'amount_percent') part
 	 * of buckets of the hash map. The algorithm is 'opportunistic' -
@@ -2838,6 +3624,8 @@ public:
 	pobj_defrag_result
 	defragment(double start_percent = 0, double amount_percent = 100)
 	{
+		check_writable();
+
 		double end_percent = start_percent + amount_percent;
 		if (start_percent < 0 || start_percent >= 100 ||
 		    end_percent < 0 || end_percent > 100 ||
@@ -2963,6 +3751,10 @@ protected:
 	template <typename K>
 	bool internal_find(const K &key, const_accessor *result, bool write);
 
+	template <typename K>
+	bool internal_find_read_only(const K &key,
+				     const_accessor *result) const;
+
 	template <typename K, typename... Args>
 	bool internal_insert(const K &key, const_accessor *result, bool write,
 			     Args &&... args);
@@ -2995,10 +3787,95 @@ protected:
 	}
 
 	template <typename K>
-	bool internal_erase(const K &key);
+	bool internal_erase(const K &key, bool defer = false);
+
+	/**
+	 * Frees elements from the list of retired nodes which are no longer
+	 * held by any accessor. Must be called in a transaction.
+	 */
+	size_type
+	reclaim_retired_list(node_ptr_t &retired)
+	{
+		size_type freed = 0;
+
+		node_ptr_t *p = &retired;
+		while (*p) {
+			node_ptr_t n = *p;
+			node *del = n.get(this->my_pool_uuid);
+
+			/* The element is unreachable, so the lock can only be
+			 * held by old accessors. */
+			scoped_t lock;
+			if (!lock.try_acquire(del->mutex, true)) {
+				p = &del->next;
+				continue;
+			}
+			lock.release();
+
+			*p = del->next;
+			delete_node(n);
+			++freed;
+		}
+
+		return freed;
+	}
+
+	/**
+	 * Frees elements retired by all threads. Not thread-safe, no accessor
+	 * can hold any of them.
+	 */
+	void
+	free_retired()
+	{
+		assert(this->my_retired != nullptr);
+
+		pool_base pop = get_pool_base();
+		flat_transaction::run(pop, [&] {
+			for (auto &retired : *this->my_retired) {
+				while (retired) {
+					node_ptr_t n = retired;
+					retired = n(this->my_pool_uuid)->next;
+					delete_node(n);
+				}
+			}
+			this->my_retired->clear();
+		});
+	}
 
 	void clear_segment(segment_index_t s);
 
+	void clear_bucket(bucket *b);
+
+	void internal_chunked_clear(size_type buckets_per_tx,
+				    size_t concurrency);
+
+	/* Number of buckets cleared in a single transaction on recovery */
+	static constexpr size_type default_clear_chunk = 1024;
+
+	/*
+	 * Finishes clear(size_type, size_t) which was interrupted. A partially
+	 * cleared map cannot be used, so it is refused in a read-only pool.
+	 */
+	void
+	recover_clear()
+	{
+		if (!(layout_features.compat & FEATURE_CLEAR_CURSOR) ||
+		    this->my_clear_cursor == 0)
+			return;
+
+		if (is_read_only())
+			throw pmem::layout_error(
+				"Interrupted clear of concurrent_hash_map cannot be finished in a read-only pool.");
+
+		internal_chunked_clear(default_clear_chunk, 1);
+	}
+
+	void copy_nodes(const concurrent_hash_map &source, hashcode_type &i,
+			hashcode_type e, node_ptr_t &n, p<int64_t> &size_diff);
+
+	/* Number of buckets of the other map merged in a single transaction */
+	static constexpr size_type merge_chunk = 1024;
+
 	/**
 	 * Copy "source" to *this, where *this must start out empty.
 	 */
@@ -3065,6 +3942,11 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 {
 	assert(!result || !result->my_node);
 
+	if (is_read_only()) {
+		assert(!write);
+		return internal_find_read_only(key, result);
+	}
+
 	hashcode_type m = mask().load(std::memory_order_acquire);
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
 	ANNOTATE_HAPPENS_AFTER(&(this->my_mask));
@@ -3119,6 +4001,41 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 	return true;
 }
 
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType>
+template <typename K>
+bool
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::
+	internal_find_read_only(const K &key, const_accessor *result) const
+{
+	assert(is_read_only());
+
+	hashcode_type const h = hasher{}(key);
+	hashcode_type idx = h & mask().load(std::memory_order_relaxed);
+	bucket *b = this->get_bucket(idx);
+
+	/* Nobody can rehash the bucket, its elements might still be stored in
+	 * one of the parent buckets. First two buckets are always rehashed. */
+	while (!b->is_rehashed(std::memory_order_relaxed)) {
+		assert(idx > 1);
+		idx &= (hashcode_type(1) << detail::Log2(idx)) - 1;
+		b = this->get_bucket(idx);
+	}
+
+	persistent_node_ptr_t node = search_bucket(key, b);
+
+	if (!node)
+		return false;
+
+	if (result) {
+		result->my_node = node.get_persistent_ptr(this->my_pool_uuid);
+		result->my_hash = h;
+		result->my_unlocked = true;
+	}
+
+	return true;
+}
+
 template <typename Key, typename T, typename Hash, typename KeyEqual,
 	  typename MutexType, typename ScopedLockType>
 template <typename K, typename... Args>
@@ -3131,6 +4048,8 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 {
 	assert(!result || !result->my_node);
 
+	check_writable();
+
 	hashcode_type m = mask().load(std::memory_order_acquire);
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
 	ANNOTATE_HAPPENS_AFTER(&(this->my_mask));
@@ -3161,6 +4080,7 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 			/* insert and set flag to grow the container */
 			new_size = insert_new_node(b.get(), node,
 						   std::forward<Args>(args)...);
+			mark_occupied(h & m);
 			inserted = true;
 		}
 
@@ -3197,8 +4117,10 @@ template <typename Key, typename T, typename Hash, typename KeyEqual,
 template <typename K>
 bool
 concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
-		    ScopedLockType>::internal_erase(const K &key)
+		    ScopedLockType>::internal_erase(const K &key, bool defer)
 {
+	check_writable();
+
 	node_ptr_t n;
 	hashcode_type const h = hasher{}(key);
 	hashcode_type m = mask().load(std::memory_order_acquire);
@@ -3243,13 +4165,21 @@ search:
 
 	persistent_ptr<node> del = n(this->my_pool_uuid);
 
+	/* Node held by accessors, unlinked without waiting for them */
+	bool retire = false;
+
 	{
 		/* We cannot remove this element immediately because
 		 * other threads might work with this element via
 		 * accessors. The item_locker required to wait while
 		 * other threads use the node. */
 		const_accessor acc;
-		if (!try_acquire_item(&acc, del->mutex, true)) {
+		if (defer) {
+			/* New accessors can only be acquired under the bucket
+			 * lock, the node is freed once the old ones are
+			 * released (see reclaim_retired()). */
+			retire = !acc.try_acquire(del->mutex, true);
+		} else if (!try_acquire_item(&acc, del->mutex, true)) {
 			/* the wait takes really long, restart the operation */
 			b.release();
 
@@ -3263,18 +4193,34 @@ search:
 
 	assert(pmemobj_tx_stage() == TX_STAGE_NONE);
 
-	auto &size_diff = this->thread_size_diff();
+	assert(this->tls_ptr != nullptr);
+	auto &tls = this->tls_ptr->local();
+
+	node_ptr_t *retired = nullptr;
+	if (retire) {
+		assert(this->my_retired != nullptr);
+		retired = &this->my_retired->local();
+	}
 
 	/* Only one thread can delete it due to write lock on the bucket
 	 */
 	flat_transaction::run(pop, [&] {
 		*p = del->next;
-		delete_node(del);
 
-		--size_diff;
+		if (retire) {
+			del->next = *retired;
+			*retired = n;
+		} else {
+			delete_node(del);
+		}
+
+		--tls.size_diff;
 	});
 
 	--(this->my_size);
+
+	if (!b->node_list)
+		mark_empty(h & m);
 }
 
 	return true;
@@ -3286,9 +4232,224 @@ void
 concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::swap(
 	concurrent_hash_map<Key, T, Hash, KeyEqual, mutex_t, scoped_t> &table)
 {
+	check_writable();
+	table.check_writable();
+
 	internal_swap(table);
 }
 
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType>
+void
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::assign(
+	const concurrent_hash_map &source, size_type buckets_per_tx,
+	size_t concurrency)
+{
+	concurrent_hash_map_internal::check_outside_tx();
+	check_writable();
+
+	if (this == &source)
+		return;
+
+	buckets_per_tx = (std::max)(buckets_per_tx, size_type(1));
+	concurrency = (std::max)(concurrency, size_t(1));
+
+	clear();
+
+	/* all buckets of the empty map are marked as rehashed */
+	reserve(source.size());
+
+	hashcode_type source_m = source.mask();
+	size_type n_chunks = (source_m + buckets_per_tx) / buckets_per_tx;
+
+	std::atomic<size_type> next_chunk(0);
+	std::mutex error_mtx;
+	std::exception_ptr error;
+
+	auto worker = [&] {
+		try {
+			auto &size_diff = this->thread_size_diff();
+
+			for (;;) {
+				size_type c = next_chunk.fetch_add(1);
+				if (c >= n_chunks)
+					return;
+
+				hashcode_type i = c * buckets_per_tx;
+				hashcode_type e = (std::min)(i + buckets_per_tx,
+							     source_m + 1);
+
+				node_ptr_t n = nullptr;
+				while (i < e)
+					copy_nodes(source, i, e, n, size_diff);
+			}
+		} catch (...) {
+			std::unique_lock<std::mutex> lock(error_mtx);
+
+			/* stop other workers */
+			next_chunk.store(n_chunks);
+			if (!error)
+				error = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(concurrency - 1);
+	for (size_t i = 1; i < concurrency; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto &t : threads)
+		t.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+/*
+ * Copies nodes of the source buckets [i, e), starting from node n of bucket
+ * i, in a single transaction. Locks of the target buckets are held until the
+ * transaction ends (an aborted transaction restores the buckets). To avoid
+ * deadlocks, the transaction is committed early if a lock cannot be acquired
+ * without waiting, i and n are then set to the first node not copied.
+ */
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType>
+void
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::
+	copy_nodes(const concurrent_hash_map &source, hashcode_type &i,
+		   hashcode_type e, node_ptr_t &n, p<int64_t> &size_diff)
+{
+	pool_base pop = get_pool_base();
+	hashcode_type m = mask();
+	size_type copied = 0;
+
+	/* must be destroyed after the transaction ends */
+	std::deque<bucket_lock_type> locks;
+	std::unordered_set<bucket *> locked;
+
+	{
+		flat_transaction::manual tx(pop);
+
+		for (; i < e; ++i) {
+			if (!n)
+				n = source.get_bucket(i)->node_list;
+
+			for (; n; n = n(source.my_pool_uuid)->next) {
+				const value_type &item =
+					n(source.my_pool_uuid)->item;
+				hashcode_type h = hasher{}(item.first) & m;
+				bucket *b = get_bucket(h);
+
+				if (locked.find(b) == locked.end()) {
+					locks.emplace_back();
+					if (!locks.back().try_acquire(b->mutex,
+								      true)) {
+						if (!locked.empty()) {
+							locks.pop_back();
+							goto commit;
+						}
+
+						locks.back().acquire(b->mutex,
+								     true);
+					}
+
+					locked.insert(b);
+				}
+
+				persistent_node_ptr_t new_node;
+				this->insert_new_node_internal(b, new_node,
+							       item);
+				mark_occupied(h);
+
+				++copied;
+			}
+		}
+
+	commit:
+		size_diff += static_cast<int64_t>(copied);
+
+		flat_transaction::commit();
+	}
+
+	this->my_size += copied;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType>
+void
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::merge(
+	concurrent_hash_map &other)
+{
+	concurrent_hash_map_internal::check_outside_tx();
+	check_writable();
+	other.check_writable();
+
+	if (this == &other)
+		return;
+
+	if (this->my_pool_uuid != other.my_pool_uuid)
+		throw std::invalid_argument(
+			"concurrent_hash_map::merge: maps reside in different pools");
+
+	/* make sure no bucket is rehashed inside the transactions below */
+	rehash(this->size() + other.size());
+
+	pool_base pop = get_pool_base();
+	hashcode_type m = mask();
+	hashcode_type other_m = other.mask();
+
+	auto &size_diff = this->thread_size_diff();
+	auto &other_size_diff = other.thread_size_diff();
+
+	for (hashcode_type first = 0; first <= other_m; first += merge_chunk) {
+		hashcode_type last =
+			(std::min)(first + merge_chunk, other_m + 1);
+		size_type moved = 0;
+
+		flat_transaction::run(pop, [&] {
+			for (hashcode_type i = first; i < last; ++i) {
+				node_ptr_t *p = &other.get_bucket(i)->node_list;
+
+				while (*p) {
+					node_ptr_t n = *p;
+					node *np = n(this->my_pool_uuid);
+					hashcode_type h =
+						hasher{}(np->item.first) & m;
+					bucket *b = get_bucket(h);
+
+					assert(b->is_rehashed(
+						std::memory_order_relaxed));
+
+					if (search_bucket(np->item.first, b)) {
+						p = &np->next;
+						continue;
+					}
+
+					*p = np->next;
+					np->next = b->node_list;
+					b->node_list = n;
+
+					mark_occupied(h);
+					++moved;
+				}
+			}
+
+			size_diff += static_cast<int64_t>(moved);
+			other_size_diff -= static_cast<int64_t>(moved);
+		});
+
+		this->my_size += moved;
+		other.my_size -= moved;
+
+		for (hashcode_type i = first; i < last; ++i) {
+			if (!other.get_bucket(i)->node_list)
+				other.mark_empty(i);
+		}
+	}
+}
+
 template <typename Key, typename T, typename Hash, typename KeyEqual,
 	  typename MutexType, typename ScopedLockType>
 void
@@ -3296,6 +4457,7 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::rehash(
 	size_type sz)
 {
 	concurrent_hash_map_internal::check_outside_tx();
+	check_writable();
 
 	reserve(sz);
 	hashcode_type m = mask();
@@ -3324,6 +4486,8 @@ template <typename Key, typename T, typename Hash, typename KeyEqual,
 void
 concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::clear()
 {
+	check_writable();
+
 	hashcode_type m = mask();
 
 	assert((m & (m + 1)) == 0);
@@ -3338,12 +4502,18 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::clear()
 	}
 #endif
 
+	/* bits of cleared buckets are kept if an outer transaction can be
+	 * aborted, they are only a hint */
+	bool outer_tx = pmemobj_tx_stage() == TX_STAGE_WORK;
+
 	pool_base pop = get_pool_base();
 	{ /* transaction scope */
 
 		flat_transaction::manual tx(pop);
 
 		assert(this->tls_ptr != nullptr);
+		if (this->layout_features.compat & FEATURE_RETIRED_NODES)
+			free_retired();
 		this->tls_ptr->clear();
 
 		this->on_init_size = 0;
@@ -3369,8 +4539,172 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::clear()
 		mask().store(embedded_buckets - 1, std::memory_order_relaxed);
 		this->my_size = 0;
 
+		this->my_clear_cursor = 0;
+		this->layout_features.incompat &=
+			~INCOMPAT_FEATURE_CLEAR_IN_PROGRESS;
+
 		flat_transaction::commit();
 	}
+
+	auto *o = this->occupancy();
+	if (!outer_tx && o)
+		o->reset();
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType>
+void
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::clear(
+	size_type buckets_per_tx, size_t concurrency)
+{
+	concurrent_hash_map_internal::check_outside_tx();
+	check_writable();
+
+	if (this->my_clear_cursor == 0) {
+		pool_base pop = get_pool_base();
+
+		/* Older versions of the library, which cannot finish the
+		 * clear, refuse to open the map until the flag is dropped. */
+		flat_transaction::run(pop, [&] {
+			this->layout_features.incompat |=
+				INCOMPAT_FEATURE_CLEAR_IN_PROGRESS;
+			this->my_clear_cursor = 1;
+		});
+	}
+
+	internal_chunked_clear(buckets_per_tx, concurrency);
+}
+
+/*
+ * Clears buckets starting from the one pointed by my_clear_cursor, in chunks
+ * of buckets_per_tx buckets (each in a separate transaction), using
+ * concurrency threads. The cursor is advanced (and persisted) only after all
+ * the preceding chunks are committed, so on recovery some buckets might be
+ * cleared again, which is a no-op. At the end, segments, mask, size and the
+ * cursor are reset in a single transaction.
+ */
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType>
+void
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType, ScopedLockType>::
+	internal_chunked_clear(size_type buckets_per_tx, size_t concurrency)
+{
+	assert(this->my_clear_cursor != 0);
+
+	buckets_per_tx = (std::max)(buckets_per_tx, size_type(1));
+	concurrency = (std::max)(concurrency, size_t(1));
+
+	pool_base pop = get_pool_base();
+	hashcode_type m = mask();
+
+	assert((m & (m + 1)) == 0);
+
+	hashcode_type first = this->my_clear_cursor - 1;
+	assert(first <= m + 1);
+
+	size_type n_chunks =
+		(m + 1 - first + buckets_per_tx - 1) / buckets_per_tx;
+
+	std::atomic<size_type> next_chunk(0);
+	std::mutex cursor_mtx;
+	std::vector<bool> committed(n_chunks, false);
+	size_type watermark = 0;
+	std::exception_ptr error;
+
+	auto worker = [&] {
+		try {
+			for (;;) {
+				size_type c = next_chunk.fetch_add(1);
+				if (c >= n_chunks)
+					return;
+
+				hashcode_type b = first + c * buckets_per_tx;
+				hashcode_type e =
+					(std::min)(b + buckets_per_tx, m + 1);
+
+				flat_transaction::run(pop, [&] {
+					for (hashcode_type i = b; i < e; ++i)
+						clear_bucket(get_bucket(i));
+				});
+
+				std::unique_lock<std::mutex> lock(cursor_mtx);
+
+				committed[c] = true;
+				if (c != watermark)
+					continue;
+
+				while (watermark < n_chunks &&
+				       committed[watermark])
+					++watermark;
+
+				hashcode_type cleared =
+					first + watermark * buckets_per_tx;
+				this->my_clear_cursor =
+					1 + (std::min)(cleared, m + 1);
+				pop.persist(this->my_clear_cursor);
+			}
+		} catch (...) {
+			std::unique_lock<std::mutex> lock(cursor_mtx);
+
+			/* stop other workers */
+			next_chunk.store(n_chunks);
+			if (!error)
+				error = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(concurrency - 1);
+	for (size_t i = 1; i < concurrency; ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto &t : threads)
+		t.join();
+
+	if (error)
+		std::rethrow_exception(error);
+
+	flat_transaction::run(pop, [&] {
+		assert(this->tls_ptr != nullptr);
+		if (this->layout_features.compat & FEATURE_RETIRED_NODES)
+			free_retired();
+		this->tls_ptr->clear();
+
+		this->on_init_size = 0;
+
+		segment_index_t s = segment_traits_t::segment_index_of(m);
+		do {
+			if (s >= segment_traits_t::embedded_segments)
+				segment_facade_t(this->my_table, s).disable();
+		} while (s-- > 0);
+
+		flat_transaction::snapshot((size_t *)&this->my_mask);
+		flat_transaction::snapshot((size_t *)&this->my_size);
+
+		mask().store(embedded_buckets - 1, std::memory_order_relaxed);
+		this->my_size = 0;
+
+		this->my_clear_cursor = 0;
+		this->layout_features.incompat &=
+			~INCOMPAT_FEATURE_CLEAR_IN_PROGRESS;
+	});
+
+	if (auto *o = this->occupancy())
+		o->reset();
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual,
+	  typename MutexType, typename ScopedLockType>
+void
+concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
+		    ScopedLockType>::clear_bucket(bucket *b)
+{
+	for (node_ptr_t n = b->node_list; n; n = b->node_list) {
+		b->node_list = n(this->my_pool_uuid)->next;
+		delete_node(n);
+	}
 }
 
 template <typename Key, typename T, typename Hash, typename KeyEqual,
@@ -3384,13 +4718,8 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 	assert(segment.is_valid());
 
 	size_type sz = segment.size();
-	for (segment_index_t i = 0; i < sz; ++i) {
-		for (node_ptr_t n = segment[i].node_list; n;
-		     n = segment[i].node_list) {
-			segment[i].node_list = n(this->my_pool_uuid)->next;
-			delete_node(n);
-		}
-	}
+	for (segment_index_t i = 0; i < sz; ++i)
+		clear_bucket(&segment[i]);
 
 	if (s >= segment_traits_t::embedded_segments)
 		segment.disable();
@@ -3425,6 +4754,7 @@ concurrent_hash_map<Key, T, Hash, KeyEqual, MutexType,
 
 		detail::persistent_pool_ptr<node> p;
 		insert_new_node(b, p, *first);
+		mark_occupied(h & m);
 	}
 }
 
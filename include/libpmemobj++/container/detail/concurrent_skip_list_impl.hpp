@@ -16,6 +16,7 @@
 #include <limits>
 #include <mutex> /* for std::unique_lock */
 #include <random>
+#include <ratio>
 #include <type_traits>
 
 #include <libpmemobj++/detail/common.hpp>
@@ -233,6 +234,27 @@ public:
 		pop.persist(&node, sizeof(node));
 	}
 
+	/**
+	 * Atomically replaces the pointer on the given level if it is equal
+	 * to expected and persists the new value.
+	 *
+	 * @return true if the pointer was replaced, false otherwise.
+	 */
+	bool
+	cas_next(obj::pool_base pop, size_type level, node_pointer expected,
+		 node_pointer desired)
+	{
+		assert(level < height());
+		auto &node = get_next(level);
+		if (!node.compare_exchange_strong(expected, desired,
+						  std::memory_order_acq_rel,
+						  std::memory_order_acquire))
+			return false;
+
+		pop.persist(&node, sizeof(node));
+		return true;
+	}
+
 	void
 	set_nexts(const node_pointer *new_nexts, size_type h)
 	{
@@ -452,6 +474,130 @@ public:
 	}
 };
 
+/**
+ * Thread-safe xorshift64* random number generator. It is much cheaper than
+ * std::mt19937_64 and good enough for choosing heights of the nodes.
+ */
+struct xorshift_random_generator {
+	using result_type = uint64_t;
+
+	result_type
+	operator()()
+	{
+		static thread_local result_type state = seed();
+
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+
+		return state * 0x2545F4914F6CDD1DULL;
+	}
+
+	static constexpr result_type
+	min()
+	{
+		return 0;
+	}
+
+	static constexpr result_type
+	max()
+	{
+		return std::numeric_limits<result_type>::max();
+	}
+
+private:
+	/* splitmix64 of the time and the address of thread-local variable,
+	 * so each thread gets a different (and non-zero) state */
+	static result_type
+	seed()
+	{
+		static thread_local char tag;
+
+		result_type z = static_cast<result_type>(time(0)) ^
+			static_cast<result_type>(
+				reinterpret_cast<uintptr_t>(&tag));
+
+		z += 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z ^= z >> 31;
+
+		return z != 0 ? z : 1;
+	}
+};
+
+/**
+ * Level generator with configurable branching probability. A node is
+ * promoted to the next level with the probability given by std::ratio
+ * Probability (e.g. std::ratio<1, 4>, or std::ratio<36788, 100000> for
+ * 1/e). Lower probability means lower towers: less memory and fewer
+ * persisted pointers per insert, at the cost of longer searches.
+ *
+ * For probabilities 1/2^k, the level is computed from the number of
+ * trailing zeros of a single random number. Otherwise, one random number
+ * is drawn per level.
+ *
+ * RndGenerator should be thread-safe random number generator, returning
+ * uniformly distributed 64-bit numbers.
+ */
+template <typename RndGenerator, size_t MAX_LEVEL,
+	  typename Probability = std::ratio<1, 2>>
+class branching_level_generator {
+public:
+	using rnd_generator_type = RndGenerator;
+
+	static constexpr size_t max_level = MAX_LEVEL;
+
+	static_assert(Probability::num > 0 &&
+			      Probability::num < Probability::den,
+		      "Probability must be in range (0, 1).");
+	static_assert(RndGenerator::min() == 0 &&
+			      RndGenerator::max() ==
+				      std::numeric_limits<uint64_t>::max(),
+		      "RndGenerator must return 64-bit numbers.");
+
+	size_t
+	operator()()
+	{
+		static rnd_generator_type gen;
+
+		if (bits_per_level != 0) {
+			uint64_t r = gen();
+			size_t zeros = r != 0 ? lssb_index64(r) : 64;
+			size_t level = 1 + zeros / bits_per_level;
+
+			return level < MAX_LEVEL ? level : MAX_LEVEL;
+		}
+
+		size_t level = 1;
+		while (level < MAX_LEVEL && gen() < threshold)
+			++level;
+
+		return level;
+	}
+
+private:
+	static constexpr size_t
+	log2_exact(intmax_t v)
+	{
+		return v == 1 ? 0
+			      : ((v & 1) != 0 ? 0 : 1 + log2_exact(v >> 1));
+	}
+
+	/* number of random bits which must be zero to promote the node, or 0
+	 * if the probability is not a power of 1/2 */
+	static constexpr size_t bits_per_level = Probability::num == 1 &&
+			(Probability::den & (Probability::den - 1)) == 0
+		? log2_exact(Probability::den)
+		: 0;
+
+	/* node is promoted if the random number is below the threshold */
+	static constexpr uint64_t threshold = static_cast<uint64_t>(
+		static_cast<long double>(Probability::num) /
+		static_cast<long double>(Probability::den) *
+		18446744073709551616.0L);
+};
+
 /**
  * Persistent memory aware implementation of the concurrent skip list.
  *
@@ -479,6 +625,18 @@ public:
  * skip list.
  * * random_generator_type - The type of random generator used by the skip list.
  * It should be thread-safe.
+ * * level_generator_type - The type of functor returning the height of a new
+ * node, in range [1, max_level].
+ *
+ * If traits_type::lock_free_insert is true, concurrent inserts do not lock
+ * the predecessors of the new node. Instead, the node is linked on each
+ * level with a compare-and-swap on the predecessor's next pointer, starting
+ * from the bottom level (which makes the node visible). On a failed CAS the
+ * position is searched again from the same predecessor. A node which was
+ * linked only partially when the application crashed is kept in the
+ * persistent TLS and its upper levels are linked by runtime_initialize(),
+ * like in the lock-based mode. Lock-free inserts are supported only if
+ * multimapping is not allowed.
  */
 template <typename Traits>
 class concurrent_skip_list {
@@ -505,8 +663,8 @@ protected:
 
 	static constexpr size_type MAX_LEVEL = traits_type::max_level;
 
-	using random_level_generator_type = geometric_level_generator<
-		typename traits_type::random_generator_type, MAX_LEVEL>;
+	using random_level_generator_type =
+		typename traits_type::level_generator_type;
 	using node_allocator_type = typename std::allocator_traits<
 		allocator_type>::template rebind_alloc<uint8_t>;
 	using node_allocator_traits = typename std::allocator_traits<
@@ -521,9 +679,103 @@ protected:
 	using node_lock_type = typename list_node_type::lock_type;
 	using lock_array = std::array<node_lock_type, MAX_LEVEL>;
 
+	/**
+	 * Cursor for series of ascending searches in the skip list.
+	 *
+	 * The cursor remembers the predecessors of the last sought key on
+	 * each level. The next seek() to a larger key resumes from them: it
+	 * climbs only as many levels as needed to pass the distance between
+	 * the keys, instead of descending from the top of the skip list.
+	 * Seeking to a smaller key restarts the search from the head.
+	 *
+	 * The cursor can be used concurrently with insertions, but a single
+	 * cursor must not be used by multiple threads at once. Like
+	 * iterators, it is invalidated by erasing elements (reset() makes it
+	 * valid again) and it is valid only until the pool is closed.
+	 */
+	template <bool is_const>
+	class skip_list_cursor {
+		using list_type =
+			typename std::conditional<is_const,
+						  const concurrent_skip_list,
+						  concurrent_skip_list>::type;
+
+	public:
+		using iterator_type =
+			typename std::conditional<is_const, const_iterator,
+						  iterator>::type;
+
+		explicit skip_list_cursor(list_type &list) : list(&list)
+		{
+			reset();
+		}
+
+		/**
+		 * Returns an iterator pointing to the first element that is
+		 * not less than (i.e. greater or equal to) key.
+		 *
+		 * @param[in] key key value to compare the elements to.
+		 *
+		 * @return Iterator pointing to the first element that is not
+		 * less than key. If no such element is found, a past-the-end
+		 * iterator is returned.
+		 */
+		iterator_type
+		seek(const key_type &key)
+		{
+			return iterator_type(
+				list->internal_seek(prev_nodes, key));
+		}
+
+		/**
+		 * Returns an iterator pointing to the first element that
+		 * compares not less (i.e. greater or equal) to the value x.
+		 * This overload only participates in overload resolution if
+		 * the qualified-id Compare::is_transparent is valid and
+		 * denotes a type.
+		 *
+		 * @param[in] x alternative value that can be compared to Key.
+		 *
+		 * @return Iterator pointing to the first element that is not
+		 * less than x. If no such element is found, a past-the-end
+		 * iterator is returned.
+		 */
+		template <typename K,
+			  typename = typename std::enable_if<
+				  has_is_transparent<key_compare>::value,
+				  K>::type>
+		iterator_type
+		seek(const K &x)
+		{
+			return iterator_type(
+				list->internal_seek(prev_nodes, x));
+		}
+
+		/**
+		 * Forgets the remembered position, the next seek() starts from
+		 * the head of the skip list.
+		 */
+		void
+		reset()
+		{
+			prev_nodes.fill(list->dummy_head.get());
+		}
+
+	private:
+		list_type *list;
+		prev_array_type prev_nodes;
+	};
+
+	using cursor = skip_list_cursor<false>;
+	using const_cursor = skip_list_cursor<true>;
+
 public:
 	static constexpr bool allow_multimapping =
 		traits_type::allow_multimapping;
+	static constexpr bool lock_free_insert = traits_type::lock_free_insert;
+
+	static_assert(!(lock_free_insert && allow_multimapping),
+		      "Lock-free insert does not support multimapping.");
 
 	/**
 	 * Default constructor. Construct empty skip list.
@@ -733,7 +985,9 @@ public:
 	void
 	runtime_initialize()
 	{
-		tls_restore();
+		/* the size is calculated on demand, see size() */
+		if (!is_read_only())
+			tls_restore();
 
 		assert(this->size() ==
 		       size_type(std::distance(this->begin(), this->end())));
@@ -966,6 +1220,10 @@ public:
 	 * Inserts value in the position as close as possible, just prior to
 	 * hint. No iterators or references are invalidated.
 	 *
+	 * If the key of hint precedes the key of value, the search for the
+	 * insert position starts from hint instead of the head of the list
+	 * (see emplace_hint()).
+	 *
 	 * @param[in] hint iterator to the position before which the new element
 	 * will be inserted.
 	 * @param[in] value element value to insert.
@@ -982,8 +1240,8 @@ public:
 	iterator
 	insert(const_iterator hint, const_reference value)
 	{
-		/* Ignore hint */
-		return insert(value).first;
+		return internal_insert_hint(hint.node, value.first, value)
+			.first;
 	}
 
 	/**
@@ -1101,6 +1359,15 @@ public:
 	 *
 	 * No iterators or references are invalidated.
 	 *
+	 * If the key of hint precedes the key of the new element, the search
+	 * for the insert position starts from hint instead of the head of the
+	 * list. This makes inserting elements with increasing keys, each with
+	 * the iterator returned by the previous call as the hint, close to
+	 * constant time. The hint is used only if the new element is not
+	 * higher than the hint element (in lock-free insert mode: only if the
+	 * new element has a single level), otherwise, as well as for end() or
+	 * a hint which does not precede the key, the whole list is searched.
+	 *
 	 * @param[in] hint iterator to the position before which the new element
 	 * will be inserted.
 	 * @param[in] args arguments to forward to the constructor of the
@@ -1124,8 +1391,9 @@ public:
 	iterator
 	emplace_hint(const_iterator hint, Args &&... args)
 	{
-		/* Ignore hint */
-		return emplace(std::forward<Args>(args)...).first;
+		return internal_emplace_hint(hint.node,
+					     std::forward<Args>(args)...)
+			.first;
 	}
 
 	/**
@@ -1246,6 +1514,7 @@ public:
 	unsafe_erase(iterator pos)
 	{
 		check_outside_tx();
+		check_writable();
 		auto &size_diff = tls_data.local().size_diff;
 		return internal_erase(pos, size_diff);
 	}
@@ -1278,6 +1547,10 @@ public:
 	 * References and iterators to the erased elements are invalidated.
 	 * Other references and iterators are not affected.
 	 *
+	 * The predecessors of first are searched only once, the whole range
+	 * is unlinked from every level at once and freed in a single
+	 * transaction.
+	 *
 	 * @param[in] first first iterator in the range of elements to remove.
 	 * @param[in] last last iterator in the range of elements to remove.
 	 *
@@ -1288,18 +1561,149 @@ public:
 	 */
 	iterator
 	unsafe_erase(const_iterator first, const_iterator last)
+	{
+		return unsafe_erase(first, last,
+				    (std::numeric_limits<size_type>::max)());
+	}
+
+	/**
+	 * Removes the elements in the range [first; last), which must be a
+	 * valid range in *this, in chunks of at most nodes_per_tx elements,
+	 * each chunk in a separate transaction. The size of the transactions
+	 * is bounded, but the whole operation is not atomic: after a failure
+	 * (or a crash), only a prefix of the range can be removed.
+	 * References and iterators to the erased elements are invalidated.
+	 * Other references and iterators are not affected.
+	 *
+	 * @param[in] first first iterator in the range of elements to remove.
+	 * @param[in] last last iterator in the range of elements to remove.
+	 * @param[in] nodes_per_tx maximum number of elements removed in
+	 * a single transaction.
+	 *
+	 * @return iterator following the last removed element.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction.
+	 * @throw pmem::transaction_error when snapshotting failed.
+	 * @throw rethrows destructor exception.
+	 */
+	iterator
+	unsafe_erase(const_iterator first, const_iterator last,
+		     size_type nodes_per_tx)
 	{
 		check_outside_tx();
+		check_writable();
+
+		if (first == last)
+			return get_iterator(last);
+
 		obj::pool_base pop = get_pool_base();
 		auto &size_diff = tls_data.local().size_diff;
 
-		obj::flat_transaction::run(pop, [&] {
-			while (first != last) {
-				first = internal_erase(first, size_diff);
-			}
-		});
+		nodes_per_tx = (std::max)(nodes_per_tx, size_type(1));
+
+		prev_array_type prev_nodes;
+		fill_prev_array_for_node(prev_nodes, first.node);
+
+		while (prev_nodes[0]->next(0).get() != last.node) {
+			obj::flat_transaction::run(pop, [&] {
+				internal_erase_run(prev_nodes, last.node,
+						   nodes_per_tx, size_diff);
+			});
+		}
 
-		return get_iterator(first);
+		return get_iterator(last);
+	}
+
+	/**
+	 * Removes all elements satisfying the predicate pred, in a single
+	 * pass over the container. Contiguous runs of such elements are
+	 * unlinked from every level at once. Elements are removed in chunks
+	 * of at most nodes_per_tx elements, each chunk in a separate
+	 * transaction. By default, all elements are removed atomically.
+	 * References and iterators to the erased elements are invalidated.
+	 * Other references and iterators are not affected.
+	 *
+	 * @param[in] pred unary predicate, called with reference to the
+	 * element, which returns true if the element should be removed. It is
+	 * called inside a transaction and must not modify the key.
+	 * @param[in] nodes_per_tx maximum number of elements removed in
+	 * a single transaction.
+	 *
+	 * @return Number of elements removed.
+	 *
+	 * @throw pmem::transaction_scope_error if called inside transaction.
+	 * @throw pmem::transaction_error when snapshotting failed.
+	 * @throw rethrows predicate or destructor exception.
+	 */
+	template <typename Predicate>
+	size_type
+	unsafe_erase_if(Predicate pred,
+			size_type nodes_per_tx =
+				(std::numeric_limits<size_type>::max)())
+	{
+		check_outside_tx();
+		check_writable();
+
+		obj::pool_base pop = get_pool_base();
+		auto &size_diff = tls_data.local().size_diff;
+
+		nodes_per_tx = (std::max)(nodes_per_tx, size_type(1));
+
+		/* last preserved node on each level */
+		prev_array_type prev_nodes;
+		prev_nodes.fill(dummy_head.get());
+
+		auto keep = [&](node_ptr n) {
+			for (size_type level = 0; level < n->height(); ++level)
+				prev_nodes[level] = n;
+		};
+
+		size_type erased = 0;
+		node_ptr current = dummy_head->next(0).get();
+
+		while (current) {
+			obj::flat_transaction::run(pop, [&] {
+				size_type n = 0;
+
+				while (current && n < nodes_per_tx) {
+					if (!pred(get_val(current))) {
+						keep(current);
+						current =
+							current->next(0).get();
+						continue;
+					}
+
+					/* find the end of the run to remove */
+					node_ptr end = current->next(0).get();
+					size_type run = 1;
+					bool end_kept = false;
+
+					while (end && n + run < nodes_per_tx) {
+						if (!pred(get_val(end))) {
+							end_kept = true;
+							break;
+						}
+
+						end = end->next(0).get();
+						++run;
+					}
+
+					n += internal_erase_run(prev_nodes, end,
+								run, size_diff);
+
+					if (end_kept) {
+						keep(end);
+						end = end->next(0).get();
+					}
+
+					current = end;
+				}
+
+				erased += n;
+			});
+		}
+
+		return erased;
 	}
 
 	/**
@@ -1359,6 +1763,30 @@ public:
 		return sz;
 	}
 
+	/**
+	 * Creates a cursor for series of ascending searches, which resume
+	 * from the position of the previous one.
+	 *
+	 * @return cursor positioned at the head of the skip list.
+	 */
+	cursor
+	make_cursor()
+	{
+		return cursor(*this);
+	}
+
+	/**
+	 * Creates a cursor for series of ascending searches, which resume
+	 * from the position of the previous one.
+	 *
+	 * @return cursor positioned at the head of the skip list.
+	 */
+	const_cursor
+	make_cursor() const
+	{
+		return const_cursor(*this);
+	}
+
 	/**
 	 * Returns an iterator pointing to the first element that is not less
 	 * than (i.e. greater or equal to) key.
@@ -1981,6 +2409,8 @@ public:
 	void
 	clear()
 	{
+		check_writable();
+
 		assert(dummy_head->height() > 0);
 		obj::pool_base pop = get_pool_base();
 
@@ -2090,6 +2520,9 @@ public:
 	size_type
 	size() const
 	{
+		if (is_read_only())
+			return read_only_size();
+
 		return _size.load(std::memory_order_relaxed);
 	}
 
@@ -2133,6 +2566,9 @@ public:
 	void
 	swap(concurrent_skip_list &other)
 	{
+		check_writable();
+		other.check_writable();
+
 		obj::pool_base pop = get_pool_base();
 		obj::flat_transaction::run(pop, [&] {
 			using pocs_t = typename node_allocator_traits::
@@ -2450,19 +2886,93 @@ private:
 	 * @param[out] next_nodes array of pointers to successor nodes on each
 	 * level.
 	 * @param[in] key inserted key.
+	 * @param[in] hint node from which the search may start, or nullptr.
+	 * @param[in] height height of the inserted node.
 	 */
 	template <typename K>
 	void
 	find_insert_pos(prev_array_type &prev_nodes,
-			next_array_type &next_nodes, const K &key)
+			next_array_type &next_nodes, const K &key,
+			const_node_ptr hint = nullptr, size_type height = 0)
 	{
 		if (allow_multimapping) {
-			fill_prev_next_arrays(prev_nodes, next_nodes, key,
-					      not_greater_compare(_compare));
+			if (!fill_prev_next_arrays_from_hint(
+				    prev_nodes, next_nodes, key,
+				    not_greater_compare(_compare), hint,
+				    height))
+				fill_prev_next_arrays(
+					prev_nodes, next_nodes, key,
+					not_greater_compare(_compare));
 		} else {
-			fill_prev_next_arrays(prev_nodes, next_nodes, key,
-					      _compare);
+			if (!fill_prev_next_arrays_from_hint(prev_nodes,
+							     next_nodes, key,
+							     _compare, hint,
+							     height))
+				fill_prev_next_arrays(prev_nodes, next_nodes,
+						      key, _compare);
+		}
+	}
+
+	/**
+	 * The method finds successor and predecessor nodes on the lowest
+	 * @arg height levels of the skip list, starting the search from the
+	 * @arg hint node instead of the head of the list.
+	 *
+	 * The hint is valid if it precedes the key. Levels of the inserted
+	 * node which are above the hint are searched from the head of the list
+	 * and the lower ones from the hint. In lock-free insert mode, upper
+	 * levels of the hint might not be linked yet, so only its lowest level
+	 * is used.
+	 *
+	 * @param[out] prev_nodes array of pointers to predecessor nodes on each
+	 * level.
+	 * @param[out] next_nodes array of pointers to successor nodes on each
+	 * level.
+	 * @param[in] key inserted key.
+	 * @param[in] cmp comparator functor used for the search.
+	 * @param[in] hint node from which the search starts.
+	 * @param[in] height height of the inserted node.
+	 *
+	 * @return true if the hint was valid and the arrays were filled, false
+	 * otherwise.
+	 */
+	template <typename K, typename comparator>
+	bool
+	fill_prev_next_arrays_from_hint(prev_array_type &prev_nodes,
+					next_array_type &next_nodes,
+					const K &key, const comparator &cmp,
+					const_node_ptr hint, size_type height)
+	{
+		if (hint == nullptr || height == 0 || !cmp(get_key(hint), key))
+			return false;
+
+		size_type hint_height = lock_free_insert ? 1 : hint->height();
+
+		node_ptr prev = dummy_head.get();
+		prev_nodes.fill(prev);
+		next_nodes.fill(nullptr);
+
+		if (height > hint_height) {
+			for (size_type h = prev->height(); h > hint_height;
+			     --h) {
+				persistent_node_ptr next =
+					internal_find_position(h - 1, prev,
+							       key, cmp);
+				prev_nodes[h - 1] = prev;
+				next_nodes[h - 1] = next;
+			}
 		}
+
+		prev = const_cast<node_ptr>(hint);
+		for (size_type h = (std::min)(height, hint_height); h > 0;
+		     --h) {
+			persistent_node_ptr next =
+				internal_find_position(h - 1, prev, key, cmp);
+			prev_nodes[h - 1] = prev;
+			next_nodes[h - 1] = next;
+		}
+
+		return true;
 	}
 
 	/**
@@ -2507,8 +3017,17 @@ private:
 	template <typename... Args>
 	std::pair<iterator, bool>
 	internal_emplace(Args &&... args)
+	{
+		return internal_emplace_hint(nullptr,
+					     std::forward<Args>(args)...);
+	}
+
+	template <typename... Args>
+	std::pair<iterator, bool>
+	internal_emplace_hint(const_node_ptr hint, Args &&... args)
 	{
 		check_outside_tx();
+		check_writable();
 		tls_entry_type &tls_entry = tls_data.local();
 		obj::pool_base pop = get_pool_base();
 
@@ -2537,11 +3056,13 @@ private:
 					    sizeof(tls_entry.insert_stage));
 
 				return tls_entry.ptr;
-			});
+			},
+			hint);
 
 		if (!insert_result.second) {
 			assert(tls_entry.ptr != nullptr);
-			assert(tls_entry.insert_stage == not_started);
+			assert(lock_free_insert ||
+			       tls_entry.insert_stage == not_started);
 
 			obj::flat_transaction::run(pop, [&] {
 				--tls_entry.size_diff;
@@ -2598,8 +3119,21 @@ private:
 	template <typename K, typename... Args>
 	std::pair<iterator, bool>
 	internal_insert(const K &key, Args &&... args)
+	{
+		return internal_insert_hint(nullptr, key,
+					    std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Construct and insert new node to the skip list in a thread-safe way.
+	 * The search for the insert position starts from hint if it is valid.
+	 */
+	template <typename K, typename... Args>
+	std::pair<iterator, bool>
+	internal_insert_hint(const_node_ptr hint, const K &key, Args &&... args)
 	{
 		check_outside_tx();
+		check_writable();
 		tls_entry_type &tls_entry = tls_data.local();
 		assert(tls_entry.ptr == nullptr);
 
@@ -2624,7 +3158,21 @@ private:
 
 				assert(tls_entry.ptr != nullptr);
 				return tls_entry.ptr;
+			},
+			hint);
+
+		if (!insert_result.second && tls_entry.ptr != nullptr) {
+			/* Lock-free insert found the key after the node was
+			 * created. */
+			assert(lock_free_insert);
+
+			obj::pool_base pop = get_pool_base();
+			obj::flat_transaction::run(pop, [&] {
+				--(tls_entry.size_diff);
+				delete_node(tls_entry.ptr);
+				tls_entry.ptr = nullptr;
 			});
+		}
 
 		assert(tls_entry.ptr == nullptr);
 
@@ -2633,18 +3181,28 @@ private:
 
 	/**
 	 * Try to insert new node to the skip list in a thread-safe way.
+	 * If hint is not null, it is used as a starting point of the search
+	 * for the insert position (see fill_prev_next_arrays_from_hint()).
 	 */
 	template <typename K, typename PrepareNode>
 	std::pair<iterator, bool>
 	internal_insert_node(const K &key, size_type height,
-			     PrepareNode &&prepare_new_node)
+			     PrepareNode &&prepare_new_node,
+			     const_node_ptr hint = nullptr)
 	{
+		if (lock_free_insert)
+			return internal_insert_node_lock_free(
+				key, height,
+				std::forward<PrepareNode>(prepare_new_node),
+				hint);
+
 		prev_array_type prev_nodes;
 		next_array_type next_nodes;
 		node_ptr n = nullptr;
 
 		do {
-			find_insert_pos(prev_nodes, next_nodes, key);
+			find_insert_pos(prev_nodes, next_nodes, key, hint,
+					height);
 
 			node_ptr next = next_nodes[0].get();
 			if (next && !allow_multimapping &&
@@ -2733,6 +3291,84 @@ private:
 		return n;
 	}
 
+	/**
+	 * Insert new node to the skip list without locking the predecessors.
+	 * Each level is linked with a CAS, the bottom one first.
+	 *
+	 * If an element with the same key is found after the node was
+	 * prepared, the node is not linked and the caller is responsible for
+	 * deleting it.
+	 */
+	template <typename K, typename PrepareNode>
+	std::pair<iterator, bool>
+	internal_insert_node_lock_free(const K &key, size_type height,
+				       PrepareNode &&prepare_new_node,
+				       const_node_ptr hint)
+	{
+		assert(dummy_head->height() >= height);
+
+		prev_array_type prev_nodes;
+		next_array_type next_nodes;
+
+		find_insert_pos(prev_nodes, next_nodes, key, hint, height);
+
+		node_ptr next = next_nodes[0].get();
+		if (next && !_compare(key, get_key(next)))
+			return std::pair<iterator, bool>(iterator(next), false);
+
+		/*
+		 * The node is recorded in persistent TLS as in progress before
+		 * it is linked, so that an interrupted insert is completed
+		 * during recovery.
+		 */
+		persistent_node_ptr &new_node = prepare_new_node(next_nodes);
+		assert(new_node != nullptr);
+		node_ptr n = new_node.get();
+
+		obj::pool_base pop = get_pool_base();
+
+		while (!prev_nodes[0]->cas_next(pop, 0, next_nodes[0],
+						new_node)) {
+			/* No element is erased concurrently, so the search
+			 * can continue from the old predecessor. */
+			next_nodes[0] = internal_find_position(0, prev_nodes[0],
+							       key, _compare);
+
+			next = next_nodes[0].get();
+			if (next && !_compare(key, get_key(next)))
+				return std::pair<iterator, bool>(
+					iterator(next), false);
+
+			n->set_next(pop, 0, next_nodes[0]);
+		}
+
+		/* The node is visible now, link the remaining levels. */
+		for (size_type level = 1; level < height; ++level) {
+			while (!prev_nodes[level]->cas_next(pop, level,
+							    next_nodes[level],
+							    new_node)) {
+				next_nodes[level] = internal_find_position(
+					level, prev_nodes[level], key,
+					_compare);
+				n->set_next(pop, level, next_nodes[level]);
+			}
+		}
+
+#ifndef NDEBUG
+		try_insert_node_finish_marker();
+#endif
+
+		new_node = nullptr;
+		pop.persist(&new_node, sizeof(new_node));
+
+		++_size;
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+		VALGRIND_PMC_DO_FLUSH(&_size, sizeof(_size));
+#endif
+
+		return std::pair<iterator, bool>(iterator(n), true);
+	}
+
 	/**
 	 * Used only inside asserts.
 	 * Checks that prev_array is filled with correct values.
@@ -2827,6 +3463,55 @@ private:
 		return iterator(next.get());
 	}
 
+	/**
+	 * Finds the first element not less than key, starting from the
+	 * predecessors found by the previous search (stored in prev_nodes),
+	 * and updates prev_nodes with the predecessors of key.
+	 *
+	 * @param[in,out] prev_nodes predecessors of the previously sought key
+	 * on each level.
+	 * @param[in] key key value to compare the elements to.
+	 *
+	 * @return pointer to the first element not less than key, nullptr if
+	 * there is no such element.
+	 */
+	template <typename K>
+	node_ptr
+	internal_seek(prev_array_type &prev_nodes, const K &key) const
+	{
+		node_ptr head = dummy_head.get();
+		assert(head->height() > 0);
+
+		/* Predecessors on upper levels precede the one on level 0, so
+		 * all of them are valid starting points if this one is. */
+		if (prev_nodes[0] != head &&
+		    !_compare(get_key(prev_nodes[0]), key))
+			prev_nodes.fill(head);
+
+		/* Find the lowest level on which the stored predecessor is
+		 * still the predecessor of key. */
+		size_type h = 0;
+		while (h < head->height()) {
+			node_ptr next = prev_nodes[h]->next(h).get();
+			if (!next || !_compare(get_key(next), key))
+				break;
+			++h;
+		}
+
+		if (h == 0)
+			return prev_nodes[0]->next(0).get();
+
+		node_ptr prev = prev_nodes[h - 1];
+		persistent_node_ptr next = nullptr;
+		for (; h > 0; --h) {
+			next = internal_find_position(h - 1, prev, key,
+						      _compare);
+			prev_nodes[h - 1] = prev;
+		}
+
+		return next.get();
+	}
+
 	/**
 	 * Returns an iterator pointing to the last element from the list for
 	 * which cmp(element, key) is true.
@@ -2932,6 +3617,92 @@ private:
 			next_nodes[0], erase_node->next(0));
 	}
 
+	/**
+	 * Fills prev_nodes with the predecessors of the node n on each level
+	 * of the skip list.
+	 *
+	 * @param[out] prev_nodes array of pointers to predecessor nodes on
+	 * each level.
+	 * @param[in] n node in the skip list.
+	 */
+	void
+	fill_prev_array_for_node(prev_array_type &prev_nodes, const_node_ptr n)
+	{
+		assert(n != nullptr);
+
+		node_ptr prev = dummy_head.get();
+		prev_nodes.fill(prev);
+
+		const key_type &key = get_key(n);
+		for (size_type h = prev->height(); h > 0; --h) {
+			internal_find_position(h - 1, prev, key, _compare);
+			prev_nodes[h - 1] = prev;
+		}
+
+		/* In multimap, nodes with equal keys can precede n */
+		for (node_ptr curr = prev_nodes[0]->next(0).get(); curr != n;
+		     curr = curr->next(0).get()) {
+			assert(curr != nullptr);
+			for (size_type level = 0; level < curr->height();
+			     ++level)
+				prev_nodes[level] = curr;
+		}
+	}
+
+	/**
+	 * Removes at most count consecutive nodes following prev_nodes[0],
+	 * stopping at the node last. The run is read only once: every level
+	 * is relinked to the successor of the last removed node on that
+	 * level, and the nodes are deleted on the way.
+	 *
+	 * @param[in] prev_nodes predecessors of the run on each level.
+	 * @param[in] last node which ends the run (not removed), might be
+	 * nullptr.
+	 * @param[in] count maximum number of nodes to remove.
+	 * @param[in,out] size_diff thread-local size difference.
+	 *
+	 * @return number of removed nodes.
+	 */
+	size_type
+	internal_erase_run(const prev_array_type &prev_nodes,
+			   const_node_ptr last, size_type count,
+			   obj::p<difference_type> &size_diff)
+	{
+		assert(pmemobj_tx_stage() == TX_STAGE_WORK);
+
+		next_array_type next_nodes;
+		size_type height = 0;
+		size_type n = 0;
+
+		persistent_node_ptr current = prev_nodes[0]->next(0);
+
+		while (current.get() != last && n < count) {
+			node_ptr node = current.get();
+			assert(node != nullptr);
+
+			size_type h = node->height();
+			for (size_type level = 0; level < h; ++level)
+				next_nodes[level] = node->next(level);
+			height = (std::max)(height, h);
+
+			delete_node(current);
+			current = next_nodes[0];
+			++n;
+		}
+
+		for (size_type level = 0; level < height; ++level) {
+			assert(prev_nodes[level]->height() > level);
+			prev_nodes[level]->set_next_tx(level,
+						       next_nodes[level]);
+		}
+
+		size_diff -= static_cast<difference_type>(n);
+		obj::flat_transaction::snapshot((size_type *)&_size);
+		_size -= n;
+
+		return n;
+	}
+
 	/**
 	 * Get the persistent memory pool where hashmap resides.
 	 * @returns pmem::obj::pool_base object.
@@ -3188,6 +3959,54 @@ private:
 #endif
 	}
 
+	/**
+	 * Calculates size of the skip list in a pool opened with
+	 * pool_base::open_read_only(), without writing to the pool. Inserts
+	 * interrupted by a crash cannot be completed (nor rolled back) here,
+	 * so the elements are counted if any of them is pending.
+	 */
+	size_type
+	read_only_size() const
+	{
+		int64_t last_run_size = 0;
+		bool pending_insert = false;
+
+		for (auto &tls_entry : tls_data) {
+			pending_insert = pending_insert || tls_entry.ptr;
+			last_run_size += tls_entry.size_diff;
+		}
+
+		if (pending_insert)
+			return static_cast<size_type>(
+				std::distance(this->begin(), this->end()));
+
+		return on_init_size + static_cast<size_type>(last_run_size);
+	}
+
+	/**
+	 * @returns true if the pool was opened with
+	 * pool_base::open_read_only().
+	 */
+	bool
+	is_read_only() const noexcept
+	{
+		return detail::in_read_only_pool(this);
+	}
+
+	/**
+	 * Called by all modifying operations, before any node is accessed.
+	 *
+	 * @throw pmem::transaction_scope_error if the pool was opened with
+	 * pool_base::open_read_only().
+	 */
+	void
+	check_writable() const
+	{
+		if (is_read_only())
+			throw pmem::transaction_scope_error(
+				"Cannot modify concurrent_skip_list in a read-only pool");
+	}
+
 	void
 	complete_insert(tls_entry_type &tls_entry)
 	{
@@ -3203,6 +4022,22 @@ private:
 		fill_prev_next_arrays(prev_nodes, next_nodes, key, _compare);
 		obj::pool_base pop = get_pool_base();
 
+		/*
+		 * Lock-free insert records the node before it is linked, an
+		 * element with the same key might have been inserted by
+		 * another thread in the meantime.
+		 */
+		node_ptr next = next_nodes[0].get();
+		if (!allow_multimapping && next && next != n &&
+		    !_compare(key, get_key(next))) {
+			obj::flat_transaction::run(pop, [&] {
+				--(tls_entry.size_diff);
+				delete_node(node);
+				node = nullptr;
+			});
+			return;
+		}
+
 		/* Node was partially linked */
 		for (size_type level = 0; level < height; ++level) {
 			assert(prev_nodes[level]->height() > level);
@@ -3212,7 +4047,9 @@ private:
 			if (prev_nodes[level]->next(level) != node) {
 				/* Otherwise, node already linked on
 				 * this layer */
-				assert(n->next(level) == next_nodes[level]);
+				if (is_stale_next(n, level, next_nodes[level]))
+					n->set_next(pop, level,
+						    next_nodes[level]);
 				prev_nodes[level]->set_next(pop, level, node);
 			}
 		}
@@ -3221,6 +4058,32 @@ private:
 		pop.persist(&node, sizeof(node));
 	}
 
+	/**
+	 * Checks if the successor of a partially linked node on the given
+	 * level has to be replaced with the one found during recovery.
+	 *
+	 * Levels not linked by lock-free insert might point to stale
+	 * successors. On the other hand, the bottom level of a node linked by
+	 * lock-free insert might already be the predecessor of nodes inserted
+	 * concurrently, even if the link to the node itself was not persisted.
+	 * Such successors precede the one found during recovery and are kept,
+	 * so that the nodes are not lost.
+	 */
+	bool
+	is_stale_next(node_ptr n, size_type level,
+		      const persistent_node_ptr &next) const
+	{
+		node_ptr curr = n->next(level).get();
+		if (curr == next.get())
+			return false;
+
+		assert(lock_free_insert);
+
+		return next != nullptr &&
+			(curr == nullptr ||
+			 !_compare(get_key(curr), get_key(next.get())));
+	}
+
 	struct not_greater_compare {
 		const key_compare &my_less_compare;
 
@@ -3257,11 +4120,16 @@ private:
 
 template <typename Key, typename Value, typename KeyCompare,
 	  typename RND_GENERATOR, typename Allocator, bool AllowMultimapping,
-	  size_t MAX_LEVEL>
+	  size_t MAX_LEVEL,
+	  typename LevelGenerator =
+		  geometric_level_generator<RND_GENERATOR, MAX_LEVEL>,
+	  bool LockFreeInsert = false>
 class map_traits {
 public:
 	static constexpr size_t max_level = MAX_LEVEL;
+	static constexpr bool lock_free_insert = LockFreeInsert;
 	using random_generator_type = RND_GENERATOR;
+	using level_generator_type = LevelGenerator;
 	using key_type = Key;
 	using mapped_type = Value;
 	using compare_type = KeyCompare;
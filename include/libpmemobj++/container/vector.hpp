@@ -2063,6 +2063,8 @@ vector<T>::alloc(size_type capacity_new)
 			throw detail::exception_with_errormsg<
 				pmem::transaction_alloc_error>(msg);
 	}
+
+	detail::telemetry_on_alloc(*res.raw_ptr());
 	_data = res;
 }
 
@@ -2193,6 +2195,7 @@ vector<T>::dealloc()
 
 	if (_data != nullptr) {
 		shrink(0);
+		detail::telemetry_on_free(*_data.raw_ptr());
 		if (pmemobj_tx_free(*_data.raw_ptr()) != 0)
 			throw detail::exception_with_errormsg<
 				pmem::transaction_free_error>(
@@ -2342,6 +2345,7 @@ vector<T>::internal_insert(size_type idx, InputIt first, InputIt last)
 		for (size_type i = 0; i < old_size; ++i)
 			detail::destroy<value_type>(
 				old_data[static_cast<difference_type>(i)]);
+		detail::telemetry_on_free(old_data.raw());
 		if (pmemobj_tx_free(old_data.raw()) != 0)
 			throw detail::exception_with_errormsg<
 				pmem::transaction_free_error>(
@@ -2405,6 +2409,7 @@ vector<T>::realloc(size_type capacity_new)
 	for (size_type i = 0; i < old_size; ++i)
 		detail::destroy<value_type>(
 			old_data[static_cast<difference_type>(i)]);
+	detail::telemetry_on_free(old_data.raw());
 	if (pmemobj_tx_free(old_data.raw()) != 0)
 		throw detail::exception_with_errormsg<
 			pmem::transaction_free_error>(
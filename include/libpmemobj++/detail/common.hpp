@@ -11,6 +11,8 @@
 
 #include <libpmemobj++/pexceptions.hpp>
 #include <libpmemobj/tx_base.h>
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <typeinfo>
 
@@ -159,6 +161,76 @@ static constexpr size_t CACHELINE_SIZE = 128ULL;
 #error unable to recognize architecture at compile time
 #endif
 
+/**
+ * Number of open pools with telemetry enabled (see pool_base::telemetry()).
+ * When it is zero, all telemetry hooks return immediately.
+ */
+inline std::atomic<std::size_t> &
+telemetry_enabled_pools()
+{
+	static std::atomic<std::size_t> cnt(0);
+	return cnt;
+}
+
+/**
+ * Number of open pools opened with pool_base::open_read_only(). When it is
+ * zero, containers do not have to look up their pool to check the mode.
+ */
+inline std::atomic<std::size_t> &
+read_only_pools()
+{
+	static std::atomic<std::size_t> cnt(0);
+	return cnt;
+}
+
+/**
+ * Number of pools closed by pool_base::close(). Volatile state cached in
+ * persistent objects (see pmem_futex_word) is revalidated when it changes.
+ */
+inline std::atomic<uint64_t> &
+closed_pools()
+{
+	static std::atomic<uint64_t> cnt(0);
+	return cnt;
+}
+
+/**
+ * Function which accounts a snapshot in the telemetry of the outermost
+ * transaction of the calling thread.
+ */
+using telemetry_snapshot_fn = void (*)(std::uintptr_t begin,
+				       std::uintptr_t end);
+
+/**
+ * Set at the beginning of the outermost transaction if telemetry is enabled
+ * for its pool, nullptr otherwise (see telemetry_on_tx_begin()). The
+ * tracking state lives in pool_data.hpp, so it is not pulled in here.
+ */
+inline telemetry_snapshot_fn &
+telemetry_snapshot_hook()
+{
+	static thread_local telemetry_snapshot_fn fn = nullptr;
+	return fn;
+}
+
+/**
+ * Account a snapshot of 'size' bytes starting at 'ptr' if telemetry is
+ * enabled for the pool of the current transaction.
+ */
+inline void
+telemetry_on_snapshot(const void *ptr, std::size_t size)
+{
+	if (telemetry_enabled_pools().load(std::memory_order_relaxed) == 0)
+		return;
+
+	auto fn = telemetry_snapshot_hook();
+	if (fn == nullptr)
+		return;
+
+	auto begin = reinterpret_cast<std::uintptr_t>(ptr);
+	fn(begin, begin + size);
+}
+
 /**
  * Conditionally add 'count' objects to a transaction.
  *
@@ -194,6 +266,10 @@ conditional_add_to_tx(const T *that, std::size_t count = 1, uint64_t flags = 0)
 			throw exception_with_errormsg<pmem::transaction_error>(
 				msg);
 	}
+
+	/* ranges added without a snapshot do not reach the undo log */
+	if (!(flags & POBJ_XADD_NO_SNAPSHOT))
+		telemetry_on_snapshot(that, sizeof(*that) * count);
 }
 
 /**
@@ -291,6 +367,13 @@ mssb_index(unsigned int value)
 	return ((uint8_t)(31 - __builtin_clz(value)));
 }
 
+/** Returns index of least significant set bit */
+static inline uint8_t
+lssb_index64(unsigned long long value)
+{
+	return ((uint8_t)__builtin_ctzll(value));
+}
+
 #else
 
 static __inline uint8_t
@@ -309,6 +392,14 @@ mssb_index64(uint64_t value)
 	return (uint8_t)ret;
 }
 
+static __inline uint8_t
+lssb_index64(uint64_t value)
+{
+	unsigned long ret;
+	_BitScanForward64(&ret, value);
+	return (uint8_t)ret;
+}
+
 #endif
 
 static constexpr size_t
@@ -37,10 +37,15 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <libpmemobj++/detail/common.hpp>
 
@@ -67,15 +72,42 @@ namespace detail
  * reclamation (garbage collection). Then, the objects in the target epoch can
  * be reclaimed after two successful increments of the global epoch. Only three
  * epochs are needed (e, e-1 and e-2), therefore we use clock arithmetics.
+ *
+ * Objects can be either staged for reclamation manually (using staging_epoch()
+ * and gc_epoch()) or retired by the worker which unlinked them
+ * (worker::retire()). Retired objects are kept on a per-worker limbo list for
+ * each epoch, so retiring does not contend with other workers. They are freed
+ * in batches by reclaim(), which may be called periodically by a background
+ * thread (see start_reclamation()).
  */
 class ebr {
 	using atomic = std::atomic<size_t>;
-	using reference = std::reference_wrapper<atomic>;
+	using retired_list = std::vector<std::function<void()>>;
 
 public:
 	class worker;
 
+	static constexpr size_t EPOCHS_NUMBER = 3;
+
+private:
+	/* Runtime state of the worker. */
+	struct worker_state {
+		worker_state() : local_epoch(0)
+		{
+		}
+
+		atomic local_epoch;
+
+		/* Protects limbo lists, which are accessed by the reclaiming
+		 * thread. */
+		std::mutex mtx;
+		retired_list limbo[EPOCHS_NUMBER];
+	};
+
+public:
+
 	ebr();
+	~ebr();
 
 	worker register_worker();
 	bool sync();
@@ -83,22 +115,37 @@ public:
 	size_t staging_epoch();
 	size_t gc_epoch();
 
+	bool reclaim();
+	template <typename F>
+	bool reclaim(F &&f);
+	void full_reclaim();
+	template <typename F>
+	void full_reclaim(F &&f);
+
+	void start_reclamation(std::chrono::milliseconds period);
+	void stop_reclamation();
+
 	class worker {
 	public:
 		worker(const worker &w) = delete;
-		worker(worker &&w) = default;
+		worker(worker &&w);
 		~worker();
 
 		worker &operator=(worker &w) = delete;
-		worker &operator=(worker &&w) = default;
+		worker &operator=(worker &&w);
 
 		template <typename F>
 		void critical(F &&f);
 
+		template <typename T, typename Deleter = std::default_delete<T>>
+		void retire(T *ptr, Deleter d = Deleter());
+
 	private:
-		worker(ebr *e_, reference ref);
+		worker(ebr *e_, worker_state *s);
+
+		void unregister();
 
-		reference local_epoch;
+		worker_state *local;
 		ebr *e;
 
 		friend ebr;
@@ -107,12 +154,26 @@ public:
 private:
 	static const size_t ACTIVE_FLAG = static_cast<size_t>(1)
 		<< (sizeof(size_t) * 8 - 1);
-	static const size_t EPOCHS_NUMBER = 3;
+
+	bool advance();
+	void collect(size_t epoch, retired_list &garbage);
+	static void destroy(retired_list &garbage);
 
 	atomic global_epoch;
 
-	std::unordered_map<std::thread::id, atomic> workers;
+	std::unordered_map<std::thread::id, worker_state> workers;
 	std::mutex mtx;
+
+	/* Objects retired by workers which were already unregistered. */
+	retired_list orphans[EPOCHS_NUMBER];
+
+	/* Serializes epoch announcements with the reclamation. */
+	std::mutex gc_mtx;
+
+	std::thread reclaimer;
+	std::mutex reclaimer_mtx;
+	std::condition_variable reclaimer_cv;
+	bool reclaimer_stop = false;
 };
 
 /**
@@ -125,6 +186,23 @@ ebr::ebr() : global_epoch(0)
 #endif
 }
 
+/**
+ * Stops the background reclamation and frees all retired objects. All workers
+ * should be destroyed before the destruction of ebr object.
+ */
+ebr::~ebr()
+{
+	stop_reclamation();
+
+	std::lock_guard<std::mutex> lock(mtx);
+	for (auto &w : workers) {
+		for (auto &l : w.second.limbo)
+			destroy(l);
+	}
+	for (auto &l : orphans)
+		destroy(l);
+}
+
 /**
  * Registers and returns a new worker, which can perform critical operations
  * (accessing some shared data that can be removed in other threads). There can
@@ -140,13 +218,16 @@ ebr::worker
 ebr::register_worker()
 {
 	std::lock_guard<std::mutex> lock(mtx);
-	auto res = workers.emplace(std::this_thread::get_id(), 0);
+	auto res = workers.emplace(std::piecewise_construct,
+				   std::forward_as_tuple(
+					   std::this_thread::get_id()),
+				   std::forward_as_tuple());
 	if (!res.second) {
 		throw std::runtime_error(
 			"There can be only one worker per thread");
 	}
 
-	return worker{this, reference{res.first->second}};
+	return worker{this, &res.first->second};
 }
 
 /**
@@ -163,14 +244,22 @@ ebr::register_worker()
  */
 bool
 ebr::sync()
+{
+	std::lock_guard<std::mutex> lock(gc_mtx);
+
+	return advance();
+}
+
+bool
+ebr::advance()
 {
 	auto current_epoch = global_epoch.load();
 
 	std::lock_guard<std::mutex> lock(mtx);
 	for (auto &w : workers) {
 		LIBPMEMOBJ_CPP_ANNOTATE_HAPPENS_BEFORE(
-			std::memory_order_seq_cst, &w.second);
-		auto local_e = w.second.load();
+			std::memory_order_seq_cst, &w.second.local_epoch);
+		auto local_e = w.second.local_epoch.load();
 		bool active = local_e & ACTIVE_FLAG;
 		if (active && (local_e != (current_epoch | ACTIVE_FLAG))) {
 			return false;
@@ -236,21 +325,235 @@ ebr::gc_epoch()
 	return res;
 }
 
-ebr::worker::worker(ebr *e_, reference ref) : local_epoch(ref), e(e_)
+/**
+ * Tries to announce a new epoch and frees objects retired by all the workers
+ * in the epoch available for reclamation. Objects are freed in a batch, after
+ * releasing all the locks, so retiring is not blocked by the deleters.
+ *
+ * This function is serialized with other reclaim(), full_reclaim() and sync()
+ * calls, so it may be called by any thread (e.g. by the background thread
+ * started with start_reclamation()).
+ *
+ * @return true if a new epoch was announced, false otherwise.
+ */
+bool
+ebr::reclaim()
+{
+	return reclaim([](size_t) {});
+}
+
+/**
+ * Tries to announce a new epoch and frees objects retired by all the workers
+ * in the epoch available for reclamation. Additionally, calls f with the epoch
+ * available for reclamation, so objects staged for reclamation outside of the
+ * workers' limbo lists (e.g. persistent ones) can be freed. No new epoch is
+ * announced until f returns.
+ *
+ * @param[in] f function with the signature void(size_t epoch).
+ *
+ * @return true if a new epoch was announced, false otherwise.
+ */
+template <typename F>
+bool
+ebr::reclaim(F &&f)
+{
+	retired_list garbage;
+	bool advanced;
+
+	{
+		std::lock_guard<std::mutex> lock(gc_mtx);
+
+		advanced = advance();
+		auto epoch = gc_epoch();
+
+		f(epoch);
+		collect(epoch, garbage);
+	}
+
+	destroy(garbage);
+
+	return advanced;
+}
+
+/**
+ * Performs full synchronisation and frees all objects retired before the call.
+ */
+void
+ebr::full_reclaim()
+{
+	full_reclaim([](size_t) {});
+}
+
+/**
+ * Performs full synchronisation and frees all objects retired before the call.
+ * Additionally, calls f for each of the epochs, see reclaim(F &&f).
+ *
+ * @param[in] f function with the signature void(size_t epoch).
+ */
+template <typename F>
+void
+ebr::full_reclaim(F &&f)
+{
+	retired_list garbage;
+
+	{
+		std::lock_guard<std::mutex> lock(gc_mtx);
+
+		size_t syncs_cnt = 0;
+		while (syncs_cnt < EPOCHS_NUMBER) {
+			if (advance())
+				syncs_cnt++;
+		}
+
+		for (size_t epoch = 0; epoch < EPOCHS_NUMBER; epoch++) {
+			f(epoch);
+			collect(epoch, garbage);
+		}
+	}
+
+	destroy(garbage);
+}
+
+/**
+ * Starts a background thread, which calls reclaim() every period. If the
+ * thread is already running, it is restarted with the new period.
+ *
+ * @param[in] period time between subsequent reclaim() calls.
+ */
+void
+ebr::start_reclamation(std::chrono::milliseconds period)
+{
+	stop_reclamation();
+
+	reclaimer_stop = false;
+	reclaimer = std::thread([this, period] {
+		std::unique_lock<std::mutex> lock(reclaimer_mtx);
+		while (!reclaimer_stop) {
+			lock.unlock();
+			reclaim();
+			lock.lock();
+
+			reclaimer_cv.wait_for(lock, period, [this] {
+				return reclaimer_stop;
+			});
+		}
+	});
+}
+
+/**
+ * Stops the background thread started with start_reclamation(), if any.
+ * Objects retired so far are not freed.
+ */
+void
+ebr::stop_reclamation()
+{
+	if (!reclaimer.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(reclaimer_mtx);
+		reclaimer_stop = true;
+	}
+	reclaimer_cv.notify_one();
+
+	reclaimer.join();
+}
+
+/*
+ * Moves objects retired in the given epoch by all the workers to garbage.
+ */
+void
+ebr::collect(size_t epoch, retired_list &garbage)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	auto append = [&](retired_list &l) {
+		garbage.insert(garbage.end(),
+			       std::make_move_iterator(l.begin()),
+			       std::make_move_iterator(l.end()));
+		l.clear();
+	};
+
+	for (auto &w : workers) {
+		std::lock_guard<std::mutex> limbo_lock(w.second.mtx);
+		append(w.second.limbo[epoch]);
+	}
+	append(orphans[epoch]);
+}
+
+void
+ebr::destroy(retired_list &garbage)
+{
+	for (auto &f : garbage)
+		f();
+	garbage.clear();
+}
+
+ebr::worker::worker(ebr *e_, worker_state *s) : local(s), e(e_)
 {
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
-	VALGRIND_HG_DISABLE_CHECKING(&ref.get(), sizeof(ref.get()));
+	VALGRIND_HG_DISABLE_CHECKING(&s->local_epoch, sizeof(s->local_epoch));
 #endif
 }
 
 /**
- * Unregisters the worker from the list of the workers in the ebr. All workers
- * should be destroyed before the destruction of ebr object.
+ * Move constructor. The other worker is left unregistered.
+ */
+ebr::worker::worker(worker &&w) : local(w.local), e(w.e)
+{
+	w.e = nullptr;
+}
+
+/**
+ * Move assignment operator. Unregisters this worker and takes over the other
+ * one.
+ */
+ebr::worker &
+ebr::worker::operator=(worker &&w)
+{
+	if (this != &w) {
+		unregister();
+
+		local = w.local;
+		e = w.e;
+		w.e = nullptr;
+	}
+
+	return *this;
+}
+
+/**
+ * Unregisters the worker from the list of the workers in the ebr. Objects
+ * retired by the worker, which were not freed yet, are handed over to the ebr.
+ * All workers should be destroyed before the destruction of ebr object.
  */
 ebr::worker::~worker()
 {
+	unregister();
+}
+
+void
+ebr::worker::unregister()
+{
+	if (!e)
+		return;
+
 	std::lock_guard<std::mutex> lock(e->mtx);
-	e->workers.erase(std::this_thread::get_id());
+	for (size_t i = 0; i < EPOCHS_NUMBER; i++) {
+		auto &l = local->limbo[i];
+		e->orphans[i].insert(e->orphans[i].end(),
+				     std::make_move_iterator(l.begin()),
+				     std::make_move_iterator(l.end()));
+	}
+
+	/* The worker might have been moved to another thread. */
+	for (auto it = e->workers.begin(); it != e->workers.end(); ++it) {
+		if (&it->second == local) {
+			e->workers.erase(it);
+			break;
+		}
+	}
+	e = nullptr;
 }
 
 /**
@@ -269,13 +572,35 @@ ebr::worker::critical(F &&f)
 	LIBPMEMOBJ_CPP_ANNOTATE_HAPPENS_AFTER(std::memory_order_seq_cst,
 					      &(e->global_epoch));
 
-	local_epoch.get().store(new_epoch);
+	local->local_epoch.store(new_epoch);
 	LIBPMEMOBJ_CPP_ANNOTATE_HAPPENS_AFTER(std::memory_order_seq_cst,
-					      &local_epoch);
+					      &local->local_epoch);
 
 	f();
 
-	local_epoch.get().store(0);
+	local->local_epoch.store(0);
+}
+
+/**
+ * Retires an object, which was already made unreachable for new critical
+ * operations. The object is put on the worker's limbo list for the current
+ * epoch and destroyed by reclaim() (or full_reclaim()), once no critical
+ * operation can access it anymore.
+ *
+ * @param[in] ptr pointer to the retired object.
+ * @param[in] d deleter, called with ptr as an argument to destroy the object.
+ * It may be called from any thread which performs the reclamation.
+ */
+template <typename T, typename Deleter>
+void
+ebr::worker::retire(T *ptr, Deleter d)
+{
+	std::lock_guard<std::mutex> lock(local->mtx);
+
+	/* The epoch has to be read under the lock, so that the list cannot
+	 * be reclaimed between reading the epoch and appending the object. */
+	local->limbo[e->staging_epoch()].emplace_back(
+		[ptr, d]() mutable { d(ptr); });
 }
 
 } /* namespace detail */
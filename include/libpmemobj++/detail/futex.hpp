@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Futex-like wait/wake primitives on a pmem-resident 32-bit word whose value
+ * is reset on every run.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_FUTEX_HPP
+#define LIBPMEMOBJ_CPP_FUTEX_HPP
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj/base.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <new>
+#include <random>
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace pmem
+{
+
+namespace detail
+{
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+	      "std::atomic<uint32_t> must have the size of uint32_t");
+
+/**
+ * Blocks until the value of 'word' is different than 'expected', the
+ * thread is woken up by futex_wake or 'timeout' expires. Spurious
+ * wakeups are possible.
+ *
+ * @return false if the timeout expired, true otherwise.
+ */
+inline bool
+futex_wait(std::atomic<uint32_t> *word, uint32_t expected,
+	   const std::chrono::nanoseconds *timeout = nullptr)
+{
+#if defined(__linux__)
+	struct timespec ts;
+	struct timespec *tsp = nullptr;
+
+	if (timeout) {
+		if (timeout->count() <= 0)
+			return false;
+
+		auto sec = std::chrono::duration_cast<std::chrono::seconds>(
+			*timeout);
+		ts.tv_sec = static_cast<time_t>(sec.count());
+		ts.tv_nsec = static_cast<long>((*timeout - sec).count());
+		tsp = &ts;
+	}
+
+	auto ret = syscall(SYS_futex, reinterpret_cast<uint32_t *>(word),
+			   FUTEX_WAIT_PRIVATE, expected, tsp, nullptr, 0);
+
+	return !(ret == -1 && errno == ETIMEDOUT);
+#elif defined(_WIN32)
+	DWORD ms = INFINITE;
+
+	if (timeout) {
+		if (timeout->count() <= 0)
+			return false;
+
+		/* round up, WaitOnAddress has millisecond granularity */
+		ms = static_cast<DWORD>(
+			(timeout->count() + 999999) / 1000000);
+	}
+
+	if (WaitOnAddress(word, &expected, sizeof(expected), ms))
+		return true;
+
+	return GetLastError() != ERROR_TIMEOUT;
+#else
+	/* no futex-like primitive, fall back to polling */
+	auto deadline = std::chrono::steady_clock::now() +
+		(timeout ? *timeout : std::chrono::nanoseconds(0));
+
+	while (word->load(std::memory_order_acquire) == expected) {
+		if (timeout && std::chrono::steady_clock::now() >= deadline)
+			return false;
+
+		std::this_thread::yield();
+	}
+
+	return true;
+#endif
+}
+
+/**
+ * Wakes up at most 'n' threads waiting on 'word'.
+ */
+inline void
+futex_wake(std::atomic<uint32_t> *word, int n)
+{
+#if defined(__linux__)
+	syscall(SYS_futex, reinterpret_cast<uint32_t *>(word),
+		FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+	if (n == 1)
+		WakeByAddressSingle(word);
+	else
+		WakeByAddressAll(word);
+#else
+	(void)word;
+	(void)n;
+#endif
+}
+
+/*
+ * Returns a value which identifies the current process and changes whenever
+ * a pool is closed. It is never 0.
+ */
+inline uint64_t
+volatile_token()
+{
+	static const uint64_t nonce = [] {
+		std::random_device rd;
+		uint64_t seed = (uint64_t(rd()) << 32) ^ rd() ^
+			static_cast<uint64_t>(std::chrono::steady_clock::now()
+						      .time_since_epoch()
+						      .count());
+		return seed | 1;
+	}();
+
+	return nonce + 2 * closed_pools().load(std::memory_order_acquire);
+}
+
+/**
+ * A 32-bit word residing in persistent memory, which is used as a futex.
+ * Its value is volatile: it is reset to 0 on first access after the pool
+ * is opened, using the run id of the pool (see pmemobj_volatile). A
+ * zeroed object is valid, so it can be a part of the root object.
+ *
+ * Looking up the pool of the word is expensive, so it is done only on the
+ * first access in a process and after any pool was closed. Otherwise get()
+ * costs one atomic load.
+ */
+class pmem_futex_word {
+public:
+	pmem_futex_word() noexcept : vlt{0}, token(0)
+	{
+	}
+
+	pmem_futex_word(const pmem_futex_word &) = delete;
+	pmem_futex_word &operator=(const pmem_futex_word &) = delete;
+
+	/**
+	 * Returns the word, initializing it to 0 if it is accessed for the
+	 * first time in this run.
+	 *
+	 * @throw pmem::lock_error if the word does not reside in pmem.
+	 */
+	std::atomic<uint32_t> &
+	get()
+	{
+		if (token.load(std::memory_order_acquire) == volatile_token())
+			return word;
+
+		return resolve();
+	}
+
+private:
+	std::atomic<uint32_t> &
+	resolve()
+	{
+		PMEMobjpool *pop = pmemobj_pool_by_ptr(this);
+		if (pop == nullptr)
+			throw pmem::lock_error(
+				1, std::generic_category(),
+				"Futex word not from persistent memory.");
+
+		auto w = static_cast<std::atomic<uint32_t> *>(
+			pmemobj_volatile(pop, &vlt, &word, sizeof(word),
+					 &construct, nullptr));
+
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+		VALGRIND_PMC_REMOVE_PMEM_MAPPING(&token, sizeof(token));
+#endif
+		/* the token is taken after the pool was looked up, so a pool
+		 * closed in the meantime invalidates it */
+		token.store(volatile_token(), std::memory_order_release);
+
+		return *w;
+	}
+
+	static int
+	construct(void *ptr, void *)
+	{
+		new (ptr) std::atomic<uint32_t>(0);
+		return 0;
+	}
+
+	struct pmemvlt vlt;
+	std::atomic<uint32_t> word;
+
+	/* volatile_token() at the time the word was last resolved */
+	std::atomic<uint64_t> token;
+};
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_FUTEX_HPP */
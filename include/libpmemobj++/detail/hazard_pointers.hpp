@@ -0,0 +1,466 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * C++ hazard pointers API.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_HAZARD_POINTERS_HPP
+#define LIBPMEMOBJ_CPP_HAZARD_POINTERS_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/tagged_ptr.hpp>
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/**
+ * Hazard pointers based memory reclamation. Reference:
+ *
+ *	M. M. Michael, Hazard Pointers: Safe Memory Reclamation for Lock-Free
+ *	Objects, IEEE Transactions on Parallel and Distributed Systems,
+ *	vol. 15, no. 6, June 2004
+ *
+ * Summary:
+ *
+ * Each worker owns a small, fixed number of hazard pointer slots. Before
+ * dereferencing a shared object, the worker publishes its address in one of
+ * the slots (worker::protect()) and then checks that the object is still
+ * reachable. Retired objects are kept on the worker's list and freed by
+ * a scan, once no slot of any worker points to them.
+ *
+ * Unlike epoch-based reclamation (ebr), a worker which stalls while holding
+ * a reference blocks reclamation of at most as many objects as it has slots,
+ * so the amount of unreclaimed memory is bounded. The price is a store and
+ * a full fence for each protected pointer, and the readers have to know how
+ * many references they hold at once.
+ */
+class hazard_pointers {
+	using slot_type = std::atomic<const void *>;
+
+	struct retired {
+		const void *ptr;
+		std::function<void()> deleter;
+	};
+
+	using retired_list = std::vector<retired>;
+
+	/* Runtime state of the worker, reused after the worker is destroyed. */
+	struct worker_state {
+		explicit worker_state(size_t slots);
+
+		std::unique_ptr<slot_type[]> hazards;
+		retired_list retired_objects;
+		bool active;
+	};
+
+public:
+	class worker;
+
+	explicit hazard_pointers(size_t slots = 2);
+	~hazard_pointers();
+
+	hazard_pointers(const hazard_pointers &) = delete;
+	hazard_pointers &operator=(const hazard_pointers &) = delete;
+
+	worker register_worker();
+	size_t slots() const;
+	void reclaim();
+
+	std::vector<const void *> protected_objects();
+
+	class worker {
+	public:
+		worker(const worker &w) = delete;
+		worker(worker &&w);
+		~worker();
+
+		worker &operator=(const worker &w) = delete;
+		worker &operator=(worker &&w);
+
+		template <typename Atomic>
+		auto protect(const Atomic &src, size_t slot = 0)
+			-> decltype(src.load());
+
+		void release(size_t slot = 0);
+		void release_all();
+
+		template <typename T, typename Deleter = std::default_delete<T>>
+		void retire(T *ptr, Deleter d = Deleter());
+
+		void reclaim();
+
+	private:
+		worker(hazard_pointers *h_, worker_state *s);
+
+		void unregister();
+
+		worker_state *local;
+		hazard_pointers *h;
+
+		friend hazard_pointers;
+	};
+
+private:
+	template <typename T>
+	static const void *address(T *ptr);
+	template <typename Ptr>
+	static const void *address(const Ptr &ptr);
+	template <typename P1, typename P2, typename PointerType>
+	static const void *
+	address(const tagged_ptr_impl<P1, P2, PointerType> &ptr);
+
+	void scan(retired_list &objects);
+
+	const size_t slots_;
+
+	/* Number of hazard pointer slots of all the workers. */
+	std::atomic<size_t> hazards_number;
+
+	std::list<worker_state> workers;
+	std::mutex mtx;
+
+	/* Objects retired by workers which were already unregistered. */
+	retired_list orphans;
+};
+
+inline hazard_pointers::worker_state::worker_state(size_t slots)
+    : hazards(new slot_type[slots]), active(true)
+{
+	for (size_t i = 0; i < slots; i++)
+		hazards[i].store(nullptr);
+}
+
+/**
+ * Constructs hazard pointers domain.
+ *
+ * @param[in] slots number of hazard pointer slots of each worker, i.e. number
+ * of objects which a single worker may protect at the same time.
+ *
+ * @throw std::invalid_argument if slots is 0.
+ */
+inline hazard_pointers::hazard_pointers(size_t slots)
+    : slots_(slots), hazards_number(0)
+{
+	if (slots == 0)
+		throw std::invalid_argument(
+			"Number of hazard pointer slots must be positive.");
+}
+
+/**
+ * Frees all retired objects. All workers should be destroyed before
+ * the destruction of hazard_pointers object.
+ */
+inline hazard_pointers::~hazard_pointers()
+{
+	for (auto &w : workers) {
+		for (auto &r : w.retired_objects)
+			r.deleter();
+	}
+	for (auto &r : orphans)
+		r.deleter();
+}
+
+/**
+ * Registers and returns a new worker, which can protect and retire objects.
+ * The worker will be automatically unregistered in the destructor. Worker
+ * objects must not be used concurrently by multiple threads.
+ *
+ * @return new registered worker.
+ */
+inline hazard_pointers::worker
+hazard_pointers::register_worker()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	for (auto &w : workers) {
+		if (!w.active) {
+			w.active = true;
+			return worker{this, &w};
+		}
+	}
+
+	workers.emplace_back(slots_);
+	hazards_number += slots_;
+
+	return worker{this, &workers.back()};
+}
+
+/**
+ * Returns number of hazard pointer slots of each worker.
+ *
+ * @return number of slots.
+ */
+inline size_t
+hazard_pointers::slots() const
+{
+	return slots_;
+}
+
+/**
+ * Frees objects retired by unregistered workers, which are not protected
+ * anymore.
+ */
+inline void
+hazard_pointers::reclaim()
+{
+	retired_list objects;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		objects.swap(orphans);
+	}
+
+	scan(objects);
+
+	std::lock_guard<std::mutex> lock(mtx);
+	orphans.insert(orphans.end(), std::make_move_iterator(objects.begin()),
+		       std::make_move_iterator(objects.end()));
+}
+
+/**
+ * Returns addresses of the objects protected by any worker, sorted. An object
+ * which was made unreachable and is not protected at the time of the call
+ * will not be protected later, so it can be freed. This allows to combine
+ * hazard pointers with other reclamation schemes, which free the objects on
+ * their own.
+ *
+ * @return sorted addresses of the protected objects.
+ */
+inline std::vector<const void *>
+hazard_pointers::protected_objects()
+{
+	std::vector<const void *> hazards;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		hazards.reserve(workers.size() * slots_);
+		for (auto &w : workers) {
+			for (size_t i = 0; i < slots_; i++) {
+				auto ptr = w.hazards[i].load();
+				if (ptr)
+					hazards.push_back(ptr);
+			}
+		}
+	}
+	std::sort(hazards.begin(), hazards.end());
+
+	return hazards;
+}
+
+template <typename T>
+const void *
+hazard_pointers::address(T *ptr)
+{
+	return ptr;
+}
+
+template <typename Ptr>
+const void *
+hazard_pointers::address(const Ptr &ptr)
+{
+	return ptr.get();
+}
+
+/* Tagged pointers are protected by the address of the pointed object. */
+template <typename P1, typename P2, typename PointerType>
+const void *
+hazard_pointers::address(const tagged_ptr_impl<P1, P2, PointerType> &ptr)
+{
+	if (ptr.template is<P1>())
+		return ptr.template get<P1>();
+
+	return ptr.template get<P2>();
+}
+
+/*
+ * Frees objects which are not protected by any worker, the rest is left in
+ * the list.
+ */
+inline void
+hazard_pointers::scan(retired_list &objects)
+{
+	if (objects.empty())
+		return;
+
+	auto hazards = protected_objects();
+
+	auto protected_end = std::partition(
+		objects.begin(), objects.end(), [&](const retired &r) {
+			return std::binary_search(hazards.begin(),
+						  hazards.end(), r.ptr);
+		});
+
+	retired_list garbage(std::make_move_iterator(protected_end),
+			     std::make_move_iterator(objects.end()));
+	objects.erase(protected_end, objects.end());
+
+	for (auto &r : garbage)
+		r.deleter();
+}
+
+inline hazard_pointers::worker::worker(hazard_pointers *h_, worker_state *s)
+    : local(s), h(h_)
+{
+}
+
+/**
+ * Move constructor. The other worker is left unregistered.
+ */
+inline hazard_pointers::worker::worker(worker &&w) : local(w.local), h(w.h)
+{
+	w.h = nullptr;
+}
+
+/**
+ * Move assignment operator. Unregisters this worker and takes over the other
+ * one.
+ */
+inline hazard_pointers::worker &
+hazard_pointers::worker::operator=(worker &&w)
+{
+	if (this != &w) {
+		unregister();
+
+		local = w.local;
+		h = w.h;
+		w.h = nullptr;
+	}
+
+	return *this;
+}
+
+/**
+ * Releases all the slots and unregisters the worker. Objects retired by
+ * the worker, which were not freed yet, are handed over to the
+ * hazard_pointers object.
+ */
+inline hazard_pointers::worker::~worker()
+{
+	unregister();
+}
+
+inline void
+hazard_pointers::worker::unregister()
+{
+	if (!h)
+		return;
+
+	release_all();
+
+	std::lock_guard<std::mutex> lock(h->mtx);
+	auto &objects = local->retired_objects;
+	h->orphans.insert(h->orphans.end(),
+			  std::make_move_iterator(objects.begin()),
+			  std::make_move_iterator(objects.end()));
+	objects.clear();
+	local->active = false;
+
+	h = nullptr;
+}
+
+/**
+ * Loads a pointer from src and protects the pointed object in the given slot,
+ * so it will not be freed until the slot is released or reused. Object which
+ * was protected in this slot before is not protected anymore.
+ *
+ * @param[in] src atomic pointer to a shared object, e.g. std::atomic<T *>.
+ * The object must be retired only after it was made unreachable from src.
+ * @param[in] slot index of the slot, less than hazard_pointers::slots().
+ *
+ * @return the protected pointer, as loaded from src.
+ */
+template <typename Atomic>
+auto
+hazard_pointers::worker::protect(const Atomic &src, size_t slot)
+	-> decltype(src.load())
+{
+	assert(slot < h->slots_);
+
+	auto &hazard = local->hazards[slot];
+	auto ptr = src.load();
+	while (true) {
+		hazard.store(address(ptr));
+
+		/* The object was still reachable after publishing the hazard
+		 * pointer, so any scan which starts later will see it. */
+		auto current = src.load();
+		if (current == ptr)
+			return ptr;
+
+		ptr = current;
+	}
+}
+
+/**
+ * Releases the given slot. The object protected in this slot may be freed
+ * afterwards.
+ *
+ * @param[in] slot index of the slot.
+ */
+inline void
+hazard_pointers::worker::release(size_t slot)
+{
+	assert(slot < h->slots_);
+
+	local->hazards[slot].store(nullptr, std::memory_order_release);
+}
+
+/**
+ * Releases all the slots of the worker.
+ */
+inline void
+hazard_pointers::worker::release_all()
+{
+	for (size_t i = 0; i < h->slots_; i++)
+		release(i);
+}
+
+/**
+ * Retires an object, which was already made unreachable for the other
+ * workers. The object is destroyed once it is not protected by any worker.
+ * The retired objects are scanned in batches, proportional to the total
+ * number of hazard pointer slots, so the amortized cost of retiring is
+ * constant.
+ *
+ * @param[in] ptr pointer to the retired object.
+ * @param[in] d deleter, called with ptr as an argument to destroy the object.
+ */
+template <typename T, typename Deleter>
+void
+hazard_pointers::worker::retire(T *ptr, Deleter d)
+{
+	auto &objects = local->retired_objects;
+	objects.push_back(retired{ptr, [ptr, d]() mutable { d(ptr); }});
+
+	if (objects.size() >= 2 * h->hazards_number.load())
+		reclaim();
+}
+
+/**
+ * Frees objects retired by this worker, which are not protected anymore.
+ */
+inline void
+hazard_pointers::worker::reclaim()
+{
+	h->scan(local->retired_objects);
+}
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_HAZARD_POINTERS_HPP */
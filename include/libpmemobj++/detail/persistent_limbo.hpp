@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Crash-consistent limbo list for persistent objects retired with EBR.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_PERSISTENT_LIMBO_HPP
+#define LIBPMEMOBJ_CPP_PERSISTENT_LIMBO_HPP
+
+#include <libpmemobj++/container/vector.hpp>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/ebr.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj++/utils.hpp>
+
+#include <vector>
+
+namespace pmem
+{
+
+namespace detail
+{
+
+/**
+ * Persistent list of objects which were unlinked from a persistent data
+ * structure, but may still be accessed by the readers, bucketed by the ebr
+ * epoch in which they were retired.
+ *
+ * Objects are appended in the same transaction which unlinks them, and are
+ * freed in a transaction which also removes them from the list, so they are
+ * neither leaked nor freed twice in case of a crash. After a restart there are
+ * no readers, so all the objects can be freed with clear().
+ *
+ * This class is not thread-safe: retire() and reclaim() calls have to be
+ * serialized by the caller (e.g. by the lock protecting modifications of the
+ * data structure). The epochs are announced in the ebr object only while
+ * reclaim() holds it, so the lists are never freed too early.
+ *
+ * @tparam T type of the stored pointers, e.g. obj::persistent_ptr.
+ */
+template <typename T>
+class persistent_limbo {
+public:
+	/* Default predicate of reclaim(), nothing is kept. */
+	struct keep_none {
+		bool
+		operator()(const T &) const
+		{
+			return false;
+		}
+	};
+
+	void retire(ebr &e, const T &ptr);
+
+	template <typename Deleter, typename Keep = keep_none>
+	bool reclaim(ebr &e, Deleter &&d, Keep keep = Keep());
+
+	template <typename Deleter, typename Keep = keep_none>
+	void full_reclaim(ebr &e, Deleter &&d, Keep keep = Keep());
+
+	template <typename Deleter>
+	void clear(Deleter &&d);
+
+	bool empty() const;
+
+private:
+	template <typename Deleter, typename Keep>
+	void reclaim_list(size_t epoch, Deleter &d, Keep &keep);
+
+	obj::vector<T> lists[ebr::EPOCHS_NUMBER];
+};
+
+/**
+ * Appends ptr to the list of the current ebr epoch. Has to be called in
+ * the transaction which makes the object unreachable.
+ *
+ * @param[in] e ebr object used by the readers of the data structure.
+ * @param[in] ptr pointer to the retired object.
+ *
+ * @throw pmem::transaction_alloc_error when allocation failed.
+ */
+template <typename T>
+void
+persistent_limbo<T>::retire(ebr &e, const T &ptr)
+{
+	lists[e.staging_epoch()].emplace_back(ptr);
+}
+
+/**
+ * Tries to announce a new epoch in e and transactionally frees the objects
+ * which are no longer accessed by any reader. Objects retired by ebr workers
+ * are freed as well, see ebr::reclaim().
+ *
+ * @param[in] e ebr object used by the readers of the data structure.
+ * @param[in] d deleter, called in a transaction for each freed pointer.
+ * @param[in] keep predicate, objects for which it returns true are not
+ * freed and stay on the list (e.g. when they are still referenced by some
+ * other mechanism than ebr).
+ *
+ * @return true if a new epoch was announced, false otherwise.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+template <typename Deleter, typename Keep>
+bool
+persistent_limbo<T>::reclaim(ebr &e, Deleter &&d, Keep keep)
+{
+	return e.reclaim([&](size_t epoch) { reclaim_list(epoch, d, keep); });
+}
+
+/**
+ * Performs full synchronisation of e and transactionally frees all the
+ * objects retired before the call.
+ *
+ * @param[in] e ebr object used by the readers of the data structure.
+ * @param[in] d deleter, called in a transaction for each freed pointer.
+ * @param[in] keep predicate, objects for which it returns true are not
+ * freed and stay on the list.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+template <typename Deleter, typename Keep>
+void
+persistent_limbo<T>::full_reclaim(ebr &e, Deleter &&d, Keep keep)
+{
+	e.full_reclaim([&](size_t epoch) { reclaim_list(epoch, d, keep); });
+}
+
+/**
+ * Transactionally frees all the objects, without synchronisation with
+ * the readers. May be used only if there are no readers, e.g. after
+ * an application restart or in a destructor.
+ *
+ * @param[in] d deleter, called in a transaction for each freed pointer.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+template <typename Deleter>
+void
+persistent_limbo<T>::clear(Deleter &&d)
+{
+	keep_none keep;
+	for (size_t epoch = 0; epoch < ebr::EPOCHS_NUMBER; epoch++)
+		reclaim_list(epoch, d, keep);
+}
+
+/**
+ * Checks whether there are any retired objects.
+ *
+ * @return true if there are no retired objects, false otherwise.
+ */
+template <typename T>
+bool
+persistent_limbo<T>::empty() const
+{
+	for (auto &l : lists) {
+		if (!l.empty())
+			return false;
+	}
+
+	return true;
+}
+
+template <typename T>
+template <typename Deleter, typename Keep>
+void
+persistent_limbo<T>::reclaim_list(size_t epoch, Deleter &d, Keep &keep)
+{
+	assert(epoch < ebr::EPOCHS_NUMBER);
+
+	auto &l = lists[epoch];
+	if (l.empty())
+		return;
+
+	/* objects which are kept are moved to the front of the list */
+	std::vector<bool> kept(l.size());
+	size_t n_kept = 0;
+	for (size_t i = 0; i < l.size(); i++) {
+		kept[i] = keep(l.const_at(i));
+		if (kept[i])
+			n_kept++;
+	}
+
+	if (n_kept == l.size())
+		return;
+
+	auto pop = obj::pool_by_vptr(this);
+
+	obj::flat_transaction::run(pop, [&] {
+		size_t pos = 0;
+		for (size_t i = 0; i < l.size(); i++) {
+			if (!kept[i]) {
+				d(l.const_at(i));
+				continue;
+			}
+
+			if (pos != i)
+				l[pos] = l.const_at(i);
+			pos++;
+		}
+
+		l.resize(n_kept);
+	});
+}
+
+} /* namespace detail */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_PERSISTENT_LIMBO_HPP */
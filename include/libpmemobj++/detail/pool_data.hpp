@@ -4,14 +4,30 @@
 /**
  * @file
  * A volatile data stored along with pmemobjpool. Stores cleanup function which
- * is called on pool close.
+ * is called on pool close, telemetry counters of the pool and volatile state
+ * of persistent objects residing in it.
  */
 
 #ifndef LIBPMEMOBJ_CPP_POOL_DATA_HPP
 #define LIBPMEMOBJ_CPP_POOL_DATA_HPP
 
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj/base.h>
+#include <libpmemobj/pool_base.h>
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace pmem
 {
@@ -19,10 +35,188 @@ namespace pmem
 namespace detail
 {
 
+/*
+ * Volatile telemetry counters of a single pool. Per-type counters are
+ * keyed by the type number of the allocation (see detail::type_num()).
+ */
+struct telemetry_data {
+	struct type_counters {
+		uint64_t allocations = 0;
+		uint64_t frees = 0;
+		uint64_t allocated_bytes = 0;
+		uint64_t freed_bytes = 0;
+	};
+
+	using types_map = std::unordered_map<uint64_t, type_counters>;
+
+	/*
+	 * Per-type counters updated by a single thread. The mutex is
+	 * contended only by collect(), so allocating threads do not
+	 * serialize on each other.
+	 */
+	struct thread_counters {
+		std::mutex mtx;
+		types_map types;
+	};
+
+	telemetry_data() : id(next_id())
+	{
+		enabled = false;
+		tx_committed = 0;
+		tx_aborted = 0;
+		snapshot_bytes = 0;
+	}
+
+	~telemetry_data()
+	{
+		stop_sampling();
+
+		if (enabled.load())
+			telemetry_enabled_pools().fetch_sub(1);
+	}
+
+	void
+	on_alloc(uint64_t type_num, uint64_t size)
+	{
+		auto &tc = local();
+		std::lock_guard<std::mutex> lock(tc.mtx);
+		auto &c = tc.types[type_num];
+		c.allocations++;
+		c.allocated_bytes += size;
+	}
+
+	void
+	on_free(uint64_t type_num, uint64_t size)
+	{
+		auto &tc = local();
+		std::lock_guard<std::mutex> lock(tc.mtx);
+		auto &c = tc.types[type_num];
+		c.frees++;
+		c.freed_bytes += size;
+	}
+
+	/* Returns per-type counters summed over all threads. */
+	types_map
+	collect()
+	{
+		types_map ret;
+
+		std::lock_guard<std::mutex> lock(threads_mtx);
+		for (auto &tc : threads) {
+			std::lock_guard<std::mutex> tc_lock(tc->mtx);
+			for (auto &e : tc->types) {
+				auto &c = ret[e.first];
+				c.allocations += e.second.allocations;
+				c.frees += e.second.frees;
+				c.allocated_bytes += e.second.allocated_bytes;
+				c.freed_bytes += e.second.freed_bytes;
+			}
+		}
+
+		return ret;
+	}
+
+	void
+	stop_sampling()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sampler_mtx);
+			sampler_stop = true;
+		}
+		sampler_cv.notify_all();
+
+		if (sampler.joinable())
+			sampler.join();
+	}
+
+	std::atomic<bool> enabled;
+	std::atomic<uint64_t> tx_committed;
+	std::atomic<uint64_t> tx_aborted;
+	std::atomic<uint64_t> snapshot_bytes;
+
+	/* Serializes starting and stopping of the sampler thread. */
+	std::mutex control_mtx;
+
+	std::mutex sampler_mtx;
+	std::condition_variable sampler_cv;
+	bool sampler_stop = false;
+	std::thread sampler;
+
+private:
+	static uint64_t
+	next_id()
+	{
+		static std::atomic<uint64_t> cnt(0);
+		return cnt.fetch_add(1);
+	}
+
+	/*
+	 * Returns counters of the calling thread. They are keyed by a unique
+	 * id rather than the address, which may be reused by another pool.
+	 * Counters of the threads which exited are kept by 'threads'.
+	 */
+	thread_counters &
+	local()
+	{
+		using local_map = std::unordered_map<
+			uint64_t, std::shared_ptr<thread_counters>>;
+		static thread_local local_map counters;
+
+		auto it = counters.find(id);
+		if (it != counters.end())
+			return *it->second;
+
+		/* drop counters of the pools which were already closed */
+		for (auto c = counters.begin(); c != counters.end();) {
+			if (c->second.use_count() == 1)
+				c = counters.erase(c);
+			else
+				++c;
+		}
+
+		auto tc = std::make_shared<thread_counters>();
+		{
+			std::lock_guard<std::mutex> lock(threads_mtx);
+			threads.push_back(tc);
+		}
+
+		return *(counters[id] = std::move(tc));
+	}
+
+	const uint64_t id;
+
+	std::mutex threads_mtx;
+	std::vector<std::shared_ptr<thread_counters>> threads;
+};
+
+/*
+ * Changes whenever volatile state of any persistent object is set or
+ * destroyed, which invalidates the lookups cached by get_volatile_object().
+ */
+inline std::atomic<uint64_t> &
+volatile_objects_generation()
+{
+	static std::atomic<uint64_t> cnt(0);
+	return cnt;
+}
+
 struct pool_data {
-	pool_data()
+	explicit pool_data(bool ro = false) : read_only(ro)
 	{
 		initialized = false;
+
+		if (read_only)
+			read_only_pools().fetch_add(1);
+	}
+
+	~pool_data()
+	{
+		if (!objects.empty())
+			volatile_objects_generation().fetch_add(
+				1, std::memory_order_release);
+
+		if (read_only)
+			read_only_pools().fetch_sub(1);
 	}
 
 	/* Set cleanup function if not already set */
@@ -42,8 +236,278 @@ struct pool_data {
 
 	std::atomic<bool> initialized;
 	std::function<void()> cleanup;
+
+	/* Set if the pool was opened with pool_base::open_read_only() */
+	const bool read_only;
+
+	telemetry_data telemetry;
+
+	/* Volatile state of persistent objects, keyed by their addresses */
+	std::mutex objects_mtx;
+	std::unordered_map<const void *, std::shared_ptr<void>> objects;
 };
 
+/*
+ * Sets volatile state of the persistent object 'obj' which resides in the
+ * pool 'pop', unless it already has one. The state is destroyed when the
+ * pool is closed. Returns the state of the object, or nullptr (and destroys
+ * the given state) if the pool was not opened by pmem::obj::pool.
+ *
+ * This is a lighter variant of detail::volatile_state, which requires
+ * C++14 and cannot be looked up cheaply on each operation.
+ */
+template <typename T>
+inline T *
+emplace_volatile_object(PMEMobjpool *pop, const void *obj,
+			std::unique_ptr<T> state)
+{
+	auto *data = static_cast<pool_data *>(pmemobj_get_user_data(pop));
+	if (data == nullptr)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(data->objects_mtx);
+	auto &entry = data->objects[obj];
+	if (!entry) {
+		entry = std::shared_ptr<T>(std::move(state));
+		volatile_objects_generation().fetch_add(
+			1, std::memory_order_release);
+	}
+
+	return static_cast<T *>(entry.get());
+}
+
+/*
+ * Returns volatile state of the persistent object 'obj' or nullptr if it has
+ * none. The last lookup is cached by the calling thread, so the pool is
+ * searched only when another object is accessed or any state was set or
+ * destroyed in the meantime. The state must not be destroyed concurrently.
+ */
+template <typename T>
+inline T *
+get_volatile_object(const void *obj)
+{
+	struct cache_entry {
+		const void *obj;
+		uint64_t generation;
+		void *state;
+	};
+	static thread_local cache_entry cache = {nullptr, 0, nullptr};
+
+	auto generation =
+		volatile_objects_generation().load(std::memory_order_acquire);
+	if (cache.obj == obj && cache.generation == generation)
+		return static_cast<T *>(cache.state);
+
+	void *state = nullptr;
+	PMEMobjpool *pop = pmemobj_pool_by_ptr(obj);
+	auto *data = pop ? static_cast<pool_data *>(pmemobj_get_user_data(pop))
+			 : nullptr;
+	if (data != nullptr) {
+		std::lock_guard<std::mutex> lock(data->objects_mtx);
+		auto it = data->objects.find(obj);
+		if (it != data->objects.end())
+			state = it->second.get();
+	}
+
+	cache = {obj, generation, state};
+
+	return static_cast<T *>(state);
+}
+
+/*
+ * Destroys volatile state of the persistent object 'obj'.
+ */
+inline void
+erase_volatile_object(PMEMobjpool *pop, const void *obj)
+{
+	auto *data = static_cast<pool_data *>(pmemobj_get_user_data(pop));
+	if (data == nullptr)
+		return;
+
+	std::lock_guard<std::mutex> lock(data->objects_mtx);
+	if (data->objects.erase(obj))
+		volatile_objects_generation().fetch_add(
+			1, std::memory_order_release);
+}
+
+/*
+ * Checks if the pool 'pop' was opened with pool_base::open_read_only().
+ */
+inline bool
+is_read_only_pool(PMEMobjpool *pop) noexcept
+{
+	if (read_only_pools().load(std::memory_order_relaxed) == 0 ||
+	    pop == nullptr)
+		return false;
+
+	auto *data = static_cast<pool_data *>(pmemobj_get_user_data(pop));
+
+	return data != nullptr && data->read_only;
+}
+
+/*
+ * Checks if 'ptr' points into a pool opened with pool_base::open_read_only().
+ * The pool is not looked up if no such pool is open.
+ */
+inline bool
+in_read_only_pool(const void *ptr) noexcept
+{
+	if (read_only_pools().load(std::memory_order_relaxed) == 0)
+		return false;
+
+	return is_read_only_pool(pmemobj_pool_by_ptr(ptr));
+}
+
+/*
+ * Returns telemetry data of the pool, or nullptr if telemetry is not
+ * enabled for it.
+ */
+inline telemetry_data *
+get_telemetry(PMEMobjpool *pop)
+{
+	if (telemetry_enabled_pools().load(std::memory_order_relaxed) == 0 ||
+	    pop == nullptr)
+		return nullptr;
+
+	auto *data = static_cast<pool_data *>(pmemobj_get_user_data(pop));
+	if (data == nullptr || !data->telemetry.enabled.load())
+		return nullptr;
+
+	return &data->telemetry;
+}
+
+/*
+ * Account an allocation of the object 'oid'. Must be called after the
+ * object was allocated.
+ */
+inline void
+telemetry_on_alloc(PMEMoid oid)
+{
+	if (telemetry_enabled_pools().load(std::memory_order_relaxed) == 0 ||
+	    OID_IS_NULL(oid))
+		return;
+
+	auto *t = get_telemetry(pmemobj_pool_by_oid(oid));
+	if (t)
+		t->on_alloc(pmemobj_type_num(oid),
+			    pmemobj_alloc_usable_size(oid));
+}
+
+/*
+ * Account a deallocation of the object 'oid'. Must be called before the
+ * object is freed.
+ */
+inline void
+telemetry_on_free(PMEMoid oid)
+{
+	if (telemetry_enabled_pools().load(std::memory_order_relaxed) == 0 ||
+	    OID_IS_NULL(oid))
+		return;
+
+	auto *t = get_telemetry(pmemobj_pool_by_oid(oid));
+	if (t)
+		t->on_free(pmemobj_type_num(oid),
+			   pmemobj_alloc_usable_size(oid));
+}
+
+/*
+ * Snapshots taken by the calling thread since the beginning of its outermost
+ * transaction. Reported to the pool at the end of the transaction.
+ */
+struct telemetry_tx_state {
+	/* Number of distinct bytes snapshotted. */
+	uint64_t bytes = 0;
+
+	/* Disjoint snapshotted address ranges, keyed by their beginning. */
+	std::map<std::uintptr_t, std::uintptr_t> ranges;
+
+	/*
+	 * Adds [begin, end) to the snapshotted ranges. Only the bytes which
+	 * were not snapshotted before are counted, as libpmemobj does not
+	 * log them again.
+	 */
+	void
+	add(std::uintptr_t begin, std::uintptr_t end)
+	{
+		auto first = begin, last = end;
+		uint64_t added = end - begin;
+
+		auto it = ranges.upper_bound(begin);
+		if (it != ranges.begin() && std::prev(it)->second >= begin)
+			--it;
+
+		while (it != ranges.end() && it->first <= end) {
+			added -= (std::min)(it->second, end) -
+				(std::max)(it->first, begin);
+			first = (std::min)(first, it->first);
+			last = (std::max)(last, it->second);
+			it = ranges.erase(it);
+		}
+
+		ranges.emplace(first, last);
+		bytes += added;
+	}
+
+	void
+	reset()
+	{
+		bytes = 0;
+		ranges.clear();
+	}
+};
+
+inline telemetry_tx_state &
+telemetry_tx()
+{
+	static thread_local telemetry_tx_state state;
+	return state;
+}
+
+/* Installed as telemetry_snapshot_hook() by telemetry_on_tx_begin(). */
+inline void
+telemetry_tx_add(std::uintptr_t begin, std::uintptr_t end)
+{
+	telemetry_tx().add(begin, end);
+}
+
+/*
+ * Starts tracking snapshots of the outermost transaction if telemetry is
+ * enabled for its pool. Snapshots of transactions which started before
+ * telemetry was enabled are not counted.
+ */
+inline void
+telemetry_on_tx_begin(PMEMobjpool *pop)
+{
+	telemetry_snapshot_hook() =
+		get_telemetry(pop) != nullptr ? telemetry_tx_add : nullptr;
+}
+
+/*
+ * Account the end of the outermost transaction and the bytes snapshotted
+ * by it. Called from the transaction stage callback.
+ */
+inline void
+telemetry_on_tx_end(PMEMobjpool *pop, bool committed)
+{
+	auto *t = get_telemetry(pop);
+	if (t) {
+		if (committed)
+			t->tx_committed.fetch_add(1);
+		else
+			t->tx_aborted.fetch_add(1);
+	}
+
+	if (telemetry_snapshot_hook() == nullptr)
+		return;
+
+	auto &tx = telemetry_tx();
+	if (t)
+		t->snapshot_bytes.fetch_add(tx.bytes);
+
+	tx.reset();
+	telemetry_snapshot_hook() = nullptr;
+}
+
 } /* namespace detail */
 
 } /* namespace pmem */
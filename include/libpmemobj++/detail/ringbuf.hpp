@@ -203,9 +203,14 @@ stable_seenoff(ringbuf_worker_t *w)
  *
  * => On success: returns the offset at which the space is available.
  * => On failure: returns -1.
+ *
+ * If 'wraps' is not null, the value of the wrap-around counter for the
+ * acquired range (i.e. the number of times the producers went around the
+ * buffer before acquiring it) is stored there.
  */
 inline ptrdiff_t
-ringbuf_acquire(ringbuf_t *rbuf, ringbuf_worker_t *w, size_t len)
+ringbuf_acquire(ringbuf_t *rbuf, ringbuf_worker_t *w, size_t len,
+		size_t *wraps = nullptr)
 {
 	ringbuf_off_t seen, next, target;
 
@@ -284,6 +289,15 @@ ringbuf_acquire(ringbuf_t *rbuf, ringbuf_worker_t *w, size_t len)
 						  w->seen_off & ~WRAP_LOCK_BIT,
 						  std::memory_order_relaxed);
 
+	/*
+	 * The range belongs to the next lap only if we wrapped-around
+	 * to the beginning; reaching exactly the end keeps the old one.
+	 */
+	if (wraps) {
+		auto counter = (target & WRAP_LOCK_BIT) ? target : seen;
+		*wraps = (counter & WRAP_COUNTER) >> 32;
+	}
+
 	/*
 	 * If we set the WRAP_LOCK_BIT in the 'next' (because we exceed
 	 * the remaining space and need to wrap-around), then save the
@@ -13,6 +13,8 @@
 #include <libpmemobj++/container/detail/concurrent_skip_list_impl.hpp>
 #include <libpmemobj++/detail/pair.hpp>
 
+#include <ratio>
+
 namespace pmem
 {
 namespace obj
@@ -46,18 +48,39 @@ namespace experimental
  * Allocator type should satisfies the named requirements
  * (https://en.cppreference.com/w/cpp/named_req/Allocator). The allocate() and
  * deallocate() methods are called inside transactions.
+ *
+ * LevelProbability (std::ratio) is the probability of promoting a node to
+ * the next level of the skip list. The default 1/2 gives the fastest
+ * searches, lower values (e.g. std::ratio<1, 4>) reduce memory usage and
+ * the number of pointers persisted per insert, which suits write-heavy
+ * maps. Changing it does not change the layout of the map.
+ *
+ * If LockFreeInsert is true, concurrent inserts link new nodes with
+ * compare-and-swap instead of locking their predecessors, which avoids lock
+ * contention on hot predecessors when there are many writers. The layout of
+ * the map and the recovery performed by runtime_initialize() do not depend on
+ * LockFreeInsert.
  * @ingroup experimental_containers
  */
 template <typename Key, typename Value, typename Comp = std::less<Key>,
 	  typename Allocator =
-		  pmem::obj::allocator<detail::pair<const Key, Value>>>
+		  pmem::obj::allocator<detail::pair<const Key, Value>>,
+	  typename LevelProbability = std::ratio<1, 2>,
+	  bool LockFreeInsert = false>
 class concurrent_map
     : public detail::concurrent_skip_list<detail::map_traits<
-	      Key, Value, Comp, detail::default_random_generator, Allocator,
-	      false, 64>> {
-	using traits_type = detail::map_traits<Key, Value, Comp,
-					       detail::default_random_generator,
-					       Allocator, false, 64>;
+	      Key, Value, Comp, detail::xorshift_random_generator, Allocator,
+	      false, 64,
+	      detail::branching_level_generator<
+		      detail::xorshift_random_generator, 64, LevelProbability>,
+	      LockFreeInsert>> {
+	using traits_type = detail::map_traits<
+		Key, Value, Comp, detail::xorshift_random_generator, Allocator,
+		false, 64,
+		detail::branching_level_generator<
+			detail::xorshift_random_generator, 64,
+			LevelProbability>,
+		LockFreeInsert>;
 	using base_type = pmem::detail::concurrent_skip_list<traits_type>;
 
 public:
@@ -74,6 +97,8 @@ public:
 	using const_pointer = typename base_type::const_pointer;
 	using iterator = typename base_type::iterator;
 	using const_iterator = typename base_type::const_iterator;
+	using cursor = typename base_type::cursor;
+	using const_cursor = typename base_type::const_cursor;
 
 	/**
 	 * Default constructor.
@@ -156,14 +181,35 @@ public:
 /** Non-member swap
  * @relates concurrent_map
  */
-template <typename Key, typename Value, typename Comp, typename Allocator>
+template <typename Key, typename Value, typename Comp, typename Allocator,
+	  typename LevelProbability, bool LockFreeInsert>
 void
-swap(concurrent_map<Key, Value, Comp, Allocator> &lhs,
-     concurrent_map<Key, Value, Comp, Allocator> &rhs)
+swap(concurrent_map<Key, Value, Comp, Allocator, LevelProbability,
+		    LockFreeInsert> &lhs,
+     concurrent_map<Key, Value, Comp, Allocator, LevelProbability,
+		    LockFreeInsert> &rhs)
 {
 	lhs.swap(rhs);
 }
 
+/** Non-member erase_if. Removes all elements satisfying the predicate pred.
+ * Equivalent of unsafe_erase_if(pred), thus not thread-safe.
+ *
+ * @return Number of elements removed.
+ *
+ * @relates concurrent_map
+ */
+template <typename Key, typename Value, typename Comp, typename Allocator,
+	  typename LevelProbability, bool LockFreeInsert, typename Predicate>
+typename concurrent_map<Key, Value, Comp, Allocator, LevelProbability,
+			LockFreeInsert>::size_type
+erase_if(concurrent_map<Key, Value, Comp, Allocator, LevelProbability,
+			LockFreeInsert> &c,
+	 Predicate pred)
+{
+	return c.unsafe_erase_if(pred);
+}
+
 } /* namespace experimental */
 } /* namespace obj */
 } /* namespace pmem */
@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Pmem-resident condition variable implemented with a futex.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_FUTEX_CONDITION_VARIABLE_HPP
+#define LIBPMEMOBJ_CPP_FUTEX_CONDITION_VARIABLE_HPP
+
+#include <libpmemobj++/detail/futex.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Persistent memory resident condition variable implemented with a futex.
+ *
+ * The condition variable is a 32-bit sequence number, reset on the first
+ * use after the pool is opened (by run id of the pool). Notifications
+ * increment it and wake the waiters with a single futex wake, waiting
+ * threads sleep until the number changes. Unlike
+ * pmem::obj::condition_variable, no internal mutex is taken on notify or
+ * wait.
+ *
+ * It works with any lock satisfying the BasicLockable requirements, e.g.
+ * futex_timed_mutex or std::unique_lock<futex_timed_mutex>, like
+ * std::condition_variable_any. As with other condition variables, spurious
+ * wakeups are possible, so waiting should be done in a loop or with a
+ * predicate.
+ *
+ * A zeroed object is valid, so the condition variable can be a part of the
+ * root object.
+ *
+ * @ingroup synchronization
+ */
+class futex_condition_variable {
+	typedef std::chrono::steady_clock clock_type;
+
+public:
+	/** The handle typedef to the underlying basic type. */
+	typedef std::atomic<uint32_t> *native_handle_type;
+
+	/**
+	 * Default constructor.
+	 */
+	futex_condition_variable() = default;
+
+	/**
+	 * Defaulted destructor.
+	 */
+	~futex_condition_variable() = default;
+
+	/**
+	 * Notify and unblock one thread waiting on `*this` condition.
+	 *
+	 * Does nothing when no threads are waiting.
+	 *
+	 * @throw lock_error if the condition variable does not reside in
+	 * pmem.
+	 */
+	void
+	notify_one()
+	{
+		auto &s = seq.get();
+		s.fetch_add(1, std::memory_order_release);
+		detail::futex_wake(&s, 1);
+	}
+
+	/**
+	 * Notify and unblock all threads waiting on `*this` condition.
+	 *
+	 * Does nothing when no threads are waiting.
+	 *
+	 * @throw lock_error if the condition variable does not reside in
+	 * pmem.
+	 */
+	void
+	notify_all()
+	{
+		auto &s = seq.get();
+		s.fetch_add(1, std::memory_order_release);
+		detail::futex_wake(&s, INT_MAX);
+	}
+
+	/**
+	 * Makes the current thread block until the condition variable
+	 * is notified or it is woken up by some other measure.
+	 *
+	 * This releases the lock, blocks the current thread and adds
+	 * it to the list of threads waiting on `*this` condition
+	 * variable. The lock needs to be acquired and owned by the
+	 * calling thread. The lock is automatically reacquired after
+	 * the call to wait.
+	 *
+	 * @param[in,out] lock a BasicLockable object.
+	 *
+	 * @throw lock_error if the condition variable does not reside in
+	 * pmem.
+	 */
+	template <typename Lock>
+	void
+	wait(Lock &lock)
+	{
+		auto &s = seq.get();
+		auto val = s.load(std::memory_order_acquire);
+
+		lock.unlock();
+		detail::futex_wait(&s, val);
+		lock.lock();
+	}
+
+	/**
+	 * Makes the current thread block until the condition variable
+	 * is notified and the predicate is met.
+	 *
+	 * @param[in,out] lock a BasicLockable object.
+	 * @param[in] pred predicate which returns `false` if waiting is
+	 * to be continued.
+	 *
+	 * @throw lock_error if the condition variable does not reside in
+	 * pmem.
+	 */
+	template <typename Lock, typename Predicate>
+	void
+	wait(Lock &lock, Predicate pred)
+	{
+		while (!pred())
+			wait(lock);
+	}
+
+	/**
+	 * Makes the current thread block until the condition variable
+	 * is notified, a specific time is reached or it is woken up by
+	 * some other measure.
+	 *
+	 * @param[in,out] lock a BasicLockable object.
+	 * @param[in] timeout a specific point in time, which when
+	 * reached unblocks the thread.
+	 *
+	 * @return std::cv_status::timeout on timeout,
+	 * std::cv_status::no_timeout otherwise.
+	 *
+	 * @throw lock_error if the condition variable does not reside in
+	 * pmem.
+	 */
+	template <typename Lock, typename Clock, typename Duration>
+	std::cv_status
+	wait_until(Lock &lock,
+		   const std::chrono::time_point<Clock, Duration> &timeout)
+	{
+		return wait_for(lock, timeout - Clock::now());
+	}
+
+	/**
+	 * Makes the current thread block until the condition variable
+	 * is notified and the predicate is met or a specific time is
+	 * reached.
+	 *
+	 * @param[in,out] lock a BasicLockable object.
+	 * @param[in] timeout a specific point in time, which when
+	 * reached unblocks the thread.
+	 * @param[in] pred predicate which returns `false` if waiting is
+	 * to be continued.
+	 *
+	 * @return `false` if pred evaluates to `false` after timeout
+	 * expired, otherwise `true`.
+	 *
+	 * @throw lock_error if the condition variable does not reside in
+	 * pmem.
+	 */
+	template <typename Lock, typename Clock, typename Duration,
+		  typename Predicate>
+	bool
+	wait_until(Lock &lock,
+		   const std::chrono::time_point<Clock, Duration> &timeout,
+		   Predicate pred)
+	{
+		while (!pred()) {
+			if (wait_until(lock, timeout) == std::cv_status::timeout)
+				return pred();
+		}
+
+		return true;
+	}
+
+	/**
+	 * Makes the current thread block until the condition variable
+	 * is notified, the specified amount of time passes or it is
+	 * woken up by some other measure.
+	 *
+	 * @param[in,out] lock a BasicLockable object.
+	 * @param[in] rel_time a specific duration, which when expired
+	 * unblocks the thread.
+	 *
+	 * @return std::cv_status::timeout on timeout,
+	 * std::cv_status::no_timeout otherwise.
+	 *
+	 * @throw lock_error if the condition variable does not reside in
+	 * pmem.
+	 */
+	template <typename Lock, typename Rep, typename Period>
+	std::cv_status
+	wait_for(Lock &lock, const std::chrono::duration<Rep, Period> &rel_time)
+	{
+		auto &s = seq.get();
+		auto val = s.load(std::memory_order_acquire);
+		auto rel = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			rel_time);
+
+		lock.unlock();
+		bool woken = detail::futex_wait(&s, val, &rel);
+		lock.lock();
+
+		return woken ? std::cv_status::no_timeout
+			     : std::cv_status::timeout;
+	}
+
+	/**
+	 * Makes the current thread block until the condition variable
+	 * is notified and the predicate is met or the specified amount
+	 * of time passes.
+	 *
+	 * @param[in,out] lock a BasicLockable object.
+	 * @param[in] rel_time a specific duration, which when expired
+	 * unblocks the thread.
+	 * @param[in] pred predicate which returns `false` if waiting is
+	 * to be continued.
+	 *
+	 * @return `false` if pred evaluates to `false` after timeout
+	 * expired, otherwise `true`.
+	 *
+	 * @throw lock_error if the condition variable does not reside in
+	 * pmem.
+	 */
+	template <typename Lock, typename Rep, typename Period,
+		  typename Predicate>
+	bool
+	wait_for(Lock &lock, const std::chrono::duration<Rep, Period> &rel_time,
+		 Predicate pred)
+	{
+		return wait_until(lock, clock_type::now() + rel_time,
+				  std::move(pred));
+	}
+
+	/**
+	 * Access a native handle to this condition variable.
+	 *
+	 * @return a pointer to the futex word.
+	 */
+	native_handle_type
+	native_handle()
+	{
+		return &seq.get();
+	}
+
+	/**
+	 * Deleted assignment operator.
+	 */
+	futex_condition_variable &
+	operator=(const futex_condition_variable &) = delete;
+
+	/**
+	 * Deleted copy constructor.
+	 */
+	futex_condition_variable(const futex_condition_variable &) = delete;
+
+private:
+	detail::pmem_futex_word seq;
+};
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_FUTEX_CONDITION_VARIABLE_HPP */
@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Pmem-resident timed mutex implemented with a futex.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_FUTEX_TIMED_MUTEX_HPP
+#define LIBPMEMOBJ_CPP_FUTEX_TIMED_MUTEX_HPP
+
+#include <libpmemobj++/detail/futex.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Persistent memory resident timed mutex implemented with a futex.
+ *
+ * It satisfies the TimedMutex requirements, just like
+ * pmem::obj::timed_mutex, but instead of PMEMmutex it uses a single
+ * 32-bit word, reset to the unlocked state on the first use after the
+ * pool is opened (by run id of the pool). An uncontended lock and unlock
+ * are a single atomic operation each and unlocking a contended mutex
+ * costs one futex wake.
+ *
+ * On Linux it uses futex(2), on Windows WaitOnAddress. On other platforms
+ * waiting falls back to polling.
+ *
+ * Unlike pmem::obj::timed_mutex, it cannot be passed to a transaction as
+ * a lock to be held for the duration of the transaction.
+ *
+ * A zeroed object is valid, so the mutex can be a part of the root object.
+ *
+ * @ingroup synchronization
+ */
+class futex_timed_mutex {
+	typedef std::chrono::steady_clock clock_type;
+
+public:
+	/** Implementation defined handle to the native type. */
+	typedef std::atomic<uint32_t> *native_handle_type;
+
+	/**
+	 * Default constructor.
+	 */
+	futex_timed_mutex() = default;
+
+	/**
+	 * Defaulted destructor.
+	 */
+	~futex_timed_mutex() = default;
+
+	/**
+	 * Locks the mutex, blocks if already locked.
+	 *
+	 * If a different thread already locked this mutex, the calling
+	 * thread will block. If the same thread tries to lock a mutex
+	 * it already owns, the behavior is undefined.
+	 *
+	 * @throw lock_error if the mutex does not reside in pmem.
+	 */
+	void
+	lock()
+	{
+		auto &w = word.get();
+
+		uint32_t c = UNLOCKED;
+		if (w.compare_exchange_strong(c, LOCKED,
+					      std::memory_order_acquire))
+			return;
+
+		if (c != CONTENDED)
+			c = w.exchange(CONTENDED, std::memory_order_acquire);
+
+		while (c != UNLOCKED) {
+			detail::futex_wait(&w, CONTENDED);
+			c = w.exchange(CONTENDED, std::memory_order_acquire);
+		}
+	}
+
+	/**
+	 * Tries to lock the mutex, returns regardless if the lock
+	 * succeeds.
+	 *
+	 * @return `true` on successful lock acquisition, `false`
+	 * otherwise.
+	 *
+	 * @throw lock_error if the mutex does not reside in pmem.
+	 */
+	bool
+	try_lock()
+	{
+		uint32_t c = UNLOCKED;
+		return word.get().compare_exchange_strong(
+			c, LOCKED, std::memory_order_acquire);
+	}
+
+	/**
+	 * Makes the current thread block until the lock is acquired or a
+	 * specific time is reached.
+	 *
+	 * @param[in] timeout_time a specific point in time, which when
+	 * reached unblocks the thread.
+	 *
+	 * @return `true` on successful lock acquisition, `false`
+	 * otherwise.
+	 *
+	 * @throw lock_error if the mutex does not reside in pmem.
+	 */
+	template <typename Clock, typename Duration>
+	bool
+	try_lock_until(
+		const std::chrono::time_point<Clock, Duration> &timeout_time)
+	{
+		return timedlock_impl(clock_type::now() +
+				      (timeout_time - Clock::now()));
+	}
+
+	/**
+	 * Makes the current thread block until the lock is acquired or a
+	 * specified amount of time passes.
+	 *
+	 * @param[in] timeout_duration a specific duration, which when
+	 * expired unblocks the thread.
+	 *
+	 * @return `true` on successful lock acquisition, `false`
+	 * otherwise.
+	 *
+	 * @throw lock_error if the mutex does not reside in pmem.
+	 */
+	template <typename Rep, typename Period>
+	bool
+	try_lock_for(const std::chrono::duration<Rep, Period> &timeout_duration)
+	{
+		return timedlock_impl(clock_type::now() + timeout_duration);
+	}
+
+	/**
+	 * Unlocks a previously locked mutex.
+	 *
+	 * Unlocking a mutex that has not been locked by the current
+	 * thread results in undefined behavior.
+	 */
+	void
+	unlock()
+	{
+		auto &w = word.get();
+
+		if (w.fetch_sub(1, std::memory_order_release) != LOCKED) {
+			w.store(UNLOCKED, std::memory_order_release);
+			detail::futex_wake(&w, 1);
+		}
+	}
+
+	/**
+	 * Access a native handle to this mutex.
+	 *
+	 * @return a pointer to the futex word.
+	 */
+	native_handle_type
+	native_handle()
+	{
+		return &word.get();
+	}
+
+	/**
+	 * Deleted assignment operator.
+	 */
+	futex_timed_mutex &operator=(const futex_timed_mutex &) = delete;
+
+	/**
+	 * Deleted copy constructor.
+	 */
+	futex_timed_mutex(const futex_timed_mutex &) = delete;
+
+private:
+	static constexpr uint32_t UNLOCKED = 0;
+	static constexpr uint32_t LOCKED = 1;
+	static constexpr uint32_t CONTENDED = 2;
+
+	/**
+	 * Internal implementation of the timed lock call.
+	 */
+	template <typename Duration>
+	bool
+	timedlock_impl(
+		const std::chrono::time_point<clock_type, Duration> &abs_time)
+	{
+		auto &w = word.get();
+
+		uint32_t c = UNLOCKED;
+		if (w.compare_exchange_strong(c, LOCKED,
+					      std::memory_order_acquire))
+			return true;
+
+		if (c != CONTENDED)
+			c = w.exchange(CONTENDED, std::memory_order_acquire);
+
+		while (c != UNLOCKED) {
+			auto rel = std::chrono::duration_cast<
+				std::chrono::nanoseconds>(abs_time -
+							  clock_type::now());
+
+			if (!detail::futex_wait(&w, CONTENDED, &rel))
+				return false;
+
+			c = w.exchange(CONTENDED, std::memory_order_acquire);
+		}
+
+		return true;
+	}
+
+	detail::pmem_futex_word word;
+};
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_FUTEX_TIMED_MUTEX_HPP */
@@ -0,0 +1,563 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Implementation of key-value container with a volatile index over
+ * persistent, append-only log of records.
+ */
+
+#ifndef LIBPMEMOBJ_HYBRID_MAP_HPP
+#define LIBPMEMOBJ_HYBRID_MAP_HPP
+
+#include <libpmemobj++/container/segment_vector.hpp>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pext.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj++/utils.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Key-value container which keeps the data in persistent memory and the
+ * index in DRAM.
+ *
+ * Records (key and value) are only appended to the persistent log
+ * (pmem_log_type), every insert_or_assign() or erase() writes a single new
+ * record in a transaction. Older records of the same key become garbage,
+ * which can be reclaimed by compact(), in place and in bounded transactions.
+ * The volatile index (Index), which maps
+ * keys to positions of their newest records, is rebuilt (by multiple threads)
+ * when hybrid_map is created over the log, e.g. after restart of the
+ * application, and then kept in sync on every modification.
+ *
+ * Lookups do not touch persistent memory until the value is accessed, which
+ * makes the container suitable for read-heavy workloads. The generalized
+ * version of simplekv_rebuild example.
+ *
+ * Key must be usable both in persistent and volatile memory (e.g. an
+ * integral type or an array of chars). Index might be any map-like container
+ * of Key and std::size_t, e.g. std::unordered_map (default) or std::map for
+ * the ordered traversal in for_each().
+ *
+ * hybrid_map is not thread-safe: const methods can be called concurrently,
+ * but not with modifying ones. Modifying methods cannot be called inside
+ * a transaction, as the index could not be restored if the transaction is
+ * aborted.
+ *
+ * @ingroup experimental_containers
+ */
+template <typename Key, typename T,
+	  typename Index = std::unordered_map<Key, std::size_t>>
+class hybrid_map {
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using size_type = std::size_t;
+	using index_type = Index;
+
+	class pmem_log_type;
+
+	hybrid_map(pmem_log_type &pmem, size_t concurrency = 1);
+
+	hybrid_map(const hybrid_map &) = delete;
+	hybrid_map &operator=(const hybrid_map &) = delete;
+
+	const mapped_type &at(const key_type &key) const;
+	size_type count(const key_type &key) const;
+
+	template <typename F>
+	void for_each(F &&f) const;
+
+	size_type size() const noexcept;
+	bool empty() const noexcept;
+	size_type log_size() const noexcept;
+
+	template <typename... Args>
+	void insert_or_assign(const key_type &key, Args &&... args);
+	size_type erase(const key_type &key);
+
+	void compact(size_type records_per_tx = default_compact_batch);
+
+private:
+	struct record {
+		template <typename... Args>
+		record(const key_type &key, bool erased, Args &&... args)
+		    : key(key),
+		      erased(erased),
+		      value(std::forward<Args>(args)...)
+		{
+		}
+
+		key_type key;
+		bool erased;
+		mapped_type value;
+	};
+
+	using log_type = pmem::obj::segment_vector<record>;
+
+	static constexpr size_type default_compact_batch = 1024;
+
+	static void check_outside_tx();
+
+	void finish_compact();
+
+	const log_type &log() const;
+
+	pmem_log_type *pmem;
+	pmem::obj::pool_base pop;
+	index_type index;
+
+public:
+	/**
+	 * Type representing persistent data, which may be managed by
+	 * hybrid_map.
+	 *
+	 * Object of this type has to be managed by pmem::obj::pool (created
+	 * with make_persistent), to be usable in hybrid_map.
+	 */
+	class pmem_log_type {
+	public:
+		pmem_log_type();
+		~pmem_log_type();
+
+		pmem_log_type(const pmem_log_type &) = delete;
+		pmem_log_type &operator=(const pmem_log_type &) = delete;
+
+	private:
+		pmem::obj::persistent_ptr<log_type> log;
+
+		/*
+		 * Progress of an unfinished compact(): records before
+		 * 'compacted' were already moved to their final positions,
+		 * records in [compacted, scanned) are garbage. Both are 0 if
+		 * no compaction is in progress.
+		 */
+		pmem::obj::p<size_type> compacted;
+		pmem::obj::p<size_type> scanned;
+
+		friend class hybrid_map;
+	};
+};
+
+/**
+ * hybrid_map constructor. Rebuilds the index from the log.
+ *
+ * The log is split into concurrency parts, each of them is scanned by
+ * a separate thread. Results are then merged in order of the records.
+ * Garbage left by an unfinished compact() is skipped, the compaction itself
+ * is finished by the next modification.
+ *
+ * @param[in] pmem reference to already allocated pmem_log_type object.
+ * @param[in] concurrency number of threads scanning the log.
+ *
+ * @throw std::bad_alloc if there is not enough memory for the index.
+ * @throw rethrows exceptions of the threads scanning the log.
+ */
+template <typename Key, typename T, typename Index>
+hybrid_map<Key, T, Index>::hybrid_map(pmem_log_type &pmem,
+				      size_t concurrency)
+    : pmem(&pmem), pop(pmem::obj::pool_by_vptr(&pmem))
+{
+	const log_type &l = log();
+	size_type n = l.size();
+
+	/* records in [skip_first, skip_last) are garbage, see compact() */
+	size_type skip_first = pmem.compacted;
+	size_type skip_last = (std::min)(size_type(pmem.scanned), n);
+
+	concurrency = (std::max)(size_t(1), (std::min)(concurrency, n));
+	size_type per_thread = (n + concurrency - 1) / concurrency;
+
+	/* index of newest records in every part of the log */
+	std::vector<index_type> parts(concurrency);
+	std::vector<std::exception_ptr> errors(concurrency);
+
+	auto worker = [&](size_t id) {
+		try {
+			size_type first = id * per_thread;
+			size_type last = (std::min)(first + per_thread, n);
+
+			for (size_type i = first; i < last; ++i) {
+				if (i >= skip_first && i < skip_last)
+					continue;
+
+				parts[id][l.const_at(i).key] = i;
+			}
+		} catch (...) {
+			errors[id] = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(concurrency - 1);
+	for (size_t i = 1; i < concurrency; ++i)
+		threads.emplace_back(worker, i);
+
+	worker(0);
+
+	for (auto &t : threads)
+		t.join();
+
+	for (auto &e : errors) {
+		if (e)
+			std::rethrow_exception(e);
+	}
+
+	index = std::move(parts[0]);
+	for (size_t i = 1; i < concurrency; ++i) {
+		for (auto &e : parts[i])
+			index[e.first] = e.second;
+
+		index_type().swap(parts[i]);
+	}
+
+	for (auto it = index.begin(); it != index.end();) {
+		if (l.const_at(it->second).erased)
+			it = index.erase(it);
+		else
+			++it;
+	}
+}
+
+/**
+ * Access the value of the element with the given key.
+ *
+ * @param[in] key key of the element.
+ *
+ * @return const reference to the value, which resides in persistent memory.
+ * The reference stays valid when the element is overwritten or erased (it
+ * refers to the old value then), but it is invalidated by compact(), which
+ * moves the records within the log.
+ *
+ * @throw std::out_of_range if there is no element with the given key.
+ */
+template <typename Key, typename T, typename Index>
+const typename hybrid_map<Key, T, Index>::mapped_type &
+hybrid_map<Key, T, Index>::at(const key_type &key) const
+{
+	auto it = index.find(key);
+	if (it == index.end())
+		throw std::out_of_range("hybrid_map::at");
+
+	return log().const_at(it->second).value;
+}
+
+/**
+ * Returns the number of elements with the given key (0 or 1). Does not
+ * access persistent memory.
+ *
+ * @param[in] key key of the element.
+ */
+template <typename Key, typename T, typename Index>
+typename hybrid_map<Key, T, Index>::size_type
+hybrid_map<Key, T, Index>::count(const key_type &key) const
+{
+	return index.find(key) == index.end() ? 0 : 1;
+}
+
+/**
+ * Calls f(key, value) for every element, in order of the index.
+ *
+ * @param[in] f function called with const key_type & and
+ * const mapped_type & arguments.
+ */
+template <typename Key, typename T, typename Index>
+template <typename F>
+void
+hybrid_map<Key, T, Index>::for_each(F &&f) const
+{
+	const log_type &l = log();
+
+	for (auto &e : index)
+		f(e.first, l.const_at(e.second).value);
+}
+
+/**
+ * @return number of elements in the container.
+ */
+template <typename Key, typename T, typename Index>
+typename hybrid_map<Key, T, Index>::size_type
+hybrid_map<Key, T, Index>::size() const noexcept
+{
+	return index.size();
+}
+
+/**
+ * @return true if the container is empty.
+ */
+template <typename Key, typename T, typename Index>
+bool
+hybrid_map<Key, T, Index>::empty() const noexcept
+{
+	return index.empty();
+}
+
+/**
+ * @return number of records in the persistent log, including the garbage
+ * ones (overwritten or erased). The garbage can be reclaimed by compact().
+ */
+template <typename Key, typename T, typename Index>
+typename hybrid_map<Key, T, Index>::size_type
+hybrid_map<Key, T, Index>::log_size() const noexcept
+{
+	return log().size();
+}
+
+/**
+ * Inserts a new element or replaces the value of the existing one, by
+ * appending a record to the log in a transaction.
+ *
+ * @param[in] key key of the element.
+ * @param[in] args arguments used to construct the value.
+ *
+ * @throw pmem::transaction_scope_error if called inside transaction.
+ * @throw pmem::transaction_alloc_error when allocating memory for the record
+ * failed.
+ * @throw rethrows constructor's exception.
+ * @throw rethrows exceptions of finishing an unfinished compact().
+ */
+template <typename Key, typename T, typename Index>
+template <typename... Args>
+void
+hybrid_map<Key, T, Index>::insert_or_assign(const key_type &key,
+					    Args &&... args)
+{
+	check_outside_tx();
+	finish_compact();
+
+	auto ret = index.emplace(key, size_type(0));
+
+	try {
+		pmem::obj::flat_transaction::run(pop, [&] {
+			pmem->log->emplace_back(key, false,
+						std::forward<Args>(args)...);
+		});
+	} catch (...) {
+		if (ret.second)
+			index.erase(ret.first);
+
+		throw;
+	}
+
+	ret.first->second = log().size() - 1;
+}
+
+/**
+ * Removes the element with the given key, by appending an erased record to
+ * the log in a transaction. The erased record holds a default-constructed
+ * value.
+ *
+ * @param[in] key key of the element.
+ *
+ * @return number of removed elements (0 or 1).
+ *
+ * @throw pmem::transaction_scope_error if called inside transaction.
+ * @throw pmem::transaction_alloc_error when allocating memory for the record
+ * failed.
+ * @throw rethrows exceptions of finishing an unfinished compact().
+ */
+template <typename Key, typename T, typename Index>
+typename hybrid_map<Key, T, Index>::size_type
+hybrid_map<Key, T, Index>::erase(const key_type &key)
+{
+	check_outside_tx();
+	finish_compact();
+
+	auto it = index.find(key);
+	if (it == index.end())
+		return 0;
+
+	pmem::obj::flat_transaction::run(
+		pop, [&] { pmem->log->emplace_back(key, true); });
+
+	index.erase(it);
+
+	return 1;
+}
+
+/**
+ * Reclaims the garbage of the log in place. Newest records of all elements
+ * are moved (in the order of the log) towards its beginning, over the
+ * garbage ones, and then the tail of the log is dropped. Segments of the log
+ * which become empty are freed.
+ *
+ * Each transaction processes at most records_per_tx records, so neither the
+ * undo log nor additional memory grows with the size of the log. The
+ * progress is stored in the log: if compact() throws or the application
+ * crashes, the map stays consistent and the compaction is continued from
+ * the place where it stopped, by the next compact() or modification (records
+ * already moved must not become garbage before the compaction is finished).
+ *
+ * All references returned by at() are invalidated.
+ *
+ * @param[in] records_per_tx number of records processed in a single
+ * transaction.
+ *
+ * @throw std::invalid_argument if records_per_tx is 0.
+ * @throw pmem::transaction_scope_error if called inside transaction.
+ * @throw pmem::transaction_error when snapshotting failed.
+ * @throw pmem::transaction_free_error when freeing empty segments failed.
+ * @throw rethrows assignment operator's exception.
+ */
+template <typename Key, typename T, typename Index>
+void
+hybrid_map<Key, T, Index>::compact(size_type records_per_tx)
+{
+	check_outside_tx();
+
+	if (records_per_tx == 0)
+		throw std::invalid_argument(
+			"Number of records per transaction must be positive.");
+
+	const log_type &l = log();
+
+	size_type written = pmem->compacted;
+	size_type next = pmem->scanned;
+
+	/* index entries of the moved records and their new positions */
+	std::vector<std::pair<typename index_type::iterator, size_type>> moved;
+	moved.reserve((std::min)(records_per_tx, index.size()));
+
+	while (next < l.size()) {
+		size_type last = (std::min)(next + records_per_tx, l.size());
+		size_type w = written;
+
+		pmem::obj::flat_transaction::run(pop, [&] {
+			moved.clear();
+			w = written;
+
+			for (size_type i = next; i < last; ++i) {
+				const record &r = l.const_at(i);
+
+				auto it = index.find(r.key);
+				if (it == index.end() || it->second != i)
+					continue;
+
+				if (w != i)
+					(*pmem->log)[w] = r;
+
+				moved.emplace_back(it, w++);
+			}
+
+			pmem->compacted = w;
+			pmem->scanned = last;
+		});
+
+		for (auto &m : moved)
+			m.first->second = m.second;
+
+		written = w;
+		next = last;
+	}
+
+	/* drop the tail of the log, the scanned range never exceeds its size,
+	 * so that records appended later are not taken for garbage */
+	do {
+		pmem::obj::flat_transaction::run(pop, [&] {
+			for (size_type i = 0;
+			     i < records_per_tx && l.size() > written; ++i)
+				pmem->log->pop_back();
+
+			pmem->log->shrink_to_fit();
+
+			if (l.size() == written) {
+				pmem->compacted = 0;
+				pmem->scanned = 0;
+			} else {
+				pmem->scanned = l.size();
+			}
+		});
+	} while (l.size() > written);
+}
+
+/**
+ * Private helper function. Checks if there is no active transaction.
+ *
+ * @throw pmem::transaction_scope_error if called inside transaction.
+ */
+template <typename Key, typename T, typename Index>
+void
+hybrid_map<Key, T, Index>::check_outside_tx()
+{
+	if (pmemobj_tx_stage() != TX_STAGE_NONE)
+		throw pmem::transaction_scope_error(
+			"Function called inside transaction scope.");
+}
+
+/*
+ * Finishes compact() which was interrupted by an exception or a crash.
+ */
+template <typename Key, typename T, typename Index>
+void
+hybrid_map<Key, T, Index>::finish_compact()
+{
+	if (pmem->scanned != 0)
+		compact();
+}
+
+template <typename Key, typename T, typename Index>
+const typename hybrid_map<Key, T, Index>::log_type &
+hybrid_map<Key, T, Index>::log() const
+{
+	return *pmem->log;
+}
+
+/**
+ * Constructs an empty log. Must be called in a transaction.
+ *
+ * @throw pmem::transaction_scope_error if called outside of transaction.
+ * @throw pmem::transaction_alloc_error when allocating memory failed.
+ */
+template <typename Key, typename T, typename Index>
+hybrid_map<Key, T, Index>::pmem_log_type::pmem_log_type()
+    : compacted(0), scanned(0)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		throw pmem::transaction_scope_error(
+			"Function called out of transaction scope.");
+
+	log = pmem::obj::make_persistent<log_type>();
+}
+
+/**
+ * Destroys the log.
+ */
+template <typename Key, typename T, typename Index>
+hybrid_map<Key, T, Index>::pmem_log_type::~pmem_log_type()
+{
+	try {
+		if (log)
+			pmem::obj::delete_persistent<log_type>(log);
+	} catch (...) {
+		std::terminate();
+	}
+}
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_HYBRID_MAP_HPP */
@@ -15,6 +15,8 @@
 #include <libpmemobj++/string_view.hpp>
 #include <libpmemobj++/transaction.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <string>
 
 namespace pmem
@@ -40,6 +42,8 @@ public:
 
 	basic_inline_string_base(basic_string_view<CharT, Traits> v);
 	basic_inline_string_base(size_type capacity);
+	basic_inline_string_base(basic_string_view<CharT, Traits> v,
+				 size_type capacity);
 	basic_inline_string_base(const basic_inline_string_base &rhs);
 
 	basic_inline_string_base &
@@ -72,12 +76,20 @@ public:
 	slice<pointer> range(size_type p, size_type count);
 
 	basic_inline_string_base &assign(basic_string_view<CharT, Traits> rhs);
+	basic_inline_string_base &append(basic_string_view<CharT, Traits> rhs);
 
 protected:
 	pointer snapshotted_data(size_t p, size_t n);
 
-	obj::p<uint64_t> size_;
+	/* Atomic, so that append() can publish the new size to concurrent
+	 * readers (radix_tree in MtMode). It is assumed to have the same
+	 * persistent layout as p<uint64_t> (a lock-free std::atomic holds just
+	 * the value), which is checked only by the static_assert below. */
+	std::atomic<uint64_t> size_;
 	obj::p<uint64_t> capacity_;
+
+	static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+		      "std::atomic<uint64_t> must not change the layout.");
 };
 
 /**
@@ -121,6 +133,13 @@ public:
 	    : basic_inline_string_base<CharT, Traits>(capacity)
 	{
 	}
+
+	basic_dram_inline_string(basic_string_view<CharT, Traits> v,
+				 size_type capacity)
+	    : basic_inline_string_base<CharT, Traits>(v, capacity)
+	{
+	}
+
 	basic_dram_inline_string(const basic_dram_inline_string &rhs)
 	    : basic_inline_string_base<CharT, Traits>(rhs)
 	{
@@ -181,6 +200,16 @@ public:
 	{
 	}
 
+	/**
+	 * @throw pool_error if inline string is not on pmem.
+	 */
+	basic_inline_string(basic_string_view<CharT, Traits> v,
+			    size_type capacity)
+	    : basic_inline_string_base<CharT, Traits>(check_forward(v),
+						      capacity)
+	{
+	}
+
 	/**
 	 * @throw pool_error if inline string is not on pmem.
 	 */
@@ -226,9 +255,9 @@ basic_inline_string_base<CharT, Traits>::basic_inline_string_base(
 	basic_string_view<CharT, Traits> v)
     : size_(v.size()), capacity_(v.size())
 {
-	std::copy(v.data(), v.data() + static_cast<ptrdiff_t>(size_), data());
+	std::copy(v.data(), v.data() + static_cast<ptrdiff_t>(size()), data());
 
-	data()[static_cast<ptrdiff_t>(size_)] = '\0';
+	data()[static_cast<ptrdiff_t>(size())] = '\0';
 }
 
 /**
@@ -239,7 +268,22 @@ basic_inline_string_base<CharT, Traits>::basic_inline_string_base(
 	size_type capacity)
     : size_(0), capacity_(capacity)
 {
-	data()[static_cast<ptrdiff_t>(size_)] = '\0';
+	data()[static_cast<ptrdiff_t>(size())] = '\0';
+}
+
+/**
+ * Constructs inline string from a string_view with specified capacity, which
+ * allows the string to grow in place. Capacity smaller than v.size() is
+ * increased to v.size().
+ */
+template <typename CharT, typename Traits>
+basic_inline_string_base<CharT, Traits>::basic_inline_string_base(
+	basic_string_view<CharT, Traits> v, size_type capacity)
+    : size_(v.size()), capacity_((std::max)(v.size(), capacity))
+{
+	std::copy(v.data(), v.data() + static_cast<ptrdiff_t>(size()), data());
+
+	data()[static_cast<ptrdiff_t>(size())] = '\0';
 }
 
 /**
@@ -250,10 +294,10 @@ basic_inline_string_base<CharT, Traits>::basic_inline_string_base(
 	const basic_inline_string_base &rhs)
     : size_(rhs.size()), capacity_(rhs.capacity())
 {
-	std::copy(rhs.data(), rhs.data() + static_cast<ptrdiff_t>(size_),
+	std::copy(rhs.data(), rhs.data() + static_cast<ptrdiff_t>(size()),
 		  data());
 
-	data()[static_cast<ptrdiff_t>(size_)] = '\0';
+	data()[static_cast<ptrdiff_t>(size())] = '\0';
 }
 
 /**
@@ -294,7 +338,7 @@ template <typename CharT, typename Traits>
 typename basic_inline_string_base<CharT, Traits>::size_type
 basic_inline_string_base<CharT, Traits>::size() const noexcept
 {
-	return size_;
+	return size_.load(std::memory_order_acquire);
 }
 
 /**
@@ -324,7 +368,7 @@ template <typename CharT, typename Traits>
 typename basic_inline_string_base<CharT, Traits>::pointer
 basic_inline_string_base<CharT, Traits>::data()
 {
-	return snapshotted_data(0, size_);
+	return snapshotted_data(0, size());
 }
 
 /** @return const_pointer to the data (equal to (this + 1)) */
@@ -507,9 +551,66 @@ basic_inline_string_base<CharT, Traits>::assign(
 		std::copy(rhs.data(),
 			  rhs.data() + static_cast<ptrdiff_t>(rhs.size()),
 			  data());
-		size_ = rhs.size();
 
-		data()[static_cast<ptrdiff_t>(size_)] = '\0';
+		detail::conditional_add_to_tx(&size_);
+		size_.store(rhs.size(), std::memory_order_release);
+
+		data()[static_cast<ptrdiff_t>(size())] = '\0';
+	});
+
+	return *this;
+}
+
+/**
+ * Transactionally append content of basic_string_view.
+ *
+ * Only the characters after the current end of the string are written and
+ * the new size is published after them, with a release store (size() is an
+ * acquire load). Concurrent readers which use size() to access the data see
+ * either the old or the new content. The old terminator is overwritten last,
+ * after the new one is written, so the string stays null-terminated, but
+ * readers should still bound their reads by size(). There can be only one
+ * writer.
+ *
+ * @throw std::out_of_range if resulting size is larger than capacity.
+ * @throw pool_error if inline string is not on pmem.
+ */
+template <typename CharT, typename Traits>
+basic_inline_string_base<CharT, Traits> &
+basic_inline_string_base<CharT, Traits>::append(
+	basic_string_view<CharT, Traits> rhs)
+{
+	auto cpop = pmemobj_pool_by_ptr(this);
+	if (nullptr == cpop)
+		throw pmem::pool_error("Invalid pool handle.");
+
+	auto pop = pool_base(cpop);
+
+	if (rhs.size() > capacity() - size())
+		throw std::out_of_range("inline_string capacity exceeded.");
+
+	if (rhs.size() == 0)
+		return *this;
+
+	auto dst = reinterpret_cast<CharT *>(this + 1) + size();
+
+	obj::flat_transaction::run(pop, [&] {
+		/* the old terminator is the only initialized character */
+		detail::conditional_add_to_tx(dst, 1);
+		detail::conditional_add_to_tx(dst + 1, rhs.size(),
+					      POBJ_XADD_NO_SNAPSHOT);
+
+		std::copy(rhs.data() + 1,
+			  rhs.data() + static_cast<ptrdiff_t>(rhs.size()),
+			  dst + 1);
+		dst[static_cast<ptrdiff_t>(rhs.size())] = '\0';
+
+		std::atomic_thread_fence(std::memory_order_release);
+		dst[0] = rhs[0];
+
+		detail::conditional_add_to_tx(&size_);
+		size_.store(size_.load(std::memory_order_relaxed) + rhs.size(),
+			    std::memory_order_release);
 	});
 
 	return *this;
@@ -546,6 +647,22 @@ struct total_sizeof<basic_inline_string<CharT, Traits>> {
 		return sizeof(basic_inline_string_base<CharT, Traits>) +
 			(s.size() + 1 /* '\0' */) * sizeof(CharT);
 	}
+
+	/* copy keeps the capacity of the original string */
+	static size_t
+	value(const basic_inline_string_base<CharT, Traits> &s)
+	{
+		return sizeof(basic_inline_string_base<CharT, Traits>) +
+			(s.capacity() + 1 /* '\0' */) * sizeof(CharT);
+	}
+
+	static size_t
+	value(const basic_string_view<CharT, Traits> &s, size_t capacity)
+	{
+		return sizeof(basic_inline_string_base<CharT, Traits>) +
+			((std::max)(s.size(), capacity) + 1 /* '\0' */) *
+			sizeof(CharT);
+	}
 };
 
 /**
@@ -563,6 +680,22 @@ struct total_sizeof<basic_dram_inline_string<CharT, Traits>> {
 		return sizeof(basic_dram_inline_string<CharT, Traits>) +
 			(s.size() + 1 /* '\0' */) * sizeof(CharT);
 	}
+
+	/* copy keeps the capacity of the original string */
+	static size_t
+	value(const basic_inline_string_base<CharT, Traits> &s)
+	{
+		return sizeof(basic_dram_inline_string<CharT, Traits>) +
+			(s.capacity() + 1 /* '\0' */) * sizeof(CharT);
+	}
+
+	static size_t
+	value(const basic_string_view<CharT, Traits> &s, size_t capacity)
+	{
+		return sizeof(basic_dram_inline_string<CharT, Traits>) +
+			((std::max)(s.size(), capacity) + 1 /* '\0' */) *
+			sizeof(CharT);
+	}
 };
 } /* namespace experimental */
 } /* namespace obj */
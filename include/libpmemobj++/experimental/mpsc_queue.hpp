@@ -20,8 +20,11 @@
 #include <atomic>
 #include <cstddef>
 #include <cstring>
+#include <deque>
 #include <iterator>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace pmem
 {
@@ -32,6 +35,8 @@ namespace obj
 namespace experimental
 {
 
+class sharded_mpsc_queue;
+
 /**
  * Persistent memory aware implementation of multi producer single consumer
  * queue.
@@ -40,6 +45,13 @@ namespace experimental
  * by new process, from the last position without loss of any, already produced
  * data.
  *
+ * If max_segments passed to the constructor is greater than 1, the queue may
+ * grow: when producers outrun the consumer and the log is full, a new segment
+ * of the same size is allocated and chained after it. Producers then write to
+ * the new segment, while the consumer drains the older ones and frees them.
+ * Once the consumer reaches the last segment, producers are moved back to
+ * the log passed to the constructor.
+ *
  * @note try_consume_batch() MUST be called after creation of mpsc_queue object
  * if pmem_log_type objcect was already used by instance of mpsc_queue - e.g. in
  * previous run of application. If try_consume_batch() is not called, produce
@@ -54,7 +66,8 @@ public:
 	class pmem_log_type;
 	class batch_type;
 
-	mpsc_queue(pmem_log_type &pmem, size_t max_workers = 1);
+	mpsc_queue(pmem_log_type &pmem, size_t max_workers = 1,
+		   size_t max_segments = 1);
 
 	worker register_worker();
 
@@ -89,27 +102,87 @@ private:
 		char *end;
 	};
 
-	void clear_cachelines(first_block *block, size_t size);
-	void restore_offsets();
+	/* Volatile state of a single log segment. Segment objects are
+	 * reused, but not freed before the queue is, so producers may check
+	 * 'sealed' through a stale pointer. */
+	struct segment {
+		/* ringbuf_t handle. Important: mpsc_queue operates on
+		 * cachelines hence ringbuf_produce/release functions are called
+		 * with number of cachelines, not bytes. */
+		std::unique_ptr<ringbuf::ringbuf_t> ring_buffer;
+		char *buf;
+		size_t buf_size;
+		pmem_log_type *pmem;
+
+		/* Number of producers accessing the segment. */
+		std::atomic<size_t> users{0};
+
+		/* Set when producers cannot use the segment anymore. */
+		std::atomic<bool> sealed{true};
+
+		/* Stores offset and length of next message to be consumed.
+		 * Only valid if ring_buffer->consume_in_progress. */
+		size_t consume_offset = 0;
+		size_t consume_len = 0;
+	};
+
+	struct segment_list {
+		std::mutex mutex;
+
+		/* Segments in the order of consumption. */
+		std::deque<segment *> order;
+
+		/* Segments which are not in use. */
+		std::vector<segment *> unused;
+
+		std::vector<std::unique_ptr<segment>> all;
+
+		/* Segment to which producers write (last in order). */
+		std::atomic<segment *> tail;
+
+		/* True if the log passed to the constructor is drained and
+		 * not in order. */
+		bool primary_idle;
+	};
+
+	void init_segment(segment *s, pmem_log_type *log, bool empty);
+	void clear_cachelines(segment *s, first_block *block, size_t size);
+	void restore_offsets(segment *s, bool empty);
+
+	static ptrdiff_t acquire_cachelines(segment *s,
+					    ringbuf::ringbuf_worker_t *w,
+					    size_t len);
+	size_t consume_cachelines(segment *s, size_t *offset);
+	void release_cachelines(segment *s, size_t len);
 
-	size_t consume_cachelines(size_t *offset);
-	void release_cachelines(size_t len);
+	template <typename Function>
+	bool consume_segment(segment *s, Function &f);
+
+	bool acquire_range(segment *s);
+	batch_type range_batch(segment *s);
+	void commit_range(segment *s);
+	void release_range(segment *s);
+	segment *ready_segment();
+
+	segment *enter_tail();
+	bool switch_tail(segment *s, bool grow);
+	void retire_head();
 
 	inline pmem::detail::id_manager &get_id_manager();
 
-	/* ringbuf_t handle. Important: mpsc_queue operates on cachelines hence
-	 * ringbuf_produce/release functions are called with number of
-	 * cachelines, not bytes. */
-	std::unique_ptr<ringbuf::ringbuf_t> ring_buffer;
-	char *buf;
+	std::unique_ptr<pmem::detail::id_manager> worker_ids;
+
 	pmem::obj::pool_base pop;
-	size_t buf_size;
 	pmem_log_type *pmem;
+	size_t max_workers;
+	size_t max_segments;
+
+	std::unique_ptr<segment_list> segments;
+
+	/* First segment in order, accessed only by the consumer. */
+	segment *head;
 
-	/* Stores offset and length of next message to be consumed. Only
-	 * valid if ring_buffer->consume_in_progress. */
-	size_t consume_offset = 0;
-	size_t consume_len = 0;
+	friend class sharded_mpsc_queue;
 
 public:
 	/**
@@ -158,14 +231,18 @@ public:
 
 	private:
 		mpsc_queue *queue;
-		ringbuf::ringbuf_worker_t *w;
 		size_t id;
 
-		ptrdiff_t acquire_cachelines(size_t len);
-		void produce_cachelines();
-		void store_to_log(pmem::obj::string_view data, char *log_data);
+		template <typename Function>
+		bool try_produce(pmem::obj::string_view header,
+				 pmem::obj::string_view data,
+				 Function &&on_produce);
+
+		void store_to_log(pmem::obj::string_view header,
+				  pmem::obj::string_view data, char *log_data);
 
 		friend class mpsc_queue;
+		friend class sharded_mpsc_queue;
 	};
 
 	/**
@@ -174,13 +251,15 @@ public:
 	 *
 	 * Object of this type has to be managed by pmem::obj::pool, to be
 	 * usable in mpsc_queue.
-	 * Once created, pmem_log_type object cannot be resized.
+	 * Once created, pmem_log_type object cannot be resized, but mpsc_queue
+	 * may chain additional segments to it.
 	 *
 	 * @param size size of the log.
 	 */
 	class pmem_log_type {
 	public:
 		pmem_log_type(size_t size);
+		~pmem_log_type();
 
 		pmem::obj::string_view data();
 
@@ -188,6 +267,13 @@ public:
 		pmem::obj::vector<char> data_;
 		pmem::obj::p<size_t> written;
 
+		/* Next segment in the order of consumption. */
+		pmem::obj::persistent_ptr<pmem_log_type> next;
+
+		/* First segment in the order of consumption, null if it is
+		 * this one. Used only in the log passed to mpsc_queue. */
+		pmem::obj::persistent_ptr<pmem_log_type> head;
+
 		friend class mpsc_queue;
 	};
 };
@@ -198,32 +284,75 @@ public:
  * @param[in] pmem reference to already allocated pmem_log_type object
  * @param[in] max_workers maximum number of workers which may be added to
  * mpsc_queue at the same time.
+ * @param[in] max_segments maximum number of log segments (including pmem)
+ * the queue may consist of. If 1, the queue does not grow.
  */
-mpsc_queue::mpsc_queue(pmem_log_type &pmem, size_t max_workers)
+inline mpsc_queue::mpsc_queue(pmem_log_type &pmem, size_t max_workers,
+			      size_t max_segments)
+    : worker_ids(new pmem::detail::id_manager),
+      max_workers(max_workers),
+      max_segments(max_segments),
+      segments(new segment_list)
 {
 	pop = pmem::obj::pool_by_vptr(&pmem);
 
-	auto buf_data = pmem.data();
+	this->pmem = &pmem;
+
+	/* Segments chained in the previous run may contain data */
+	segments->primary_idle = true;
+	for (auto log = pmem.head ? pmem.head.get() : &pmem; log;
+	     log = log->next.get()) {
+		if (log == &pmem)
+			segments->primary_idle = false;
 
-	buf = const_cast<char *>(buf_data.data());
-	buf_size = buf_data.size();
+		segments->all.emplace_back(new segment);
+		auto s = segments->all.back().get();
 
-	assert(buf_size % pmem::detail::CACHELINE_SIZE == 0);
+		init_segment(s, log, false);
+		s->sealed = log->next != nullptr;
 
-	ring_buffer =
+		segments->order.push_back(s);
+	}
+
+	head = segments->order.front();
+	segments->tail = segments->order.back();
+}
+
+/*
+ * Sets up the volatile state of a segment. If empty is true, there is no
+ * data to consume in the log.
+ */
+inline void
+mpsc_queue::init_segment(segment *s, pmem_log_type *log, bool empty)
+{
+	auto buf_data = log->data();
+
+	s->buf = const_cast<char *>(buf_data.data());
+	s->buf_size = buf_data.size();
+	s->pmem = log;
+	s->consume_offset = 0;
+	s->consume_len = 0;
+
+	assert(s->buf_size % pmem::detail::CACHELINE_SIZE == 0);
+
+	s->ring_buffer =
 		std::unique_ptr<ringbuf::ringbuf_t>(new ringbuf::ringbuf_t(
-			max_workers, buf_size / pmem::detail::CACHELINE_SIZE));
+			max_workers,
+			s->buf_size / pmem::detail::CACHELINE_SIZE));
 
-	this->pmem = &pmem;
+	restore_offsets(s, empty);
 
-	restore_offsets();
+	/* Workers may switch between segments at any time. */
+	for (unsigned i = 0; i < max_workers; i++)
+		ringbuf_register(s->ring_buffer.get(), i);
 }
 
 ptrdiff_t
-mpsc_queue::worker::acquire_cachelines(size_t len)
+mpsc_queue::acquire_cachelines(segment *s, ringbuf::ringbuf_worker_t *w,
+			       size_t len)
 {
 	assert(len % pmem::detail::CACHELINE_SIZE == 0);
-	auto ret = ringbuf_acquire(queue->ring_buffer.get(), w,
+	auto ret = ringbuf_acquire(s->ring_buffer.get(), w,
 				   len / pmem::detail::CACHELINE_SIZE);
 
 	if (ret < 0)
@@ -232,16 +361,10 @@ mpsc_queue::worker::acquire_cachelines(size_t len)
 	return ret * static_cast<ptrdiff_t>(pmem::detail::CACHELINE_SIZE);
 }
 
-void
-mpsc_queue::worker::produce_cachelines()
-{
-	ringbuf_produce(queue->ring_buffer.get(), w);
-}
-
 size_t
-mpsc_queue::consume_cachelines(size_t *offset)
+mpsc_queue::consume_cachelines(segment *s, size_t *offset)
 {
-	auto ret = ringbuf_consume(ring_buffer.get(), offset);
+	auto ret = ringbuf_consume(s->ring_buffer.get(), offset);
 	if (ret) {
 		*offset *= pmem::detail::CACHELINE_SIZE;
 		return ret * pmem::detail::CACHELINE_SIZE;
@@ -251,21 +374,25 @@ mpsc_queue::consume_cachelines(size_t *offset)
 }
 
 void
-mpsc_queue::release_cachelines(size_t len)
+mpsc_queue::release_cachelines(segment *s, size_t len)
 {
 	assert(len % pmem::detail::CACHELINE_SIZE == 0);
-	ringbuf_release(ring_buffer.get(), len / pmem::detail::CACHELINE_SIZE);
+	ringbuf_release(s->ring_buffer.get(),
+			len / pmem::detail::CACHELINE_SIZE);
 }
 
 void
-mpsc_queue::restore_offsets()
+mpsc_queue::restore_offsets(segment *s, bool empty)
 {
+	auto pmem = s->pmem;
+	auto buf_size = s->buf_size;
+
 	/* Invariant */
 	assert(pmem->written < buf_size);
 
 	/* XXX: implement restore_offset function in ringbuf */
 
-	auto w = register_worker();
+	auto w = ringbuf_register(s->ring_buffer.get(), 0);
 
 	if (!pmem->written) {
 		/* If pmem->written == 0 it means that consumer should start
@@ -273,13 +400,15 @@ mpsc_queue::restore_offsets()
 		 * anywhere in the log. Since we want to prohibit any producers
 		 * from overwriting the original content - mark the entire log
 		 * as produced. */
+		if (empty)
+			return;
 
-		auto acq = w.acquire_cachelines(buf_size -
-						pmem::detail::CACHELINE_SIZE);
+		auto acq = acquire_cachelines(
+			s, w, buf_size - pmem::detail::CACHELINE_SIZE);
 		assert(acq == 0);
 		(void)acq;
 
-		w.produce_cachelines();
+		ringbuf_produce(s->ring_buffer.get(), w);
 
 		return;
 	}
@@ -297,31 +426,159 @@ mpsc_queue::restore_offsets()
 	 *
 	 * This results in producer offset equal to pmem->written -
 	 * CACHELINE_SIZE and consumer offset equal to pmem->written.
+	 * If the log is known to be empty, only consumer and producer offsets
+	 * are moved to pmem->written.
 	 */
 
-	auto acq = w.acquire_cachelines(pmem->written);
+	auto acq = acquire_cachelines(s, w, pmem->written);
 	assert(acq == 0);
-	w.produce_cachelines();
+	ringbuf_produce(s->ring_buffer.get(), w);
 
 	/* Restore consumer offset */
 	size_t offset;
-	auto len = consume_cachelines(&offset);
+	auto len = consume_cachelines(s, &offset);
 	assert(len == pmem->written);
-	release_cachelines(len);
+	release_cachelines(s, len);
 
 	assert(offset == 0);
 	assert(len == pmem->written);
 
-	acq = w.acquire_cachelines(buf_size - pmem->written);
+	if (empty)
+		return;
+
+	acq = acquire_cachelines(s, w, buf_size - pmem->written);
 	assert(acq >= 0);
 	assert(static_cast<size_t>(acq) == pmem->written);
-	w.produce_cachelines();
+	ringbuf_produce(s->ring_buffer.get(), w);
+
+	if (pmem->written > pmem::detail::CACHELINE_SIZE) {
+		acq = acquire_cachelines(
+			s, w, pmem->written - pmem::detail::CACHELINE_SIZE);
+		assert(acq == 0);
+		ringbuf_produce(s->ring_buffer.get(), w);
+	}
 
-	acq = w.acquire_cachelines(pmem->written -
-				   pmem::detail::CACHELINE_SIZE);
-	assert(acq == 0);
 	(void)acq;
-	w.produce_cachelines();
+}
+
+/*
+ * Returns the segment to which producers write, with the number of its
+ * users incremented.
+ */
+inline mpsc_queue::segment *
+mpsc_queue::enter_tail()
+{
+	for (pmem::detail::atomic_backoff backoff;;) {
+		auto s = segments->tail.load();
+
+		/* Pairs with the consumer, which checks the number of users
+		 * after the segment is sealed. */
+		s->users.fetch_add(1);
+		if (!s->sealed.load())
+			return s;
+
+		s->users.fetch_sub(1);
+		backoff.pause();
+	}
+}
+
+/*
+ * Moves producers from the segment s to a new one, which is either the
+ * log passed to the constructor (if it is idle) or, if grow is true, a newly
+ * allocated segment.
+ *
+ * Returns false if producers cannot be moved.
+ */
+inline bool
+mpsc_queue::switch_tail(segment *s, bool grow)
+{
+	std::lock_guard<std::mutex> lock(segments->mutex);
+
+	/* Other thread already did it. */
+	if (segments->tail.load() != s)
+		return true;
+
+	pmem::obj::persistent_ptr<pmem_log_type> log;
+	if (segments->primary_idle)
+		log = pmem;
+	else if (!grow || segments->order.size() >= max_segments)
+		return false;
+
+	try {
+		pmem::obj::flat_transaction::run(pop, [&] {
+			if (!log)
+				log = pmem::obj::make_persistent<pmem_log_type>(
+					pmem->data_.size());
+
+			s->pmem->next = log;
+		});
+	} catch (pmem::transaction_alloc_error &) {
+		return false;
+	}
+
+	segment *n;
+	if (segments->unused.empty()) {
+		segments->all.emplace_back(new segment);
+		n = segments->all.back().get();
+	} else {
+		n = segments->unused.back();
+		segments->unused.pop_back();
+	}
+
+	/* There is no data left in the idle log. */
+	init_segment(n, log.get(), true);
+
+	segments->order.push_back(n);
+	segments->primary_idle = false;
+
+	/* Segment is unsealed after it is published, so that producers
+	 * which still have a pointer to it from its previous use do not write
+	 * to it before the others. */
+	segments->tail.store(n);
+	n->sealed.store(false);
+	s->sealed.store(true);
+
+	return true;
+}
+
+/*
+ * Removes the first segment from the order of consumption. The segment
+ * must be sealed and drained. If it is not the log passed to the
+ * constructor, it is freed.
+ */
+inline void
+mpsc_queue::retire_head()
+{
+	std::lock_guard<std::mutex> lock(segments->mutex);
+
+	assert(segments->order.front() == head);
+	assert(head->sealed);
+	assert(segments->order.size() > 1);
+
+	segments->order.pop_front();
+	auto next = segments->order.front();
+
+	pmem::obj::flat_transaction::run(pop, [&] {
+		auto retired = pmem->head;
+
+		if (next->pmem == pmem)
+			pmem->head = nullptr;
+		else
+			pmem->head = head->pmem->next;
+
+		if (!retired) {
+			pmem->next = nullptr;
+		} else {
+			retired->next = nullptr;
+			pmem::obj::delete_persistent<pmem_log_type>(retired);
+		}
+	});
+
+	if (head->pmem == pmem)
+		segments->primary_idle = true;
+
+	segments->unused.push_back(head);
+	head = next;
 }
 
 /**
@@ -334,6 +591,28 @@ mpsc_queue::pmem_log_type::pmem_log_type(size_t size)
 {
 }
 
+/**
+ * Destroys pmem_log_type object and all the segments chained to it.
+ */
+inline mpsc_queue::pmem_log_type::~pmem_log_type()
+{
+	std::vector<pmem::obj::persistent_ptr<pmem_log_type>> chained;
+
+	if (head)
+		chained.push_back(head);
+
+	for (auto log = head ? head.get() : this; log->next;
+	     log = log->next.get()) {
+		if (log->next.get() != this)
+			chained.push_back(log->next);
+	}
+
+	for (auto &log : chained) {
+		log->next = nullptr;
+		pmem::obj::delete_persistent<pmem_log_type>(log);
+	}
+}
+
 /**
  * Returns  pmem::obj::string_view which allows to read-only access to the
  * underlying buffer.
@@ -358,8 +637,7 @@ mpsc_queue::pmem_log_type::data()
 inline pmem::detail::id_manager &
 mpsc_queue::get_id_manager()
 {
-	static pmem::detail::id_manager manager;
-	return manager;
+	return *worker_ids;
 }
 
 /**
@@ -405,57 +683,56 @@ mpsc_queue::try_consume_batch(Function &&f)
 
 	bool consumed = false;
 
+	for (;;) {
+		auto s = head;
+
+		consumed |= consume_segment(s, f);
+
+		if (!s->sealed.load()) {
+			/* Producers write to this segment. If it is a chained
+			 * segment, move them back to the idle log, so that this
+			 * one can be freed. */
+			if (s->pmem == pmem || !switch_tail(s, false))
+				return consumed;
+		}
+
+		/* Pairs with enter_tail(). After the segment is sealed and
+		 * has no users, no new data will be produced to it. */
+		if (s->users.load() != 0)
+			return consumed;
+
+		consumed |= consume_segment(s, f);
+
+		retire_head();
+	}
+}
+
+template <typename Function>
+inline bool
+mpsc_queue::consume_segment(segment *s, Function &f)
+{
+	bool consumed = false;
+
 	/* Need to call try_consume twice, as some data may be at the end
 	 * of buffer, and some may be at the beginning. Ringbuffer does not
 	 * merge those two parts into one try_consume. If all data was
 	 * consumed during first try_consume, second will do nothing. */
 	for (int i = 0; i < 2; i++) {
-		/* If there is no consume in progress, it's safe to call
-		 * ringbuf_consume. */
-		if (!ring_buffer->consume_in_progress) {
-			size_t offset;
-			auto len = consume_cachelines(&offset);
-			if (!len)
-				return consumed;
+		if (!acquire_range(s))
+			return consumed;
 
-			consume_offset = offset;
-			consume_len = len;
-		} else {
-			assert(consume_len != 0);
-		}
-
-#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
-		ANNOTATE_HAPPENS_AFTER(ring_buffer.get());
-#endif
-
-		auto data = buf + consume_offset;
-		auto begin = iterator(data, data + consume_len);
-		auto end = iterator(data + consume_len, data + consume_len);
+		auto batch = range_batch(s);
 
 		pmem::obj::flat_transaction::run(pop, [&] {
-			if (begin != end) {
+			if (batch.begin() != batch.end()) {
 				consumed = true;
-				f(batch_type(begin, end));
+				f(batch);
 			}
 
-			auto b = reinterpret_cast<first_block *>(data);
-			clear_cachelines(b, consume_len);
-
-			if (consume_offset + consume_len < buf_size)
-				pmem->written = consume_offset + consume_len;
-			else if (consume_offset + consume_len == buf_size)
-				pmem->written = 0;
-			else
-				assert(false);
+			commit_range(s);
 		});
 
-#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
-		ANNOTATE_HAPPENS_BEFORE(ring_buffer.get());
-#endif
-
-		release_cachelines(consume_len);
-
-		assert(!ring_buffer->consume_in_progress);
+		release_range(s);
 
 		/* XXX: it would be better to call f once - hide
 		 * wraparound behind iterators */
@@ -466,6 +743,111 @@ mpsc_queue::try_consume_batch(Function &&f)
 	return consumed;
 }
 
+/*
+ * Acquires the next range of the segment to be consumed. Returns false if
+ * there is no data ready.
+ */
+inline bool
+mpsc_queue::acquire_range(segment *s)
+{
+	/* If there is no consume in progress, it's safe to call
+	 * ringbuf_consume. */
+	if (!s->ring_buffer->consume_in_progress) {
+		size_t offset;
+		auto len = consume_cachelines(s, &offset);
+		if (!len)
+			return false;
+
+		s->consume_offset = offset;
+		s->consume_len = len;
+	} else {
+		assert(s->consume_len != 0);
+	}
+
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+	ANNOTATE_HAPPENS_AFTER(s->ring_buffer.get());
+#endif
+
+	return true;
+}
+
+/*
+ * Returns messages from the acquired range of the segment.
+ */
+inline mpsc_queue::batch_type
+mpsc_queue::range_batch(segment *s)
+{
+	auto data = s->buf + s->consume_offset;
+	auto begin = iterator(data, data + s->consume_len);
+	auto end = iterator(data + s->consume_len, data + s->consume_len);
+
+	return batch_type(begin, end);
+}
+
+/*
+ * Marks the acquired range of the segment as consumed. Must be called
+ * in a transaction.
+ */
+inline void
+mpsc_queue::commit_range(segment *s)
+{
+	auto b = reinterpret_cast<first_block *>(s->buf + s->consume_offset);
+	clear_cachelines(s, b, s->consume_len);
+
+	auto consume_end = s->consume_offset + s->consume_len;
+	if (consume_end < s->buf_size)
+		s->pmem->written = consume_end;
+	else if (consume_end == s->buf_size)
+		s->pmem->written = 0;
+	else
+		assert(false);
+}
+
+/*
+ * Makes the consumed range of the segment available for producers. Must be
+ * called after the transaction in which commit_range() was called.
+ */
+inline void
+mpsc_queue::release_range(segment *s)
+{
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+	ANNOTATE_HAPPENS_BEFORE(s->ring_buffer.get());
+#endif
+
+	release_cachelines(s, s->consume_len);
+
+	assert(!s->ring_buffer->consume_in_progress);
+}
+
+/*
+ * Returns the first segment with a range acquired for consumption or nullptr
+ * if there is no data ready. Drained segments are retired on the way.
+ */
+inline mpsc_queue::segment *
+mpsc_queue::ready_segment()
+{
+	for (;;) {
+		auto s = head;
+
+		if (acquire_range(s))
+			return s;
+
+		/* See try_consume_batch(). */
+		if (!s->sealed.load()) {
+			if (s->pmem == pmem || !switch_tail(s, false))
+				return nullptr;
+		}
+
+		if (s->users.load() != 0)
+			return nullptr;
+
+		if (acquire_range(s))
+			return s;
+
+		retire_head();
+	}
+}
+
 inline mpsc_queue::worker::worker(mpsc_queue *q)
 {
 	queue = q;
@@ -479,9 +861,7 @@ inline mpsc_queue::worker::worker(mpsc_queue *q)
 
 	id = manager.get();
 
-	assert(id < q->ring_buffer->nworkers);
-
-	w = ringbuf_register(queue->ring_buffer.get(), id);
+	assert(id < q->max_workers);
 }
 
 inline mpsc_queue::worker::worker(mpsc_queue::worker &&other)
@@ -494,19 +874,16 @@ mpsc_queue::worker::operator=(worker &&other)
 {
 	if (this != &other) {
 		queue = other.queue;
-		w = other.w;
 		id = other.id;
 
 		other.queue = nullptr;
-		other.w = nullptr;
 	}
 	return *this;
 }
 
 inline mpsc_queue::worker::~worker()
 {
-	if (w) {
-		ringbuf_unregister(queue->ring_buffer.get(), w);
+	if (queue) {
 		auto &manager = queue->get_id_manager();
 		manager.release(id);
 	}
@@ -529,45 +906,77 @@ bool
 mpsc_queue::worker::try_produce(pmem::obj::string_view data,
 				Function &&on_produce)
 {
-	auto req_size =
-		pmem::detail::align_up(data.size() + sizeof(first_block::size),
-				       pmem::detail::CACHELINE_SIZE);
-	auto offset = acquire_cachelines(req_size);
+	return try_produce(pmem::obj::string_view(), data,
+			   std::forward<Function>(on_produce));
+}
+
+/**
+ * Copies header followed by data into the mpsc_queue, as a single entry.
+ * The header has to fit in the first cacheline of the entry.
+ */
+template <typename Function>
+bool
+mpsc_queue::worker::try_produce(pmem::obj::string_view header,
+				pmem::obj::string_view data,
+				Function &&on_produce)
+{
+	auto size = header.size() + data.size();
+	auto req_size = pmem::detail::align_up(size + sizeof(first_block::size),
+					       pmem::detail::CACHELINE_SIZE);
+
+	for (;;) {
+		auto s = queue->enter_tail();
+		auto w = &s->ring_buffer->workers[id];
+		auto offset = acquire_cachelines(s, w, req_size);
 
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
-	ANNOTATE_HAPPENS_AFTER(queue->ring_buffer.get());
+		ANNOTATE_HAPPENS_AFTER(s->ring_buffer.get());
 #endif
 
-	if (offset == -1)
-		return false;
+		if (offset == -1) {
+			s->users.fetch_sub(1);
+
+			/* Segment is full, try to move to the next one. */
+			if (!queue->switch_tail(s, true))
+				return false;
 
-	store_to_log(data, queue->buf + offset);
+			continue;
+		}
+
+		store_to_log(header, data, s->buf + offset);
 
 #if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
-	ANNOTATE_HAPPENS_BEFORE(queue->ring_buffer.get());
+		ANNOTATE_HAPPENS_BEFORE(s->ring_buffer.get());
 #endif
 
-	on_produce(pmem::obj::string_view(
-		queue->buf + offset + sizeof(first_block::size), data.size()));
+		on_produce(pmem::obj::string_view(
+			s->buf + offset + sizeof(first_block::size), size));
 
-	produce_cachelines();
+		ringbuf_produce(s->ring_buffer.get(), w);
 
-	return true;
+		s->users.fetch_sub(1);
+
+		return true;
+	}
 }
 
 inline void
-mpsc_queue::worker::store_to_log(pmem::obj::string_view data, char *log_data)
+mpsc_queue::worker::store_to_log(pmem::obj::string_view header,
+				 pmem::obj::string_view data, char *log_data)
 {
 	assert(reinterpret_cast<uintptr_t>(log_data) %
 		       pmem::detail::CACHELINE_SIZE ==
 	       0);
+	assert(header.size() <= first_block::CAPACITY);
+
+	size_t size = header.size() + data.size();
 
 /* Invariant: producer can only produce data to cachelines which have
  * first 8 bytes zeroed.
  */
 #ifndef NDEBUG
 	auto b = reinterpret_cast<first_block *>(log_data);
-	auto s = pmem::detail::align_up(data.size() + sizeof(first_block::size),
+	auto s = pmem::detail::align_up(size + sizeof(first_block::size),
 					pmem::detail::CACHELINE_SIZE);
 	auto e = b + s / pmem::detail::CACHELINE_SIZE;
 	while (b < e) {
@@ -579,12 +988,12 @@ mpsc_queue::worker::store_to_log(pmem::obj::string_view data, char *log_data)
 	assert(reinterpret_cast<first_block *>(log_data)->size == 0);
 
 	first_block fblock;
-	fblock.size = data.size() | size_t(first_block::DIRTY_FLAG);
+	fblock.size = size | size_t(first_block::DIRTY_FLAG);
 
 	/*
-	 * First step is to copy up to 56B of data and store
-	 * data.size() with DIRTY flag set. After that, we store
-	 * rest of the data in two steps:
+	 * First step is to copy the header and data, up to 56B in
+	 * total, and store their size with DIRTY flag set. After
+	 * that, we store rest of the data in two steps:
 	 *	1. Remainder of the data is aligned down to
 	 *	cacheline and copied.
 	 * Now, we are left with between 0 to 63 bytes. If
@@ -598,16 +1007,18 @@ mpsc_queue::worker::store_to_log(pmem::obj::string_view data, char *log_data)
 	 * misaligned writes.
 	 */
 
-	size_t ncopy = (std::min)(data.size(), size_t(first_block::CAPACITY));
-	std::copy_n(data.data(), ncopy, fblock.data);
+	size_t ncopy = (std::min)(size, size_t(first_block::CAPACITY));
+	std::copy_n(header.data(), header.size(), fblock.data);
+	std::copy_n(data.data(), ncopy - header.size(),
+		    fblock.data + header.size());
 
 	pmemobj_memcpy(queue->pop.handle(), log_data,
 		       reinterpret_cast<char *>(&fblock),
 		       pmem::detail::CACHELINE_SIZE, PMEMOBJ_F_MEM_NONTEMPORAL);
 
-	size_t remaining_size = ncopy > data.size() ? 0 : data.size() - ncopy;
+	size_t remaining_size = size - ncopy;
 
-	const char *srcof = data.data() + ncopy;
+	const char *srcof = data.data() + (ncopy - header.size());
 	size_t rcopy = pmem::detail::align_down(remaining_size,
 						pmem::detail::CACHELINE_SIZE);
 	size_t lcopy = remaining_size - rcopy;
@@ -680,7 +1091,7 @@ mpsc_queue::iterator::iterator(char *data, char *end) : data(data), end(end)
 }
 
 void
-mpsc_queue::clear_cachelines(first_block *block, size_t size)
+mpsc_queue::clear_cachelines(segment *s, first_block *block, size_t size)
 {
 	assert(size % pmem::detail::CACHELINE_SIZE == 0);
 	assert(pmemobj_tx_stage() == TX_STAGE_WORK);
@@ -696,7 +1107,8 @@ mpsc_queue::clear_cachelines(first_block *block, size_t size)
 		block++;
 	}
 
-	assert(end <= reinterpret_cast<first_block *>(buf + buf_size));
+	assert(end <= reinterpret_cast<first_block *>(s->buf + s->buf_size));
+	(void)s;
 }
 
 mpsc_queue::iterator &
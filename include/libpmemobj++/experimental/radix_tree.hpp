@@ -33,15 +33,29 @@
 #include <libpmemobj++/utils.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #if __cpp_lib_endian
 #include <bit>
 #endif
 
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/ebr.hpp>
+#include <libpmemobj++/detail/hazard_pointers.hpp>
 #include <libpmemobj++/detail/integer_sequence.hpp>
+#include <libpmemobj++/detail/persistent_limbo.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/detail/tagged_ptr.hpp>
 
 namespace pmem
@@ -94,6 +108,8 @@ struct bytes_view;
  * not invalidated by other inserts or erases, but might be invalidated by
  * assigning new value to the element. Using find(K).assign_val("new_value") may
  * invalidate other iterators and references to the element with key K.
+ * Reallocations caused by growing values can be made less frequent with
+ * set_value_slack(), which reserves additional capacity in the new leaf.
  *
  * swap() invalidates all references and iterators.
  *
@@ -107,11 +123,41 @@ struct bytes_view;
  * added to a garbage list which can be freed by calling garbage_collect()
  * - insert_or_assign and iterator.assign_val do not perform an in-place update,
  * instead a new leaf is allocated and the old one is added to the garbage list
+ * (except for assign_val of basic_inline_string value which only appends
+ * characters and fits in the capacity, while no snapshot is alive)
  * - memory-reclamation mechanisms are initialized
+ * - snapshot() can be used to obtain a read-only, point-in-time view of the
+ * tree
+ * - lookups can be protected by hazard pointers instead of ebr critical
+ * sections (see register_hazard_worker()), so a stalled reader does not block
+ * freeing of all the garbage
+ *
+ * If the pool was opened with pool_base::open_read_only(), the tree cannot be
+ * modified (modifying operations throw before touching it) and nothing is
+ * ever freed. Lookups then need neither ebr critical sections nor hazard
+ * pointers, lower_bound() and upper_bound() do not revalidate the path, and
+ * snapshot() is free. runtime_initialize_mt() is required only for
+ * register_worker() and register_hazard_worker().
+ *
+ * While at least one snapshot is alive, the writer does not modify internal
+ * nodes which are shared with a snapshot. Instead, the node and all its
+ * ancestors are copied (path copying) and the copies are linked into the
+ * tree. Replaced nodes and leaves are put on the garbage list. They are not
+ * collected until all snapshots taken before they were replaced are
+ * released, so a long-lived snapshot holds at most the garbage produced
+ * while it is alive.
  *
  * By default, concurrency is not enabled (it is not allowed to perform
  * concurrent operations on radix tree).
  *
+ * Order statistics (count(first, last), rank() and select()) can be sped up by
+ * calling enable_order_statistics(). Every internal node then keeps the number
+ * of elements in its subtree, which is updated transactionally by inserts and
+ * erases, and those queries take time proportional to the depth of the tree
+ * instead of the number of elements in the range. Maintaining the counts is
+ * disabled by default. In MtMode the counts are updated in place, so order
+ * statistics must not be queried concurrently with the writer.
+ *
  * An example of custom BytesView implementation:
  * @snippet radix_tree/radix_tree_custom_key.cpp bytes_view_example
  * @ingroup experimental_containers
@@ -121,6 +167,7 @@ template <typename Key, typename Value, typename BytesView = bytes_view<Key>,
 class radix_tree {
 	template <bool IsConst>
 	struct radix_tree_iterator;
+	class radix_tree_snapshot;
 
 public:
 	using key_type = Key;
@@ -136,6 +183,8 @@ public:
 	using difference_type = std::ptrdiff_t;
 	using ebr = detail::ebr;
 	using worker_type = detail::ebr::worker;
+	using hazard_worker_type = detail::hazard_pointers::worker;
+	using snapshot_type = radix_tree_snapshot;
 
 	radix_tree();
 
@@ -243,6 +292,19 @@ public:
 			detail::has_is_transparent<BytesView>::value, K>::type>
 	const_iterator find(const K &k) const;
 
+	const_iterator find(const key_type &k, hazard_worker_type &w) const;
+	template <
+		typename K,
+		typename = typename std::enable_if<
+			detail::has_is_transparent<BytesView>::value, K>::type>
+	const_iterator find(const K &k, hazard_worker_type &w) const;
+
+	template <typename ForwardIt>
+	std::vector<iterator> find_many(ForwardIt first, ForwardIt last);
+	template <typename ForwardIt>
+	std::vector<const_iterator> find_many(ForwardIt first,
+					      ForwardIt last) const;
+
 	iterator lower_bound(const key_type &k);
 	const_iterator lower_bound(const key_type &k) const;
 	template <
@@ -255,6 +317,13 @@ public:
 		typename = typename std::enable_if<
 			detail::has_is_transparent<BytesView>::value, K>::type>
 	const_iterator lower_bound(const K &k) const;
+	const_iterator lower_bound(const key_type &k,
+				   hazard_worker_type &w) const;
+	template <
+		typename K,
+		typename = typename std::enable_if<
+			detail::has_is_transparent<BytesView>::value, K>::type>
+	const_iterator lower_bound(const K &k, hazard_worker_type &w) const;
 
 	iterator upper_bound(const key_type &k);
 	const_iterator upper_bound(const key_type &k) const;
@@ -269,6 +338,23 @@ public:
 			detail::has_is_transparent<BytesView>::value, K>::type>
 	const_iterator upper_bound(const K &k) const;
 
+	size_type count(const_iterator first, const_iterator last) const;
+	size_type rank(const key_type &k) const;
+	template <
+		typename K,
+		typename = typename std::enable_if<
+			detail::has_is_transparent<BytesView>::value, K>::type>
+	size_type rank(const K &k) const;
+	iterator select(size_type i);
+	const_iterator select(size_type i) const;
+
+	void enable_order_statistics();
+	void disable_order_statistics();
+	bool order_statistics_enabled() const noexcept;
+
+	void set_value_slack(uint32_t percent);
+	uint32_t value_slack() const noexcept;
+
 	iterator begin();
 	iterator end();
 	const_iterator cbegin() const;
@@ -303,7 +389,8 @@ public:
 
 	template <bool Mt = MtMode,
 		  typename Enable = typename std::enable_if<Mt>::type>
-	void runtime_initialize_mt(ebr *e = new ebr());
+	void runtime_initialize_mt(ebr *e = new ebr(),
+				   bool hazard_readers = false);
 	template <bool Mt = MtMode,
 		  typename Enable = typename std::enable_if<Mt>::type>
 	void runtime_finalize_mt();
@@ -311,6 +398,13 @@ public:
 	template <bool Mt = MtMode,
 		  typename Enable = typename std::enable_if<Mt>::type>
 	worker_type register_worker();
+	template <bool Mt = MtMode,
+		  typename Enable = typename std::enable_if<Mt>::type>
+	hazard_worker_type register_hazard_worker();
+
+	template <bool Mt = MtMode,
+		  typename Enable = typename std::enable_if<Mt>::type>
+	snapshot_type snapshot();
 
 private:
 	using byten_t = uint64_t;
@@ -326,8 +420,6 @@ private:
 	static constexpr bitn_t SLICE_MASK = (bitn_t) ~(SLICE - 1);
 	/* Position of the first SLICE */
 	static constexpr bitn_t FIRST_NIB = 8 - SLICE;
-	/* Number of EBR epochs */
-	static constexpr size_t EPOCHS_NUMBER = 3;
 
 	struct leaf;
 	struct node;
@@ -346,22 +438,116 @@ private:
 
 	using path_type = std::vector<node_desc>;
 
+	/* Number of hazard pointer slots used by a single lookup: two for
+	 * descending the tree and one for the subtree of the successor. */
+	static constexpr size_t HAZARD_SLOTS = 3;
+
+	/* Runtime state of the readers which use hazard pointers instead of
+	 * ebr, see register_hazard_worker(). */
+	struct hazard_data {
+		hazard_data() : domain(HAZARD_SLOTS)
+		{
+		}
+
+		detail::hazard_pointers domain;
+		/* Number of started garbage collections. A lookup is restarted
+		 * if it changes, see hazard_protect(). */
+		std::atomic<uint64_t> collections{0};
+	};
+
+	/* Runtime state of the snapshots (see snapshot()) and of the hazard
+	 * pointers readers. */
+	struct snapshot_data {
+		/* Number of alive snapshots. */
+		std::atomic<size_t> count{0};
+		/* Number of snapshots taken, the sequence number of the most
+		 * recent one. Accessed only by the writer. */
+		uint64_t taken = 0;
+
+		/* Sequence numbers of alive snapshots, they may be released
+		 * by any thread. */
+		std::mutex mtx;
+		std::multiset<uint64_t> alive;
+
+		/* Live nodes allocated after the most recent snapshot was
+		 * taken. Accessed only by the writer. */
+		std::unordered_set<const void *> fresh;
+		/* Garbage retired while any snapshot was alive, mapped to
+		 * the sequence number of the most recent snapshot at that
+		 * time. Accessed only by the writer. */
+		std::unordered_map<const void *, uint64_t> held;
+
+		/* nullptr if hazard pointers readers are not enabled. */
+		std::unique_ptr<hazard_data> hazards;
+
+		uint64_t oldest();
+	};
+
+	/* Volatile state of the tree in MtMode, created by
+	 * runtime_initialize_mt(). It is kept behind a single pointer, so
+	 * that snapshots and hazard pointers readers did not change the
+	 * persistent layout of the tree. */
+	struct runtime_data {
+		explicit runtime_data(ebr *e) : reclamation(e)
+		{
+		}
+
+		std::unique_ptr<ebr> reclamation;
+		snapshot_data snapshots;
+	};
+
 	/* Arbitrarily choosen value, overhead of vector resizing for deep radix
 	 * tree will not be noticeable. */
 	static constexpr size_t PATH_INIT_CAP = 64;
 
+	/*
+	 * The number of elements is kept in the low bits of size_. The high
+	 * bits, which are zero in trees created by older versions, hold the
+	 * persistent settings, so that the layout does not change.
+	 */
+	static constexpr uint64_t SIZE_MASK = (1ULL << 48) - 1;
+	static constexpr unsigned VALUE_SLACK_SHIFT = 48;
+	static constexpr uint64_t VALUE_SLACK_MAX = (1ULL << 15) - 1;
+	static constexpr uint64_t VALUE_SLACK_MASK = VALUE_SLACK_MAX
+		<< VALUE_SLACK_SHIFT;
+	static constexpr uint64_t ORDER_STATS_FLAG = 1ULL << 63;
+
 	/*** pmem members ***/
 	atomic_pointer_type root;
 	p<uint64_t> size_;
-	vector<pointer_type> garbages[EPOCHS_NUMBER];
+	detail::persistent_limbo<pointer_type> garbages;
 
-	ebr *ebr_ = nullptr;
+	runtime_data *runtime_ = nullptr;
 
 	/* helper functions */
 	template <typename K, typename F, class... Args>
 	std::pair<iterator, bool> internal_emplace(const K &, F &&);
 	template <typename K>
 	leaf *internal_find(const K &k) const;
+	template <typename ForwardIt>
+	std::vector<leaf *> internal_find_many(ForwardIt first,
+					       ForwardIt last) const;
+	template <typename K>
+	const leaf *hazard_find(const K &k, hazard_worker_type &w) const;
+	template <typename K>
+	const leaf *hazard_lower_bound(const K &k,
+				       hazard_worker_type &w) const;
+	bool hazard_protect(hazard_worker_type &w,
+			    const atomic_pointer_type &src, size_t slot,
+			    uint64_t seq, pointer_type &n) const;
+	bool hazard_leftmost_leaf(hazard_worker_type &w, pointer_type n,
+				  size_t &slot, uint64_t seq,
+				  size_type min_depth,
+				  const leaf *&result) const;
+	hazard_data *hazards() const;
+	ebr *get_ebr() const noexcept;
+	snapshot_data *get_snapshots() const noexcept;
+	size_type position(const leaf *l) const;
+	const leaf *internal_select(size_type i) const;
+
+	static uint64_t subtree_size(pointer_type n);
+	static uint64_t init_subtree_sizes(pointer_type n);
+	void update_subtree_sizes(pointer_type n, bool increment);
 
 	static atomic_pointer_type &parent_ref(pointer_type n);
 	template <typename K1, typename K2>
@@ -405,7 +591,16 @@ private:
 	static node *get_node(const pointer_type &p);
 	template <typename T>
 	void free(persistent_ptr<T> ptr);
-	void clear_garbage(size_t n);
+	static void free_garbage(const pointer_type &p);
+	static const void *address(const pointer_type &p);
+	std::function<bool(const pointer_type &)> held_by_snapshot();
+	std::function<bool(const pointer_type &)> held();
+	bool snapshots_alive() const;
+	bool is_shared(pointer_type n) const;
+	void on_node_alloc(pointer_type n);
+	pointer_type cow(pointer_type n);
+	atomic_pointer_type *writable_slot(pointer_type &n,
+					   const atomic_pointer_type *slot);
 	static pointer_type
 	load(const std::atomic<detail::tagged_ptr<leaf, node>> &ptr);
 	static pointer_type load(const pointer_type &ptr);
@@ -414,9 +609,15 @@ private:
 	static void store(pointer_type &ptr, pointer_type desired);
 	void check_pmem();
 	void check_tx_stage_work();
+	bool is_read_only() const noexcept;
+	void check_writable() const;
 
 	static_assert(sizeof(node) == 256,
 		      "Internal node should have size equal to 256 bytes.");
+	static_assert(offsetof(node, byte) == 144 &&
+			      offsetof(node, bit) == 152 &&
+			      offsetof(node, n_leaves) == 160,
+		      "Layout of internal node should not change.");
 };
 
 template <typename Key, typename Value, typename BytesView, bool MtMode>
@@ -531,6 +732,13 @@ struct radix_tree<Key, Value, BytesView, MtMode>::node {
 	byten_t byte;
 	bitn_t bit;
 
+	/**
+	 * Number of leaves in the subtree. Valid only if order statistics are
+	 * enabled for the tree. Carved out of the padding, so the offsets of
+	 * the fields above did not change.
+	 */
+	p<uint64_t> n_leaves;
+
 	struct direction {
 		static constexpr bool Forward = 0;
 		static constexpr bool Reverse = 1;
@@ -593,7 +801,9 @@ struct radix_tree<Key, Value, BytesView, MtMode>::node {
 		-> decltype(begin<Direction>());
 
 	uint8_t padding[256 - sizeof(parent) - sizeof(leaf) - sizeof(child) -
-			sizeof(byte) - sizeof(bit)];
+			detail::align_up(sizeof(byte) + sizeof(bit),
+					 alignof(p<uint64_t>)) -
+			sizeof(n_leaves)];
 };
 
 /**
@@ -670,8 +880,8 @@ private:
 	leaf_ptr leaf_ = nullptr;
 	tree_ptr tree = nullptr;
 
-	template <typename T>
-	void replace_val(T &&rhs);
+	template <typename... Args>
+	void replace_val(Args &&... args);
 
 	bool try_increment();
 	bool try_decrement();
@@ -705,6 +915,116 @@ private:
 	const node *n;
 };
 
+/**
+ * Read-only, point-in-time view of the radix tree, returned by
+ * radix_tree::snapshot().
+ *
+ * The view is not affected by modifications of the tree performed after
+ * it was taken. It can be used (e.g. for an online backup) from any thread
+ * without registering an EBR worker, concurrently with the writer.
+ *
+ * Nodes and leaves which are reachable from the snapshot are not freed
+ * until the snapshot is released (by the destructor or release()). The
+ * snapshot must be released before runtime_finalize_mt() is called.
+ *
+ * Values must not be modified in place (e.g. through an iterator
+ * dereference) while the snapshot is alive, only by insert_or_assign
+ * or assign_val.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+class radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot {
+public:
+	class const_iterator;
+
+	radix_tree_snapshot(const radix_tree_snapshot &) = delete;
+	radix_tree_snapshot(radix_tree_snapshot &&other) noexcept;
+
+	radix_tree_snapshot &operator=(const radix_tree_snapshot &) = delete;
+	radix_tree_snapshot &operator=(radix_tree_snapshot &&other) noexcept;
+
+	~radix_tree_snapshot();
+
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	const_iterator find(const key_type &k) const;
+	template <
+		typename K,
+		typename = typename std::enable_if<
+			detail::has_is_transparent<BytesView>::value, K>::type>
+	const_iterator find(const K &k) const;
+
+	size_type count(const key_type &k) const;
+	template <
+		typename K,
+		typename = typename std::enable_if<
+			detail::has_is_transparent<BytesView>::value, K>::type>
+	size_type count(const K &k) const;
+
+	bool empty() const noexcept;
+	uint64_t size() const noexcept;
+
+	void release() noexcept;
+
+private:
+	friend class radix_tree;
+
+	radix_tree_snapshot(snapshot_data *data, uint64_t seq,
+			    pointer_type root, uint64_t size);
+
+	snapshot_data *data;
+	uint64_t seq;
+	pointer_type root;
+	uint64_t size_;
+};
+
+/**
+ * Forward iterator over a radix tree snapshot. Elements are visited in the
+ * same order as by radix_tree::iterator.
+ *
+ * Since the snapshot does not use parent pointers (they are updated by the
+ * writer), the iterator keeps the path from the root of the snapshot.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+class radix_tree<Key, Value, BytesView,
+		 MtMode>::radix_tree_snapshot::const_iterator {
+public:
+	using difference_type = std::ptrdiff_t;
+	using value_type = radix_tree::leaf;
+	using reference = const value_type &;
+	using pointer = const value_type *;
+	using iterator_category = std::forward_iterator_tag;
+
+	const_iterator() = default;
+
+	reference operator*() const;
+	pointer operator->() const;
+
+	const_iterator &operator++();
+	const_iterator operator++(int);
+
+	bool operator==(const const_iterator &rhs) const;
+	bool operator!=(const const_iterator &rhs) const;
+
+private:
+	friend class radix_tree_snapshot;
+
+	/* Node on the path and index of the next child to visit (0 is the
+	 * embedded entry). */
+	struct frame {
+		const node *n;
+		size_t idx;
+	};
+
+	void find_next();
+
+	template <typename K>
+	void seek(pointer_type root, const K &k);
+
+	std::vector<frame> path;
+	const leaf *leaf_ = nullptr;
+};
+
 /**
  * Default radix tree constructor. Constructs an empty container.
  * @pre must be called in transaction scope.
@@ -800,7 +1120,7 @@ radix_tree<Key, Value, BytesView, MtMode>::radix_tree(radix_tree &&m)
 	store(root, load(m.root));
 	size_ = m.size_;
 	store(m.root, nullptr);
-	m.size_ = 0;
+	m.size_ = m.size_ & ~SIZE_MASK;
 }
 
 /**
@@ -846,7 +1166,7 @@ radix_tree<Key, Value, BytesView, MtMode>::operator=(const radix_tree &other)
 			clear();
 
 			store(this->root, nullptr);
-			this->size_ = 0;
+			this->size_ = this->size_ & ~SIZE_MASK;
 
 			for (auto it = other.cbegin(); it != other.cend(); it++)
 				emplace(*it);
@@ -879,7 +1199,7 @@ radix_tree<Key, Value, BytesView, MtMode>::operator=(radix_tree &&other)
 			store(this->root, load(other.root));
 			this->size_ = other.size_;
 			store(other.root, nullptr);
-			other.size_ = 0;
+			other.size_ = other.size_ & ~SIZE_MASK;
 		});
 	}
 
@@ -909,7 +1229,7 @@ radix_tree<Key, Value, BytesView, MtMode>::operator=(
 		clear();
 
 		store(this->root, nullptr);
-		this->size_ = 0;
+		this->size_ = this->size_ & ~SIZE_MASK;
 
 		for (auto it = ilist.begin(); it != ilist.end(); it++)
 			emplace(*it);
@@ -926,8 +1246,7 @@ radix_tree<Key, Value, BytesView, MtMode>::~radix_tree()
 {
 	try {
 		clear();
-		for (size_t i = 0; i < EPOCHS_NUMBER; ++i)
-			clear_garbage(i);
+		garbages.clear(free_garbage);
 	} catch (...) {
 		std::terminate();
 	}
@@ -942,7 +1261,7 @@ template <typename Key, typename Value, typename BytesView, bool MtMode>
 bool
 radix_tree<Key, Value, BytesView, MtMode>::empty() const noexcept
 {
-	return size_ == 0;
+	return size() == 0;
 }
 
 /**
@@ -952,7 +1271,7 @@ template <typename Key, typename Value, typename BytesView, bool MtMode>
 typename radix_tree<Key, Value, BytesView, MtMode>::size_type
 radix_tree<Key, Value, BytesView, MtMode>::max_size() const noexcept
 {
-	return std::numeric_limits<difference_type>::max();
+	return SIZE_MASK;
 }
 
 /**
@@ -962,7 +1281,7 @@ template <typename Key, typename Value, typename BytesView, bool MtMode>
 uint64_t
 radix_tree<Key, Value, BytesView, MtMode>::size() const noexcept
 {
-	return this->size_;
+	return this->size_ & SIZE_MASK;
 }
 
 /**
@@ -974,6 +1293,8 @@ template <typename Key, typename Value, typename BytesView, bool MtMode>
 void
 radix_tree<Key, Value, BytesView, MtMode>::swap(radix_tree &rhs)
 {
+	check_writable();
+
 	auto pop = pool_by_vptr(this);
 
 	flat_transaction::run(pop, [&] {
@@ -988,6 +1309,8 @@ radix_tree<Key, Value, BytesView, MtMode>::swap(radix_tree &rhs)
  * concurrent mode (if MtMode == true).
  *
  * Garbage is not automatically collected on move/copy ctor/assignment.
+ * Garbage which may be reachable from an alive snapshot (it was produced
+ * after the oldest alive snapshot was taken) is not collected.
  *
  * @throw pmem::transaction_error when snapshotting failed.
  */
@@ -996,10 +1319,9 @@ template <bool Mt, typename Enable>
 void
 radix_tree<Key, Value, BytesView, MtMode>::garbage_collect_force()
 {
-	ebr_->full_sync();
-	for (size_t i = 0; i < EPOCHS_NUMBER; ++i) {
-		clear_garbage(i);
-	}
+	check_writable();
+
+	garbages.full_reclaim(*get_ebr(), free_garbage, held());
 }
 
 /**
@@ -1009,6 +1331,8 @@ radix_tree<Key, Value, BytesView, MtMode>::garbage_collect_force()
  * depends on operations currently performed by other threads.
  *
  * Garbage is not automatically collected on move/copy ctor/assignment.
+ * Garbage which may be reachable from an alive snapshot (it was produced
+ * after the oldest alive snapshot was taken) is not collected.
  *
  * @throw pmem::transaction_error when snapshotting failed.
  */
@@ -1017,32 +1341,105 @@ template <bool Mt, typename Enable>
 void
 radix_tree<Key, Value, BytesView, MtMode>::garbage_collect()
 {
-	ebr_->sync();
-	clear_garbage(ebr_->gc_epoch());
+	check_writable();
+
+	garbages.reclaim(*get_ebr(), free_garbage, held());
 }
 
+/*
+ * Returns a predicate which checks if the garbage might be reachable from
+ * an alive snapshot, i.e. it was retired while a snapshot taken before the
+ * oldest alive one was alive. Entries of the garbage which is not held
+ * anymore are dropped, the garbage is freed right after the check.
+ */
 template <typename Key, typename Value, typename BytesView, bool MtMode>
-void
-radix_tree<Key, Value, BytesView, MtMode>::clear_garbage(size_t n)
+std::function<bool(
+	const typename radix_tree<Key, Value, BytesView, MtMode>::pointer_type &)>
+radix_tree<Key, Value, BytesView, MtMode>::held_by_snapshot()
 {
-	assert(n >= 0 && n < EPOCHS_NUMBER);
+	auto *snapshots = get_snapshots();
+	if (!snapshots || snapshots->held.empty())
+		return [](const pointer_type &) { return false; };
 
-	auto pop = pool_by_vptr(this);
+	auto oldest = snapshots->oldest();
+	auto &held = snapshots->held;
 
-	flat_transaction::run(pop, [&] {
-		for (auto &e : garbages[n]) {
-			if (is_leaf(e))
-				delete_persistent<radix_tree::leaf>(
-					persistent_ptr<radix_tree::leaf>(
-						get_leaf(e)));
-			else
-				delete_persistent<radix_tree::node>(
-					persistent_ptr<radix_tree::node>(
-						get_node(e)));
-		}
+	return [oldest, &held](const pointer_type &p) {
+		auto it = held.find(address(p));
+		if (it == held.end())
+			return false;
 
-		garbages[n].clear();
-	});
+		/* it was retired when the oldest alive snapshot existed */
+		if (it->second >= oldest)
+			return true;
+
+		held.erase(it);
+		return false;
+	};
+}
+
+/*
+ * Returns a predicate which checks if the garbage cannot be freed yet,
+ * because it might be reachable from an alive snapshot or it is protected by
+ * a hazard pointers reader.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+std::function<bool(
+	const typename radix_tree<Key, Value, BytesView, MtMode>::pointer_type &)>
+radix_tree<Key, Value, BytesView, MtMode>::held()
+{
+	auto by_snapshot = held_by_snapshot();
+
+	auto h = hazards();
+	if (!h)
+		return by_snapshot;
+
+	/* Lookups which are in progress are restarted, unless they already
+	 * protected the nodes they access, see hazard_protect(). */
+	h->collections.fetch_add(1);
+	auto hazards = h->domain.protected_objects();
+
+	return [by_snapshot, hazards](const pointer_type &p) {
+		return by_snapshot(p) ||
+			std::binary_search(hazards.begin(), hazards.end(),
+					   address(p));
+	};
+}
+
+/*
+ * Returns sequence number of the oldest alive snapshot, or the maximum
+ * value if there are no snapshots.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+uint64_t
+radix_tree<Key, Value, BytesView, MtMode>::snapshot_data::oldest()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	return alive.empty() ? std::numeric_limits<uint64_t>::max()
+			     : *alive.begin();
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::free_garbage(const pointer_type &p)
+{
+	if (is_leaf(p))
+		delete_persistent<radix_tree::leaf>(
+			persistent_ptr<radix_tree::leaf>(get_leaf(p)));
+	else
+		delete_persistent<radix_tree::node>(
+			persistent_ptr<radix_tree::node>(get_node(p)));
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+const void *
+radix_tree<Key, Value, BytesView, MtMode>::address(const pointer_type &p)
+{
+	if (is_leaf(p))
+		return get_leaf(p);
+
+	return get_node(p);
 }
 
 template <typename Key, typename Value, typename BytesView, bool MtMode>
@@ -1083,31 +1480,41 @@ radix_tree<Key, Value, BytesView, MtMode>::store(pointer_type &ptr,
  *
  * @param[in] e pointer to already created ebr, default it will be created
  * automatically.
+ * @param[in] hazard_readers if true, lookups can also be performed without
+ * ebr critical sections, protected by hazard pointers (see
+ * register_hazard_worker()).
  */
 template <typename Key, typename Value, typename BytesView, bool MtMode>
 template <bool Mt, typename Enable>
 void
-radix_tree<Key, Value, BytesView, MtMode>::runtime_initialize_mt(ebr *e)
+radix_tree<Key, Value, BytesView, MtMode>::runtime_initialize_mt(
+	ebr *e, bool hazard_readers)
 {
 #if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
-	VALGRIND_PMC_REMOVE_PMEM_MAPPING(&ebr_, sizeof(ebr *));
+	VALGRIND_PMC_REMOVE_PMEM_MAPPING(&runtime_, sizeof(runtime_data *));
 #endif
-	ebr_ = e;
+	runtime_ = new runtime_data(e);
+
+	if (hazard_readers)
+		runtime_->snapshots.hazards.reset(new hazard_data());
 }
 
 /**
  * If MtMode == true, this function must be called before each application close
  * and before calling radix destructor or there will be possible a memory leak.
+ *
+ * @pre all snapshots must be released.
  */
 template <typename Key, typename Value, typename BytesView, bool MtMode>
 template <bool Mt, typename Enable>
 void
 radix_tree<Key, Value, BytesView, MtMode>::runtime_finalize_mt()
 {
-	if (ebr_) {
-		delete ebr_;
+	if (runtime_) {
+		assert(!snapshots_alive());
+		delete runtime_;
 	}
-	ebr_ = nullptr;
+	runtime_ = nullptr;
 }
 
 /**
@@ -1123,113 +1530,345 @@ template <bool Mt, typename Enable>
 typename radix_tree<Key, Value, BytesView, MtMode>::worker_type
 radix_tree<Key, Value, BytesView, MtMode>::register_worker()
 {
-	assert(ebr_);
+	assert(get_ebr());
 
-	return ebr_->register_worker();
+	return get_ebr()->register_worker();
 }
 
-/*
- * Returns reference to n->parent (handles both internal and leaf nodes).
+/**
+ * Registers and returns a new worker, which can perform lookups without
+ * entering ebr critical sections: find(const key_type &, hazard_worker_type &)
+ * and lower_bound(const key_type &, hazard_worker_type &). The nodes accessed
+ * by such a lookup are protected by hazard pointers, so a stalled reader
+ * blocks freeing of at most a few nodes, instead of all the garbage. The
+ * price is a full memory fence for each visited node.
+ *
+ * Hazard pointers readers have to be enabled by runtime_initialize_mt(). The
+ * worker must not be used concurrently by multiple threads and it has to be
+ * destroyed before runtime_finalize_mt() is called.
+ *
+ * @return new registered worker.
  */
 template <typename Key, typename Value, typename BytesView, bool MtMode>
-typename radix_tree<Key, Value, BytesView, MtMode>::atomic_pointer_type &
-radix_tree<Key, Value, BytesView, MtMode>::parent_ref(pointer_type n)
+template <bool Mt, typename Enable>
+typename radix_tree<Key, Value, BytesView, MtMode>::hazard_worker_type
+radix_tree<Key, Value, BytesView, MtMode>::register_hazard_worker()
 {
-	if (is_leaf(n))
-		return get_leaf(n)->parent;
+	assert(hazards());
 
-	return n->parent;
+	return hazards()->domain.register_worker();
 }
 
-/*
- * Find a leftmost leaf in a subtree of @param n.
+/**
+ * Returns a read-only, point-in-time view of the tree.
  *
- * @param min_depth specifies minimum depth of the leaf. If the
- * tree is shorter than min_depth, a bottom leaf is returned.
+ * Taking a snapshot is O(1). While the snapshot is alive, modifications of
+ * the tree copy the internal nodes shared with the snapshot (along with
+ * their ancestors) instead of modifying them in place, and replaced nodes
+ * and leaves are kept until this snapshot and all the older ones are
+ * released (memory is reclaimed by garbage_collect() afterwards). The
+ * writer keeps track of nodes allocated after the most recent snapshot and
+ * of garbage retired while any snapshot is alive, which is bounded by the
+ * number of nodes in the tree and the amount of garbage.
  *
- * Can return nullptr if there is a conflicting, concurrent operation.
+ * This function must be called by the writer thread (it must not be
+ * called concurrently with any modification of the tree). The returned
+ * snapshot can be used and released by any thread.
+ *
+ * In a pool opened with pool_base::open_read_only() the tree cannot change,
+ * so the snapshot is not tracked at all and runtime_initialize_mt() does not
+ * have to be called.
+ *
+ * @pre runtime_initialize_mt() must be called (unless the pool is
+ * read-only).
+ *
+ * @return snapshot of the tree.
  */
 template <typename Key, typename Value, typename BytesView, bool MtMode>
-typename radix_tree<Key, Value, BytesView, MtMode>::leaf *
-radix_tree<Key, Value, BytesView, MtMode>::any_leftmost_leaf(
-	typename radix_tree<Key, Value, BytesView, MtMode>::pointer_type n,
-	size_type min_depth) const
+template <bool Mt, typename Enable>
+typename radix_tree<Key, Value, BytesView, MtMode>::snapshot_type
+radix_tree<Key, Value, BytesView, MtMode>::snapshot()
 {
-	assert(n);
+	if (is_read_only())
+		return snapshot_type(nullptr, 0, load(root), size());
 
-	while (n && !is_leaf(n)) {
-		auto ne = load(n->embedded_entry);
-		if (ne && n->byte >= min_depth)
-			return get_leaf(ne);
+	auto *snapshots = get_snapshots();
+	assert(snapshots);
 
-		pointer_type nn = nullptr;
-		for (size_t i = 0; i < SLNODES; i++) {
-			nn = load(n->child[i]);
-			if (nn) {
-				break;
-			}
-		}
+	/* All existing nodes are shared with the new snapshot. */
+	snapshots->fresh.clear();
 
-		n = nn;
+	auto seq = ++snapshots->taken;
+	{
+		std::lock_guard<std::mutex> lock(snapshots->mtx);
+		snapshots->alive.insert(seq);
 	}
+	snapshots->count.fetch_add(1, std::memory_order_acq_rel);
 
-	return n ? get_leaf(n) : nullptr;
+	return snapshot_type(snapshots, seq, load(root), size());
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+bool
+radix_tree<Key, Value, BytesView, MtMode>::snapshots_alive() const
+{
+	auto *snapshots = get_snapshots();
+
+	return MtMode && snapshots &&
+		snapshots->count.load(std::memory_order_acquire) != 0;
 }
 
 /*
- * Descends to the leaf that shares a common prefix with the @param key.
- * Returns a pair consisting of a pointer to above mentioned leaf and
- * object of type `path_type` which represents path to a divergence point.
- *
- * @param root_snap is a pointer to the root node (we pass it here because
- * loading it within this function might cause inconsistency if outer code
- * sees a different root.
- *
- * Can return nullptr if there is a conflicting, concurrent operation.
+ * Checks if internal node @param n might be reachable from any alive
+ * snapshot, in which case it cannot be modified in place.
  */
 template <typename Key, typename Value, typename BytesView, bool MtMode>
-template <typename K>
-std::pair<typename radix_tree<Key, Value, BytesView, MtMode>::leaf *,
-	  typename radix_tree<Key, Value, BytesView, MtMode>::path_type>
-radix_tree<Key, Value, BytesView, MtMode>::descend(pointer_type root_snap,
-						   const K &key) const
+bool
+radix_tree<Key, Value, BytesView, MtMode>::is_shared(pointer_type n) const
 {
-	assert(root_snap);
+	assert(n && !is_leaf(n));
 
-	auto slot = &this->root;
-	auto n = root_snap;
-	decltype(n) prev = nullptr;
+	return snapshots_alive() &&
+		!get_snapshots()->fresh.count(get_node(n));
+}
 
-	path_type path;
-	path.reserve(PATH_INIT_CAP);
-	path.push_back(node_desc{slot, n, prev});
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::on_node_alloc(pointer_type n)
+{
+	if (snapshots_alive())
+		get_snapshots()->fresh.insert(get_node(n));
+}
 
-	while (n && !is_leaf(n) && n->byte < key.size()) {
-		auto prev = n;
-		slot = &n->child[slice_index(key[n->byte], n->bit)];
-		auto nn = load(*slot);
+/*
+ * Returns internal node which can be modified in place instead of @param n.
+ * If n is shared with a snapshot, it is copied along with its shared
+ * ancestors, the copy is linked into the tree and n is put on the garbage
+ * list. Parent pointers are not used by snapshots, so they are updated in
+ * place.
+ *
+ * After this call all ancestors of the returned node can be modified in
+ * place as well. Must be called in a transaction.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::pointer_type
+radix_tree<Key, Value, BytesView, MtMode>::cow(pointer_type n)
+{
+	if (!n || !is_shared(n))
+		return n;
 
-		if (nn) {
-			path.push_back(node_desc{slot, nn, prev});
-			n = nn;
-		} else {
-			path.push_back(node_desc{slot, nullptr, prev});
-			n = any_leftmost_leaf(n, key.size());
-			break;
-		}
-	}
+	auto parent = cow(load(n->parent));
 
-	if (!n)
-		return {nullptr, std::move(path)};
+	pointer_type copy = make_persistent<radix_tree::node>(parent, n->byte,
+							       n->bit);
+	on_node_alloc(copy);
 
-	/* This can happen when key is a prefix of some leaf or when the node at
-	 * which the keys diverge isn't a leaf */
-	if (!is_leaf(n)) {
-		n = any_leftmost_leaf(n, key.size());
+	store(copy->embedded_entry, load(n->embedded_entry));
+	for (size_t i = 0; i < SLNODES; i++)
+		store(copy->child[i], load(n->child[i]));
+	copy->n_leaves = n->n_leaves;
+
+	for (auto it = copy->begin(); it != copy->end(); ++it) {
+		auto child = load(*it);
+		if (child)
+			store(parent_ref(child), copy);
 	}
 
-	if (n) {
-		return std::pair<leaf *, path_type>{get_leaf(n),
+	auto *slot = parent ? const_cast<atomic_pointer_type *>(
+				      &*parent->find_child(n))
+			    : &root;
+	store(*slot, copy);
+
+	free(persistent_ptr<radix_tree::node>(get_node(n)));
+
+	return copy;
+}
+
+/*
+ * Returns a slot (child or embedded_entry) which can be modified in place
+ * instead of @param slot of node @param n (or the root slot if n is null).
+ * @param n is updated to the node which holds the returned slot.
+ * Must be called in a transaction.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::atomic_pointer_type *
+radix_tree<Key, Value, BytesView, MtMode>::writable_slot(
+	pointer_type &n, const atomic_pointer_type *slot)
+{
+	if (!n) {
+		assert(slot == &root);
+		return &root;
+	}
+
+	auto copy = cow(n);
+	auto *ret = slot == &n->embedded_entry
+		? &copy->embedded_entry
+		: &copy->child[slot - &n->child[0]];
+	n = copy;
+
+	return ret;
+}
+
+/*
+ * Returns reference to n->parent (handles both internal and leaf nodes).
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::atomic_pointer_type &
+radix_tree<Key, Value, BytesView, MtMode>::parent_ref(pointer_type n)
+{
+	if (is_leaf(n))
+		return get_leaf(n)->parent;
+
+	return n->parent;
+}
+
+/*
+ * Returns number of leaves in the subtree rooted at @param n. Valid only if
+ * order statistics are enabled.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+uint64_t
+radix_tree<Key, Value, BytesView, MtMode>::subtree_size(pointer_type n)
+{
+	if (!n)
+		return 0;
+
+	if (is_leaf(n))
+		return 1;
+
+	return n->n_leaves;
+}
+
+/*
+ * Recalculates number of leaves of all internal nodes in the subtree rooted
+ * at @param n. Must be called in a transaction.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+uint64_t
+radix_tree<Key, Value, BytesView, MtMode>::init_subtree_sizes(pointer_type n)
+{
+	if (!n || is_leaf(n))
+		return subtree_size(n);
+
+	uint64_t sum = 0;
+	for (auto it = n->begin(); it != n->end(); ++it)
+		sum += init_subtree_sizes(load(*it));
+
+	n->n_leaves = sum;
+
+	return sum;
+}
+
+/*
+ * Increments (or decrements) number of leaves of @param n and all its
+ * ancestors if order statistics are enabled. Must be called in a
+ * transaction.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::update_subtree_sizes(
+	pointer_type n, bool increment)
+{
+	if (!order_statistics_enabled())
+		return;
+
+	for (; n; n = load(n->parent)) {
+		if (increment)
+			n->n_leaves++;
+		else
+			n->n_leaves--;
+	}
+}
+
+/*
+ * Find a leftmost leaf in a subtree of @param n.
+ *
+ * @param min_depth specifies minimum depth of the leaf. If the
+ * tree is shorter than min_depth, a bottom leaf is returned.
+ *
+ * Can return nullptr if there is a conflicting, concurrent operation.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::leaf *
+radix_tree<Key, Value, BytesView, MtMode>::any_leftmost_leaf(
+	typename radix_tree<Key, Value, BytesView, MtMode>::pointer_type n,
+	size_type min_depth) const
+{
+	assert(n);
+
+	while (n && !is_leaf(n)) {
+		auto ne = load(n->embedded_entry);
+		if (ne && n->byte >= min_depth)
+			return get_leaf(ne);
+
+		pointer_type nn = nullptr;
+		for (size_t i = 0; i < SLNODES; i++) {
+			nn = load(n->child[i]);
+			if (nn) {
+				break;
+			}
+		}
+
+		n = nn;
+	}
+
+	return n ? get_leaf(n) : nullptr;
+}
+
+/*
+ * Descends to the leaf that shares a common prefix with the @param key.
+ * Returns a pair consisting of a pointer to above mentioned leaf and
+ * object of type `path_type` which represents path to a divergence point.
+ *
+ * @param root_snap is a pointer to the root node (we pass it here because
+ * loading it within this function might cause inconsistency if outer code
+ * sees a different root.
+ *
+ * Can return nullptr if there is a conflicting, concurrent operation.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K>
+std::pair<typename radix_tree<Key, Value, BytesView, MtMode>::leaf *,
+	  typename radix_tree<Key, Value, BytesView, MtMode>::path_type>
+radix_tree<Key, Value, BytesView, MtMode>::descend(pointer_type root_snap,
+						   const K &key) const
+{
+	assert(root_snap);
+
+	auto slot = &this->root;
+	auto n = root_snap;
+	decltype(n) prev = nullptr;
+
+	path_type path;
+	path.reserve(PATH_INIT_CAP);
+	path.push_back(node_desc{slot, n, prev});
+
+	while (n && !is_leaf(n) && n->byte < key.size()) {
+		auto prev = n;
+		slot = &n->child[slice_index(key[n->byte], n->bit)];
+		auto nn = load(*slot);
+
+		if (nn) {
+			path.push_back(node_desc{slot, nn, prev});
+			n = nn;
+		} else {
+			path.push_back(node_desc{slot, nullptr, prev});
+			n = any_leftmost_leaf(n, key.size());
+			break;
+		}
+	}
+
+	if (!n)
+		return {nullptr, std::move(path)};
+
+	/* This can happen when key is a prefix of some leaf or when the node at
+	 * which the keys diverge isn't a leaf */
+	if (!is_leaf(n)) {
+		n = any_leftmost_leaf(n, key.size());
+	}
+
+	if (n) {
+		return std::pair<leaf *, path_type>{get_leaf(n),
 						    std::move(path)};
 	} else {
 		return std::pair<leaf *, path_type>{nullptr, std::move(path)};
@@ -1369,6 +2008,8 @@ std::pair<typename radix_tree<Key, Value, BytesView, MtMode>::iterator, bool>
 radix_tree<Key, Value, BytesView, MtMode>::internal_emplace(const K &k,
 							    F &&make_leaf)
 {
+	check_writable();
+
 	auto key = bytes_view(k);
 	auto pop = pool_base(pmemobj_pool_by_ptr(this));
 
@@ -1417,8 +2058,11 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_emplace(const K &k,
 	if (!n) {
 		assert(diff < (std::min)(leaf_key.size(), key.size()));
 
-		flat_transaction::run(pop,
-				      [&] { store(*slot, make_leaf(prev)); });
+		flat_transaction::run(pop, [&] {
+			slot = writable_slot(prev, slot);
+			store(*slot, make_leaf(prev));
+			update_subtree_sizes(prev, true);
+		});
 		return {iterator(get_leaf(load(*slot)), this), true};
 	}
 
@@ -1429,7 +2073,9 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_emplace(const K &k,
 			assert(!load(n->embedded_entry));
 
 			flat_transaction::run(pop, [&] {
+				n = cow(n);
 				store(n->embedded_entry, make_leaf(n));
+				update_subtree_sizes(n, true);
 			});
 
 			return {iterator(get_leaf(load(n->embedded_entry)),
@@ -1441,15 +2087,19 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_emplace(const K &k,
 		 * We have to allocate new internal node above n. */
 		pointer_type node;
 		flat_transaction::run(pop, [&] {
+			slot = writable_slot(prev, slot);
 			node = make_persistent<radix_tree::node>(
 				load(parent_ref(n)), diff, bitn_t(FIRST_NIB));
+			on_node_alloc(node);
 			store(node->embedded_entry, make_leaf(node));
 			store(node->child[slice_index(leaf_key[diff],
 						      bitn_t(FIRST_NIB))],
 			      n);
+			node->n_leaves = subtree_size(n);
 
 			store(parent_ref(n), node);
 			store(*slot, node);
+			update_subtree_sizes(node, true);
 		});
 
 		return {iterator(get_leaf(load(node->embedded_entry)), this),
@@ -1463,15 +2113,19 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_emplace(const K &k,
 		flat_transaction::run(pop, [&] {
 			/* We have to add new node at the edge from parent to n
 			 */
+			slot = writable_slot(prev, slot);
 			node = make_persistent<radix_tree::node>(
 				load(parent_ref(n)), diff, bitn_t(FIRST_NIB));
+			on_node_alloc(node);
 			store(node->embedded_entry, n);
 			store(node->child[slice_index(key[diff],
 						      bitn_t(FIRST_NIB))],
 			      make_leaf(node));
+			node->n_leaves = 1;
 
 			store(parent_ref(n), node);
 			store(*slot, node);
+			update_subtree_sizes(node, true);
 		});
 
 		return {iterator(get_leaf(load(node->child[slice_index(
@@ -1486,13 +2140,17 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_emplace(const K &k,
 	 * node. */
 	pointer_type node;
 	flat_transaction::run(pop, [&] {
+		slot = writable_slot(prev, slot);
 		node = make_persistent<radix_tree::node>(load(parent_ref(n)),
 							 diff, sh);
+		on_node_alloc(node);
 		store(node->child[slice_index(leaf_key[diff], sh)], n);
 		store(node->child[slice_index(key[diff], sh)], make_leaf(node));
+		node->n_leaves = subtree_size(n);
 
 		store(parent_ref(n), node);
 		store(*slot, node);
+		update_subtree_sizes(node, true);
 	});
 
 	return {iterator(
@@ -1986,6 +2644,136 @@ radix_tree<Key, Value, BytesView, MtMode>::find(const K &k) const
 	return const_iterator(internal_find(k), this);
 }
 
+/**
+ * Finds an element with key equivalent to key, without entering an ebr
+ * critical section. The element is protected by a hazard pointer of w, so it
+ * is not freed by garbage_collect() until w is used for another lookup or
+ * w.release_all() is called. The returned iterator must not be incremented
+ * nor decremented.
+ *
+ * Unlike an ebr critical section, a stalled reader blocks freeing of at most
+ * a few nodes. The lookup is restarted if it runs concurrently with
+ * garbage_collect().
+ *
+ * Can be called only if hazard pointers readers were enabled by
+ * runtime_initialize_mt().
+ *
+ * @param[in] k key value of the element to search for.
+ * @param[in] w worker returned by register_hazard_worker().
+ *
+ * @return Const iterator to an element with key equivalent to key. If no such
+ * element is found, past-the-end iterator is returned.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::find(const key_type &k,
+						hazard_worker_type &w) const
+{
+	return const_iterator(hazard_find(k, w), this);
+}
+
+/**
+ * Finds an element with key equivalent to key, without entering an ebr
+ * critical section, see find(const key_type &, hazard_worker_type &).
+ *
+ * This overload only participates in overload resolution if BytesView struct
+ * has a type member named is_transparent.
+ *
+ * @param[in] k key value of the element to search for.
+ * @param[in] w worker returned by register_hazard_worker().
+ *
+ * @return Const iterator to an element with key equivalent to key. If no such
+ * element is found, past-the-end iterator is returned.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K, typename>
+typename radix_tree<Key, Value, BytesView, MtMode>::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::find(const K &k,
+						hazard_worker_type &w) const
+{
+	return const_iterator(hazard_find(k, w), this);
+}
+
+/**
+ * Finds elements with keys equivalent to the keys in the range [first, last).
+ *
+ * Keys are processed in sorted order, so the path from the root which is
+ * shared by consecutive keys (determined by their common prefix) is
+ * traversed only once and each lookup continues from the deepest common
+ * node. It is much faster than separate find() calls for clustered keys
+ * (e.g. with the same prefix).
+ *
+ * In concurrent mode (MtMode == true) the whole function should be called
+ * inside a single critical section (worker_type::critical()), the same way
+ * as find().
+ *
+ * @param[in] first first iterator of the range of keys (key_type, or any
+ * type accepted by find()). Referenced keys must stay valid until the
+ * function returns.
+ * @param[in] last last iterator of the range of keys.
+ *
+ * @return Vector of iterators to the found elements, in order of the keys
+ * in the range. Past-the-end iterator is returned for every key which was
+ * not found.
+ *
+ * @throw std::bad_alloc if there is not enough memory for the results.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename ForwardIt>
+std::vector<typename radix_tree<Key, Value, BytesView, MtMode>::iterator>
+radix_tree<Key, Value, BytesView, MtMode>::find_many(ForwardIt first,
+						     ForwardIt last)
+{
+	auto leaves = internal_find_many(first, last);
+
+	std::vector<iterator> ret;
+	ret.reserve(leaves.size());
+	for (auto l : leaves)
+		ret.push_back(iterator(l, this));
+
+	return ret;
+}
+
+/**
+ * Finds elements with keys equivalent to the keys in the range [first, last).
+ *
+ * Keys are processed in sorted order, so the path from the root which is
+ * shared by consecutive keys (determined by their common prefix) is
+ * traversed only once and each lookup continues from the deepest common
+ * node. It is much faster than separate find() calls for clustered keys
+ * (e.g. with the same prefix).
+ *
+ * In concurrent mode (MtMode == true) the whole function should be called
+ * inside a single critical section (worker_type::critical()), the same way
+ * as find().
+ *
+ * @param[in] first first iterator of the range of keys (key_type, or any
+ * type accepted by find()). Referenced keys must stay valid until the
+ * function returns.
+ * @param[in] last last iterator of the range of keys.
+ *
+ * @return Vector of const iterators to the found elements, in order of the
+ * keys in the range. Past-the-end iterator is returned for every key which
+ * was not found.
+ *
+ * @throw std::bad_alloc if there is not enough memory for the results.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename ForwardIt>
+std::vector<typename radix_tree<Key, Value, BytesView, MtMode>::const_iterator>
+radix_tree<Key, Value, BytesView, MtMode>::find_many(ForwardIt first,
+						     ForwardIt last) const
+{
+	auto leaves = internal_find_many(first, last);
+
+	std::vector<const_iterator> ret;
+	ret.reserve(leaves.size());
+	for (auto l : leaves)
+		ret.push_back(const_iterator(l, this));
+
+	return ret;
+}
+
 template <typename Key, typename Value, typename BytesView, bool MtMode>
 template <typename K>
 typename radix_tree<Key, Value, BytesView, MtMode>::leaf *
@@ -2012,53 +2800,400 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_find(const K &k) const
 	return get_leaf(n);
 }
 
-/**
- * Erases all elements from the container transactionally.
- *
- * @post size() == 0
- *
- * @throw pmem::transaction_error when snapshotting failed.
+/*
+ * Loads a pointer from src and protects it in the given slot of w. Returns
+ * false if garbage collection started after the lookup (seq). The node
+ * holding src might have been unlinked by then and its children freed, so
+ * the lookup has to be restarted. Otherwise, n can be accessed until the
+ * slot is reused.
  */
 template <typename Key, typename Value, typename BytesView, bool MtMode>
-void
-radix_tree<Key, Value, BytesView, MtMode>::clear()
+bool
+radix_tree<Key, Value, BytesView, MtMode>::hazard_protect(
+	hazard_worker_type &w, const atomic_pointer_type &src, size_t slot,
+	uint64_t seq, pointer_type &n) const
 {
-	if (size() != 0)
-		erase(begin(), end());
+	n = w.protect(src, slot);
+
+	return hazards()->collections.load() == seq;
 }
 
-/**
- * Removes the element at pos from the container.
- * References and iterators to the erased elements are invalidated.
- * Other references and iterators are not affected.
- *
- * @pre The iterator pos must be valid and dereferenceable. Thus the
- * end() iterator (which is valid, but is not dereferenceable) cannot be
- * used as a value for pos.
- *
- * @param[in] pos iterator to the element to remove.
- *
- * @return iterator following the removed element.
- *
- * @throw pmem::transaction_error when snapshotting failed.
+/*
+ * Finds the smallest leaf in the subtree of n, which is protected in the
+ * given slot, skipping the embedded entries of nodes above min_depth (see
+ * any_leftmost_leaf()). The nodes below n are protected in slots 0 and 1,
+ * slot is set to the one which protects the result. Returns false if the
+ * lookup has to be restarted, result is nullptr if the subtree was emptied
+ * concurrently.
  */
 template <typename Key, typename Value, typename BytesView, bool MtMode>
-typename radix_tree<Key, Value, BytesView, MtMode>::iterator
-radix_tree<Key, Value, BytesView, MtMode>::erase(const_iterator pos)
+bool
+radix_tree<Key, Value, BytesView, MtMode>::hazard_leftmost_leaf(
+	hazard_worker_type &w, pointer_type n, size_t &slot, uint64_t seq,
+	size_type min_depth, const leaf *&result) const
 {
-	auto pop = pool_base(pmemobj_pool_by_ptr(this));
+	while (!is_leaf(n)) {
+		size_t next = slot == 0 ? 1 : 0;
+		pointer_type child = nullptr;
 
-	flat_transaction::run(pop, [&] {
-		auto *leaf = pos.leaf_;
-		auto parent = load(leaf->parent);
+		for (auto it = n->template begin<node::direction::Forward>();
+		     it != n->template end<node::direction::Forward>(); ++it) {
+			if (&*it == &n->embedded_entry && n->byte < min_depth)
+				continue;
 
-		/* there are more elements in the container */
-		if (parent)
-			++pos;
+			if (!hazard_protect(w, *it, next, seq, child))
+				return false;
 
-		free(persistent_ptr<radix_tree::leaf>(leaf));
+			if (child)
+				break;
+		}
 
-		size_--;
+		if (!child) {
+			result = nullptr;
+			return true;
+		}
+
+		n = child;
+		slot = next;
+	}
+
+	result = get_leaf(n);
+	return true;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K>
+const typename radix_tree<Key, Value, BytesView, MtMode>::leaf *
+radix_tree<Key, Value, BytesView, MtMode>::hazard_find(
+	const K &k, hazard_worker_type &w) const
+{
+	static_assert(MtMode, "Hazard pointers are supported only in MtMode.");
+
+	/* Nothing is freed in a read-only pool. */
+	if (is_read_only())
+		return internal_find(k);
+
+	assert(hazards());
+
+	auto key = bytes_view(k);
+
+	while (true) {
+		auto seq = hazards()->collections.load();
+
+		size_t slot = 0;
+		pointer_type n;
+		bool valid = hazard_protect(w, root, slot, seq, n);
+
+		while (valid && n && !is_leaf(n)) {
+			const atomic_pointer_type *next;
+			if (path_length_equal(key.size(), n))
+				next = &n->embedded_entry;
+			else if (n->byte >= key.size())
+				break;
+			else
+				next = &n->child[slice_index(key[n->byte],
+							     n->bit)];
+
+			slot = slot == 0 ? 1 : 0;
+			valid = hazard_protect(w, *next, slot, seq, n);
+		}
+
+		if (!valid)
+			continue;
+
+		/* the parent is not accessed anymore */
+		w.release(slot == 0 ? 1 : 0);
+
+		if (!n || !is_leaf(n) ||
+		    !keys_equal(key, bytes_view(get_leaf(n)->key()))) {
+			w.release(slot);
+			return nullptr;
+		}
+
+		return get_leaf(n);
+	}
+}
+
+/*
+ * Top-down version of internal_bound<true>(), which does not follow the
+ * parent pointers, so it needs only HAZARD_SLOTS nodes to be protected at
+ * a time. Instead of looking for the next leaf after the point of divergence,
+ * it remembers the closest subtree on the right of the path.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K>
+const typename radix_tree<Key, Value, BytesView, MtMode>::leaf *
+radix_tree<Key, Value, BytesView, MtMode>::hazard_lower_bound(
+	const K &k, hazard_worker_type &w) const
+{
+	static_assert(MtMode, "Hazard pointers are supported only in MtMode.");
+
+	/* Nothing is freed in a read-only pool. */
+	if (is_read_only())
+		return internal_bound<true>(k).leaf_;
+
+	assert(hazards());
+
+	auto key = bytes_view(k);
+
+	while (true) {
+		auto seq = hazards()->collections.load();
+
+		/* Find a leaf which shares the longest common prefix with
+		 * the key, to learn the labels of the compressed paths. */
+		size_t slot = 0;
+		pointer_type n;
+		if (!hazard_protect(w, root, slot, seq, n))
+			continue;
+
+		if (!n) {
+			w.release_all();
+			return nullptr;
+		}
+
+		bool valid = true;
+		while (!is_leaf(n) && n->byte < key.size()) {
+			size_t next = slot == 0 ? 1 : 0;
+			pointer_type nn;
+			valid = hazard_protect(
+				w, n->child[slice_index(key[n->byte], n->bit)],
+				next, seq, nn);
+			if (!valid || !nn)
+				break;
+
+			n = nn;
+			slot = next;
+		}
+
+		const leaf *l = nullptr;
+		if (!valid ||
+		    !hazard_leftmost_leaf(w, n, slot, seq, key.size(), l) ||
+		    !l)
+			continue;
+
+		auto leaf_key = bytes_view(l->key());
+		auto diff = prefix_diff(key, leaf_key);
+		auto sh = bit_diff(leaf_key, key, diff);
+
+		/* Key exists. */
+		if (diff == key.size() && leaf_key.size() == key.size()) {
+			for (size_t i = 0; i < HAZARD_SLOTS; i++) {
+				if (i != slot)
+					w.release(i);
+			}
+
+			return l;
+		}
+
+		/* Descend again, to the point of divergence. */
+		pointer_type successor = nullptr;
+		slot = 0;
+		if (!hazard_protect(w, root, slot, seq, n))
+			continue;
+
+		while (n && !is_leaf(n) &&
+		       (n->byte < diff || (n->byte == diff && n->bit >= sh))) {
+			auto idx = slice_index(key[n->byte], n->bit);
+
+			/* Keys in the subtrees on the right of the path are
+			 * bigger than the key, the closest one is kept. */
+			for (auto i = idx + 1; i < SLNODES; i++) {
+				if (!load(n->child[i]))
+					continue;
+
+				valid = hazard_protect(w, n->child[i], 2, seq,
+						       successor) &&
+					successor;
+				break;
+			}
+
+			size_t next = slot == 0 ? 1 : 0;
+			if (!valid ||
+			    !hazard_protect(w, n->child[idx], next, seq, n)) {
+				valid = false;
+				break;
+			}
+
+			slot = next;
+		}
+
+		if (!valid)
+			continue;
+
+		/* n is the point of divergence. Keys in its subtree are either
+		 * all bigger or all smaller than the key, see
+		 * internal_bound(). */
+		bool smaller = !n || diff == leaf_key.size() ||
+			(diff != key.size() &&
+			 static_cast<unsigned char>(key[diff]) >
+				 static_cast<unsigned char>(leaf_key[diff]));
+
+		const leaf *result = nullptr;
+		if (smaller && !successor) {
+			w.release_all();
+			return nullptr;
+		} else if (smaller) {
+			slot = 2;
+			valid = hazard_leftmost_leaf(w, successor, slot, seq,
+						     0, result);
+		} else {
+			valid = hazard_leftmost_leaf(w, n, slot, seq, 0,
+						     result);
+		}
+
+		/* the tree was modified concurrently */
+		if (!valid || !result ||
+		    compare(bytes_view(result->key()), key) < 0)
+			continue;
+
+		for (size_t i = 0; i < HAZARD_SLOTS; i++) {
+			if (i != slot)
+				w.release(i);
+		}
+
+		return result;
+	}
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::hazard_data *
+radix_tree<Key, Value, BytesView, MtMode>::hazards() const
+{
+	return runtime_ ? runtime_->snapshots.hazards.get() : nullptr;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::ebr *
+radix_tree<Key, Value, BytesView, MtMode>::get_ebr() const noexcept
+{
+	return runtime_ ? runtime_->reclamation.get() : nullptr;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::snapshot_data *
+radix_tree<Key, Value, BytesView, MtMode>::get_snapshots() const noexcept
+{
+	return runtime_ ? &runtime_->snapshots : nullptr;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename ForwardIt>
+std::vector<typename radix_tree<Key, Value, BytesView, MtMode>::leaf *>
+radix_tree<Key, Value, BytesView, MtMode>::internal_find_many(
+	ForwardIt first, ForwardIt last) const
+{
+	using key_view_type = decltype(bytes_view(*first));
+
+	std::vector<key_view_type> keys;
+	for (; first != last; ++first)
+		keys.push_back(bytes_view(*first));
+
+	std::vector<size_t> order(keys.size());
+	for (size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+
+	std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+		return compare(keys[lhs], keys[rhs]) < 0;
+	});
+
+	std::vector<leaf *> ret(keys.size(), nullptr);
+
+	/* Nodes on the path from the root to the previous key. Each node
+	 * (except the first one) was reached by the decision of the previous
+	 * node, made on byte path[i - 1]->byte of the key. */
+	std::vector<pointer_type> path;
+	path.reserve(PATH_INIT_CAP);
+	path.push_back(load(root));
+
+	const key_view_type *prev_key = nullptr;
+	for (auto i : order) {
+		const auto &key = keys[i];
+
+		/* Keep only the nodes reached by decisions on bytes shared with
+		 * the previous key. */
+		if (prev_key) {
+			auto diff = prefix_diff(*prev_key, key);
+			size_t depth = 1;
+			while (depth < path.size() &&
+			       path[depth - 1]->byte < diff)
+				++depth;
+
+			path.resize(depth);
+		}
+		prev_key = &key;
+
+		auto n = path.back();
+		while (n && !is_leaf(n)) {
+			if (path_length_equal(key.size(), n))
+				n = load(n->embedded_entry);
+			else if (n->byte >= key.size())
+				break;
+			else
+				n = load(n->child[slice_index(key[n->byte],
+							      n->bit)]);
+
+			path.push_back(n);
+		}
+
+		if (n && is_leaf(n) &&
+		    keys_equal(key, bytes_view(get_leaf(n)->key())))
+			ret[i] = get_leaf(n);
+	}
+
+	return ret;
+}
+
+/**
+ * Erases all elements from the container transactionally.
+ *
+ * @post size() == 0
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::clear()
+{
+	if (size() != 0)
+		erase(begin(), end());
+}
+
+/**
+ * Removes the element at pos from the container.
+ * References and iterators to the erased elements are invalidated.
+ * Other references and iterators are not affected.
+ *
+ * @pre The iterator pos must be valid and dereferenceable. Thus the
+ * end() iterator (which is valid, but is not dereferenceable) cannot be
+ * used as a value for pos.
+ *
+ * @param[in] pos iterator to the element to remove.
+ *
+ * @return iterator following the removed element.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::iterator
+radix_tree<Key, Value, BytesView, MtMode>::erase(const_iterator pos)
+{
+	check_writable();
+
+	auto pop = pool_base(pmemobj_pool_by_ptr(this));
+
+	flat_transaction::run(pop, [&] {
+		auto *leaf = pos.leaf_;
+		auto parent = load(leaf->parent);
+
+		/* there are more elements in the container */
+		if (parent) {
+			++pos;
+			parent = cow(parent);
+		}
+
+		free(persistent_ptr<radix_tree::leaf>(leaf));
+
+		size_--;
 
 		/* was root */
 		if (!parent) {
@@ -2071,6 +3206,7 @@ radix_tree<Key, Value, BytesView, MtMode>::erase(const_iterator pos)
 		store(const_cast<atomic_pointer_type &>(
 			      *parent->find_child(leaf)),
 		      nullptr);
+		update_subtree_sizes(parent, false);
 
 		/* Compress the tree vertically. */
 		auto n = parent;
@@ -2127,6 +3263,8 @@ typename radix_tree<Key, Value, BytesView, MtMode>::iterator
 radix_tree<Key, Value, BytesView, MtMode>::erase(const_iterator first,
 						 const_iterator last)
 {
+	check_writable();
+
 	auto pop = pool_base(pmemobj_pool_by_ptr(this));
 
 	flat_transaction::run(pop, [&] {
@@ -2202,10 +3340,17 @@ template <typename T>
 void
 radix_tree<Key, Value, BytesView, MtMode>::free(persistent_ptr<T> ptr)
 {
-	if (MtMode && ebr_ != nullptr)
-		garbages[ebr_->staging_epoch()].emplace_back(ptr);
-	else
+	if (MtMode && runtime_ != nullptr) {
+		garbages.retire(*get_ebr(), ptr);
+
+		auto &snapshots = runtime_->snapshots;
+
+		/* a fresh node is not reachable from any snapshot */
+		if (!snapshots.fresh.erase(ptr.get()) && snapshots_alive())
+			snapshots.held[ptr.get()] = snapshots.taken;
+	} else {
 		delete_persistent<T>(ptr);
+	}
 }
 
 /**
@@ -2265,6 +3410,10 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_bound(const K &k) const
 	auto key = bytes_view(k);
 	auto pop = pool_base(pmemobj_pool_by_ptr(this));
 
+	/* A tree in a read-only pool cannot change, so the result does not
+	 * have to be validated. */
+	const bool read_only = MtMode && is_read_only();
+
 	path_type path;
 	const_iterator result;
 
@@ -2283,7 +3432,7 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_bound(const K &k) const
 		 */
 		auto ret = descend(r, key);
 		auto leaf = ret.first;
-		path = ret.second;
+		path = std::move(ret.second);
 
 		if (!leaf)
 			continue;
@@ -2443,7 +3592,7 @@ radix_tree<Key, Value, BytesView, MtMode>::internal_bound(const K &k) const
 
 		/* If some node on the path was modified, the calculated result
 		 * might not be correct. */
-		if (validate_path(path))
+		if (read_only || validate_path(path))
 			break;
 	}
 
@@ -2532,6 +3681,52 @@ radix_tree<Key, Value, BytesView, MtMode>::lower_bound(const K &k) const
 	return internal_bound<true>(k);
 }
 
+/**
+ * Returns an iterator pointing to the first element that is not less
+ * than (i.e. greater or equal to) key, without entering an ebr critical
+ * section. The element is protected by a hazard pointer of w, see
+ * find(const key_type &, hazard_worker_type &). The returned iterator must
+ * not be incremented nor decremented.
+ *
+ * @param[in] k key value to compare the elements to.
+ * @param[in] w worker returned by register_hazard_worker().
+ *
+ * @return Const iterator pointing to the first element that is not less than
+ * key. If no such element is found, a past-the-end iterator is
+ * returned.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::lower_bound(
+	const key_type &k, hazard_worker_type &w) const
+{
+	return const_iterator(hazard_lower_bound(k, w), this);
+}
+
+/**
+ * Returns an iterator pointing to the first element that is not less
+ * than (i.e. greater or equal to) key, without entering an ebr critical
+ * section, see lower_bound(const key_type &, hazard_worker_type &).
+ *
+ * This overload only participates in overload resolution if BytesView struct
+ * has a type member named is_transparent.
+ *
+ * @param[in] k key value to compare the elements to.
+ * @param[in] w worker returned by register_hazard_worker().
+ *
+ * @return Const iterator pointing to the first element that is not less than
+ * key. If no such element is found, a past-the-end iterator is
+ * returned.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K, typename>
+typename radix_tree<Key, Value, BytesView, MtMode>::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::lower_bound(
+	const K &k, hazard_worker_type &w) const
+{
+	return const_iterator(hazard_lower_bound(k, w), this);
+}
+
 /**
  * Returns an iterator pointing to the first element that is greater
  * than key.
@@ -2612,6 +3807,260 @@ radix_tree<Key, Value, BytesView, MtMode>::upper_bound(const K &k) const
 	return internal_bound<false>(k);
 }
 
+/**
+ * Returns the number of elements in the range [first, last).
+ *
+ * If order statistics are enabled, the complexity is proportional to the
+ * depth of the tree. Otherwise, the range is iterated over.
+ *
+ * @param[in] first iterator to the first element of the range.
+ * @param[in] last iterator following the last element of the range.
+ *
+ * @return number of elements in the range.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::size_type
+radix_tree<Key, Value, BytesView, MtMode>::count(const_iterator first,
+						 const_iterator last) const
+{
+	if (!order_statistics_enabled())
+		return static_cast<size_type>(std::distance(first, last));
+
+	return position(last.leaf_) - position(first.leaf_);
+}
+
+/**
+ * Returns the number of elements with key that compares less than the
+ * specified argument, that is the position of lower_bound(k).
+ *
+ * If order statistics are enabled, the complexity is proportional to the
+ * depth of the tree. Otherwise, the elements are iterated over.
+ *
+ * @param[in] k key value to compare the elements to.
+ *
+ * @return number of elements less than k.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::size_type
+radix_tree<Key, Value, BytesView, MtMode>::rank(const key_type &k) const
+{
+	return count(begin(), lower_bound(k));
+}
+
+/**
+ * Returns the number of elements with key that compares less than the
+ * specified argument, that is the position of lower_bound(k).
+ *
+ * This overload only participates in overload resolution if BytesView struct
+ * has a type member named is_transparent.
+ *
+ * @param[in] k key value to compare the elements to.
+ *
+ * @return number of elements less than k.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K, typename>
+typename radix_tree<Key, Value, BytesView, MtMode>::size_type
+radix_tree<Key, Value, BytesView, MtMode>::rank(const K &k) const
+{
+	return count(begin(), lower_bound(k));
+}
+
+/**
+ * Returns an iterator to the element at the specified position (in the
+ * container's order).
+ *
+ * If order statistics are enabled, the complexity is proportional to the
+ * depth of the tree. Otherwise, the elements are iterated over.
+ *
+ * @param[in] i zero-based position of the element.
+ *
+ * @return Iterator to the i-th element or end() if i >= size().
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::iterator
+radix_tree<Key, Value, BytesView, MtMode>::select(size_type i)
+{
+	auto it = const_cast<const radix_tree *>(this)->select(i);
+	return iterator(const_cast<typename iterator::leaf_ptr>(it.leaf_),
+			this);
+}
+
+/**
+ * Returns a const iterator to the element at the specified position (in the
+ * container's order).
+ *
+ * If order statistics are enabled, the complexity is proportional to the
+ * depth of the tree. Otherwise, the elements are iterated over.
+ *
+ * @param[in] i zero-based position of the element.
+ *
+ * @return Const iterator to the i-th element or end() if i >= size().
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::select(size_type i) const
+{
+	if (i >= size())
+		return end();
+
+	if (order_statistics_enabled())
+		return const_iterator(internal_select(i), this);
+
+	auto it = begin();
+	std::advance(it, static_cast<difference_type>(i));
+
+	return it;
+}
+
+/**
+ * Starts maintaining the number of elements in every subtree, which makes
+ * count(first, last), rank() and select() independent of the number of
+ * elements. The counts are calculated for the existing elements in a single
+ * transaction. Does nothing if order statistics are already enabled.
+ *
+ * The setting is persistent. In MtMode, this method must not be called
+ * concurrently with the writer.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::enable_order_statistics()
+{
+	if (order_statistics_enabled())
+		return;
+
+	auto pop = pool_by_vptr(this);
+
+	flat_transaction::run(pop, [&] {
+		init_subtree_sizes(load(root));
+		size_ = size_ | ORDER_STATS_FLAG;
+	});
+}
+
+/**
+ * Stops maintaining the number of elements in every subtree.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::disable_order_statistics()
+{
+	auto pop = pool_by_vptr(this);
+
+	flat_transaction::run(pop,
+			      [&] { size_ = size_ & ~ORDER_STATS_FLAG; });
+}
+
+/**
+ * @return true if the number of elements in every subtree is maintained,
+ * false otherwise.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+bool
+radix_tree<Key, Value, BytesView, MtMode>::order_statistics_enabled() const
+	noexcept
+{
+	return (size_ & ORDER_STATS_FLAG) != 0;
+}
+
+/**
+ * Sets additional capacity, in percent of the value size, which is reserved
+ * when a basic_inline_string value is reallocated by assign_val. Reserved
+ * capacity allows the value to grow (or, in MtMode, to be appended to)
+ * in place. Zero (default) means no additional capacity.
+ *
+ * The setting is persistent and does not affect existing elements.
+ *
+ * @param[in] percent additional capacity in percent of the value size,
+ * at most 32767.
+ *
+ * @throw std::invalid_argument if percent is too big.
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::set_value_slack(uint32_t percent)
+{
+	if (percent > VALUE_SLACK_MAX)
+		throw std::invalid_argument("value slack is too big");
+
+	auto pop = pool_by_vptr(this);
+
+	flat_transaction::run(pop, [&] {
+		size_ = (size_ & ~VALUE_SLACK_MASK) |
+			(uint64_t(percent) << VALUE_SLACK_SHIFT);
+	});
+}
+
+/**
+ * @return additional capacity, in percent of the value size, reserved when a
+ * value is reallocated.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+uint32_t
+radix_tree<Key, Value, BytesView, MtMode>::value_slack() const noexcept
+{
+	return static_cast<uint32_t>((size_ & VALUE_SLACK_MASK) >>
+				     VALUE_SLACK_SHIFT);
+}
+
+/*
+ * Returns the number of elements preceding leaf @param l (or size() if l is
+ * null) by summing sizes of the subtrees on the left side of the path from
+ * the root. Requires order statistics to be enabled.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::size_type
+radix_tree<Key, Value, BytesView, MtMode>::position(const leaf *l) const
+{
+	if (!l)
+		return size();
+
+	size_type ret = 0;
+	pointer_type n =
+		persistent_ptr<radix_tree::leaf>(const_cast<leaf *>(l));
+
+	for (auto parent = load(l->parent); parent;
+	     n = parent, parent = load(parent->parent)) {
+		auto child = parent->find_child(n);
+		for (auto it = parent->begin(); it != child; ++it)
+			ret += subtree_size(load(*it));
+	}
+
+	return ret;
+}
+
+/*
+ * Returns the leaf at position @param i by descending into the subtree which
+ * contains it. Requires order statistics to be enabled and i < size().
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+const typename radix_tree<Key, Value, BytesView, MtMode>::leaf *
+radix_tree<Key, Value, BytesView, MtMode>::internal_select(size_type i) const
+{
+	assert(i < size());
+
+	auto n = load(root);
+	while (!is_leaf(n)) {
+		for (auto it = n->begin(); it != n->end(); ++it) {
+			auto child = load(*it);
+			auto child_size = subtree_size(child);
+			if (i < child_size) {
+				n = child;
+				break;
+			}
+			i -= child_size;
+		}
+	}
+
+	assert(i == 0);
+
+	return get_leaf(n);
+}
+
 /**
  * Returns an iterator to the first element of the container.
  * If the map is empty, the returned iterator will be equal to end().
@@ -2885,7 +4334,7 @@ radix_tree<Key, Value, BytesView, MtMode>::node::forward_iterator::operator++()
 template <typename Key, typename Value, typename BytesView, bool MtMode>
 radix_tree<Key, Value, BytesView, MtMode>::node::node(pointer_type parent,
 						      byten_t byte, bitn_t bit)
-    : parent(parent), byte(byte), bit(bit)
+    : parent(parent), byte(byte), bit(bit), n_leaves(0)
 {
 }
 
@@ -3074,7 +4523,12 @@ typename radix_tree<Key, Value, BytesView,
 /**
  * Handles assignment to the value. If there is enough capacity
  * old content is overwritten (with a help of undo log). Otherwise
- * a new leaf is allocated and the old one is freed.
+ * a new leaf is allocated and the old one is freed. The new value gets
+ * additional capacity according to value_slack().
+ *
+ * In MtMode, the content is modified in place only if rhs extends the old
+ * value and fits in the capacity. The new characters are written first and
+ * then the size is published, so concurrent readers never see partial data.
  *
  * If reallocation happens, all other iterators to this element are invalidated.
  *
@@ -3094,40 +4548,55 @@ radix_tree<Key, Value, BytesView, MtMode>::radix_tree_iterator<
 	assert(leaf_);
 	assert(tree);
 
-	auto pop = pool_base(pmemobj_pool_by_ptr(leaf_));
+	/* The value may be appended to outside of a transaction. */
+	tree->check_writable();
 
-	if (rhs.size() <= leaf_->value().capacity() && !MtMode) {
-		flat_transaction::run(pop, [&] { leaf_->value() = rhs; });
-	} else {
+	auto pop = pool_base(pmemobj_pool_by_ptr(leaf_));
+	auto &value = leaf_->value();
+
+	if (rhs.size() <= value.capacity() && !MtMode) {
+		flat_transaction::run(pop, [&] { value = rhs; });
+	} else if (rhs.size() <= value.capacity() &&
+		   rhs.size() > value.size() && !tree->snapshots_alive() &&
+		   rhs.substr(0, value.size()).compare(value) == 0) {
+		/* Readers see either the old or the appended value. */
+		value.append(rhs.substr(value.size()));
+	} else if (tree->value_slack() == 0) {
 		replace_val(rhs);
+	} else {
+		auto percent = tree->value_slack();
+		auto slack = rhs.size() / 100 * percent +
+			rhs.size() % 100 * percent / 100;
+		replace_val(rhs, rhs.size() + slack);
 	}
 }
 
 template <typename Key, typename Value, typename BytesView, bool MtMode>
 template <bool IsConst>
-template <typename T>
+template <typename... Args>
 void
 radix_tree<Key, Value, BytesView,
-	   MtMode>::radix_tree_iterator<IsConst>::replace_val(T &&rhs)
+	   MtMode>::radix_tree_iterator<IsConst>::replace_val(Args &&... args)
 {
 	auto pop = pool_base(pmemobj_pool_by_ptr(leaf_));
 	atomic_pointer_type *slot;
 
-	if (!load(leaf_->parent)) {
-		assert(get_leaf(load(tree->root)) == leaf_);
-		slot = &tree->root;
-	} else {
-		slot = const_cast<atomic_pointer_type *>(
-			&*load(leaf_->parent)->find_child(leaf_));
-	}
-
 	auto old_leaf = leaf_;
 
 	flat_transaction::run(pop, [&] {
+		auto parent = tree->cow(load(old_leaf->parent));
+
+		if (!parent) {
+			assert(get_leaf(load(tree->root)) == old_leaf);
+			slot = &tree->root;
+		} else {
+			slot = const_cast<atomic_pointer_type *>(
+				&*parent->find_child(old_leaf));
+		}
+
 		store(*slot,
-		      leaf::make_key_args(load(old_leaf->parent),
-					  old_leaf->key(),
-					  std::forward<T>(rhs)));
+		      leaf::make_key_args(parent, old_leaf->key(),
+					  std::forward<Args>(args)...));
 		tree->free(persistent_ptr<radix_tree::leaf>(old_leaf));
 	});
 
@@ -3148,7 +4617,7 @@ void
 radix_tree<Key, Value, BytesView,
 	   MtMode>::radix_tree_iterator<IsConst>::assign_val(T &&rhs)
 {
-	if (MtMode && tree->ebr_ != nullptr)
+	if (MtMode && tree->get_ebr() != nullptr)
 		replace_val(std::forward<T>(rhs));
 	else {
 		auto pop = pool_base(pmemobj_pool_by_ptr(leaf_));
@@ -3410,6 +4879,352 @@ radix_tree<Key, Value, BytesView, MtMode>::find_leaf(
 	return nullptr;
 }
 
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::
+	radix_tree_snapshot(snapshot_data *data, uint64_t seq,
+			    pointer_type root, uint64_t size)
+    : data(data), seq(seq), root(root), size_(size)
+{
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::
+	radix_tree_snapshot(radix_tree_snapshot &&other) noexcept
+    : data(other.data), seq(other.seq), root(other.root), size_(other.size_)
+{
+	other.data = nullptr;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot &
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::operator=(
+	radix_tree_snapshot &&other) noexcept
+{
+	if (this != &other) {
+		release();
+
+		data = other.data;
+		seq = other.seq;
+		root = other.root;
+		size_ = other.size_;
+
+		other.data = nullptr;
+	}
+
+	return *this;
+}
+
+/**
+ * Destructor. Releases the snapshot.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::
+	~radix_tree_snapshot()
+{
+	release();
+}
+
+/**
+ * Releases the snapshot. Memory held by the snapshot is reclaimed by
+ * garbage_collect() or garbage_collect_force() after all snapshots taken
+ * before it are released as well.
+ *
+ * After this call the snapshot is empty.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::release()
+	noexcept
+{
+	if (data) {
+		{
+			std::lock_guard<std::mutex> lock(data->mtx);
+			data->alive.erase(data->alive.find(seq));
+		}
+		data->count.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	data = nullptr;
+	root = nullptr;
+	size_ = 0;
+}
+
+/**
+ * @return number of elements in the tree at the moment the snapshot was
+ * taken.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+uint64_t
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::size() const
+	noexcept
+{
+	return size_;
+}
+
+/**
+ * Checks whether the snapshot is empty.
+ *
+ * @return true if snapshot is empty, false otherwise.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+bool
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::empty() const
+	noexcept
+{
+	return size_ == 0;
+}
+
+/**
+ * Returns a const iterator to the first element of the snapshot.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView,
+		    MtMode>::radix_tree_snapshot::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::begin() const
+{
+	const_iterator it;
+
+	if (!root)
+		return it;
+
+	if (is_leaf(root)) {
+		it.leaf_ = get_leaf(root);
+		return it;
+	}
+
+	it.path.reserve(PATH_INIT_CAP);
+	it.path.push_back({get_node(root), 0});
+	it.find_next();
+
+	return it;
+}
+
+/**
+ * Returns a const iterator to the element following the last element of the
+ * snapshot.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView,
+		    MtMode>::radix_tree_snapshot::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::end() const
+{
+	return const_iterator();
+}
+
+/**
+ * Finds an element with key equivalent to key.
+ *
+ * @param[in] k key value of the element to search for.
+ *
+ * @return Const iterator to an element with key equivalent to key. If no
+ * such element is found, past-the-end iterator is returned.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView,
+		    MtMode>::radix_tree_snapshot::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::find(
+	const key_type &k) const
+{
+	const_iterator it;
+	it.seek(root, k);
+
+	return it;
+}
+
+/**
+ * Finds an element with key equivalent to key.
+ *
+ * This overload only participates in overload resolution if BytesView struct
+ * has a type member named is_transparent.
+ *
+ * @param[in] k key value of the element to search for.
+ *
+ * @return Const iterator to an element with key equivalent to key. If no
+ * such element is found, past-the-end iterator is returned.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K, typename>
+typename radix_tree<Key, Value, BytesView,
+		    MtMode>::radix_tree_snapshot::const_iterator
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::find(
+	const K &k) const
+{
+	const_iterator it;
+	it.seek(root, k);
+
+	return it;
+}
+
+/**
+ * Returns the number of elements with key that compares equivalent to
+ * the specified argument.
+ *
+ * @param[in] k key value of the element to count.
+ *
+ * @return Number of elements with key that compares equivalent to the
+ * specified argument.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView, MtMode>::size_type
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::count(
+	const key_type &k) const
+{
+	return find(k) != end() ? 1 : 0;
+}
+
+/**
+ * Returns the number of elements with key that compares equivalent to
+ * the specified argument.
+ *
+ * This overload only participates in overload resolution if BytesView struct
+ * has a type member named is_transparent.
+ *
+ * @param[in] k key value of the element to count.
+ *
+ * @return Number of elements with key that compares equivalent to the
+ * specified argument.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K, typename>
+typename radix_tree<Key, Value, BytesView, MtMode>::size_type
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::count(
+	const K &k) const
+{
+	return find(k) != end() ? 1 : 0;
+}
+
+/*
+ * Moves the iterator to the next leaf, using the path from the root of the
+ * snapshot. Sets leaf_ to nullptr if there are no more leaves.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView,
+	   MtMode>::radix_tree_snapshot::const_iterator::find_next()
+{
+	leaf_ = nullptr;
+
+	while (!path.empty()) {
+		auto &f = path.back();
+
+		if (f.idx > SLNODES) {
+			path.pop_back();
+			continue;
+		}
+
+		auto n = f.idx == 0 ? load(f.n->embedded_entry)
+				    : load(f.n->child[f.idx - 1]);
+		f.idx++;
+
+		if (!n)
+			continue;
+
+		if (is_leaf(n)) {
+			leaf_ = get_leaf(n);
+			return;
+		}
+
+		path.push_back({get_node(n), 0});
+	}
+}
+
+/*
+ * Descends from @param root to the leaf with key equivalent to @param k,
+ * recording the path. Sets leaf_ to nullptr if there is no such leaf.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+template <typename K>
+void
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::
+	const_iterator::seek(pointer_type root, const K &k)
+{
+	auto key = bytes_view(k);
+
+	path.clear();
+	leaf_ = nullptr;
+
+	auto n = root;
+	while (n && !is_leaf(n)) {
+		if (path_length_equal(key.size(), n)) {
+			path.push_back({get_node(n), 1});
+			n = load(n->embedded_entry);
+		} else if (n->byte >= key.size()) {
+			n = nullptr;
+		} else {
+			auto idx = slice_index(key[n->byte], n->bit);
+			path.push_back({get_node(n), idx + 2});
+			n = load(n->child[idx]);
+		}
+	}
+
+	if (n && keys_equal(key, bytes_view(get_leaf(n)->key())))
+		leaf_ = get_leaf(n);
+	else
+		path.clear();
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView,
+		    MtMode>::radix_tree_snapshot::const_iterator::reference
+	radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::
+		const_iterator::operator*() const
+{
+	assert(leaf_);
+
+	return *leaf_;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView,
+		    MtMode>::radix_tree_snapshot::const_iterator::pointer
+	radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::
+		const_iterator::operator->() const
+{
+	assert(leaf_);
+
+	return leaf_;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView,
+		    MtMode>::radix_tree_snapshot::const_iterator &
+radix_tree<Key, Value, BytesView,
+	   MtMode>::radix_tree_snapshot::const_iterator::operator++()
+{
+	assert(leaf_);
+
+	find_next();
+
+	return *this;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+typename radix_tree<Key, Value, BytesView,
+		    MtMode>::radix_tree_snapshot::const_iterator
+radix_tree<Key, Value, BytesView,
+	   MtMode>::radix_tree_snapshot::const_iterator::operator++(int)
+{
+	auto tmp = *this;
+	operator++();
+	return tmp;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+bool
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::
+	const_iterator::operator==(const const_iterator &rhs) const
+{
+	return leaf_ == rhs.leaf_;
+}
+
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+bool
+radix_tree<Key, Value, BytesView, MtMode>::radix_tree_snapshot::
+	const_iterator::operator!=(const const_iterator &rhs) const
+{
+	return !(*this == rhs);
+}
+
 template <typename Key, typename Value, typename BytesView, bool MtMode>
 Key &
 radix_tree<Key, Value, BytesView, MtMode>::leaf::key()
@@ -3621,6 +5436,34 @@ radix_tree<Key, Value, BytesView, MtMode>::check_tx_stage_work()
 			"Function called out of transaction scope.");
 }
 
+/**
+ * Private helper function. Checks if the tree resides in a pool opened with
+ * pool_base::open_read_only(). Such a tree cannot change, so lookups do not
+ * have to be protected nor validated.
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+bool
+radix_tree<Key, Value, BytesView, MtMode>::is_read_only() const noexcept
+{
+	return detail::in_read_only_pool(this);
+}
+
+/**
+ * Private helper function. Called by all modifying operations, before any
+ * node is accessed.
+ *
+ * @throw pmem::transaction_scope_error if the pool was opened with
+ * pool_base::open_read_only().
+ */
+template <typename Key, typename Value, typename BytesView, bool MtMode>
+void
+radix_tree<Key, Value, BytesView, MtMode>::check_writable() const
+{
+	if (is_read_only())
+		throw pmem::transaction_scope_error(
+			"Cannot modify radix_tree in a read-only pool");
+}
+
 template <typename Key, typename Value, typename BytesView, bool MtMode>
 bool
 radix_tree<Key, Value, BytesView, MtMode>::is_leaf(
@@ -0,0 +1,437 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Persistent pointer to an immutable object, updated using read-copy-update.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_RCU_PTR_HPP
+#define LIBPMEMOBJ_CPP_RCU_PTR_HPP
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/ebr.hpp>
+#include <libpmemobj++/detail/persistent_limbo.hpp>
+#include <libpmemobj++/experimental/atomic_self_relative_ptr.hpp>
+#include <libpmemobj++/experimental/self_relative_ptr.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pext.hpp>
+#include <libpmemobj++/transaction.hpp>
+#include <libpmemobj++/utils.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Persistent pointer to an immutable object of type T, which may be read
+ * concurrently with updates (read-copy-update).
+ *
+ * Readers access the current version of the object without any locks, inside
+ * an ebr critical section (see read()). Writers never modify the published
+ * version. Instead, they build a new version, publish it with a single atomic
+ * store and retire the old one, which is freed once no reader can access it.
+ * This makes rcu_ptr suitable for read-mostly data, e.g. configuration or
+ * routing tables, which would otherwise be protected by a shared_mutex.
+ *
+ * Updates are serialized by rcu_ptr. A new version is allocated and published
+ * in one transaction, together with recording the old version, so neither of
+ * them is leaked in case of a crash.
+ *
+ * rcu_ptr HAS TO be initialized with runtime_initialize() after each
+ * application restart, and runtime_finalize() has to be called before
+ * destroying it or closing the pool.
+ *
+ * @ingroup primitives
+ */
+template <typename T>
+class rcu_ptr {
+public:
+	using element_type = T;
+	using worker_type = detail::ebr::worker;
+
+	rcu_ptr();
+
+	rcu_ptr(const rcu_ptr &) = delete;
+	rcu_ptr &operator=(const rcu_ptr &) = delete;
+
+	~rcu_ptr();
+
+	void runtime_initialize(detail::ebr *e = new detail::ebr());
+	void runtime_finalize();
+
+	worker_type register_worker();
+
+	const T *get() const noexcept;
+	explicit operator bool() const noexcept;
+
+	template <typename F>
+	void read(worker_type &w, F &&f) const;
+
+	template <typename... Args>
+	void emplace(Args &&... args);
+	template <typename F>
+	void update(F &&f);
+	void reset();
+
+	void garbage_collect();
+	void garbage_collect_force();
+
+private:
+	using pointer_type = persistent_ptr<T>;
+
+	struct runtime_data {
+		explicit runtime_data(detail::ebr *e) : ebr_(e)
+		{
+		}
+
+		~runtime_data()
+		{
+			delete ebr_;
+		}
+
+		detail::ebr *ebr_;
+
+		/* Serializes the writers. */
+		std::mutex mtx;
+	};
+
+	void publish(pointer_type version);
+	void retire_pending();
+	static void free_version(const pointer_type &version);
+	static void check_outside_tx();
+
+	std::atomic<self_relative_ptr<T>> ptr;
+
+	/* Version which was unpublished, but not yet put on the limbo list. */
+	pointer_type pending;
+	detail::persistent_limbo<pointer_type> limbo;
+
+	runtime_data *runtime_ = nullptr;
+};
+
+/**
+ * Constructs an empty rcu_ptr. Has to be called in a transaction.
+ *
+ * @throw pmem::pool_error if the object is not in persistent memory.
+ */
+template <typename T>
+rcu_ptr<T>::rcu_ptr() : ptr(nullptr), pending(nullptr)
+{
+	if (nullptr == pmemobj_pool_by_ptr(this))
+		throw pmem::pool_error("Invalid pool handle.");
+}
+
+/**
+ * Destructor. Frees the current version and all the retired ones. Has to be
+ * called in a transaction, after runtime_finalize().
+ */
+template <typename T>
+rcu_ptr<T>::~rcu_ptr()
+{
+	try {
+		free_version(ptr.load().to_persistent_ptr());
+		free_version(pending);
+		limbo.clear(free_version);
+	} catch (...) {
+		std::terminate();
+	}
+}
+
+/**
+ * Initializes the runtime state. Has to be called after each application
+ * restart, before any other operation. Versions which were retired, but not
+ * freed before the restart, are freed.
+ *
+ * @param[in] e pointer to already created ebr, by default it will be created
+ * automatically. rcu_ptr takes the ownership of it.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+void
+rcu_ptr<T>::runtime_initialize(detail::ebr *e)
+{
+#if LIBPMEMOBJ_CPP_VG_PMEMCHECK_ENABLED
+	VALGRIND_PMC_REMOVE_PMEM_MAPPING(&runtime_, sizeof(runtime_data *));
+#endif
+	runtime_ = new runtime_data(e);
+
+	/* There are no readers after a restart. */
+	auto pop = pool_by_vptr(this);
+	flat_transaction::run(pop, [&] {
+		free_version(pending);
+		pending = nullptr;
+		limbo.clear(free_version);
+	});
+}
+
+/**
+ * Releases the runtime state. Has to be called before each application close
+ * and before destroying rcu_ptr. All the workers have to be destroyed before.
+ */
+template <typename T>
+void
+rcu_ptr<T>::runtime_finalize()
+{
+	delete runtime_;
+	runtime_ = nullptr;
+}
+
+/**
+ * Registers and returns a new worker, which can read the object. There can be
+ * only one worker per thread.
+ *
+ * @return new registered worker.
+ */
+template <typename T>
+typename rcu_ptr<T>::worker_type
+rcu_ptr<T>::register_worker()
+{
+	assert(runtime_);
+
+	return runtime_->ebr_->register_worker();
+}
+
+/**
+ * Returns pointer to the current version of the object. The returned object
+ * may be accessed only inside a critical section of a registered worker
+ * (worker_type::critical()) in which get() was called.
+ *
+ * @return pointer to the current version, nullptr if rcu_ptr is empty.
+ */
+template <typename T>
+const T *
+rcu_ptr<T>::get() const noexcept
+{
+	return ptr.load(std::memory_order_acquire).get();
+}
+
+/**
+ * Checks whether rcu_ptr points to an object.
+ *
+ * @return true if rcu_ptr is not empty, false otherwise.
+ */
+template <typename T>
+rcu_ptr<T>::operator bool() const noexcept
+{
+	return get() != nullptr;
+}
+
+/**
+ * Calls f with a pointer to the current version of the object, inside
+ * a critical section of the worker. The pointer must not be used after f
+ * returns.
+ *
+ * @param[in] w worker registered for the current thread.
+ * @param[in] f function with the signature void(const T *), the argument is
+ * nullptr if rcu_ptr is empty.
+ */
+template <typename T>
+template <typename F>
+void
+rcu_ptr<T>::read(worker_type &w, F &&f) const
+{
+	w.critical([&] { f(get()); });
+}
+
+/**
+ * Publishes a new version of the object, constructed from args. The previous
+ * version is retired.
+ *
+ * @param[in] args arguments passed to the constructor of T.
+ *
+ * @throw pmem::transaction_scope_error if called inside transaction.
+ * @throw pmem::transaction_alloc_error when allocation failed.
+ * @throw rethrows constructor exception.
+ */
+template <typename T>
+template <typename... Args>
+void
+rcu_ptr<T>::emplace(Args &&... args)
+{
+	check_outside_tx();
+	assert(runtime_);
+
+	std::lock_guard<std::mutex> lock(runtime_->mtx);
+	retire_pending();
+
+	auto pop = pool_by_vptr(this);
+	flat_transaction::run(pop, [&] {
+		publish(make_persistent<T>(std::forward<Args>(args)...));
+	});
+
+	retire_pending();
+	limbo.reclaim(*runtime_->ebr_, free_version);
+}
+
+/**
+ * Publishes a new version of the object, which is a copy of the current one,
+ * modified by f. f is called in a transaction, the current version is not
+ * modified.
+ *
+ * @param[in] f function with the signature void(T &), called for the copy.
+ *
+ * @throw pmem::transaction_scope_error if called inside transaction.
+ * @throw std::logic_error if rcu_ptr is empty.
+ * @throw pmem::transaction_alloc_error when allocation failed.
+ * @throw rethrows exception thrown by f or by the copy constructor of T.
+ */
+template <typename T>
+template <typename F>
+void
+rcu_ptr<T>::update(F &&f)
+{
+	check_outside_tx();
+	assert(runtime_);
+
+	std::lock_guard<std::mutex> lock(runtime_->mtx);
+	retire_pending();
+
+	auto current = ptr.load().get();
+	if (current == nullptr)
+		throw std::logic_error("Update of an empty rcu_ptr.");
+
+	auto pop = pool_by_vptr(this);
+	flat_transaction::run(pop, [&] {
+		auto version = make_persistent<T>(*current);
+		f(*version);
+
+		publish(version);
+	});
+
+	retire_pending();
+	limbo.reclaim(*runtime_->ebr_, free_version);
+}
+
+/**
+ * Makes rcu_ptr empty. The current version is retired.
+ *
+ * @throw pmem::transaction_scope_error if called inside transaction.
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+void
+rcu_ptr<T>::reset()
+{
+	check_outside_tx();
+	assert(runtime_);
+
+	std::lock_guard<std::mutex> lock(runtime_->mtx);
+	retire_pending();
+
+	auto pop = pool_by_vptr(this);
+	flat_transaction::run(pop, [&] { publish(nullptr); });
+
+	retire_pending();
+	limbo.reclaim(*runtime_->ebr_, free_version);
+}
+
+/**
+ * Tries to free retired versions. It is not guaranteed that this method will
+ * free any memory, it depends on the critical sections in progress. It is
+ * also called by every update.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+void
+rcu_ptr<T>::garbage_collect()
+{
+	assert(runtime_);
+
+	std::lock_guard<std::mutex> lock(runtime_->mtx);
+
+	limbo.reclaim(*runtime_->ebr_, free_version);
+}
+
+/**
+ * Performs full epochs synchronisation and frees all retired versions.
+ *
+ * @throw pmem::transaction_error when snapshotting failed.
+ */
+template <typename T>
+void
+rcu_ptr<T>::garbage_collect_force()
+{
+	assert(runtime_);
+
+	std::lock_guard<std::mutex> lock(runtime_->mtx);
+
+	limbo.full_reclaim(*runtime_->ebr_, free_version);
+}
+
+/*
+ * Replaces the current version with the given one. The old version is saved
+ * as pending, before the new one is published, so nothing can fail after the
+ * store, which makes the new version visible to the readers.
+ */
+template <typename T>
+void
+rcu_ptr<T>::publish(pointer_type version)
+{
+	assert(pending == nullptr);
+
+	pending = ptr.load().to_persistent_ptr();
+
+	transaction::snapshot(&ptr);
+	ptr.store(version, std::memory_order_release);
+}
+
+/*
+ * Puts the pending version on the limbo list. The pending version has to be
+ * retired after it was unpublished, so that its epoch is not older than
+ * the unpublishing. If it fails, it is retried by the next update.
+ */
+template <typename T>
+void
+rcu_ptr<T>::retire_pending()
+{
+	if (pending == nullptr)
+		return;
+
+	auto pop = pool_by_vptr(this);
+	flat_transaction::run(pop, [&] {
+		limbo.retire(*runtime_->ebr_, pending);
+		pending = nullptr;
+	});
+}
+
+template <typename T>
+void
+rcu_ptr<T>::free_version(const pointer_type &version)
+{
+	if (version != nullptr)
+		delete_persistent<T>(version);
+}
+
+/*
+ * The new version is visible to the readers before the transaction commits,
+ * so it cannot be a part of an outer transaction, which could be aborted.
+ */
+template <typename T>
+void
+rcu_ptr<T>::check_outside_tx()
+{
+	if (pmemobj_tx_stage() != TX_STAGE_NONE)
+		throw pmem::transaction_scope_error(
+			"Function called inside transaction scope.");
+}
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_RCU_PTR_HPP */
@@ -0,0 +1,445 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Implementation of persistent multi producer single consumer queue, which
+ * consists of independent shards.
+ */
+
+#ifndef LIBPMEMOBJ_SHARDED_MPSC_QUEUE_HPP
+#define LIBPMEMOBJ_SHARDED_MPSC_QUEUE_HPP
+
+#include <libpmemobj++/container/vector.hpp>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/experimental/mpsc_queue.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/slice.hpp>
+#include <libpmemobj++/string_view.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Persistent memory aware multi producer single consumer queue, which
+ * consists of a number of mpsc_queue shards.
+ *
+ * Each producer worker is bound to a single shard, so producers which use
+ * different shards do not contend on the same ring buffer. The consumer
+ * reads from all the shards, starting from a different one in each call,
+ * and consumes the data from all of them in a single transaction.
+ *
+ * Each message has a sequence number assigned by the producer. The queue does
+ * not generate sequence numbers by itself, as it would require a counter
+ * shared by all producers. If ordering matters, try_consume_ordered() may be
+ * used to pass the ready messages to the consumer sorted by the sequence
+ * numbers (e.g. timestamps).
+ *
+ * @note try_consume_batch() or try_consume_ordered() MUST be called after
+ * creation of sharded_mpsc_queue object if pmem_log_type object was already
+ * used by instance of sharded_mpsc_queue - e.g. in previous run of
+ * application.
+ *
+ * @see mpsc_queue
+ * @ingroup experimental_containers
+ */
+class sharded_mpsc_queue {
+public:
+	class worker;
+	class pmem_log_type;
+	class message;
+
+	/**
+	 * Type representing the range of the messages passed to the
+	 * consumer.
+	 */
+	using batch_type = pmem::obj::slice<const message *>;
+
+	sharded_mpsc_queue(pmem_log_type &pmem,
+			   size_t max_workers_per_shard = 1,
+			   size_t max_segments = 1);
+
+	size_t shards() const;
+
+	worker register_worker();
+	worker register_worker(size_t shard);
+
+	template <typename Function>
+	bool try_consume_batch(Function &&f);
+
+	template <typename Function>
+	bool try_consume_ordered(Function &&f);
+
+private:
+	template <typename Function>
+	bool consume(Function &f, bool ordered);
+
+	pmem::obj::pool_base pop;
+	std::vector<std::unique_ptr<mpsc_queue>> queues;
+
+	/* Used to assign shards to workers. */
+	std::atomic<size_t> next_shard;
+
+	/* Shard from which the consumer starts. */
+	size_t first_shard = 0;
+
+	/* Buffers reused by the consumer. */
+	std::vector<std::pair<mpsc_queue *, mpsc_queue::segment *>> ranges;
+	std::vector<message> messages;
+
+public:
+	/**
+	 * Message stored in the sharded_mpsc_queue.
+	 */
+	class message {
+	public:
+		uint64_t sequence() const;
+		pmem::obj::string_view data() const;
+
+	private:
+		message(pmem::obj::string_view raw);
+
+		pmem::obj::string_view raw;
+
+		friend class sharded_mpsc_queue;
+	};
+
+	/**
+	 * sharded_mpsc_queue producer worker class. Each producer thread have
+	 * to use its own worker object. Worker writes only to the shard it
+	 * was registered to.
+	 *
+	 * @note All workers have to be destroyed before destruction of
+	 * the sharded_mpsc_queue
+	 */
+	class worker {
+	public:
+		bool try_produce(pmem::obj::string_view data,
+				 uint64_t sequence = 0);
+
+		size_t shard() const;
+
+	private:
+		worker(mpsc_queue::worker &&w, size_t shard);
+
+		mpsc_queue::worker w;
+		size_t shard_;
+
+		friend class sharded_mpsc_queue;
+	};
+
+	/**
+	 * Type representing persistent data, which may be managed by
+	 * sharded_mpsc_queue.
+	 *
+	 * Object of this type has to be managed by pmem::obj::pool, to be
+	 * usable in sharded_mpsc_queue.
+	 *
+	 * @param shards number of shards.
+	 * @param size size of the log of each shard.
+	 */
+	class pmem_log_type {
+	public:
+		pmem_log_type(size_t shards, size_t size);
+		~pmem_log_type();
+
+	private:
+		pmem::obj::vector<
+			pmem::obj::persistent_ptr<mpsc_queue::pmem_log_type>>
+			shards_;
+
+		friend class sharded_mpsc_queue;
+	};
+};
+
+/**
+ * sharded_mpsc_queue constructor.
+ *
+ * @param[in] pmem reference to already allocated pmem_log_type object
+ * @param[in] max_workers_per_shard maximum number of workers which may be
+ * registered to each of the shards at the same time.
+ * @param[in] max_segments maximum number of log segments of each shard.
+ *
+ * @see mpsc_queue::mpsc_queue()
+ */
+inline sharded_mpsc_queue::sharded_mpsc_queue(pmem_log_type &pmem,
+					      size_t max_workers_per_shard,
+					      size_t max_segments)
+    : next_shard(0)
+{
+	pop = pmem::obj::pool_by_vptr(&pmem);
+
+	for (auto &log : pmem.shards_)
+		queues.emplace_back(new mpsc_queue(
+			*log, max_workers_per_shard, max_segments));
+}
+
+/**
+ * Returns number of shards.
+ *
+ * @return number of shards.
+ */
+inline size_t
+sharded_mpsc_queue::shards() const
+{
+	return queues.size();
+}
+
+/**
+ * Registers the producer worker to one of the shards, chosen in a round-robin
+ * fashion.
+ *
+ * @return producer worker object.
+ */
+inline sharded_mpsc_queue::worker
+sharded_mpsc_queue::register_worker()
+{
+	return register_worker(next_shard.fetch_add(1) % queues.size());
+}
+
+/**
+ * Registers the producer worker to the given shard. Number of workers
+ * registered to a shard have to be less or equal to max_workers_per_shard
+ * specified in the sharded_mpsc_queue constructor.
+ *
+ * @param[in] shard index of the shard.
+ *
+ * @return producer worker object.
+ *
+ * @throw std::out_of_range if shard is not less than shards().
+ */
+inline sharded_mpsc_queue::worker
+sharded_mpsc_queue::register_worker(size_t shard)
+{
+	if (shard >= queues.size())
+		throw std::out_of_range("Shard index out of range.");
+
+	return worker(queues[shard]->register_worker(), shard);
+}
+
+/**
+ * Evaluates callback function f() for the messages, which are ready to be
+ * consumed in all the shards. Messages from each shard are passed in the
+ * order in which they were stored, shards are visited in a round-robin
+ * fashion. try_consume_batch() accesses data, and evaluates callback inside
+ * a transaction. If an exception is thrown within callback, it gets
+ * propagated to the caller and causes a transaction abort. In such case, next
+ * try_consume_batch() call would consume the same data.
+ *
+ * @return true if consumed any data, false otherwise.
+ *
+ * @throws transaction_scope_error
+ */
+template <typename Function>
+inline bool
+sharded_mpsc_queue::try_consume_batch(Function &&f)
+{
+	return consume(f, false);
+}
+
+/**
+ * Evaluates callback function f() for the messages, which are ready to be
+ * consumed in all the shards, sorted by their sequence numbers. Messages with
+ * equal sequence numbers are passed in the same order as in
+ * try_consume_batch().
+ *
+ * @note Only the messages, which are ready at the time of the call, are
+ * sorted. A message with a lower sequence number may be passed in one of the
+ * following calls, if it was not fully produced yet.
+ *
+ * @return true if consumed any data, false otherwise.
+ *
+ * @throws transaction_scope_error
+ */
+template <typename Function>
+inline bool
+sharded_mpsc_queue::try_consume_ordered(Function &&f)
+{
+	return consume(f, true);
+}
+
+template <typename Function>
+bool
+sharded_mpsc_queue::consume(Function &f, bool ordered)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_NONE)
+		throw pmem::transaction_scope_error(
+			"Function called inside a transaction scope.");
+
+	bool consumed = false;
+
+	/* As in mpsc_queue, data of each shard may be split into two
+	 * ranges. */
+	for (int i = 0; i < 2; i++) {
+		ranges.clear();
+		messages.clear();
+
+		auto n = queues.size();
+		for (size_t j = 0; j < n; j++) {
+			auto q = queues[(first_shard + j) % n].get();
+			auto s = q->ready_segment();
+			if (!s)
+				continue;
+
+			ranges.emplace_back(q, s);
+			for (auto raw : q->range_batch(s))
+				messages.push_back(message(raw));
+		}
+
+		if (ranges.empty())
+			break;
+
+		if (ordered)
+			std::stable_sort(messages.begin(), messages.end(),
+					 [](const message &lhs,
+					    const message &rhs) {
+						 return lhs.sequence() <
+							 rhs.sequence();
+					 });
+
+		pmem::obj::flat_transaction::run(pop, [&] {
+			if (!messages.empty()) {
+				consumed = true;
+				f(batch_type(messages.data(),
+					     messages.data() +
+						     messages.size()));
+			}
+
+			for (auto &r : ranges)
+				r.first->commit_range(r.second);
+		});
+
+		for (auto &r : ranges)
+			r.first->release_range(r.second);
+	}
+
+	first_shard = (first_shard + 1) % queues.size();
+
+	return consumed;
+}
+
+inline sharded_mpsc_queue::message::message(pmem::obj::string_view raw)
+    : raw(raw)
+{
+	assert(raw.size() >= sizeof(uint64_t));
+}
+
+/**
+ * Returns sequence number of the message.
+ *
+ * @return sequence number passed to worker::try_produce().
+ */
+inline uint64_t
+sharded_mpsc_queue::message::sequence() const
+{
+	uint64_t sequence;
+	std::memcpy(&sequence, raw.data(), sizeof(sequence));
+
+	return sequence;
+}
+
+/**
+ * Returns data of the message.
+ *
+ * @return pmem::obj::string_view of the message data.
+ */
+inline pmem::obj::string_view
+sharded_mpsc_queue::message::data() const
+{
+	return pmem::obj::string_view(raw.data() + sizeof(uint64_t),
+				      raw.size() - sizeof(uint64_t));
+}
+
+inline sharded_mpsc_queue::worker::worker(mpsc_queue::worker &&w,
+					  size_t shard)
+    : w(std::move(w)), shard_(shard)
+{
+}
+
+/**
+ * Copies data with the sequence number into the shard of the worker.
+ *
+ * @param[in] data Data to be copied into sharded_mpsc_queue
+ * @param[in] sequence sequence number of the message
+ *
+ * @return true if the data was saved in the sharded_mpsc_queue and is
+ * visible for the consumer, false otherwise.
+ */
+inline bool
+sharded_mpsc_queue::worker::try_produce(pmem::obj::string_view data,
+					uint64_t sequence)
+{
+	/* The sequence number is written in front of the data, directly into
+	 * the entry acquired in the shard. */
+	return w.try_produce(
+		pmem::obj::string_view(
+			reinterpret_cast<const char *>(&sequence),
+			sizeof(sequence)),
+		data, [](pmem::obj::string_view) {});
+}
+
+/**
+ * Returns index of the shard to which the worker writes.
+ *
+ * @return index of the shard.
+ */
+inline size_t
+sharded_mpsc_queue::worker::shard() const
+{
+	return shard_;
+}
+
+/**
+ * Constructs pmem_log_type object. Must be called in a transaction.
+ *
+ * @param shards number of shards
+ * @param size size of the log of each shard in bytes
+ *
+ * @throw std::invalid_argument if shards is 0.
+ */
+inline sharded_mpsc_queue::pmem_log_type::pmem_log_type(size_t shards,
+							 size_t size)
+{
+	if (shards == 0)
+		throw std::invalid_argument(
+			"Queue must consist of at least one shard.");
+
+	shards_.reserve(shards);
+	for (size_t i = 0; i < shards; i++)
+		shards_.emplace_back(
+			pmem::obj::make_persistent<mpsc_queue::pmem_log_type>(
+				size));
+}
+
+/**
+ * Destroys pmem_log_type object and logs of all the shards.
+ */
+inline sharded_mpsc_queue::pmem_log_type::~pmem_log_type()
+{
+	for (auto &log : shards_)
+		pmem::obj::delete_persistent<mpsc_queue::pmem_log_type>(log);
+}
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_SHARDED_MPSC_QUEUE_HPP */
@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Per-thread, reusable transaction log buffers.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_TX_LOG_BUFFERS_HPP
+#define LIBPMEMOBJ_CPP_TX_LOG_BUFFERS_HPP
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/enumerable_thread_specific.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <algorithm>
+#include <functional>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Persistent set of per-thread undo log buffers.
+ *
+ * Transactions which snapshot a lot of data (e.g. vector reallocation,
+ * concurrent_hash_map swap or bulk erases) extend the undo log by
+ * allocating from the heap while they run. tx_log_buffers keeps one
+ * buffer per thread, grown to the requested size outside of any
+ * transaction and appended to the undo log at the beginning of the
+ * transaction, so that the log does not have to be extended in the
+ * common case. The buffers are reused by subsequent transactions of the
+ * same thread.
+ *
+ * The size of a buffer for a known set of snapshots can be calculated
+ * with flat_transaction::log_snapshots_max_size().
+ *
+ * Example:
+ * @code
+ * auto size = pmem::obj::flat_transaction::log_snapshots_max_size(
+ *	{sizeof(value_type) * vec.capacity()});
+ * root->log_buffers->run(pop, size, [&] { vec.reserve(2 * vec.capacity()); });
+ * @endcode
+ *
+ * This class must be allocated on pmem.
+ */
+class tx_log_buffers {
+public:
+	class buffer_view;
+
+	tx_log_buffers() = default;
+	~tx_log_buffers();
+
+	tx_log_buffers(const tx_log_buffers &) = delete;
+	tx_log_buffers &operator=(const tx_log_buffers &) = delete;
+
+	buffer_view reserve(size_t size);
+
+	template <typename... Locks>
+	void run(pool_base &pool, size_t size, std::function<void()> tx,
+		 Locks &... locks);
+
+	void clear();
+
+private:
+	struct buffer {
+		persistent_ptr<char[]> data;
+		p<size_t> size = 0;
+	};
+
+	pool_base get_pool() const;
+
+	pmem::detail::enumerable_thread_specific<buffer> buffers;
+};
+
+/**
+ * Non-owning view of the buffer of a single thread, obtained by
+ * tx_log_buffers::reserve().
+ */
+class tx_log_buffers::buffer_view {
+public:
+	/**
+	 * Appends the buffer to the undo log of the current transaction.
+	 *
+	 * @throw transaction_scope_error when called outside of a
+	 * transaction scope.
+	 * @throw transaction_error when the buffer could not be appended.
+	 */
+	void
+	append() const
+	{
+		flat_transaction::log_append_buffer(
+			flat_transaction::log_type::snapshot, data, size);
+	}
+
+	/** Address of the buffer. */
+	void *data;
+	/** Size of the buffer in bytes. */
+	size_t size;
+};
+
+/**
+ * Destructor. Frees buffers of all threads.
+ *
+ * @pre must be called in a transaction (by delete_persistent).
+ */
+inline tx_log_buffers::~tx_log_buffers()
+{
+	try {
+		for (auto &b : buffers) {
+			if (b.data != nullptr)
+				delete_persistent<char[]>(b.data, b.size);
+		}
+	} catch (...) {
+		std::terminate();
+	}
+}
+
+/**
+ * Makes sure the buffer of the calling thread has at least 'size' bytes.
+ * The buffer is reallocated in a separate transaction if needed.
+ *
+ * @param[in] size requested size of the buffer in bytes.
+ *
+ * @pre must not be called in a transaction.
+ *
+ * @return view of the buffer of the calling thread, valid until the next
+ * call to reserve() by this thread or clear().
+ *
+ * @throw transaction_scope_error if called in a transaction.
+ * @throw transaction_alloc_error when the buffer could not be allocated.
+ */
+inline tx_log_buffers::buffer_view
+tx_log_buffers::reserve(size_t size)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_NONE)
+		throw pmem::transaction_scope_error(
+			"tx_log_buffers::reserve cannot be called in a transaction");
+
+	auto &b = buffers.local();
+
+	if (b.size < size) {
+		/* grow geometrically to avoid reallocating for every bigger
+		 * hint */
+		size_t new_size = (std::max)(size, 2 * b.size.get_ro());
+
+		auto pop = get_pool();
+		flat_transaction::run(pop, [&] {
+			if (b.data != nullptr)
+				delete_persistent<char[]>(b.data, b.size);
+
+			b.data = make_persistent<char[]>(new_size);
+			b.size = new_size;
+		});
+	}
+
+	return buffer_view{b.data.get(), b.size};
+}
+
+/**
+ * Executes a flat transaction which uses the buffer of the calling thread,
+ * grown to at least 'size' bytes, as its undo log. Works like
+ * flat_transaction::run() otherwise. If called inside a transaction, the
+ * buffer is not used and the nested transaction uses the log of the outer
+ * one.
+ *
+ * @param[in,out] pool the pool in which the transaction will take
+ *	place, must be the pool of this object.
+ * @param[in] size requested size of the undo log buffer in bytes.
+ * @param[in] tx an std::function<void ()> which will perform
+ *	operations within this transaction.
+ * @param[in,out] locks locks to be taken for the duration of
+ *	the transaction.
+ *
+ * @throw pool_error if 'pool' is not the pool of this object.
+ * @throw transaction_error on any error pertaining the execution
+ *	of the transaction.
+ * @throw manual_tx_abort on manual transaction abort.
+ */
+template <typename... Locks>
+void
+tx_log_buffers::run(pool_base &pool, size_t size, std::function<void()> tx,
+		    Locks &... locks)
+{
+	if (pmemobj_tx_stage() == TX_STAGE_WORK) {
+		flat_transaction::run(pool, tx, locks...);
+		return;
+	}
+
+	if (pool.handle() != pmemobj_pool_by_ptr(this))
+		throw pmem::pool_error(
+			"tx_log_buffers must reside in the transaction pool");
+
+	auto buf = reserve(size);
+
+	flat_transaction::run(
+		pool,
+		[&] {
+			buf.append();
+			tx();
+		},
+		locks...);
+}
+
+/**
+ * Frees buffers of all threads.
+ *
+ * @pre must not be called concurrently with any other method.
+ *
+ * @throw transaction_error when the buffers could not be freed.
+ */
+inline void
+tx_log_buffers::clear()
+{
+	auto pop = get_pool();
+	flat_transaction::run(pop, [&] {
+		for (auto &b : buffers) {
+			if (b.data != nullptr)
+				delete_persistent<char[]>(b.data, b.size);
+
+			b.data = nullptr;
+			b.size = 0;
+		}
+	});
+}
+
+inline pool_base
+tx_log_buffers::get_pool() const
+{
+	auto pop = pmemobj_pool_by_ptr(this);
+	assert(pop != nullptr);
+	return pool_base(pop);
+}
+
+} /* namespace experimental */
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_TX_LOG_BUFFERS_HPP */
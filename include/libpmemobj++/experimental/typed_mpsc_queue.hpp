@@ -0,0 +1,543 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Implementation of persistent multi producer single consumer queue of
+ * fixed-size records.
+ */
+
+#ifndef LIBPMEMOBJ_TYPED_MPSC_QUEUE_HPP
+#define LIBPMEMOBJ_TYPED_MPSC_QUEUE_HPP
+
+#include <libpmemobj++/container/vector.hpp>
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/enumerable_thread_specific.hpp>
+#include <libpmemobj++/detail/ringbuf.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/slice.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+namespace experimental
+{
+
+/**
+ * Persistent memory aware implementation of multi producer single consumer
+ * queue of fixed-size records.
+ *
+ * Unlike mpsc_queue, which stores each message with a size header and
+ * aligns it to a cacheline, typed_mpsc_queue stores records of trivially
+ * copyable type T densely, one after another. Every slot of the log has an
+ * epoch - the number of the lap around the log in which the slot was
+ * written. A record is valid only if its epoch matches the lap which is
+ * being consumed, so consumed slots do not have to be cleared.
+ *
+ * In case of crash or shutdown, reading and writing may be continued
+ * by new process, from the last position without loss of any, already produced
+ * data.
+ *
+ * @note try_consume_batch() MUST be called after creation of typed_mpsc_queue
+ * object if pmem_log_type object was already used by instance of
+ * typed_mpsc_queue - e.g. in previous run of application. If
+ * try_consume_batch() is not called, produce may fail, even if the queue is
+ * empty.
+ *
+ * @ingroup experimental_containers
+ */
+template <typename T>
+class typed_mpsc_queue {
+	static_assert(std::is_trivially_copyable<T>::value,
+		      "typed_mpsc_queue requires trivially copyable type");
+
+public:
+	class worker;
+	class pmem_log_type;
+
+	using value_type = T;
+
+	/**
+	 * Type representing contiguous range of the records, passed to the
+	 * consumer.
+	 */
+	using batch_type = pmem::obj::slice<const T *>;
+
+	typed_mpsc_queue(pmem_log_type &pmem, size_t max_workers = 1);
+
+	worker register_worker();
+
+	template <typename Function>
+	bool try_consume_batch(Function &&f);
+
+private:
+	/* Epochs are in range [1, MAX_EPOCH], 0 marks a slot which was never
+	 * written. MAX_EPOCH matches the range of the wrap-around counter of
+	 * ringbuf. */
+	static constexpr size_t MAX_EPOCH = size_t(1) << 31;
+
+	static uint32_t epoch_add(uint32_t epoch, size_t n);
+
+	void restore_offsets();
+
+	inline pmem::detail::id_manager &get_id_manager();
+
+	/* ringbuf_t handle. Important: typed_mpsc_queue operates on slots
+	 * hence ringbuf_produce/release functions are called with number of
+	 * records, not bytes. */
+	std::unique_ptr<ringbuf::ringbuf_t> ring_buffer;
+	T *values;
+	uint32_t *epochs;
+	size_t capacity;
+	pmem::obj::pool_base pop;
+	pmem_log_type *pmem;
+
+	/* Epoch of the records produced in the first lap of ringbuf. */
+	uint32_t base_epoch;
+
+	/* Stores offset and length of next range to be consumed. Only
+	 * valid if ring_buffer->consume_in_progress. */
+	size_t consume_offset = 0;
+	size_t consume_len = 0;
+
+public:
+	/**
+	 * typed_mpsc_queue producer worker class. To write data concurrently
+	 * into the typed_mpsc_queue in the multi-threaded application, each
+	 * producer thread have to use its own worker object. Workers might be
+	 * added concurrently to the typed_mpsc_queue.
+	 *
+	 * @note  All workers have to be destroyed before destruction of
+	 * the typed_mpsc_queue
+	 *
+	 * @see typed_mpsc_queue::worker::try_produce()
+	 */
+	class worker {
+	public:
+		worker(typed_mpsc_queue *q);
+		~worker();
+
+		worker(const worker &) = delete;
+		worker &operator=(const worker &) = delete;
+
+		worker(worker &&other);
+		worker &operator=(worker &&other);
+
+		bool try_produce(const T &value);
+		bool try_produce(const T *data, size_t n);
+
+	private:
+		typed_mpsc_queue *queue;
+		ringbuf::ringbuf_worker_t *w;
+		size_t id;
+
+		friend class typed_mpsc_queue;
+	};
+
+	/**
+	 * Type representing persistent data, which may be managed by
+	 * typed_mpsc_queue.
+	 *
+	 * Object of this type has to be managed by pmem::obj::pool, to be
+	 * usable in typed_mpsc_queue.
+	 * Once created, pmem_log_type object cannot be resized.
+	 *
+	 * @param size number of slots in the log.
+	 */
+	class pmem_log_type {
+	public:
+		pmem_log_type(size_t size);
+
+		size_t capacity() const;
+
+	private:
+		pmem::obj::vector<char> data_;
+		pmem::obj::vector<uint32_t> epochs_;
+		pmem::obj::p<size_t> consumed;
+		pmem::obj::p<uint32_t> epoch;
+
+		friend class typed_mpsc_queue;
+	};
+};
+
+/**
+ * typed_mpsc_queue constructor.
+ *
+ * @param[in] pmem reference to already allocated pmem_log_type object
+ * @param[in] max_workers maximum number of workers which may be added to
+ * typed_mpsc_queue at the same time.
+ */
+template <typename T>
+typed_mpsc_queue<T>::typed_mpsc_queue(pmem_log_type &pmem, size_t max_workers)
+{
+	pop = pmem::obj::pool_by_vptr(&pmem);
+
+	auto addr = reinterpret_cast<uintptr_t>(pmem.data_.cdata());
+	values = reinterpret_cast<T *>(
+		pmem::detail::align_up(addr, alignof(T)));
+	epochs = const_cast<uint32_t *>(pmem.epochs_.cdata());
+	capacity = pmem.capacity();
+
+	ring_buffer = std::unique_ptr<ringbuf::ringbuf_t>(
+		new ringbuf::ringbuf_t(max_workers, capacity));
+
+	this->pmem = &pmem;
+	base_epoch = pmem.epoch;
+
+	restore_offsets();
+}
+
+template <typename T>
+uint32_t
+typed_mpsc_queue<T>::epoch_add(uint32_t epoch, size_t n)
+{
+	assert(epoch != 0 && epoch <= MAX_EPOCH);
+
+	return static_cast<uint32_t>((epoch - 1 + n) % MAX_EPOCH + 1);
+}
+
+template <typename T>
+void
+typed_mpsc_queue<T>::restore_offsets()
+{
+	auto consumed = static_cast<size_t>(pmem->consumed);
+
+	/* Invariant */
+	assert(consumed < capacity);
+
+	/* Offsets are restored the same way as in mpsc_queue, in slots
+	 * instead of cachelines. Slots which are not valid records (already
+	 * consumed or never written) are skipped by the consumer based on
+	 * their epochs. */
+	auto w = register_worker();
+	auto rbuf = ring_buffer.get();
+
+	if (!consumed) {
+		auto acq = ringbuf::ringbuf_acquire(rbuf, w.w, capacity - 1);
+		assert(acq == 0);
+		(void)acq;
+		ringbuf::ringbuf_produce(rbuf, w.w);
+
+		return;
+	}
+
+	auto acq = ringbuf::ringbuf_acquire(rbuf, w.w, consumed);
+	assert(acq == 0);
+	ringbuf::ringbuf_produce(rbuf, w.w);
+
+	/* Restore consumer offset */
+	size_t offset;
+	auto len = ringbuf::ringbuf_consume(rbuf, &offset);
+	assert(offset == 0);
+	assert(len == consumed);
+	ringbuf::ringbuf_release(rbuf, len);
+
+	/* Records in this range were produced in the lap of pmem->epoch... */
+	acq = ringbuf::ringbuf_acquire(rbuf, w.w, capacity - consumed);
+	assert(acq >= 0);
+	assert(static_cast<size_t>(acq) == consumed);
+	ringbuf::ringbuf_produce(rbuf, w.w);
+
+	/* ...and records in this one in the next lap. */
+	if (consumed > 1) {
+		acq = ringbuf::ringbuf_acquire(rbuf, w.w, consumed - 1);
+		assert(acq == 0);
+		ringbuf::ringbuf_produce(rbuf, w.w);
+	}
+
+	(void)acq;
+}
+
+/**
+ * Constructs pmem_log_type object.
+ *
+ * At most size - 1 records may be stored in the log at the same time.
+ *
+ * @param size number of slots in the log
+ *
+ * @throw std::invalid_argument if size is less than 2.
+ */
+template <typename T>
+typed_mpsc_queue<T>::pmem_log_type::pmem_log_type(size_t size)
+    : data_(size * sizeof(T) + alignof(T), 0),
+      epochs_(size, 0),
+      consumed(0),
+      epoch(1)
+{
+	if (size < 2)
+		throw std::invalid_argument(
+			"Log must consist of at least 2 slots.");
+}
+
+/**
+ * Returns number of slots in the log.
+ *
+ * @return number of slots in the log.
+ */
+template <typename T>
+inline size_t
+typed_mpsc_queue<T>::pmem_log_type::capacity() const
+{
+	return epochs_.size();
+}
+
+template <typename T>
+inline pmem::detail::id_manager &
+typed_mpsc_queue<T>::get_id_manager()
+{
+	static pmem::detail::id_manager manager;
+	return manager;
+}
+
+/**
+ * Registers the producer worker. Number of workers have to be less or equal
+ * to max_workers specified in the typed_mpsc_queue constructor.
+ *
+ * @return producer worker object.
+ */
+template <typename T>
+inline typename typed_mpsc_queue<T>::worker
+typed_mpsc_queue<T>::register_worker()
+{
+	return worker(this);
+}
+
+/**
+ * Evaluates callback function f() for the records, which are ready to be
+ * consumed. Callback is called with batch_type object - contiguous range of
+ * the records in the log - and may be called several times, if the ready
+ * records are not contiguous (e.g. after wrap-around or recovery).
+ * try_consume_batch() accesses data, and evaluates callback inside a
+ * transaction. If an exception is thrown within callback, it gets
+ * propagated to the caller and causes a transaction abort. In such case, next
+ * try_consume_batch() call would consume the same data.
+ *
+ * @return true if consumed any data, false otherwise.
+ *
+ * @throws transaction_scope_error
+ *
+ * @note try_consume_batch() MUST be called after creation of typed_mpsc_queue
+ * object if pmem_log_type object was already used by any instance of
+ * typed_mpsc_queue. Otherwise produce might fail even if the queue is empty)
+ *
+ * @see typed_mpsc_queue::worker::try_produce()
+ */
+template <typename T>
+template <typename Function>
+inline bool
+typed_mpsc_queue<T>::try_consume_batch(Function &&f)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_NONE)
+		throw pmem::transaction_scope_error(
+			"Function called inside a transaction scope.");
+
+	bool consumed = false;
+
+	/* Need to call try_consume twice, as some data may be at the end
+	 * of buffer, and some may be at the beginning. */
+	for (int i = 0; i < 2; i++) {
+		/* If there is no consume in progress, it's safe to call
+		 * ringbuf_consume. */
+		if (!ring_buffer->consume_in_progress) {
+			size_t offset;
+			auto len = ringbuf::ringbuf_consume(ring_buffer.get(),
+							    &offset);
+			if (!len)
+				return consumed;
+
+			consume_offset = offset;
+			consume_len = len;
+		} else {
+			assert(consume_len != 0);
+		}
+
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+		ANNOTATE_HAPPENS_AFTER(ring_buffer.get());
+#endif
+
+		/* Range which starts before the consumer position was
+		 * produced in the next lap. */
+		uint32_t epoch = pmem->epoch;
+		if (consume_offset < pmem->consumed)
+			epoch = epoch_add(epoch, 1);
+
+		auto end = consume_offset + consume_len;
+		assert(end <= capacity);
+
+		pmem::obj::flat_transaction::run(pop, [&] {
+			auto first = consume_offset;
+			while (first < end) {
+				while (first < end && epochs[first] != epoch)
+					++first;
+
+				auto last = first;
+				while (last < end && epochs[last] == epoch)
+					++last;
+
+				if (first != last) {
+					consumed = true;
+					f(batch_type(values + first,
+						     values + last));
+				}
+
+				first = last;
+			}
+
+			if (end < capacity) {
+				pmem->consumed = end;
+				pmem->epoch = epoch;
+			} else {
+				pmem->consumed = 0;
+				pmem->epoch = epoch_add(epoch, 1);
+			}
+		});
+
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+		ANNOTATE_HAPPENS_BEFORE(ring_buffer.get());
+#endif
+
+		ringbuf::ringbuf_release(ring_buffer.get(), consume_len);
+
+		assert(!ring_buffer->consume_in_progress);
+	}
+
+	return consumed;
+}
+
+template <typename T>
+inline typed_mpsc_queue<T>::worker::worker(typed_mpsc_queue *q)
+{
+	queue = q;
+	auto &manager = queue->get_id_manager();
+
+#if LIBPMEMOBJ_CPP_VG_DRD_ENABLED
+	ANNOTATE_BENIGN_RACE_SIZED(
+		&manager, sizeof(std::mutex),
+		"https://bugs.kde.org/show_bug.cgi?id=416286");
+#endif
+
+	id = manager.get();
+
+	assert(id < q->ring_buffer->nworkers);
+
+	w = ringbuf::ringbuf_register(queue->ring_buffer.get(),
+				      static_cast<unsigned>(id));
+}
+
+template <typename T>
+inline typed_mpsc_queue<T>::worker::worker(worker &&other)
+{
+	*this = std::move(other);
+}
+
+template <typename T>
+inline typename typed_mpsc_queue<T>::worker &
+typed_mpsc_queue<T>::worker::operator=(worker &&other)
+{
+	if (this != &other) {
+		queue = other.queue;
+		w = other.w;
+		id = other.id;
+
+		other.queue = nullptr;
+		other.w = nullptr;
+	}
+	return *this;
+}
+
+template <typename T>
+inline typed_mpsc_queue<T>::worker::~worker()
+{
+	if (w) {
+		ringbuf::ringbuf_unregister(queue->ring_buffer.get(), w);
+		auto &manager = queue->get_id_manager();
+		manager.release(id);
+	}
+}
+
+/**
+ * Copies a record into the typed_mpsc_queue.
+ *
+ * @param[in] value record to be copied into typed_mpsc_queue
+ *
+ * @return true if the record was saved in the typed_mpsc_queue and is
+ * visible for the consumer, false if there is not enough space in the queue.
+ */
+template <typename T>
+inline bool
+typed_mpsc_queue<T>::worker::try_produce(const T &value)
+{
+	return try_produce(&value, 1);
+}
+
+/**
+ * Copies n records into the typed_mpsc_queue. Either all the records are
+ * stored in the queue (in contiguous slots), or none of them.
+ *
+ * @note Each record is stored in the log atomically, but after a crash only
+ * some of the records from the range may be recovered.
+ *
+ * @param[in] data pointer to the records to be copied into typed_mpsc_queue
+ * @param[in] n number of the records
+ *
+ * @return true if the records were saved in the typed_mpsc_queue and are
+ * visible for the consumer, false if there is not enough space in the queue.
+ */
+template <typename T>
+bool
+typed_mpsc_queue<T>::worker::try_produce(const T *data, size_t n)
+{
+	if (n == 0)
+		return true;
+	if (n >= queue->capacity)
+		return false;
+
+	size_t wraps;
+	auto offset = ringbuf::ringbuf_acquire(queue->ring_buffer.get(), w, n,
+					       &wraps);
+
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+	ANNOTATE_HAPPENS_AFTER(queue->ring_buffer.get());
+#endif
+
+	if (offset == -1)
+		return false;
+
+	auto slot = static_cast<size_t>(offset);
+	auto epoch = epoch_add(queue->base_epoch, wraps);
+	auto pop = queue->pop.handle();
+
+	/* Records have to be persistent before their epochs are. */
+	pmemobj_memcpy(pop, queue->values + slot, data, n * sizeof(T),
+		       PMEMOBJ_F_MEM_NODRAIN);
+	pmemobj_drain(pop);
+
+	std::fill_n(queue->epochs + slot, n, epoch);
+	pmemobj_persist(pop, queue->epochs + slot, n * sizeof(uint32_t));
+
+#if LIBPMEMOBJ_CPP_VG_HELGRIND_ENABLED
+	ANNOTATE_HAPPENS_BEFORE(queue->ring_buffer.get());
+#endif
+
+	ringbuf::ringbuf_produce(queue->ring_buffer.get(), w);
+
+	return true;
+}
+
+} /* namespace experimental */
+} /* namespace obj */
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_TYPED_MPSC_QUEUE_HPP */
@@ -15,13 +15,17 @@
 #include <libpmemobj++/detail/check_persistent_ptr_array.hpp>
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/life.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/detail/variadic.hpp>
 #include <libpmemobj++/make_persistent_array.hpp>
 #include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj/action_base.h>
 #include <libpmemobj/tx_base.h>
 
 #include <new>
 #include <utility>
+#include <vector>
 
 namespace pmem
 {
@@ -67,6 +71,8 @@ make_persistent(allocation_flag flag, Args &&... args)
 				pmem::transaction_alloc_error>(msg);
 	}
 
+	detail::telemetry_on_alloc(*ptr.raw_ptr());
+
 	detail::create<T, Args...>(ptr.get(), std::forward<Args>(args)...);
 
 	return ptr;
@@ -98,6 +104,89 @@ make_persistent(Args &&... args)
 				  std::forward<Args>(args)...);
 }
 
+/**
+ * Transactionally allocate and construct 'count' independent objects of
+ * type T.
+ *
+ * All objects are reserved first and then published to the transaction in
+ * a single batch, which is much cheaper than calling make_persistent()
+ * 'count' times: there is one allocator interaction and one redo log entry
+ * set for the whole batch and the objects are not snapshotted when they
+ * are constructed. Each returned object can be freed independently with
+ * delete_persistent(). Cannot be used for array types.
+ *
+ * @param[in,out] pool the pool in which the transaction takes place.
+ * @param[in] count number of objects to allocate.
+ * @param[in] args a list of parameters passed to the constructor of every
+ * object. They are not forwarded, as they are used 'count' times.
+ *
+ * @return std::vector of persistent_ptr<T> to allocated objects.
+ *
+ * @throw transaction_scope_error if called outside of an active
+ * transaction
+ * @throw transaction_alloc_error on transactional allocation failure.
+ * @throw rethrow exception from T constructor
+ * @ingroup allocation
+ */
+template <typename T, typename... Args>
+std::vector<typename detail::pp_if_not_array<T>::type>
+make_persistent_n(pool_base &pool, std::size_t count, Args &&... args)
+{
+	if (pmemobj_tx_stage() != TX_STAGE_WORK)
+		throw pmem::transaction_scope_error(
+			"refusing to allocate memory outside of transaction scope");
+
+	std::vector<persistent_ptr<T>> ret;
+	if (count == 0)
+		return ret;
+
+	ret.reserve(count);
+	std::vector<pobj_action> actv(count);
+
+	for (std::size_t i = 0; i < count; ++i) {
+		PMEMoid oid = pmemobj_reserve(pool.handle(), &actv[i],
+					      sizeof(T), detail::type_num<T>());
+
+		if (OID_IS_NULL(oid)) {
+			pmemobj_cancel(pool.handle(), actv.data(), i);
+
+			const char *msg =
+				"Failed to reserve persistent memory object";
+			if (errno == ENOMEM)
+				throw detail::exception_with_errormsg<
+					pmem::transaction_out_of_memory>(msg);
+			else
+				throw detail::exception_with_errormsg<
+					pmem::transaction_alloc_error>(msg);
+		}
+
+		ret.emplace_back(oid);
+	}
+
+	if (pmemobj_tx_publish(actv.data(), count) != 0)
+		throw detail::exception_with_errormsg<
+			pmem::transaction_alloc_error>(
+			"Failed to publish persistent memory objects");
+
+	for (auto &ptr : ret) {
+		/*
+		 * Objects are new in this transaction, there is nothing to
+		 * snapshot. Register them to avoid snapshots from the
+		 * constructor and to have them flushed on commit.
+		 */
+		if (pmemobj_tx_xadd_range(*ptr.raw_ptr(), 0, sizeof(T),
+					  POBJ_XADD_NO_SNAPSHOT) != 0)
+			throw detail::exception_with_errormsg<
+				pmem::transaction_error>(
+				"Could not add object to the transaction.");
+
+		detail::create<T>(ptr.get(), args...);
+		detail::telemetry_on_alloc(*ptr.raw_ptr());
+	}
+
+	return ret;
+}
+
 /**
  * Transactionally free an object of type T held in a persistent_ptr.
  *
@@ -133,6 +222,7 @@ delete_persistent(typename detail::pp_if_not_array<T>::type ptr)
 	 */
 	detail::destroy<T>(*ptr);
 
+	detail::telemetry_on_free(*ptr.raw_ptr());
 	if (pmemobj_tx_free(*ptr.raw_ptr()) != 0)
 		throw detail::exception_with_errormsg<
 			pmem::transaction_free_error>(
@@ -16,6 +16,7 @@
 #include <libpmemobj++/detail/check_persistent_ptr_array.hpp>
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/life.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/detail/variadic.hpp>
 #include <libpmemobj++/pexceptions.hpp>
 #include <libpmemobj/tx_base.h>
@@ -77,6 +78,8 @@ make_persistent(std::size_t N, allocation_flag flag = allocation_flag::none())
 				pmem::transaction_alloc_error>(msg);
 	}
 
+	detail::telemetry_on_alloc(*ptr.raw_ptr());
+
 	/*
 	 * cache raw pointer to data - using persistent_ptr.get() in a loop
 	 * is expensive.
@@ -137,6 +140,8 @@ make_persistent(allocation_flag flag = allocation_flag::none())
 				pmem::transaction_alloc_error>(msg);
 	}
 
+	detail::telemetry_on_alloc(*ptr.raw_ptr());
+
 	/*
 	 * cache raw pointer to data - using persistent_ptr.get() in a loop
 	 * is expensive.
@@ -198,6 +203,7 @@ delete_persistent(typename detail::pp_if_array<T>::type ptr, std::size_t N)
 		detail::destroy<I>(
 			data[static_cast<std::ptrdiff_t>(N) - 1 - i]);
 
+	detail::telemetry_on_free(*ptr.raw_ptr());
 	if (pmemobj_tx_free(*ptr.raw_ptr()) != 0)
 		throw detail::exception_with_errormsg<
 			pmem::transaction_free_error>(
@@ -245,6 +251,7 @@ delete_persistent(typename detail::pp_if_size_array<T>::type ptr)
 		detail::destroy<I>(
 			data[static_cast<std::ptrdiff_t>(N) - 1 - i]);
 
+	detail::telemetry_on_free(*ptr.raw_ptr());
 	if (pmemobj_tx_free(*ptr.raw_ptr()) != 0)
 		throw detail::exception_with_errormsg<
 			pmem::transaction_free_error>(
@@ -16,6 +16,7 @@
 #include <libpmemobj++/detail/check_persistent_ptr_array.hpp>
 #include <libpmemobj++/detail/common.hpp>
 #include <libpmemobj++/detail/make_atomic_impl.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
 #include <libpmemobj++/detail/variadic.hpp>
 #include <libpmemobj++/pexceptions.hpp>
 #include <libpmemobj/atomic_base.h>
@@ -57,6 +58,8 @@ make_persistent_atomic(
 
 	if (ret != 0)
 		throw std::bad_alloc();
+
+	detail::telemetry_on_alloc(*ptr.raw_ptr());
 }
 
 /**
@@ -89,6 +92,8 @@ make_persistent_atomic(
 
 	if (ret != 0)
 		throw std::bad_alloc();
+
+	detail::telemetry_on_alloc(*ptr.raw_ptr());
 }
 
 /**
@@ -110,6 +115,7 @@ delete_persistent_atomic(typename detail::pp_if_array<T>::type &ptr,
 		return;
 
 	/* we CAN'T call destructor */
+	detail::telemetry_on_free(*ptr.raw_ptr());
 	pmemobj_free(ptr.raw_ptr());
 }
 
@@ -130,6 +136,7 @@ delete_persistent_atomic(typename detail::pp_if_size_array<T>::type &ptr)
 		return;
 
 	/* we CAN'T call destructor */
+	detail::telemetry_on_free(*ptr.raw_ptr());
 	pmemobj_free(ptr.raw_ptr());
 }
 
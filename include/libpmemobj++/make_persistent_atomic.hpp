@@ -19,9 +19,11 @@
 #include <libpmemobj++/make_persistent_array_atomic.hpp>
 #include <libpmemobj++/pexceptions.hpp>
 #include <libpmemobj++/pool.hpp>
+#include <libpmemobj/action_base.h>
 #include <libpmemobj/atomic_base.h>
 
 #include <tuple>
+#include <vector>
 
 namespace pmem
 {
@@ -61,6 +63,8 @@ make_persistent_atomic(pool_base &pool,
 
 	if (ret != 0)
 		throw std::bad_alloc();
+
+	detail::telemetry_on_alloc(*ptr.raw_ptr());
 }
 
 /**
@@ -90,6 +94,95 @@ make_persistent_atomic(pool_base &pool,
 				  std::forward<Args>(args)...);
 }
 
+/**
+ * Atomically allocate and construct 'count' independent objects of type T
+ * and store pointers to them in 'ptrs'.
+ *
+ * All objects are reserved and constructed first and then published,
+ * together with the new values of all 'ptrs', in a single atomic action.
+ * Either all objects are allocated and all pointers are set, or none. This
+ * is much cheaper than calling make_persistent_atomic() 'count' times.
+ * Each object can be freed independently with delete_persistent_atomic()
+ * or delete_persistent(). Do *NOT* use this inside transactions, as it
+ * might lead to undefined behavior in the presence of transaction aborts.
+ *
+ * @param[in,out] pool the pool from which the objects will be allocated.
+ * @param[in,out] ptrs array of 'count' persistent pointers residing in
+ * 'pool', to which the allocations will take place.
+ * @param[in] count number of objects to allocate.
+ * @param[in] args a list of parameters passed to the constructor of every
+ * object. They are not forwarded, as they are used 'count' times.
+ *
+ * @throw pmem::pool_error if any of 'ptrs' does not reside in 'pool'.
+ * @throw std::bad_alloc on allocation failure.
+ * @throw rethrows constructor exception. Objects which were already
+ * constructed are destroyed before that.
+ * @ingroup allocation
+ */
+template <typename T, typename... Args>
+void
+make_persistent_atomic_batch(pool_base &pool,
+			     typename detail::pp_if_not_array<T>::type *ptrs,
+			     std::size_t count, Args &&... args)
+{
+	if (count == 0)
+		return;
+
+	for (std::size_t i = 0; i < count; ++i) {
+		if (pmemobj_pool_by_ptr(&ptrs[i]) != pool.handle())
+			throw pmem::pool_error(
+				"Pointers must reside in the allocation pool");
+	}
+
+	/* one action per object and two per pointer (pool uuid and offset) */
+	std::vector<pobj_action> actv(3 * count);
+	std::vector<T *> objects;
+	objects.reserve(count);
+
+	/* destroys constructed objects and cancels first 'n' reservations */
+	auto cancel = [&](std::size_t n) {
+		for (auto it = objects.rbegin(); it != objects.rend(); ++it)
+			detail::destroy<T>(**it);
+
+		pmemobj_cancel(pool.handle(), actv.data(), n);
+	};
+
+	for (std::size_t i = 0; i < count; ++i) {
+		PMEMoid oid = pmemobj_reserve(pool.handle(), &actv[i],
+					      sizeof(T), detail::type_num<T>());
+
+		if (OID_IS_NULL(oid)) {
+			cancel(i);
+			throw std::bad_alloc();
+		}
+
+		auto obj = static_cast<T *>(pmemobj_direct(oid));
+		try {
+			detail::create<T>(obj, args...);
+		} catch (...) {
+			cancel(i + 1);
+			throw;
+		}
+		objects.push_back(obj);
+
+		pool.persist(obj, sizeof(T));
+
+		PMEMoid *dest = ptrs[i].raw_ptr();
+		pmemobj_set_value(pool.handle(), &actv[count + 2 * i],
+				  &dest->pool_uuid_lo, oid.pool_uuid_lo);
+		pmemobj_set_value(pool.handle(), &actv[count + 2 * i + 1],
+				  &dest->off, oid.off);
+	}
+
+	if (pmemobj_publish(pool.handle(), actv.data(), actv.size()) != 0) {
+		cancel(count);
+		throw std::bad_alloc();
+	}
+
+	for (std::size_t i = 0; i < count; ++i)
+		detail::telemetry_on_alloc(*ptrs[i].raw_ptr());
+}
+
 /**
  * Atomically deallocate an object.
  *
@@ -110,6 +203,7 @@ delete_persistent_atomic(
 		return;
 
 	/* we CAN'T call the destructor */
+	detail::telemetry_on_free(*ptr.raw_ptr());
 	pmemobj_free(ptr.raw_ptr());
 }
 
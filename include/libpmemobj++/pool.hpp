@@ -25,6 +25,7 @@
 #include <libpmemobj++/p.hpp>
 #include <libpmemobj++/persistent_ptr_base.hpp>
 #include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj++/telemetry.hpp>
 #include <libpmemobj/atomic_base.h>
 #include <libpmemobj/pool_base.h>
 
@@ -120,6 +121,41 @@ public:
 		return pool_base(pop);
 	}
 
+	/**
+	 * Opens an existing object store memory pool for reading only.
+	 *
+	 * No transaction can be started on a pool opened this way. Containers
+	 * serve lookups without taking any locks (see
+	 * concurrent_hash_map::find()) and their modifying operations throw
+	 * before touching the container. Lookups of experimental::radix_tree
+	 * in MtMode need no ebr critical sections nor hazard pointers and its
+	 * snapshots are not tracked. The mode is kept in the volatile state of
+	 * the pool, nothing is written to the pool to track it.
+	 *
+	 * @param path System path to the file containing the memory
+	 *	pool or a pool set.
+	 * @param layout Unique identifier of the pool as specified at
+	 *	pool creation time.
+	 *
+	 * @return handle to the opened pool.
+	 *
+	 * @throw pmem::pool_error when an error during opening occurs.
+	 */
+	static pool_base
+	open_read_only(const std::string &path, const std::string &layout)
+	{
+#ifdef _WIN32
+		pmemobjpool *pop = pmemobj_openU(path.c_str(), layout.c_str());
+#else
+		pmemobjpool *pop = pmemobj_open(path.c_str(), layout.c_str());
+#endif
+		check_pool(pop, "opening");
+
+		pmemobj_set_user_data(pop, new detail::pool_data(true));
+
+		return pool_base(pop);
+	}
+
 	/**
 	 * Creates a new transactional object store pool.
 	 *
@@ -199,6 +235,30 @@ public:
 		return pool_base(pop);
 	}
 
+	/**
+	 * Opens an existing object store memory pool for reading only. Wide
+	 * string variant. Available only on Windows.
+	 *
+	 * @param path System path to the file containing the memory
+	 *	pool or a pool set.
+	 * @param layout Unique identifier of the pool as specified at
+	 *	pool creation time.
+	 *
+	 * @return handle to the opened pool.
+	 *
+	 * @throw pmem::pool_error when an error during opening occurs.
+	 */
+	static pool_base
+	open_read_only(const std::wstring &path, const std::wstring &layout)
+	{
+		pmemobjpool *pop = pmemobj_openW(path.c_str(), layout.c_str());
+		check_pool(pop, "opening");
+
+		pmemobj_set_user_data(pop, new detail::pool_data(true));
+
+		return pool_base(pop);
+	}
+
 	/**
 	 * Creates a new transactional object store pool. Wide string variant.
 	 * Available only on Windows.
@@ -268,6 +328,42 @@ public:
 
 		pmemobj_close(this->pop);
 		this->pop = nullptr;
+
+		detail::closed_pools().fetch_add(1, std::memory_order_release);
+	}
+
+	/**
+	 * Checks if the pool was opened with open_read_only().
+	 *
+	 * @return true if no modifications are allowed in the pool.
+	 */
+	bool
+	is_read_only() const noexcept
+	{
+		return detail::is_read_only_pool(this->pop);
+	}
+
+	/**
+	 * Returns a handle to the telemetry of the pool. Telemetry is
+	 * disabled until pool_telemetry::enable() is called.
+	 *
+	 * Example:
+	 * @code
+	 * auto t = pop.telemetry();
+	 * t.enable();
+	 * t.start_sampling(std::chrono::seconds(1),
+	 *	[](const pmem::obj::telemetry_snapshot &s) {
+	 *		std::cout << s.curr_allocated << " "
+	 *			  << s.snapshot_bytes_per_tx() << std::endl;
+	 *	});
+	 * @endcode
+	 *
+	 * @return pool_telemetry handle, valid until the pool is closed.
+	 */
+	pool_telemetry
+	telemetry() const noexcept
+	{
+		return pool_telemetry(this->pop);
 	}
 
 	/**
@@ -674,6 +770,24 @@ public:
 		return pool<T>(pool_base::open(path, layout));
 	}
 
+	/**
+	 * Opens an existing object store memory pool for reading only.
+	 *
+	 * @param path System path to the file containing the memory
+	 *	pool or a pool set.
+	 * @param layout Unique identifier of the pool as specified at
+	 *	pool creation time.
+	 *
+	 * @return handle to the opened pool.
+	 *
+	 * @throw pmem::pool_error when an error during opening occurs.
+	 */
+	static pool<T>
+	open_read_only(const std::string &path, const std::string &layout)
+	{
+		return pool<T>(pool_base::open_read_only(path, layout));
+	}
+
 	/**
 	 * Creates a new transactional object store pool.
 	 *
@@ -733,6 +847,25 @@ public:
 		return pool<T>(pool_base::open(path, layout));
 	}
 
+	/**
+	 * Opens an existing object store memory pool for reading only. Wide
+	 * string variant. Available only on Windows.
+	 *
+	 * @param path System path to the file containing the memory
+	 *	pool or a pool set.
+	 * @param layout Unique identifier of the pool as specified at
+	 *	pool creation time.
+	 *
+	 * @return handle to the opened pool.
+	 *
+	 * @throw pmem::pool_error when an error during opening occurs.
+	 */
+	static pool<T>
+	open_read_only(const std::wstring &path, const std::wstring &layout)
+	{
+		return pool<T>(pool_base::open_read_only(path, layout));
+	}
+
 	/**
 	 * Creates a new transactional object store pool. Wide string variant.
 	 * Available only on Windows.
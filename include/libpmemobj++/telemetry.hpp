@@ -0,0 +1,313 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/**
+ * @file
+ * Pool telemetry: heap statistics, transaction counters and per-type
+ * allocation statistics.
+ */
+
+#ifndef LIBPMEMOBJ_CPP_TELEMETRY_HPP
+#define LIBPMEMOBJ_CPP_TELEMETRY_HPP
+
+#include <libpmemobj++/detail/common.hpp>
+#include <libpmemobj++/detail/ctl.hpp>
+#include <libpmemobj++/detail/pool_data.hpp>
+#include <libpmemobj++/pexceptions.hpp>
+#include <libpmemobj/ctl.h>
+#include <libpmemobj/pool_base.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace pmem
+{
+
+namespace obj
+{
+
+/**
+ * Allocation statistics of a single type number.
+ */
+struct allocation_stats {
+	/** Number of allocations. */
+	uint64_t allocations = 0;
+	/** Number of deallocations. */
+	uint64_t frees = 0;
+	/** Sum of usable sizes of allocated objects. */
+	uint64_t allocated_bytes = 0;
+	/** Sum of usable sizes of freed objects. */
+	uint64_t freed_bytes = 0;
+
+	/**
+	 * @return number of bytes currently held by objects of this type.
+	 */
+	uint64_t
+	live_bytes() const noexcept
+	{
+		return allocated_bytes - freed_bytes;
+	}
+};
+
+/**
+ * Point-in-time view of the telemetry of a pool.
+ *
+ * Heap statistics come from libpmemobj (see "stats.heap.*" entry points
+ * in pmemobj_ctl_get(3)). Other counters are gathered by libpmemobj-cpp
+ * since telemetry was enabled for the pool.
+ */
+struct telemetry_snapshot {
+	/** Number of bytes currently allocated in the heap. */
+	uint64_t curr_allocated = 0;
+	/** Number of bytes allocated in run-based (small) allocations. */
+	uint64_t run_allocated = 0;
+	/** Number of bytes of runs currently active in the heap. */
+	uint64_t run_active = 0;
+
+	/** Number of committed (outermost) transactions. */
+	uint64_t tx_committed = 0;
+	/** Number of aborted (outermost) transactions. */
+	uint64_t tx_aborted = 0;
+	/**
+	 * Number of bytes added to undo logs by transactions. Ranges which
+	 * were already snapshotted in the same transaction and ranges added
+	 * with POBJ_XADD_NO_SNAPSHOT are not counted, nor are snapshots of
+	 * transactions which started before telemetry was enabled.
+	 */
+	uint64_t snapshot_bytes = 0;
+
+	/** Allocation statistics keyed by type number. */
+	std::map<uint64_t, allocation_stats> types;
+
+	/**
+	 * Returns allocation statistics of objects of type T. For
+	 * containers, T is the type of the internal node or segment the
+	 * container allocates.
+	 *
+	 * @return statistics for detail::type_num<T>().
+	 */
+	template <typename T>
+	allocation_stats
+	for_type() const
+	{
+		auto it = types.find(detail::type_num<T>());
+		return it == types.end() ? allocation_stats() : it->second;
+	}
+
+	/**
+	 * Returns the average number of bytes snapshotted per committed
+	 * transaction, a measure of transactional write amplification.
+	 *
+	 * @return snapshot_bytes / tx_committed or 0 if no transaction
+	 * was committed.
+	 */
+	double
+	snapshot_bytes_per_tx() const noexcept
+	{
+		return tx_committed == 0
+			? 0.0
+			: static_cast<double>(snapshot_bytes) /
+				static_cast<double>(tx_committed);
+	}
+};
+
+/**
+ * Handle to the telemetry of a pool, returned by pool_base::telemetry().
+ *
+ * Telemetry is disabled by default. When no pool has it enabled, the cost
+ * of the instrumentation is a single relaxed atomic load per allocation,
+ * free and snapshot. Otherwise, snapshots taken in transactions of pools
+ * without telemetry cost one more thread-local load; only transactions of
+ * pools with telemetry track the snapshotted ranges.
+ *
+ * Allocations made by make_persistent(), make_persistent_atomic(),
+ * pmem::obj::allocator and all containers are accounted to the type number
+ * of the allocated object. Frees and
+ * allocations are accounted when they are requested, so objects freed or
+ * allocated in an aborted transaction are counted as well.
+ *
+ * The handle does not own any state and may be freely copied, but it must
+ * not be used after the pool is closed. All methods, except the constructor,
+ * throw pmem::pool_error if the pool was not opened by pmem::obj::pool.
+ */
+class pool_telemetry {
+public:
+	/**
+	 * Callback type of periodic sampling.
+	 */
+	using callback_type = std::function<void(const telemetry_snapshot &)>;
+
+	/**
+	 * Constructs handle to the telemetry of the pool.
+	 */
+	explicit pool_telemetry(PMEMobjpool *pop) noexcept : pop(pop)
+	{
+	}
+
+	/**
+	 * Enables telemetry for the pool. It also enables libpmemobj
+	 * runtime statistics ("stats.enabled").
+	 *
+	 * @throw pmem::ctl_error if statistics could not be enabled.
+	 */
+	void
+	enable()
+	{
+		ctl_set_detail(pop, "stats.enabled",
+			       POBJ_STATS_ENABLED_TRANSIENT);
+
+		bool expected = false;
+		if (data().enabled.compare_exchange_strong(expected, true))
+			detail::telemetry_enabled_pools().fetch_add(1);
+	}
+
+	/**
+	 * Disables telemetry for the pool and stops periodic sampling.
+	 * Counters are preserved.
+	 */
+	void
+	disable()
+	{
+		auto &d = data();
+		{
+			std::lock_guard<std::mutex> lock(d.control_mtx);
+			d.stop_sampling();
+		}
+
+		bool expected = true;
+		if (d.enabled.compare_exchange_strong(expected, false))
+			detail::telemetry_enabled_pools().fetch_sub(1);
+	}
+
+	/**
+	 * @return true if telemetry is enabled for the pool.
+	 */
+	bool
+	enabled() const
+	{
+		return data().enabled.load();
+	}
+
+	/**
+	 * Takes a snapshot of the telemetry counters and heap statistics.
+	 *
+	 * @return telemetry_snapshot of the pool.
+	 *
+	 * @throw pmem::ctl_error if heap statistics could not be read.
+	 */
+	telemetry_snapshot
+	sample() const
+	{
+		telemetry_snapshot s;
+
+		s.curr_allocated = ctl_get_detail<uint64_t>(
+			pop, "stats.heap.curr_allocated");
+		s.run_allocated = ctl_get_detail<uint64_t>(
+			pop, "stats.heap.run_allocated");
+		s.run_active = ctl_get_detail<uint64_t>(
+			pop, "stats.heap.run_active");
+
+		auto &d = data();
+		s.tx_committed = d.tx_committed.load();
+		s.tx_aborted = d.tx_aborted.load();
+		s.snapshot_bytes = d.snapshot_bytes.load();
+
+		for (auto &e : d.collect()) {
+			auto &t = s.types[e.first];
+			t.allocations = e.second.allocations;
+			t.frees = e.second.frees;
+			t.allocated_bytes = e.second.allocated_bytes;
+			t.freed_bytes = e.second.freed_bytes;
+		}
+
+		return s;
+	}
+
+	/**
+	 * Starts a background thread which calls sample() every 'interval'
+	 * and passes the result to 'cb'. Previously started sampling is
+	 * stopped. Sampling is stopped by stop_sampling(), disable() or when
+	 * the pool is closed. Exceptions thrown by sample() or 'cb' are
+	 * ignored. It may be called concurrently with the other sampling
+	 * functions.
+	 *
+	 * 'cb' must not call stop_sampling(), disable() or close the pool.
+	 *
+	 * @param[in] interval time between consecutive samples.
+	 * @param[in] cb callback receiving the snapshots.
+	 */
+	void
+	start_sampling(std::chrono::milliseconds interval, callback_type cb)
+	{
+		auto &d = data();
+		std::lock_guard<std::mutex> control_lock(d.control_mtx);
+
+		d.stop_sampling();
+		{
+			std::lock_guard<std::mutex> lock(d.sampler_mtx);
+			d.sampler_stop = false;
+		}
+
+		pool_telemetry self(*this);
+		d.sampler = std::thread([self, interval, cb]() {
+			auto &d = self.data();
+			std::unique_lock<std::mutex> lock(d.sampler_mtx);
+
+			while (!d.sampler_cv.wait_for(lock, interval, [&] {
+				return d.sampler_stop;
+			})) {
+				lock.unlock();
+
+				try {
+					cb(self.sample());
+				} catch (...) {
+				}
+
+				lock.lock();
+			}
+		});
+	}
+
+	/**
+	 * Stops periodic sampling started by start_sampling(). Waits for the
+	 * callback in progress to finish.
+	 */
+	void
+	stop_sampling()
+	{
+		auto &d = data();
+		std::lock_guard<std::mutex> lock(d.control_mtx);
+		d.stop_sampling();
+	}
+
+private:
+	/*
+	 * Returns telemetry data of the pool. Pools opened without
+	 * pmem::obj::pool (e.g. by a C application) have no such data.
+	 */
+	detail::telemetry_data &
+	data() const
+	{
+		auto *pdata = pop == nullptr
+			? nullptr
+			: static_cast<detail::pool_data *>(
+				  pmemobj_get_user_data(pop));
+		if (pdata == nullptr)
+			throw pmem::pool_error(
+				"Pool has no telemetry data, it was not opened by pmem::obj::pool.");
+
+		return pdata->telemetry;
+	}
+
+	PMEMobjpool *pop;
+};
+
+} /* namespace obj */
+
+} /* namespace pmem */
+
+#endif /* LIBPMEMOBJ_CPP_TELEMETRY_HPP */
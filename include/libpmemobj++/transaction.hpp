@@ -10,6 +10,7 @@
 #define LIBPMEMOBJ_CPP_TRANSACTION_HPP
 
 #include <array>
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <vector>
@@ -62,12 +63,18 @@ public:
 		 *
 		 * @throw pmem::transaction_error when pmemobj_tx_begin
 		 * function or locks adding failed.
+		 * @throw pmem::transaction_scope_error if the pool was opened
+		 * with pool_base::open_read_only().
 		 */
 		template <typename... L>
 		manual(obj::pool_base &pop, L &... locks)
 		{
 			int ret = 0;
 
+			if (pop.is_read_only())
+				throw pmem::transaction_scope_error(
+					"Cannot start transaction in a read-only pool");
+
 			nested = pmemobj_tx_stage() == TX_STAGE_WORK;
 
 			if (nested) {
@@ -78,6 +85,10 @@ public:
 					pop.handle(), nullptr, TX_PARAM_CB,
 					transaction_base::c_callback, nullptr,
 					TX_PARAM_NONE);
+
+				if (ret == 0)
+					detail::telemetry_on_tx_begin(
+						pop.handle());
 			} else {
 				throw pmem::transaction_scope_error(
 					"Cannot start transaction in stage different than WORK or NONE");
@@ -450,6 +461,8 @@ public:
 				throw detail::exception_with_errormsg<
 					pmem::transaction_error>(msg);
 		}
+
+		detail::telemetry_on_snapshot(addr, sizeof(*addr) * num);
 	}
 
 	/*! \enum stage
@@ -494,6 +507,124 @@ public:
 			cb);
 	}
 
+	/*! \enum log_type
+		\brief Types of transaction logs.
+
+		To read more about transaction logs, see manpage
+		pmemobj_tx_log_append_buffer(3):
+		https://pmem.io/pmdk/manpages/linux/master/libpmemobj/pmemobj_tx_begin.3
+	 */
+	enum class log_type {
+		snapshot = TX_LOG_TYPE_SNAPSHOT, /**< undo log of snapshots */
+		intent = TX_LOG_TYPE_INTENT,	 /**< redo log of allocations
+						    and frees */
+	};
+
+	/**
+	 * Appends a user-provided buffer to the transaction log of the given
+	 * type. The buffer is used before the log is extended by an
+	 * allocation, which saves allocator round-trips for big
+	 * transactions. The buffer must reside in the pool of the
+	 * transaction, must not be modified or freed until the end of the
+	 * outermost transaction and must not be used as a log by any other
+	 * concurrent transaction.
+	 *
+	 * @param[in] type type of the log.
+	 * @param[in] addr address of the buffer.
+	 * @param[in] size size of the buffer in bytes.
+	 *
+	 * @pre this function must be called during a transaction.
+	 *
+	 * @throw transaction_scope_error when called outside of a transaction
+	 * scope.
+	 * @throw transaction_error when the buffer could not be appended.
+	 */
+	static void
+	log_append_buffer(log_type type, void *addr, size_t size)
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_WORK)
+			throw pmem::transaction_scope_error(
+				"log_append_buffer must be called during a transaction");
+
+		if (pmemobj_tx_log_append_buffer(
+			    static_cast<enum pobj_log_type>(type), addr, size))
+			throw detail::exception_with_errormsg<
+				pmem::transaction_error>(
+				"Could not append buffer to the transaction log.");
+	}
+
+	/**
+	 * Enables or disables automatic extension of the transaction log of
+	 * the given type. With automatic extension disabled, a transaction
+	 * which does not fit in the buffers appended with
+	 * log_append_buffer() is aborted.
+	 *
+	 * @param[in] type type of the log.
+	 * @param[in] on whether the log may be extended by allocations.
+	 *
+	 * @pre this function must be called during a transaction.
+	 *
+	 * @throw transaction_scope_error when called outside of a transaction
+	 * scope.
+	 * @throw transaction_error when the setting could not be changed.
+	 */
+	static void
+	log_auto_alloc(log_type type, bool on)
+	{
+		if (pmemobj_tx_stage() != TX_STAGE_WORK)
+			throw pmem::transaction_scope_error(
+				"log_auto_alloc must be called during a transaction");
+
+		if (pmemobj_tx_log_auto_alloc(
+			    static_cast<enum pobj_log_type>(type), on ? 1 : 0))
+			throw detail::exception_with_errormsg<
+				pmem::transaction_error>(
+				"Could not change the log auto allocation setting.");
+	}
+
+	/**
+	 * Calculates the size of the undo log buffer needed to snapshot
+	 * ranges of the given sizes in a single transaction.
+	 *
+	 * @param[in] sizes sizes of the ranges to be snapshotted.
+	 *
+	 * @return size of the buffer in bytes.
+	 *
+	 * @throw transaction_error if the size overflows.
+	 */
+	static size_t
+	log_snapshots_max_size(std::vector<size_t> sizes)
+	{
+		auto ret = pmemobj_tx_log_snapshots_max_size(sizes.data(),
+							     sizes.size());
+		if (ret == SIZE_MAX)
+			throw pmem::transaction_error(
+				"Snapshots log size overflow.");
+
+		return ret;
+	}
+
+	/**
+	 * Calculates the size of the intent log buffer needed for the
+	 * given number of allocations and frees in a single transaction.
+	 *
+	 * @param[in] nintents number of allocations and frees.
+	 *
+	 * @return size of the buffer in bytes.
+	 *
+	 * @throw transaction_error if the size overflows.
+	 */
+	static size_t
+	log_intents_max_size(size_t nintents)
+	{
+		auto ret = pmemobj_tx_log_intents_max_size(nintents);
+		if (ret == SIZE_MAX)
+			throw pmem::transaction_error(
+				"Intents log size overflow.");
+
+		return ret;
+	}
+
 private:
 	/**
 	 * Recursively add locks to the active transaction.
@@ -548,6 +679,11 @@ private:
 		if (obj_stage == TX_STAGE_NONE)
 			return;
 
+		if (obj_stage == TX_STAGE_ONCOMMIT ||
+		    obj_stage == TX_STAGE_ONABORT)
+			detail::telemetry_on_tx_end(
+				pop, obj_stage == TX_STAGE_ONCOMMIT);
+
 		auto *data = static_cast<tx_data *>(pmemobj_tx_get_user_data());
 		if (data == nullptr)
 			return;
@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * concurrent_hash_map_clear.cpp -- pmem::obj::concurrent_hash_map test of
+ * clear and free_data in bounded transactions
+ *
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <iterator>
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+
+#define LAYOUT "concurrent_hash_map"
+
+/* When this is defined we test deprecated runtime_initialize() method which
+ * is needed for compatibility. We test new runtime_initialize() otherwise. */
+#ifdef USE_DEPRECATED_RUNTIME_INITIALIZE
+#define RUNTIME_INITIALIZE runtime_initialize(true)
+#else
+#define RUNTIME_INITIALIZE runtime_initialize()
+#endif
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>> map_type;
+
+/*
+ * Map is derived to get access to the clear cursor and layout features, to
+ * simulate an interrupted clear.
+ */
+struct persistent_map_type : public map_type {
+	void
+	start_clear()
+	{
+		auto pop = nvobj::pool_base(pmemobj_pool_by_ptr(this));
+
+		nvobj::flat_transaction::run(pop, [&] {
+			this->layout_features.incompat |=
+				INCOMPAT_FEATURE_CLEAR_IN_PROGRESS;
+			this->my_clear_cursor = 1;
+		});
+	}
+
+	uint64_t
+	clear_cursor() const
+	{
+		return this->my_clear_cursor;
+	}
+
+	/* Older versions of the library refuse to open a map with any
+	 * incompat feature set. */
+	bool
+	clear_in_progress() const
+	{
+		return this->layout_features.incompat &
+			INCOMPAT_FEATURE_CLEAR_IN_PROGRESS;
+	}
+};
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+};
+
+static const int ITEMS = 10000;
+
+void
+insert_items(nvobj::persistent_ptr<persistent_map_type> map, int n)
+{
+	for (int i = 0; i < n; i++) {
+		map_type::value_type val(i, i);
+		UT_ASSERT(map->insert(val));
+	}
+
+	UT_ASSERTeq(map->size(), static_cast<size_t>(n));
+}
+
+void
+check_empty(nvobj::persistent_ptr<persistent_map_type> map)
+{
+	UT_ASSERTeq(map->size(), 0);
+	UT_ASSERT(map->begin() == map->end());
+	UT_ASSERTeq(map->count(0), 0);
+	UT_ASSERTeq(map->clear_cursor(), 0);
+	UT_ASSERT(!map->clear_in_progress());
+}
+
+/*
+ * clear_test -- (internal) clear the map in chunks using a different number
+ * of threads
+ */
+void
+clear_test(nvobj::pool<root> &pop, size_t concurrency)
+{
+	auto map = pop.root()->cons;
+
+	size_t chunks[] = {1, 7, 64, 1 << 20};
+	for (auto chunk : chunks) {
+		insert_items(map, ITEMS);
+
+		map->clear(chunk, concurrency);
+		check_empty(map);
+
+		/* map can be used after clear */
+		insert_items(map, ITEMS / 10);
+		map->clear();
+		check_empty(map);
+	}
+
+	try {
+		nvobj::flat_transaction::run(pop, [&] { map->clear(1); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+}
+
+/*
+ * resume_test -- (internal) interrupted clear is finished by
+ * runtime_initialize, it cannot be finished in a read-only pool
+ */
+void
+resume_test(nvobj::pool<root> &pop, const char *path)
+{
+	auto map = pop.root()->cons;
+
+	insert_items(map, ITEMS);
+	map->start_clear();
+	UT_ASSERT(map->clear_in_progress());
+
+	pop.close();
+
+	pop = nvobj::pool<root>::open_read_only(path, LAYOUT);
+	map = pop.root()->cons;
+
+	try {
+		map->RUNTIME_INITIALIZE;
+		UT_ASSERT(0);
+	} catch (pmem::layout_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+	UT_ASSERT(map->clear_cursor() != 0);
+	UT_ASSERT(map->clear_in_progress());
+
+	pop.close();
+
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+	map = pop.root()->cons;
+
+	map->RUNTIME_INITIALIZE;
+	check_empty(map);
+
+	insert_items(map, ITEMS);
+}
+
+/*
+ * free_data_test -- (internal) free the map in chunks and delete it
+ */
+void
+free_data_test(nvobj::pool<root> &pop)
+{
+	auto map = pop.root()->cons;
+
+	map->free_data(16, 4);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<persistent_map_type>(map);
+		pop.root()->cons = nullptr;
+	});
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		pmem::obj::transaction::run(pop, [&] {
+			pop.root()->cons =
+				nvobj::make_persistent<persistent_map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	size_t concurrency = 8;
+	if (On_drd)
+		concurrency = 2;
+
+	clear_test(pop, 1);
+	clear_test(pop, concurrency);
+	resume_test(pop, path);
+	free_data_test(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * concurrent_hash_map_erase_deferred.cpp -- pmem::obj::concurrent_hash_map
+ * test of erase which does not wait for accessors
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <atomic>
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+
+#define LAYOUT "concurrent_hash_map"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>> map_type;
+
+struct root {
+	nvobj::persistent_ptr<map_type> cons;
+};
+
+static const int ITEMS = 100;
+
+/*
+ * basic_test -- (internal) element held by an accessor is unlinked at once
+ * and freed after the accessor is released
+ */
+void
+basic_test(nvobj::pool<root> &pop)
+{
+	auto map = pop.root()->cons;
+
+	for (int i = 0; i < ITEMS; i++)
+		map->insert(map_type::value_type(i, i));
+
+	auto allocs = num_allocs(pop);
+
+	/* element which is not held is freed immediately */
+	UT_ASSERT(map->erase_deferred(0));
+	UT_ASSERTeq(num_allocs(pop), allocs - 1);
+	UT_ASSERT(!map->erase_deferred(0));
+
+	{
+		/* the same thread can erase an element it holds */
+		map_type::const_accessor acc;
+		UT_ASSERT(map->find(acc, 1));
+
+		UT_ASSERT(map->erase_deferred(1));
+		UT_ASSERTeq(map->count(1), 0);
+		UT_ASSERTeq(map->size(), static_cast<size_t>(ITEMS - 2));
+
+		/* the element is still valid */
+		UT_ASSERTeq(acc->first, 1);
+		UT_ASSERTeq(acc->second, 1);
+
+		UT_ASSERTeq(map->reclaim_retired(), 0);
+		UT_ASSERTeq(num_allocs(pop), allocs - 1);
+
+		/* the key can be inserted again */
+		UT_ASSERT(map->insert(map_type::value_type(1, -1)));
+		UT_ASSERTeq(acc->second, 1);
+		UT_ASSERT(map->erase(1));
+	}
+
+	UT_ASSERTeq(map->reclaim_retired(), 1);
+	UT_ASSERTeq(map->reclaim_retired(), 0);
+	UT_ASSERTeq(num_allocs(pop), allocs - 2);
+
+	/* elements retired by other threads are freed by a map-wide sweep */
+	{
+		map_type::const_accessor acc;
+		UT_ASSERT(map->find(acc, 3));
+
+		parallel_exec(1, [&](size_t) {
+			UT_ASSERT(map->erase_deferred(3));
+		});
+
+		UT_ASSERTeq(map->reclaim_all_retired(), 0);
+	}
+
+	UT_ASSERTeq(map->reclaim_retired(), 0);
+	UT_ASSERTeq(num_allocs(pop), allocs - 2);
+	UT_ASSERTeq(map->reclaim_all_retired(), 1);
+	UT_ASSERTeq(map->reclaim_all_retired(), 0);
+	UT_ASSERTeq(num_allocs(pop), allocs - 3);
+
+	/* clear frees the retired elements */
+	{
+		map_type::accessor acc;
+		UT_ASSERT(map->find(acc, 2));
+		UT_ASSERT(map->erase_deferred(2));
+	}
+	map->clear();
+	UT_ASSERTeq(map->reclaim_retired(), 0);
+	UT_ASSERTeq(map->size(), 0);
+}
+
+/*
+ * reopen_test -- (internal) elements retired before the pool was closed are
+ * freed by runtime_initialize (leaks are detected at the end of the test)
+ */
+void
+reopen_test(nvobj::pool<root> &pop, const char *path)
+{
+	auto map = pop.root()->cons;
+
+	for (int i = 0; i < ITEMS; i++)
+		map->insert(map_type::value_type(i, i));
+
+	for (int i = 0; i < ITEMS; i += 2) {
+		map_type::const_accessor acc;
+		UT_ASSERT(map->find(acc, i));
+		UT_ASSERT(map->erase_deferred(i));
+	}
+
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	map = pop.root()->cons;
+	map->runtime_initialize();
+
+	UT_ASSERTeq(map->reclaim_retired(), 0);
+	UT_ASSERTeq(map->size(), static_cast<size_t>(ITEMS / 2));
+	for (int i = 0; i < ITEMS; i++)
+		UT_ASSERTeq(map->count(i), static_cast<size_t>(i % 2));
+
+	map->clear();
+}
+
+/*
+ * concurrent_test -- (internal) erasers do not wait for readers which hold
+ * the erased elements
+ */
+void
+concurrent_test(nvobj::pool<root> &pop, size_t concurrency)
+{
+	auto map = pop.root()->cons;
+
+	const int rounds = 100;
+	std::atomic<size_t> erased(0);
+
+	for (int i = 0; i < ITEMS; i++)
+		map->insert(map_type::value_type(i, i));
+
+	parallel_exec(2 * concurrency, [&](size_t thread_id) {
+		if (thread_id < concurrency) {
+			for (int r = 0; r < rounds; r++) {
+				for (int i = 0; i < ITEMS; i++) {
+					map_type::const_accessor acc;
+					if (map->find(acc, i))
+						UT_ASSERTeq(acc->second, i);
+				}
+			}
+		} else {
+			int i = static_cast<int>(thread_id - concurrency);
+			for (; i < ITEMS; i += static_cast<int>(concurrency)) {
+				if (map->erase_deferred(i))
+					++erased;
+			}
+			map->reclaim_retired();
+		}
+	});
+
+	UT_ASSERTeq(erased.load(), static_cast<size_t>(ITEMS));
+	UT_ASSERTeq(map->size(), 0);
+
+	/* no accessors are left, the sweep frees everything */
+	map->reclaim_all_retired();
+	UT_ASSERTeq(map->reclaim_all_retired(), 0);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->cons = nvobj::make_persistent<map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	size_t concurrency = 4;
+	if (On_drd)
+		concurrency = 2;
+
+	basic_test(pop);
+	reopen_test(pop, path);
+	concurrent_test(pop, concurrency);
+
+	nvobj::transaction::run(pop, [&] {
+		pop.root()->cons->free_data();
+		nvobj::delete_persistent<map_type>(pop.root()->cons);
+	});
+	UT_ASSERTeq(num_allocs(pop), 0);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
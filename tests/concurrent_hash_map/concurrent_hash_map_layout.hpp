@@ -48,6 +48,8 @@ struct hashmap_test : public MapType {
 		ASSERT_OFFSET_CHECKPOINT(T, 16 * pmem::detail::CACHELINE_SIZE);
 		ASSERT_ALIGNED_FIELD(T, t, tls_ptr);
 		ASSERT_ALIGNED_FIELD(T, t, on_init_size);
+		ASSERT_ALIGNED_FIELD(T, t, my_clear_cursor);
+		ASSERT_ALIGNED_FIELD(T, t, my_retired);
 		ASSERT_ALIGNED_FIELD(T, t, reserved);
 		ASSERT_OFFSET_CHECKPOINT(T, 17 * pmem::detail::CACHELINE_SIZE);
 		ASSERT_ALIGNED_FIELD(T, t, my_segment_enable_mutex);
@@ -56,6 +58,7 @@ struct hashmap_test : public MapType {
 		ASSERT_ALIGNED_CHECK(T);
 		static_assert(sizeof(T) == HASHMAP_SIZE, "");
 		static_assert(std::is_standard_layout<T>::value, "");
+		static_assert(sizeof(typename T::tls_data_t) == 16, "");
 	}
 
 	static void
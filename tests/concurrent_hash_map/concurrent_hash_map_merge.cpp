@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * concurrent_hash_map_merge.cpp -- pmem::obj::concurrent_hash_map test of
+ * parallel assign and merge
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <map>
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+
+#define LAYOUT "concurrent_hash_map"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>> map_type;
+
+struct root {
+	nvobj::persistent_ptr<map_type> map1;
+	nvobj::persistent_ptr<map_type> map2;
+};
+
+static const int ITEMS = 10000;
+
+/*
+ * verify -- (internal) check that the map consists of the expected elements
+ */
+void
+verify(nvobj::persistent_ptr<map_type> map, const std::map<int, int> &expected)
+{
+	UT_ASSERTeq(map->size(), expected.size());
+
+	std::map<int, int> found;
+	for (auto &e : *map)
+		UT_ASSERT(found.emplace(e.first, e.second).second);
+
+	UT_ASSERT(found == expected);
+
+	for (auto &e : expected) {
+		map_type::const_accessor acc;
+		UT_ASSERT(map->find(acc, e.first));
+		UT_ASSERTeq(acc->second, e.second);
+	}
+}
+
+std::map<int, int>
+fill(nvobj::persistent_ptr<map_type> map, int first, int last, int value)
+{
+	std::map<int, int> ret;
+	for (int i = first; i < last; i++) {
+		map->insert_or_assign(i, i + value);
+		ret[i] = i + value;
+	}
+
+	return ret;
+}
+
+/*
+ * assign_test -- (internal) copy the map using a different number of threads
+ */
+void
+assign_test(nvobj::pool<root> &pop, size_t concurrency)
+{
+	auto map1 = pop.root()->map1;
+	auto map2 = pop.root()->map2;
+
+	auto expected = fill(map2, 0, ITEMS, 1);
+
+	map_type::size_type chunks[] = {1, 64, 1 << 20};
+	for (auto chunk : chunks) {
+		fill(map1, -ITEMS, ITEMS, 2);
+
+		map1->assign(*map2, chunk, concurrency);
+		verify(map1, expected);
+		verify(map2, expected);
+
+		/* map can be used after assign */
+		UT_ASSERT(map1->insert(map_type::value_type(ITEMS, 0)));
+		UT_ASSERT(map1->erase(0));
+		UT_ASSERTeq(map1->size(), expected.size());
+	}
+
+	map1->assign(*map1, 1, concurrency);
+	UT_ASSERTeq(map1->size(), expected.size());
+
+	try {
+		nvobj::flat_transaction::run(
+			pop, [&] { map1->assign(*map2, 1, concurrency); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	map1->clear();
+	map2->clear();
+}
+
+/*
+ * merge_test -- (internal) move elements between maps without reallocation
+ */
+void
+merge_test(nvobj::pool<root> &pop, const char *path)
+{
+	auto map1 = pop.root()->map1;
+	auto map2 = pop.root()->map2;
+
+	auto expected1 = fill(map1, 0, ITEMS, 1);
+	auto other = fill(map2, ITEMS / 2, ITEMS + ITEMS / 2, 2);
+
+	std::map<int, const void *> addresses;
+	for (auto &e : *map2)
+		addresses[e.first] = &e;
+
+	std::map<int, int> expected2;
+	for (auto &e : other) {
+		if (expected1.count(e.first))
+			expected2.insert(e);
+		else
+			expected1.insert(e);
+	}
+
+	map1->merge(*map2);
+	verify(map1, expected1);
+	verify(map2, expected2);
+
+	/* nodes were relinked, not copied */
+	for (auto &e : *map1) {
+		if (e.first >= ITEMS)
+			UT_ASSERT(addresses[e.first] == &e);
+	}
+	for (auto &e : *map2)
+		UT_ASSERT(addresses[e.first] == &e);
+
+	try {
+		nvobj::flat_transaction::run(pop, [&] { map1->merge(*map2); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	/* sizes are consistent after restart */
+	pop.close();
+
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+	map1 = pop.root()->map1;
+	map2 = pop.root()->map2;
+
+	map1->runtime_initialize();
+	map2->runtime_initialize();
+
+	verify(map1, expected1);
+	verify(map2, expected2);
+
+	/* all elements of map2 are duplicates */
+	map1->merge(*map2);
+	verify(map1, expected1);
+	verify(map2, expected2);
+
+	map2->merge(*map1);
+	verify(map2, expected1);
+	verify(map1, {});
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		pmem::obj::transaction::run(pop, [&] {
+			pop.root()->map1 = nvobj::make_persistent<map_type>();
+			pop.root()->map2 = nvobj::make_persistent<map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	size_t concurrency = 8;
+	if (On_drd)
+		concurrency = 2;
+
+	assign_test(pop, 1);
+	assign_test(pop, concurrency);
+	merge_test(pop, path);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
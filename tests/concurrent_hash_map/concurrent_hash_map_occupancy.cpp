@@ -0,0 +1,277 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * concurrent_hash_map_occupancy.cpp -- pmem::obj::concurrent_hash_map test
+ * of iteration over sparsely populated maps (with empty buckets skipped)
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <set>
+
+#include <libpmemobj++/container/concurrent_hash_map.hpp>
+
+#define LAYOUT "concurrent_hash_map"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int>> map_type;
+
+/*
+ * Map is derived to check if the empty buckets are really skipped.
+ */
+struct persistent_map_type : public map_type {
+	/* returns true if the bitmap of non-empty buckets was built */
+	bool
+	has_occupancy() const
+	{
+		return this->occupancy() != nullptr;
+	}
+
+	/* returns true if no bucket is marked as non-empty */
+	bool
+	no_occupied_buckets() const
+	{
+		UT_ASSERTne(this->occupancy(), nullptr);
+
+		auto m = this->mask().load();
+		return this->next_occupied(0, m) == m + 1;
+	}
+};
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> map1;
+	nvobj::persistent_ptr<persistent_map_type> map2;
+};
+
+static const int ITEMS = 10000;
+
+/*
+ * verify -- (internal) check that iteration visits exactly the expected
+ * elements
+ */
+void
+verify(nvobj::persistent_ptr<persistent_map_type> map,
+       const std::set<int> &expected)
+{
+	std::set<int> found;
+	for (auto &e : *map) {
+		UT_ASSERTeq(e.first, e.second);
+		UT_ASSERT(found.insert(e.first).second);
+	}
+
+	UT_ASSERT(found == expected);
+	UT_ASSERTeq(map->size(), expected.size());
+}
+
+/*
+ * sparse_test -- (internal) iterate over a map with many buckets and only a
+ * few elements
+ */
+void
+sparse_test(nvobj::pool<root> &pop)
+{
+	auto map = pop.root()->map1;
+	UT_ASSERT(map->no_occupied_buckets());
+
+	std::set<int> expected;
+	for (int i = 0; i < ITEMS; i++) {
+		UT_ASSERT(map->insert(map_type::value_type(i, i)));
+		expected.insert(i);
+	}
+	verify(map, expected);
+
+	/* leave only every 97th element */
+	for (int i = 0; i < ITEMS; i++) {
+		if (i % 97 == 0)
+			continue;
+
+		UT_ASSERT(map->erase(i));
+		expected.erase(i);
+	}
+	verify(map, expected);
+
+	/* buckets are not freed by erase, reserve even more of them */
+	map->rehash(static_cast<map_type::size_type>(ITEMS) * 64);
+	verify(map, expected);
+
+	for (int i = 0; i < ITEMS; i += 97) {
+		UT_ASSERT(map->erase(i));
+		expected.erase(i);
+	}
+	verify(map, expected);
+	UT_ASSERT(map->begin() == map->end());
+	UT_ASSERT(map->no_occupied_buckets());
+
+	UT_ASSERT(map->insert(map_type::value_type(ITEMS, ITEMS)));
+	expected.insert(ITEMS);
+	verify(map, expected);
+
+	map->clear();
+	expected.clear();
+	verify(map, expected);
+	UT_ASSERT(map->no_occupied_buckets());
+}
+
+/*
+ * concurrent_test -- (internal) iterate after concurrent inserts and erases
+ */
+void
+concurrent_test(nvobj::pool<root> &pop, size_t concurrency)
+{
+	auto map = pop.root()->map1;
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		int begin = static_cast<int>(thread_id) * ITEMS;
+		for (int i = begin; i < begin + ITEMS; i++)
+			map->insert(map_type::value_type(i, i));
+
+		for (int i = begin; i < begin + ITEMS; i++) {
+			if (i % 10 != 0)
+				map->erase(i);
+		}
+	});
+
+	std::set<int> expected;
+	for (int i = 0; i < static_cast<int>(concurrency) * ITEMS; i += 10)
+		expected.insert(i);
+	verify(map, expected);
+
+	map->clear();
+}
+
+/*
+ * tx_test -- (internal) aborted clear and swap do not hide any elements
+ */
+void
+tx_test(nvobj::pool<root> &pop)
+{
+	auto map1 = pop.root()->map1;
+	auto map2 = pop.root()->map2;
+
+	std::set<int> expected1, expected2;
+	for (int i = 0; i < ITEMS; i += 3) {
+		map1->insert(map_type::value_type(i, i));
+		expected1.insert(i);
+	}
+	for (int i = 1; i < 10 * ITEMS; i += 300) {
+		map2->insert(map_type::value_type(i, i));
+		expected2.insert(i);
+	}
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			map1->clear();
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+	verify(map1, expected1);
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			map1->swap(*map2);
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+	verify(map1, expected1);
+	verify(map2, expected2);
+
+	nvobj::transaction::run(pop, [&] { map1->swap(*map2); });
+	verify(map1, expected2);
+	verify(map2, expected1);
+
+	map1->swap(*map2);
+	verify(map1, expected1);
+	verify(map2, expected2);
+
+	nvobj::transaction::run(pop, [&] { map2->clear(); });
+	verify(map2, {});
+}
+
+/*
+ * reopen_test -- (internal) bitmap is rebuilt by runtime_initialize() after
+ * a restart
+ */
+void
+reopen_test(nvobj::pool<root> &pop, const char *path)
+{
+	std::set<int> expected;
+	for (auto &e : *pop.root()->map1)
+		expected.insert(e.first);
+
+	pop.close();
+
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+	auto map = pop.root()->map1;
+	UT_ASSERT(!map->has_occupancy());
+	map->runtime_initialize();
+	UT_ASSERT(map->has_occupancy());
+
+	verify(map, expected);
+
+	for (auto i : expected)
+		UT_ASSERT(map->erase(i));
+
+	verify(map, {});
+	UT_ASSERT(map->no_occupied_buckets());
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		pmem::obj::transaction::run(pop, [&] {
+			pop.root()->map1 =
+				nvobj::make_persistent<persistent_map_type>();
+			pop.root()->map2 =
+				nvobj::make_persistent<persistent_map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	size_t concurrency = 8;
+	if (On_drd)
+		concurrency = 2;
+
+	sparse_test(pop);
+	concurrent_test(pop, concurrency);
+	tx_test(pop);
+	reopen_test(pop, path);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
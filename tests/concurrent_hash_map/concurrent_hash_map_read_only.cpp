@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * concurrent_hash_map_read_only.cpp -- pmem::obj::concurrent_hash_map test
+ * for pools opened with pool_base::open_read_only()
+ *
+ */
+
+#include "../concurrent_hash_map/concurrent_hash_map_test.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/transaction.hpp>
+
+#include <functional>
+
+/*
+ * read_only_lookup_test -- (internal) fill the map, reopen the pool in
+ * read-only mode and verify lookups and that no modification is possible
+ * pmem::obj::concurrent_hash_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+read_only_lookup_test(nvobj::pool<root> &pop, std::string path,
+		      size_t concurrency = 4)
+{
+	PRINT_TEST_PARAMS;
+
+	const int items = 1000;
+
+	{
+		auto map = pop.root()->cons;
+		UT_ASSERT(map != nullptr);
+
+		map->runtime_initialize();
+
+		/* growing the map leaves new buckets not rehashed until they
+		 * are accessed */
+		for (int i = 0; i < items; ++i) {
+			persistent_map_type::value_type val(i, i * 2);
+			UT_ASSERT(map->insert(val));
+		}
+
+		pop.close();
+	}
+
+	{
+		pop = nvobj::pool<root>::open_read_only(path, LAYOUT);
+		UT_ASSERT(pop.is_read_only());
+
+		auto map = pop.root()->cons;
+		UT_ASSERT(map != nullptr);
+
+		map->runtime_initialize();
+
+		UT_ASSERTeq(map->size(), static_cast<size_t>(items));
+		UT_ASSERTeq(static_cast<size_t>(
+				    std::distance(map->begin(), map->end())),
+			    map->size());
+
+		parallel_exec(concurrency, [&](size_t) {
+			for (int i = 0; i < items; ++i) {
+				persistent_map_type::const_accessor acc;
+				UT_ASSERT(map->find(acc, i));
+				UT_ASSERTeq(acc->first, i);
+				UT_ASSERTeq(acc->second, i * 2);
+
+				UT_ASSERTeq(map->count(i), 1);
+			}
+
+			persistent_map_type::const_accessor acc;
+			UT_ASSERT(!map->find(acc, items));
+			UT_ASSERTeq(map->count(items), 0);
+		});
+
+		/* modifications are rejected before any bucket is accessed */
+		auto assert_rejected = [&](std::function<void()> f) {
+			try {
+				f();
+				UT_ASSERT(0);
+			} catch (pmem::transaction_scope_error &) {
+			} catch (std::exception &e) {
+				UT_FATALexc(e);
+			}
+		};
+
+		assert_rejected([&] {
+			persistent_map_type::value_type val(items, items);
+			map->insert(val);
+		});
+		assert_rejected([&] {
+			persistent_map_type::accessor acc;
+			map->find(acc, 0);
+		});
+		assert_rejected([&] { map->erase(0); });
+		assert_rejected([&] { map->erase_deferred(0); });
+		assert_rejected([&] { map->reclaim_all_retired(); });
+		assert_rejected([&] { map->rehash(); });
+		assert_rejected([&] { map->clear(); });
+		assert_rejected([&] { map->clear(1); });
+		assert_rejected([&] { map->defragment(); });
+		assert_rejected([&] { nvobj::flat_transaction::run(pop, [&] {}); });
+
+		UT_ASSERTeq(map->size(), static_cast<size_t>(items));
+		for (int i = 0; i < items; ++i)
+			UT_ASSERTeq(map->count(i), 1);
+
+		pop.close();
+	}
+
+	{
+		pop = nvobj::pool<root>::open(path, LAYOUT);
+		UT_ASSERT(!pop.is_read_only());
+
+		auto map = pop.root()->cons;
+		map->runtime_initialize();
+
+		UT_ASSERTeq(map->size(), static_cast<size_t>(items));
+
+		persistent_map_type::value_type val(items, items);
+		UT_ASSERT(map->insert(val));
+
+		UT_ASSERTeq(map->size(), static_cast<size_t>(items + 1));
+	}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		pmem::obj::transaction::run(pop, [&] {
+			pop.root()->cons =
+				nvobj::make_persistent<persistent_map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	size_t concurrency = 8;
+	if (On_drd)
+		concurrency = 2;
+
+	read_only_lookup_test(pop, path, concurrency);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * concurrent_map_lock_free_insert.cpp -- pmem::obj::experimental::
+ * concurrent_map test of inserts which link nodes with compare-and-swap
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <atomic>
+#include <iterator>
+#include <vector>
+
+#include <libpmemobj++/experimental/concurrent_map.hpp>
+
+#define LAYOUT "concurrent_map"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+typedef nvobj::experimental::concurrent_map<
+	nvobj::p<int>, nvobj::p<int>, std::less<nvobj::p<int>>,
+	nvobj::allocator<pmem::detail::pair<const nvobj::p<int>,
+					    nvobj::p<int>>>,
+	std::ratio<1, 2>, true>
+	persistent_map_type;
+
+static_assert(persistent_map_type::lock_free_insert,
+	      "lock-free insert should be enabled");
+
+struct root {
+	nvobj::persistent_ptr<persistent_map_type> cons;
+};
+
+/*
+ * verify -- (internal) check that the map consists of keys [0, n) in
+ * ascending order, each mapped to itself
+ */
+void
+verify(persistent_map_type *map, int n)
+{
+	UT_ASSERTeq(map->size(), static_cast<size_t>(n));
+	UT_ASSERTeq(std::distance(map->begin(), map->end()), n);
+
+	int expected = 0;
+	for (auto &e : *map) {
+		UT_ASSERTeq(e.first, expected);
+		UT_ASSERTeq(e.second, expected);
+		++expected;
+	}
+
+	for (int i = 0; i < n; ++i) {
+		UT_ASSERTeq(map->count(i), 1);
+		auto it = map->find(i);
+		UT_ASSERT(it != map->end());
+		UT_ASSERTeq(it->second, i);
+	}
+}
+
+/*
+ * interleaved_insert_test -- (internal) threads insert adjacent keys, so that
+ * they compete for the same predecessors
+ */
+void
+interleaved_insert_test(persistent_map_type *map, size_t concurrency)
+{
+	const int items = 200;
+
+	map->runtime_initialize();
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		for (int i = static_cast<int>(thread_id); i < items;
+		     i += static_cast<int>(concurrency)) {
+			auto ret = map->emplace(i, i);
+			UT_ASSERT(ret.second);
+			UT_ASSERTeq(ret.first->first, i);
+		}
+	});
+
+	verify(map, items);
+
+	map->clear();
+}
+
+/*
+ * hint_test -- (internal) threads append increasing keys, each with the
+ * iterator returned by the previous insert as the hint
+ */
+void
+hint_test(persistent_map_type *map, size_t concurrency)
+{
+	const int thread_items = 50;
+
+	parallel_exec(concurrency, [&](size_t thread_id) {
+		int begin = static_cast<int>(thread_id) * thread_items;
+		auto it = map->end();
+		for (int i = begin; i < begin + thread_items; ++i) {
+			it = map->emplace_hint(it, i, i);
+			UT_ASSERTeq(it->first, i);
+		}
+	});
+
+	verify(map, static_cast<int>(concurrency) * thread_items);
+
+	map->clear();
+}
+
+/*
+ * duplicates_test -- (internal) all threads insert the same keys, each key is
+ * inserted exactly once
+ */
+void
+duplicates_test(persistent_map_type *map, size_t concurrency)
+{
+	const int items = 100;
+
+	std::atomic<int> inserted(0);
+	parallel_exec(concurrency, [&](size_t) {
+		for (int i = 0; i < items; ++i) {
+			auto ret = map->insert(
+				persistent_map_type::value_type(i, i));
+			if (ret.second)
+				++inserted;
+			UT_ASSERTeq(ret.first->first, i);
+			UT_ASSERTeq(ret.first->second, i);
+		}
+	});
+
+	UT_ASSERTeq(inserted.load(), items);
+	verify(map, items);
+}
+
+/*
+ * reopen_test -- (internal) the map is consistent after the pool is reopened
+ */
+void
+reopen_test(nvobj::pool<root> &pop, const char *path)
+{
+	const int items = 100;
+
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	auto map = pop.root()->cons.get();
+	map->runtime_initialize();
+
+	verify(map, items);
+
+	/* map can be used after recovery */
+	UT_ASSERT(map->emplace(items, items).second);
+	UT_ASSERT(!map->emplace(items, items).second);
+	verify(map, items + 1);
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->cons =
+				nvobj::make_persistent<persistent_map_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	// Adding more concurrency will increase DRD test time
+	size_t concurrency = 8;
+	if (On_drd)
+		concurrency = 2;
+
+	interleaved_insert_test(pop.root()->cons.get(), concurrency);
+	hint_test(pop.root()->cons.get(), concurrency);
+	duplicates_test(pop.root()->cons.get(), concurrency);
+	reopen_test(pop, path);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<persistent_map_type>(pop.root()->cons);
+	});
+	UT_ASSERTeq(num_allocs(pop), 0);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -84,6 +84,17 @@ typedef nvobj::experimental::concurrent_map<pmem::obj::string,
 					    pmem::obj::string, hetero_less>
 	persistent_map_string_type;
 
+typedef nvobj::experimental::concurrent_map<
+	nvobj::p<int>, nvobj::p<int>, std::less<nvobj::p<int>>,
+	nvobj::allocator<persistent_map_type::value_type>, std::ratio<1, 4>>
+	persistent_map_quarter_type;
+
+typedef nvobj::experimental::concurrent_map<
+	nvobj::p<int>, nvobj::p<int>, std::less<nvobj::p<int>>,
+	nvobj::allocator<persistent_map_type::value_type>,
+	std::ratio<36788, 100000>>
+	persistent_map_e_type;
+
 struct root {
 	nvobj::persistent_ptr<persistent_map_type> map1;
 	nvobj::persistent_ptr<persistent_map_type> map2;
@@ -91,6 +102,9 @@ struct root {
 	nvobj::persistent_ptr<persistent_map_move_type> map_move;
 
 	nvobj::persistent_ptr<persistent_map_string_type> map_string;
+
+	nvobj::persistent_ptr<persistent_map_quarter_type> map_quarter;
+	nvobj::persistent_ptr<persistent_map_e_type> map_e;
 };
 
 void
@@ -406,6 +420,69 @@ emplace_test(nvobj::pool<root> &pop)
 	pmem::detail::destroy<persistent_map_string_type>(*map_string);
 }
 
+/*
+ * hint_test -- (internal) test insert and emplace_hint with valid and
+ * invalid hints
+ */
+void
+hint_test(nvobj::pool<root> &pop)
+{
+	auto &map = pop.root()->map1;
+
+	const int items = 1000;
+
+	tx_alloc_wrapper<persistent_map_type>(pop, map);
+
+	/* increasing keys, each inserted after the previous one */
+	auto it = map->end();
+	for (int i = 0; i < items; i += 2) {
+		auto next = map->emplace_hint(it, i, i);
+		UT_ASSERT(next != map->end());
+		UT_ASSERTeq(next->first, i);
+		UT_ASSERTeq(next->second, i);
+		it = next;
+	}
+
+	/* hint which is not followed by the key */
+	it = map->find(items - 2);
+	for (int i = 1; i < items; i += 4) {
+		auto next = map->insert(it, value_type(i, i));
+		UT_ASSERTeq(next->first, i);
+		UT_ASSERTeq(next->second, i);
+	}
+
+	/* hint which precedes the key, but not directly */
+	it = map->begin();
+	for (int i = 3; i < items; i += 4) {
+		auto next = map->emplace_hint(it, i, i);
+		UT_ASSERTeq(next->first, i);
+		UT_ASSERTeq(next->second, i);
+	}
+
+	verify_elements(*map, static_cast<size_t>(items));
+	UT_ASSERT(std::is_sorted(map->begin(), map->end(),
+				 [](const value_type &lhs,
+				    const value_type &rhs) {
+					 return lhs.first < rhs.first;
+				 }));
+
+	/* element with the same key prevents the insertion */
+	for (int i = 1; i < items; i++) {
+		auto prev = map->find(i - 1);
+		auto next = map->emplace_hint(prev, i, -i);
+		UT_ASSERTeq(next->first, i);
+		UT_ASSERTeq(next->second, i);
+
+		next = map->insert(map->find(i), value_type(i, -i));
+		UT_ASSERTeq(next->first, i);
+		UT_ASSERTeq(next->second, i);
+	}
+
+	verify_elements(*map, static_cast<size_t>(items));
+
+	pmem::detail::destroy<persistent_map_type>(*map);
+}
+
 template <bool is_const, typename MapType>
 void
 bound_helper(nvobj::persistent_ptr<MapType> &m)
@@ -572,6 +649,224 @@ erase_test(nvobj::pool<root> &pop)
 	pmem::detail::destroy<persistent_map_type>(*map1);
 }
 
+/*
+ * verify_range -- (internal) check that the map consists of the keys from
+ * [0, n) satisfying the predicate
+ */
+template <typename Predicate>
+void
+verify_range(persistent_map_type &map, int n, Predicate present)
+{
+	size_t expected = 0;
+	auto it = map.begin();
+	for (int i = 0; i < n; ++i) {
+		if (!present(i)) {
+			UT_ASSERT(map.contains(i) == false);
+			continue;
+		}
+
+		++expected;
+		UT_ASSERT(map.contains(i));
+		UT_ASSERT(it != map.end());
+		UT_ASSERTeq(it->first, i);
+		UT_ASSERT(map.lower_bound(i) == it);
+		++it;
+	}
+
+	UT_ASSERT(it == map.end());
+	UT_ASSERTeq(map.size(), expected);
+}
+
+/*
+ * erase_range_test -- (internal) test range erase and erase_if
+ * pmem::obj::concurrent_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+erase_range_test(nvobj::pool<root> &pop)
+{
+	const int n = 3000;
+	auto &map1 = pop.root()->map1;
+
+	tx_alloc_wrapper<persistent_map_type>(pop, map1);
+
+	for (int i = 0; i < n; ++i) {
+		auto ret = map1->insert(value_type(i, i));
+		UT_ASSERT(ret.second == true);
+	}
+
+	/* purge the front of the map in bounded transactions */
+	auto ret = map1->unsafe_erase(map1->begin(), map1->find(1000), 7);
+	UT_ASSERT(ret == map1->begin());
+	UT_ASSERTeq(ret->first, 1000);
+	verify_range(*map1, n, [](int i) { return i >= 1000; });
+
+	/* range in the middle in a single transaction */
+	ret = map1->unsafe_erase(map1->find(1500), map1->find(2000));
+	UT_ASSERTeq(ret->first, 2000);
+	verify_range(*map1, n, [](int i) {
+		return i >= 1000 && (i < 1500 || i >= 2000);
+	});
+
+	/* range up to the end, empty range */
+	ret = map1->unsafe_erase(map1->find(2990), map1->end(), 3);
+	UT_ASSERT(ret == map1->end());
+	ret = map1->unsafe_erase(map1->find(1200), map1->find(1200));
+	UT_ASSERTeq(ret->first, 1200);
+	auto present = [](int i) {
+		return i >= 1000 && (i < 1500 || i >= 2000) && i < 2990;
+	};
+	verify_range(*map1, n, present);
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			map1->unsafe_erase(map1->begin(), map1->end());
+		});
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+	verify_range(*map1, n, present);
+
+	/* runs of erased elements of different lengths */
+	auto pred = [](const value_type &v) { return v.first % 10 < 3; };
+	size_t expected = 0;
+	for (auto &e : *map1)
+		expected += pred(e) ? size_t(1) : size_t(0);
+
+	UT_ASSERTeq(map1->unsafe_erase_if(pred, 5U), expected);
+	verify_range(*map1, n,
+		     [&](int i) { return present(i) && i % 10 >= 3; });
+
+	UT_ASSERTeq(map1->unsafe_erase_if(pred), 0U);
+
+	auto odd = [](const value_type &v) { return v.first % 2 != 0; };
+	expected = 0;
+	for (auto &e : *map1)
+		expected += odd(e) ? size_t(1) : size_t(0);
+
+	UT_ASSERTeq(nvobj::experimental::erase_if(*map1, odd), expected);
+	verify_range(*map1, n, [&](int i) {
+		return present(i) && i % 10 >= 3 && i % 2 == 0;
+	});
+
+	expected = map1->size();
+	UT_ASSERTeq(map1->unsafe_erase_if(
+			    [](const value_type &) { return true; }, 1U),
+		    expected);
+	UT_ASSERTeq(map1->size(), 0);
+	UT_ASSERT(map1->begin() == map1->end());
+
+	/* map can be used after erase */
+	for (int i = 0; i < 100; ++i)
+		map1->insert(value_type(i, i));
+	verify_elements(*map1, 100);
+
+	pmem::detail::destroy<persistent_map_type>(*map1);
+}
+
+/*
+ * level_probability_test -- (internal) test maps with different
+ * probabilities of promoting nodes to the next level
+ */
+template <typename MapType>
+void
+level_probability_test(nvobj::pool<root> &pop,
+		       nvobj::persistent_ptr<MapType> &map)
+{
+	const int n = 1000;
+
+	tx_alloc_wrapper<MapType>(pop, map);
+
+	for (int i = n - 1; i >= 0; --i) {
+		auto ret = map->emplace(i, i);
+		UT_ASSERT(ret.second == true);
+	}
+
+	UT_ASSERTeq(map->size(), static_cast<size_t>(n));
+
+	int expected = 0;
+	for (auto &e : *map) {
+		UT_ASSERTeq(e.first, expected);
+		UT_ASSERTeq(e.second, expected);
+		++expected;
+	}
+	UT_ASSERTeq(expected, n);
+
+	for (int i = 0; i < n; i += 2)
+		UT_ASSERTeq(map->unsafe_erase(i), size_t(1));
+
+	for (int i = 0; i < n; ++i) {
+		auto it = map->find(i);
+		if (i % 2 == 0) {
+			UT_ASSERT(it == map->end());
+		} else {
+			UT_ASSERT(it != map->end());
+			UT_ASSERTeq(it->second, i);
+		}
+	}
+
+	pmem::detail::destroy<MapType>(*map);
+}
+
+/*
+ * cursor_test -- (internal) test ascending and descending seeks of cursor
+ * pmem::obj::concurrent_map<nvobj::p<int>, nvobj::p<int> >
+ */
+void
+cursor_test(nvobj::pool<root> &pop)
+{
+	const int n = 2000;
+	auto &map1 = pop.root()->map1;
+
+	tx_alloc_wrapper<persistent_map_type>(pop, map1);
+
+	/* only even keys */
+	for (int i = 0; i < n; i += 2)
+		map1->insert(value_type(i, i));
+
+	auto c = map1->make_cursor();
+
+	/* ascending seeks with growing distances */
+	for (int i = -1, step = 1; i <= n + 1; i += step, step = step % 97 + 1)
+		UT_ASSERT(c.seek(i) == map1->lower_bound(i));
+
+	UT_ASSERT(c.seek(n) == map1->end());
+
+	/* seek to the same key and backwards */
+	UT_ASSERT(c.seek(n) == map1->end());
+	for (int i = n + 1; i >= -1; i -= 37)
+		UT_ASSERT(c.seek(i) == map1->lower_bound(i));
+
+	/* inserted elements are found by the cursor */
+	c.reset();
+	UT_ASSERT(c.seek(500) == map1->find(500));
+	for (int i = 501; i < n; i += 100)
+		map1->insert(value_type(i, i));
+	for (int i = 501; i < n - 2; i += 2) {
+		auto it = c.seek(i);
+		UT_ASSERT(it == map1->lower_bound(i));
+		UT_ASSERT(it != map1->end());
+		UT_ASSERTeq(it->first, (i % 100 == 1) ? i : i + 1);
+	}
+
+	/* const cursor */
+	const persistent_map_type &cmap = *map1;
+	auto cc = cmap.make_cursor();
+	for (int i = 0; i < n; i += 3) {
+		persistent_map_type::const_iterator it = cc.seek(i);
+		UT_ASSERT(it == cmap.lower_bound(i));
+	}
+
+	/* cursor is valid after reset */
+	map1->unsafe_erase(map1->find(1000), map1->find(1200));
+	c.reset();
+	UT_ASSERTeq(c.seek(1000)->first, 1200);
+	UT_ASSERTeq(c.seek(1201)->first, 1202);
+
+	pmem::detail::destroy<persistent_map_type>(*map1);
+}
+
 template <bool is_const, typename MapType>
 void
 hetero_helper(nvobj::persistent_ptr<MapType> &m)
@@ -687,8 +982,13 @@ test(int argc, char *argv[])
 	swap_test(pop);
 	insert_test(pop);
 	emplace_test(pop);
+	hint_test(pop);
 	bound_test(pop);
 	erase_test(pop);
+	erase_range_test(pop);
+	cursor_test(pop);
+	level_probability_test(pop, pop.root()->map_quarter);
+	level_probability_test(pop, pop.root()->map_e);
 	hetero_test(pop);
 
 	pop.close();
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * futex_cond_var.cpp -- futex_timed_mutex and futex_condition_variable test
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/futex_condition_variable.hpp>
+#include <libpmemobj++/experimental/futex_timed_mutex.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = pmem::obj;
+namespace nvobjex = pmem::obj::experimental;
+
+namespace
+{
+
+/* pool root structure */
+struct root {
+	nvobjex::futex_timed_mutex pmutex;
+	nvobjex::futex_condition_variable cond;
+	unsigned counter;
+};
+
+/* the number of threads */
+const unsigned num_threads = 16;
+
+/* number of ops per thread */
+const unsigned num_ops = 1000;
+
+/* timeout for timed waits */
+const auto timeout = std::chrono::milliseconds(50);
+
+/*
+ * Premature wake-up tolerance.
+ */
+const auto epsilon = std::chrono::milliseconds(16);
+
+/*
+ * test_mutex -- (internal) test mutual exclusion
+ */
+void
+test_mutex(nvobj::pool<root> &pop)
+{
+	auto proot = pop.root();
+	proot->counter = 0;
+
+	parallel_exec(num_threads, [&](size_t id) {
+		for (unsigned i = 0; i < num_ops; ++i) {
+			if (id % 2) {
+				std::lock_guard<nvobjex::futex_timed_mutex>
+					lock(proot->pmutex);
+				proot->counter++;
+			} else {
+				while (!proot->pmutex.try_lock_for(timeout))
+					;
+				proot->counter++;
+				proot->pmutex.unlock();
+			}
+		}
+	});
+
+	UT_ASSERTeq(proot->counter, num_threads * num_ops);
+}
+
+/*
+ * test_mutex_timeout -- (internal) test timed lock of a taken mutex
+ */
+void
+test_mutex_timeout(nvobj::pool<root> &pop)
+{
+	auto proot = pop.root();
+
+	proot->pmutex.lock();
+	UT_ASSERT(!proot->pmutex.try_lock());
+
+	std::thread t([&] {
+		auto t1 = std::chrono::steady_clock::now();
+		UT_ASSERT(!proot->pmutex.try_lock_for(timeout));
+		auto t2 = std::chrono::steady_clock::now();
+		UT_ASSERT(t2 - t1 + epsilon >= timeout);
+
+		UT_ASSERT(!proot->pmutex.try_lock_until(
+			std::chrono::system_clock::now() + timeout));
+	});
+	t.join();
+
+	proot->pmutex.unlock();
+	UT_ASSERT(proot->pmutex.try_lock());
+	proot->pmutex.unlock();
+}
+
+/*
+ * test_cond_var -- (internal) test notifications
+ */
+void
+test_cond_var(nvobj::pool<root> &pop)
+{
+	auto proot = pop.root();
+	proot->counter = 0;
+
+	std::vector<std::thread> readers;
+	for (unsigned i = 0; i < num_threads; ++i) {
+		readers.emplace_back([&] {
+			std::unique_lock<nvobjex::futex_timed_mutex> lock(
+				proot->pmutex);
+			proot->cond.wait(lock,
+					 [&] { return proot->counter != 0; });
+			UT_ASSERTeq(proot->counter, 1);
+		});
+	}
+
+	{
+		std::lock_guard<nvobjex::futex_timed_mutex> lock(
+			proot->pmutex);
+		proot->counter = 1;
+	}
+	proot->cond.notify_all();
+
+	for (auto &t : readers)
+		t.join();
+
+	/* ping-pong between two threads with notify_one */
+	proot->counter = 0;
+	std::thread ping([&] {
+		std::unique_lock<nvobjex::futex_timed_mutex> lock(
+			proot->pmutex);
+		for (;;) {
+			proot->cond.wait(lock, [&] {
+				return proot->counter % 2 == 0 ||
+					proot->counter >= num_ops;
+			});
+			if (proot->counter >= num_ops)
+				break;
+			proot->counter++;
+			proot->cond.notify_one();
+		}
+	});
+
+	{
+		std::unique_lock<nvobjex::futex_timed_mutex> lock(
+			proot->pmutex);
+		for (;;) {
+			proot->cond.wait(lock, [&] {
+				return proot->counter % 2 == 1 ||
+					proot->counter >= num_ops;
+			});
+			if (proot->counter >= num_ops)
+				break;
+			proot->counter++;
+			proot->cond.notify_one();
+		}
+	}
+
+	ping.join();
+	UT_ASSERTeq(proot->counter, num_ops);
+}
+
+/*
+ * test_cond_var_timeout -- (internal) test timed waits
+ */
+void
+test_cond_var_timeout(nvobj::pool<root> &pop)
+{
+	auto proot = pop.root();
+
+	std::unique_lock<nvobjex::futex_timed_mutex> lock(proot->pmutex);
+
+	auto t1 = std::chrono::steady_clock::now();
+	UT_ASSERT(!proot->cond.wait_for(lock, timeout, [] { return false; }));
+	auto t2 = std::chrono::steady_clock::now();
+	UT_ASSERT(t2 - t1 + epsilon >= timeout);
+
+	UT_ASSERT(proot->cond.wait_until(
+		lock, std::chrono::system_clock::now() + timeout,
+		[] { return true; }));
+
+	UT_ASSERT(lock.owns_lock());
+}
+
+} /* namespace */
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	auto path = argv[1];
+
+	nvobj::pool<root> pop;
+	try {
+		pop = nvobj::pool<root>::create(path, LAYOUT, PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_mutex(pop);
+	test_mutex_timeout(pop);
+	test_cond_var(pop);
+	test_cond_var_timeout(pop);
+
+	/* the mutex is unlocked after the pool is reopened */
+	pop.root()->pmutex.lock();
+	pop.close();
+
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+	UT_ASSERT(pop.root()->pmutex.try_lock());
+	pop.root()->pmutex.unlock();
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
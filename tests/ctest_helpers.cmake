@@ -115,7 +115,8 @@ function(build_test name)
 		target_link_libraries(${name} ${LIBUNWIND_LIBRARIES} ${CMAKE_DL_LIBS})
 	endif()
 	if(WIN32)
-		target_link_libraries(${name} dbghelp)
+		# Synchronization is required by futex-based primitives
+		target_link_libraries(${name} dbghelp Synchronization)
 	else()
 		target_link_libraries(${name} atomic)
 	endif()
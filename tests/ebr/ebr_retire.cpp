@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * ebr_retire -- Test retiring objects with Epoch Based Reclamation
+ * mechanism and the persistent limbo list.
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/detail/ebr.hpp>
+#include <libpmemobj++/detail/persistent_limbo.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define LAYOUT "ebr_retire"
+
+static constexpr uint64_t ALIVE = 0xA11CE;
+
+using limbo_type =
+	pmem::detail::persistent_limbo<pmem::obj::persistent_ptr<int>>;
+
+struct root {
+	pmem::obj::persistent_ptr<limbo_type> limbo;
+};
+
+struct object {
+	object(std::atomic<size_t> &freed) : magic(ALIVE), freed(freed)
+	{
+	}
+
+	~object()
+	{
+		magic = 0;
+		freed++;
+	}
+
+	uint64_t magic;
+	std::atomic<size_t> &freed;
+};
+
+/*
+ * retire_test -- (internal) retired objects are freed after two epochs, also
+ * if the worker was already unregistered
+ */
+static void
+retire_test()
+{
+	std::atomic<size_t> freed(0);
+	pmem::detail::ebr ebr;
+
+	{
+		auto w = ebr.register_worker();
+		for (int i = 0; i < 10; i++)
+			w.retire(new object(freed));
+
+		ebr.reclaim();
+		UT_ASSERTeq(freed.load(), 0);
+		ebr.reclaim();
+		UT_ASSERTeq(freed.load(), 10);
+
+		w.retire(new object(freed));
+
+		auto other = std::move(w);
+		other.retire(new object(freed));
+	}
+
+	UT_ASSERTeq(freed.load(), 10);
+	ebr.full_reclaim();
+	UT_ASSERTeq(freed.load(), 12);
+
+	/* custom deleter */
+	auto w = ebr.register_worker();
+	int deleted = 0;
+	int obj;
+	w.retire(&obj, [&](int *ptr) {
+		UT_ASSERTeq(ptr, &obj);
+		deleted++;
+	});
+	ebr.full_reclaim();
+	UT_ASSERTeq(deleted, 1);
+
+	/* objects which are not reclaimed yet are freed by ebr destructor */
+	w.retire(new object(freed));
+}
+
+/*
+ * blocked_reader_test -- (internal) objects are not freed while a reader,
+ * which might access them, is in a critical section
+ */
+static void
+blocked_reader_test()
+{
+	std::atomic<size_t> freed(0);
+	pmem::detail::ebr ebr;
+	std::atomic<bool> entered(false);
+	std::atomic<bool> release(false);
+
+	std::thread reader([&] {
+		auto w = ebr.register_worker();
+		w.critical([&] {
+			entered = true;
+			while (!release.load())
+				std::this_thread::yield();
+		});
+	});
+
+	while (!entered.load())
+		std::this_thread::yield();
+
+	{
+		auto w = ebr.register_worker();
+		w.retire(new object(freed));
+
+		for (int i = 0; i < 10; i++)
+			ebr.reclaim();
+		UT_ASSERTeq(freed.load(), 0);
+
+		release = true;
+		reader.join();
+
+		ebr.full_reclaim();
+		UT_ASSERTeq(freed.load(), 1);
+	}
+}
+
+/*
+ * background_test -- (internal) retired objects are freed by the background
+ * thread
+ */
+static void
+background_test()
+{
+	std::atomic<size_t> freed(0);
+	pmem::detail::ebr ebr;
+
+	ebr.start_reclamation(std::chrono::milliseconds(1));
+
+	{
+		auto w = ebr.register_worker();
+		for (int i = 0; i < 100; i++)
+			w.retire(new object(freed));
+	}
+
+	while (freed.load() != 100)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	ebr.stop_reclamation();
+	ebr.stop_reclamation();
+}
+
+/*
+ * mt_test -- (internal) readers never access objects, which were freed by
+ * concurrent writers and the background thread
+ */
+static void
+mt_test(size_t concurrency)
+{
+	const size_t slots_number = 16;
+	const size_t iterations = 10000;
+
+	std::atomic<size_t> freed(0);
+	pmem::detail::ebr ebr;
+	std::vector<std::atomic<object *>> slots(slots_number);
+	for (auto &s : slots)
+		s.store(new object(freed));
+
+	ebr.start_reclamation(std::chrono::milliseconds(1));
+
+	parallel_exec(concurrency * 2, [&](size_t thread_id) {
+		auto w = ebr.register_worker();
+
+		for (size_t i = 0; i < iterations; i++) {
+			auto &slot = slots[(thread_id + i) % slots_number];
+
+			if (thread_id % 2 == 0) {
+				w.critical([&] {
+					UT_ASSERTeq(slot.load()->magic, ALIVE);
+				});
+			} else {
+				auto old = slot.exchange(new object(freed));
+				w.retire(old);
+			}
+		}
+	});
+
+	ebr.stop_reclamation();
+	ebr.full_reclaim();
+	UT_ASSERTeq(freed.load(), concurrency * iterations);
+
+	for (auto &s : slots)
+		delete s.load();
+}
+
+/*
+ * persistent_limbo_test -- (internal) persistent objects are retired in
+ * transactions and freed after two epochs
+ */
+static void
+persistent_limbo_test(pmem::obj::pool<root> &pop)
+{
+	using pmem::obj::delete_persistent;
+	using pmem::obj::make_persistent;
+	using pmem::obj::persistent_ptr;
+
+	auto deleter = [](const persistent_ptr<int> &ptr) {
+		delete_persistent<int>(ptr);
+	};
+
+	pmem::obj::transaction::run(pop, [&] {
+		pop.root()->limbo = make_persistent<limbo_type>();
+	});
+
+	auto &limbo = *pop.root()->limbo;
+	UT_ASSERT(limbo.empty());
+
+	auto allocs = num_allocs(pop);
+
+	pmem::detail::ebr ebr;
+
+	pmem::obj::transaction::run(pop, [&] {
+		for (int i = 0; i < 10; i++)
+			limbo.retire(ebr, make_persistent<int>(i));
+	});
+	UT_ASSERT(!limbo.empty());
+
+	/* retire is rolled back together with the transaction */
+	try {
+		pmem::obj::transaction::run(pop, [&] {
+			limbo.retire(ebr, make_persistent<int>(10));
+			throw std::runtime_error("abort");
+		});
+		ASSERT_UNREACHABLE;
+	} catch (std::runtime_error &) {
+	}
+
+	limbo.reclaim(ebr, deleter);
+	UT_ASSERT(!limbo.empty());
+	limbo.reclaim(ebr, deleter);
+	UT_ASSERT(limbo.empty());
+	UT_ASSERTeq(num_allocs(pop), allocs);
+
+	pmem::obj::transaction::run(
+		pop, [&] { limbo.retire(ebr, make_persistent<int>(0)); });
+	limbo.full_reclaim(ebr, deleter);
+	UT_ASSERT(limbo.empty());
+
+	pmem::obj::transaction::run(
+		pop, [&] { limbo.retire(ebr, make_persistent<int>(0)); });
+	limbo.clear(deleter);
+	UT_ASSERT(limbo.empty());
+	UT_ASSERTeq(num_allocs(pop), allocs);
+
+	pmem::obj::transaction::run(pop, [&] {
+		delete_persistent<limbo_type>(pop.root()->limbo);
+	});
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	pmem::obj::pool<root> pop;
+
+	try {
+		pop = pmem::obj::pool<root>::create(std::string(path), LAYOUT,
+						    PMEMOBJ_MIN_POOL,
+						    S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	retire_test();
+	blocked_reader_test();
+	background_test();
+	mt_test(4);
+	persistent_limbo_test(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
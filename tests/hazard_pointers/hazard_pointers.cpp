@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * hazard_pointers -- Test hazard pointers based memory reclamation.
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/detail/hazard_pointers.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static constexpr uint64_t ALIVE = 0xA11CE;
+
+using pmem::detail::hazard_pointers;
+
+struct object {
+	object(std::atomic<size_t> &freed) : magic(ALIVE), freed(freed)
+	{
+	}
+
+	~object()
+	{
+		magic = 0;
+		freed++;
+	}
+
+	uint64_t magic;
+	std::atomic<size_t> &freed;
+};
+
+/*
+ * protect_test -- (internal) protected objects are not freed until
+ * the slot is released
+ */
+static void
+protect_test()
+{
+	std::atomic<size_t> freed(0);
+	hazard_pointers hp(2);
+	UT_ASSERTeq(hp.slots(), 2);
+
+	auto reader = hp.register_worker();
+	auto writer = hp.register_worker();
+
+	std::atomic<object *> a(new object(freed));
+	std::atomic<object *> b(new object(freed));
+
+	UT_ASSERTeq(reader.protect(a, 0), a.load());
+	UT_ASSERTeq(reader.protect(b, 1), b.load());
+
+	writer.retire(a.exchange(nullptr));
+	writer.retire(b.exchange(nullptr));
+	writer.reclaim();
+	UT_ASSERTeq(freed.load(), 0);
+
+	/* protecting a null pointer releases the object */
+	UT_ASSERTeq(reader.protect(a, 0), nullptr);
+	writer.reclaim();
+	UT_ASSERTeq(freed.load(), 1);
+
+	reader.release(1);
+	writer.reclaim();
+	UT_ASSERTeq(freed.load(), 2);
+
+	/* custom deleter */
+	int obj;
+	int deleted = 0;
+	writer.retire(&obj, [&](int *ptr) {
+		UT_ASSERTeq(ptr, &obj);
+		deleted++;
+	});
+	writer.reclaim();
+	UT_ASSERTeq(deleted, 1);
+
+	try {
+		hazard_pointers invalid(0);
+		ASSERT_UNREACHABLE;
+	} catch (std::invalid_argument &) {
+	}
+}
+
+/*
+ * stalled_reader_test -- (internal) reader which never releases its slots
+ * blocks reclamation of only the objects it protects
+ */
+static void
+stalled_reader_test()
+{
+	const size_t n = 1000;
+
+	std::atomic<size_t> freed(0);
+	hazard_pointers hp(1);
+
+	auto reader = hp.register_worker();
+	auto writer = hp.register_worker();
+
+	std::atomic<object *> shared(new object(freed));
+	reader.protect(shared);
+
+	for (size_t i = 0; i < n; i++)
+		writer.retire(shared.exchange(new object(freed)));
+
+	/* retire scans the objects in batches */
+	UT_ASSERT(freed.load() >= n - 2 * 2);
+
+	writer.reclaim();
+	UT_ASSERTeq(freed.load(), n - 1);
+
+	reader.release();
+	writer.reclaim();
+	UT_ASSERTeq(freed.load(), n);
+
+	delete shared.load();
+}
+
+/*
+ * orphans_test -- (internal) objects retired by unregistered workers are
+ * freed by hazard_pointers::reclaim() or the destructor
+ */
+static void
+orphans_test()
+{
+	std::atomic<size_t> freed(0);
+	hazard_pointers hp;
+
+	auto reader = hp.register_worker();
+	std::atomic<object *> a(new object(freed));
+	reader.protect(a);
+
+	{
+		auto writer = hp.register_worker();
+		auto other = std::move(writer);
+
+		other.retire(a.exchange(nullptr));
+		other.retire(new object(freed));
+	}
+
+	hp.reclaim();
+	UT_ASSERTeq(freed.load(), 1);
+
+	reader.release();
+	hp.reclaim();
+	UT_ASSERTeq(freed.load(), 2);
+
+	/* state of the unregistered worker is reused */
+	auto writer = hp.register_worker();
+	writer.retire(new object(freed));
+}
+
+/*
+ * mt_test -- (internal) readers never access objects, which were freed by
+ * concurrent writers
+ */
+static void
+mt_test(size_t concurrency)
+{
+	const size_t slots_number = 16;
+	const size_t iterations = 10000;
+
+	std::atomic<size_t> freed(0);
+	hazard_pointers hp(2);
+	std::vector<std::atomic<object *>> slots(slots_number);
+	for (auto &s : slots)
+		s.store(new object(freed));
+
+	parallel_exec(concurrency * 2, [&](size_t thread_id) {
+		auto w = hp.register_worker();
+
+		for (size_t i = 0; i < iterations; i++) {
+			auto &first = slots[(thread_id + i) % slots_number];
+			auto &second = slots[(thread_id * i) % slots_number];
+
+			if (thread_id % 2 == 0) {
+				auto p1 = w.protect(first, 0);
+				auto p2 = w.protect(second, 1);
+				UT_ASSERTeq(p1->magic, ALIVE);
+				UT_ASSERTeq(p2->magic, ALIVE);
+				w.release_all();
+			} else {
+				w.retire(first.exchange(new object(freed)));
+			}
+		}
+	});
+
+	hp.reclaim();
+	UT_ASSERTeq(freed.load(), concurrency * iterations);
+
+	for (auto &s : slots)
+		delete s.load();
+}
+
+static void
+test()
+{
+	protect_test();
+	stalled_reader_test();
+	orphans_test();
+	mt_test(4);
+}
+
+int
+main()
+{
+	return run_test([&] { test(); });
+}
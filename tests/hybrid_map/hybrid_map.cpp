@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * hybrid_map.cpp -- pmem::obj::experimental::hybrid_map test of basic
+ * operations, rebuilding the index and compaction
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/hybrid_map.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <map>
+
+#define LAYOUT "hybrid_map"
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+using map_type = nvobj::experimental::hybrid_map<int, int>;
+using ordered_map_type =
+	nvobj::experimental::hybrid_map<int, int, std::map<int, std::size_t>>;
+
+/*
+ * Value which throws on assignment after the given number of assignments.
+ */
+struct fragile {
+	fragile() : v(0)
+	{
+	}
+
+	fragile(int v) : v(v)
+	{
+	}
+
+	fragile(const fragile &other) = default;
+
+	fragile &
+	operator=(const fragile &other)
+	{
+		if (assignments_left-- == 0)
+			throw std::runtime_error("assignment failed");
+
+		v = other.v;
+		return *this;
+	}
+
+	int v;
+
+	static int assignments_left;
+};
+
+int fragile::assignments_left = -1;
+
+using fragile_map_type = nvobj::experimental::hybrid_map<int, fragile>;
+
+struct root {
+	nvobj::persistent_ptr<map_type::pmem_log_type> log;
+	nvobj::persistent_ptr<ordered_map_type::pmem_log_type> ordered_log;
+	nvobj::persistent_ptr<fragile_map_type::pmem_log_type> fragile_log;
+};
+
+static const int ITEMS = 1000;
+
+/*
+ * verify -- (internal) check that the map consists of the expected elements
+ */
+template <typename Map>
+void
+verify(const Map &map, const std::map<int, int> &expected)
+{
+	UT_ASSERTeq(map.size(), expected.size());
+	UT_ASSERTeq(map.empty(), expected.empty());
+
+	std::map<int, int> found;
+	map.for_each([&](const int &k, const int &v) {
+		UT_ASSERT(found.emplace(k, v).second);
+	});
+	UT_ASSERT(found == expected);
+
+	for (int i = -ITEMS; i < 2 * ITEMS; i++) {
+		auto it = expected.find(i);
+		if (it == expected.end()) {
+			UT_ASSERTeq(map.count(i), 0);
+			continue;
+		}
+
+		UT_ASSERTeq(map.count(i), 1);
+		UT_ASSERTeq(map.at(i), it->second);
+	}
+}
+
+/*
+ * basic_test -- (internal) insert, overwrite and erase elements, rebuild the
+ * index after the pool is reopened
+ */
+void
+basic_test(nvobj::pool<root> &pop, const char *path, size_t concurrency)
+{
+	std::map<int, int> expected;
+	{
+		map_type map(*pop.root()->log);
+		verify(map, expected);
+
+		try {
+			map.at(0);
+			UT_ASSERT(0);
+		} catch (std::out_of_range &) {
+		} catch (std::exception &e) {
+			UT_FATALexc(e);
+		}
+
+		for (int i = 0; i < ITEMS; i++) {
+			map.insert_or_assign(i, i);
+			expected[i] = i;
+		}
+		verify(map, expected);
+
+		for (int i = 0; i < ITEMS; i += 2) {
+			map.insert_or_assign(i, i + 1);
+			expected[i] = i + 1;
+		}
+		for (int i = 0; i < ITEMS; i += 3) {
+			UT_ASSERTeq(map.erase(i), 1);
+			expected.erase(i);
+		}
+		UT_ASSERTeq(map.erase(-1), 0);
+		verify(map, expected);
+
+		/* erased element can be inserted again */
+		map.insert_or_assign(3, 30);
+		expected[3] = 30;
+		verify(map, expected);
+
+		UT_ASSERT(map.log_size() > map.size());
+	}
+
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	map_type map(*pop.root()->log, concurrency);
+	verify(map, expected);
+
+	/* more threads than records */
+	auto log_size = map.log_size();
+	map_type map2(*pop.root()->log, log_size * 2);
+	verify(map2, expected);
+}
+
+/*
+ * compact_test -- (internal) reclaim the garbage of the log
+ */
+void
+compact_test(nvobj::pool<root> &pop, const char *path, size_t concurrency)
+{
+	std::map<int, int> expected;
+	{
+		ordered_map_type map(*pop.root()->ordered_log);
+
+		for (int r = 0; r < 3; r++) {
+			for (int i = 0; i < ITEMS; i++) {
+				map.insert_or_assign(i, i * r);
+				expected[i] = i * r;
+			}
+		}
+		for (int i = 0; i < ITEMS; i += 5) {
+			map.erase(i);
+			expected.erase(i);
+		}
+
+		/* a few records in each transaction */
+		map.compact(7);
+		UT_ASSERTeq(map.log_size(), map.size());
+		verify(map, expected);
+
+		/* index is renumbered */
+		map.insert_or_assign(1, -1);
+		expected[1] = -1;
+		map.erase(2);
+		expected.erase(2);
+		verify(map, expected);
+
+		/* for_each of ordered index visits elements in order */
+		int prev = -1;
+		map.for_each([&](const int &k, const int &) {
+			UT_ASSERT(k > prev);
+			prev = k;
+		});
+	}
+
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	ordered_map_type map(*pop.root()->ordered_log, concurrency);
+	verify(map, expected);
+
+	map.compact();
+	map.compact();
+	verify(map, expected);
+
+	for (auto &e : expected)
+		map.erase(e.first);
+	map.compact();
+	UT_ASSERTeq(map.log_size(), 0);
+	verify(map, {});
+
+	try {
+		map.compact(0);
+		UT_ASSERT(0);
+	} catch (std::invalid_argument &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+}
+
+/*
+ * verify_fragile -- (internal) check the elements of the fragile map
+ */
+void
+verify_fragile(const fragile_map_type &map, const std::map<int, int> &expected)
+{
+	std::map<int, int> found;
+	map.for_each([&](const int &k, const fragile &f) {
+		UT_ASSERT(found.emplace(k, f.v).second);
+		UT_ASSERTeq(map.at(k).v, f.v);
+	});
+	UT_ASSERT(found == expected);
+}
+
+/*
+ * interrupted_compact_test -- (internal) compact() which failed in the
+ * middle leaves the map consistent, also after restart, and is finished by
+ * the next modification
+ */
+void
+interrupted_compact_test(nvobj::pool<root> &pop, const char *path)
+{
+	std::map<int, int> expected;
+	{
+		fragile_map_type map(*pop.root()->fragile_log);
+
+		for (int r = 0; r < 2; r++) {
+			for (int i = 0; i < ITEMS; i++) {
+				map.insert_or_assign(i, i + r);
+				expected[i] = i + r;
+			}
+		}
+
+		fragile::assignments_left = ITEMS / 2;
+		try {
+			map.compact(10);
+			UT_ASSERT(0);
+		} catch (std::runtime_error &) {
+		} catch (std::exception &e) {
+			UT_FATALexc(e);
+		}
+		fragile::assignments_left = -1;
+
+		UT_ASSERTeq(map.log_size(), 2 * ITEMS);
+		verify_fragile(map, expected);
+	}
+
+	pop.close();
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+
+	fragile_map_type map(*pop.root()->fragile_log, 4);
+	verify_fragile(map, expected);
+
+	map.insert_or_assign(1, -1);
+	expected[1] = -1;
+	UT_ASSERTeq(map.log_size(), ITEMS + 1);
+
+	map.erase(2);
+	expected.erase(2);
+	verify_fragile(map, expected);
+
+	map.compact(10);
+	UT_ASSERTeq(map.log_size(), map.size());
+	verify_fragile(map, expected);
+
+	fragile_map_type map2(*pop.root()->fragile_log);
+	verify_fragile(map2, expected);
+}
+
+/*
+ * tx_test -- (internal) modifying methods cannot be called in a transaction
+ */
+void
+tx_test(nvobj::pool<root> &pop)
+{
+	map_type map(*pop.root()->log);
+	auto size = map.size();
+
+	try {
+		nvobj::flat_transaction::run(
+			pop, [&] { map.insert_or_assign(ITEMS, 0); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	try {
+		nvobj::flat_transaction::run(pop, [&] { map.compact(); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	UT_ASSERTeq(map.size(), size);
+	UT_ASSERTeq(map.count(ITEMS), 0);
+
+	try {
+		map_type::pmem_log_type log;
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc < 2) {
+		UT_FATAL("usage: %s file-name", argv[0]);
+	}
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(
+			path, LAYOUT, PMEMOBJ_MIN_POOL * 20, S_IWUSR | S_IRUSR);
+		nvobj::transaction::run(pop, [&] {
+			pop.root()->log = nvobj::make_persistent<
+				map_type::pmem_log_type>();
+			pop.root()->ordered_log = nvobj::make_persistent<
+				ordered_map_type::pmem_log_type>();
+			pop.root()->fragile_log = nvobj::make_persistent<
+				fragile_map_type::pmem_log_type>();
+		});
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	size_t concurrency = 8;
+	if (On_drd)
+		concurrency = 2;
+
+	basic_test(pop, path, concurrency);
+	compact_test(pop, path, concurrency);
+	interrupted_compact_test(pop, path);
+	tx_test(pop);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<map_type::pmem_log_type>(
+			pop.root()->log);
+		nvobj::delete_persistent<ordered_map_type::pmem_log_type>(
+			pop.root()->ordered_log);
+		nvobj::delete_persistent<fragile_map_type::pmem_log_type>(
+			pop.root()->fragile_log);
+	});
+	UT_ASSERTeq(num_allocs(pop), 0);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
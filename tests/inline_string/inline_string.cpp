@@ -136,6 +136,42 @@ test_inline_string(nvobj::pool<struct root<T>> &pop)
 	nvobj::basic_string_view<T> new_view = r->o1->s;
 	UT_ASSERT(new_view.compare(test_view) == 0);
 
+	{
+		auto bs = bs3 + bs1;
+		nvobj::basic_string_view<T> v1(bs1.data(), bs1.length());
+
+		try {
+			nvobj::transaction::run(pop, [&] {
+				r->o1->s.append(v1);
+				nvobj::transaction::abort(0);
+			});
+		} catch (pmem::manual_tx_abort &) {
+		} catch (...) {
+			UT_ASSERT(0);
+		}
+		UT_ASSERT(test_view.compare(r->o1->s) == 0);
+
+		r->o1->s.append(v1);
+		UT_ASSERT(nvobj::basic_string_view<T>(r->o1->s).compare(bs) ==
+			  0);
+		UT_ASSERT(r->o1->s.cdata()[bs.size()] == '\0');
+
+		r->o1->s = bs3;
+	}
+
+	try {
+		std::basic_string<T> bs(r->o1->s.capacity() - bs3.size() + 1,
+					static_cast<T>('x'));
+		nvobj::basic_string_view<T> v1(bs.data(), bs.length());
+
+		r->o1->s.append(v1);
+		UT_ASSERT(0);
+	} catch (std::out_of_range &) {
+	} catch (...) {
+		UT_ASSERT(0);
+	}
+	UT_ASSERT(test_view.compare(r->o1->s) == 0);
+
 	try {
 		std::string str(r->o1->s.capacity() + 5, 'x');
 		std::basic_string<T> bs(str.begin(), str.end());
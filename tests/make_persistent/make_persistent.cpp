@@ -133,6 +133,68 @@ test_make_args(nvobj::pool<struct root> &pop)
 	UT_ASSERT(r->pfoo == nullptr);
 }
 
+/*
+ * test_make_n -- (internal) test make_persistent_n
+ */
+void
+test_make_n(nvobj::pool<struct root> &pop)
+{
+	const size_t count = 100;
+
+	try {
+		std::vector<nvobj::persistent_ptr<foo>> foos;
+
+		nvobj::transaction::run(pop, [&] {
+			foos = nvobj::make_persistent_n<foo>(pop, count, 5, 6);
+		});
+
+		UT_ASSERTeq(foos.size(), count);
+		for (auto &f : foos)
+			f->check_foo(5, 6);
+
+		nvobj::transaction::run(pop, [&] {
+			UT_ASSERT(nvobj::make_persistent_n<foo>(pop, 0).empty());
+
+			for (auto &f : foos)
+				nvobj::delete_persistent<foo>(f);
+		});
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	/* allocations are rolled back on abort */
+	try {
+		nvobj::transaction::run(pop, [&] {
+			auto foos = nvobj::make_persistent_n<foo>(pop, count);
+
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			nvobj::make_persistent_n<struct_throwing>(pop, count);
+		});
+		UT_ASSERT(0);
+	} catch (int &e) {
+		UT_ASSERTeq(e, struct_throwing::magic_number);
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	try {
+		nvobj::make_persistent_n<foo>(pop, count);
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+}
+
 /*
  * test_additional_delete -- (internal) test double delete and delete rollback
  */
@@ -370,6 +432,7 @@ test(int argc, char *argv[])
 
 	test_make_no_args(pop);
 	test_make_args(pop);
+	test_make_n(pop);
 	test_additional_delete(pop);
 	test_exceptions_handling(pop);
 	test_flags(pop);
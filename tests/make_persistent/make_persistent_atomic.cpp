@@ -66,6 +66,29 @@ public:
 	nvobj::p<char> arr[TEST_ARR_SIZE];
 };
 
+/* Throws from the constructor called when 'constructed' reaches 'throw_at'. */
+struct counted {
+	static int constructed;
+	static int alive;
+
+	explicit counted(int throw_at)
+	{
+		if (constructed++ == throw_at)
+			throw std::runtime_error("counted");
+		alive++;
+	}
+
+	~counted()
+	{
+		alive--;
+	}
+
+	nvobj::p<int> val;
+};
+
+int counted::constructed = 0;
+int counted::alive = 0;
+
 static int var_bar_copy_ctors_called = 0;
 static int var_bar_move_ctors_called = 0;
 
@@ -91,9 +114,13 @@ struct var_bar {
 	}
 };
 
+const size_t TEST_BATCH_SIZE = 100;
+
 struct root {
 	nvobj::persistent_ptr<foo> pfoo;
 	nvobj::persistent_ptr<var_bar> pvbar;
+	nvobj::persistent_ptr<foo> pfoos[TEST_BATCH_SIZE];
+	nvobj::persistent_ptr<counted> pcounted[TEST_BATCH_SIZE];
 };
 
 /*
@@ -132,6 +159,75 @@ test_make_args(nvobj::pool<struct root> &pop)
 	nvobj::delete_persistent_atomic<foo>(r->pfoo);
 }
 
+/*
+ * test_make_batch -- (internal) test make_persistent_atomic_batch
+ */
+void
+test_make_batch(nvobj::pool<struct root> &pop)
+{
+	nvobj::persistent_ptr<root> r = pop.root();
+
+	nvobj::make_persistent_atomic_batch<foo>(pop, r->pfoos,
+						 TEST_BATCH_SIZE, 3, 4);
+
+	for (size_t i = 0; i < TEST_BATCH_SIZE; i++) {
+		UT_ASSERT(r->pfoos[i] != nullptr);
+		r->pfoos[i]->check_foo(3, 4);
+
+		for (size_t j = 0; j < i; j++)
+			UT_ASSERT(r->pfoos[i] != r->pfoos[j]);
+	}
+
+	for (size_t i = 0; i < TEST_BATCH_SIZE; i++)
+		nvobj::delete_persistent_atomic<foo>(r->pfoos[i]);
+
+	/* constructor failure leaves all pointers untouched */
+	bool exception_thrown = false;
+	force_throw val;
+	try {
+		nvobj::make_persistent_atomic_batch<foo>(pop, r->pfoos,
+							 TEST_BATCH_SIZE, val);
+	} catch (std::bad_alloc &) {
+		exception_thrown = true;
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	UT_ASSERT(exception_thrown);
+
+	/* constructed objects are destroyed and the exception is rethrown */
+	exception_thrown = false;
+	try {
+		nvobj::make_persistent_atomic_batch<counted>(
+			pop, r->pcounted, TEST_BATCH_SIZE, 3);
+	} catch (std::runtime_error &) {
+		exception_thrown = true;
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	UT_ASSERT(exception_thrown);
+	UT_ASSERTeq(counted::constructed, 4);
+	UT_ASSERTeq(counted::alive, 0);
+	for (size_t i = 0; i < TEST_BATCH_SIZE; i++)
+		UT_ASSERT(r->pcounted[i] == nullptr);
+
+	/* pointers must reside in the pool */
+	exception_thrown = false;
+	nvobj::persistent_ptr<foo> volatile_ptrs[2];
+	try {
+		nvobj::make_persistent_atomic_batch<foo>(pop, volatile_ptrs,
+							 2);
+	} catch (pmem::pool_error &) {
+		exception_thrown = true;
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	UT_ASSERT(exception_thrown);
+	UT_ASSERT(volatile_ptrs[0] == nullptr);
+}
+
 /*
  * test_throw -- (internal) test if make_persistent_atomic rethrows constructor
  * exception
@@ -297,6 +393,7 @@ test(int argc, char *argv[])
 
 	test_make_no_args(pop);
 	test_make_args(pop);
+	test_make_batch(pop);
 	test_throw(pop);
 	test_delete_null(pop);
 	test_flags(pop);
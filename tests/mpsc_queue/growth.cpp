@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * growth.cpp -- tests for pmem::obj::experimental::mpsc_queue which chains
+ * additional log segments when the log is full
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <libpmemobj++/experimental/mpsc_queue.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/string_view.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#define LAYOUT "layout"
+
+using queue_type = pmem::obj::experimental::mpsc_queue;
+
+/* 16 cachelines */
+static constexpr size_t QUEUE_SIZE = 1024;
+
+struct root {
+	pmem::obj::persistent_ptr<queue_type::pmem_log_type> log;
+};
+
+/*
+ * fill -- (internal) produce messages with consecutive numbers until the
+ * queue is full, returns number of produced messages
+ */
+static size_t
+fill(queue_type &queue, size_t first)
+{
+	auto worker = queue.register_worker();
+
+	size_t n = 0;
+	while (worker.try_produce(std::to_string(first + n)))
+		n++;
+
+	return n;
+}
+
+/*
+ * consume_all -- (internal) consume all the messages and check that they
+ * have consecutive numbers, starting from first
+ */
+static size_t
+consume_all(queue_type &queue, size_t first)
+{
+	size_t n = 0;
+	queue.try_consume_batch([&](queue_type::batch_type batch) {
+		for (auto str : batch) {
+			UT_ASSERT(std::string(str.data(), str.size()) ==
+				  std::to_string(first + n));
+			n++;
+		}
+	});
+
+	return n;
+}
+
+/*
+ * growth_test -- (internal) queue grows up to max_segments segments, which
+ * are freed once drained
+ */
+static void
+growth_test(pmem::obj::pool<root> &pop)
+{
+	auto allocs = num_allocs(pop);
+
+	size_t n1;
+	{
+		auto queue = queue_type(*pop.root()->log, 1);
+		UT_ASSERTeq(consume_all(queue, 0), 0);
+
+		n1 = fill(queue, 0);
+		UT_ASSERT(n1 > 0);
+		UT_ASSERTeq(num_allocs(pop), allocs);
+		UT_ASSERTeq(consume_all(queue, 0), n1);
+	}
+
+	auto queue = queue_type(*pop.root()->log, 1, 3);
+	UT_ASSERTeq(consume_all(queue, 0), 0);
+
+	for (int i = 0; i < 3; i++) {
+		auto n3 = fill(queue, 0);
+		UT_ASSERT(n3 > 2 * n1);
+		UT_ASSERTeq(num_allocs(pop), allocs + 2);
+
+		UT_ASSERTeq(consume_all(queue, 0), n3);
+		UT_ASSERTeq(num_allocs(pop), allocs);
+
+		UT_ASSERT(!queue.try_consume_batch(
+			[&](queue_type::batch_type) { ASSERT_UNREACHABLE; }));
+	}
+
+	/* queue does not grow if the consumer keeps up */
+	auto worker = queue.register_worker();
+	for (size_t i = 0; i < 10 * n1; i++) {
+		UT_ASSERT(worker.try_produce(std::to_string(i)));
+		UT_ASSERTeq(consume_all(queue, i), 1);
+	}
+	UT_ASSERTeq(num_allocs(pop), allocs);
+}
+
+/*
+ * recovery_test -- (internal) data from all the segments is recovered in
+ * order, even if the new queue is not allowed to grow
+ */
+static void
+recovery_test(pmem::obj::pool<root> &pop)
+{
+	auto allocs = num_allocs(pop);
+
+	size_t n;
+	{
+		auto queue = queue_type(*pop.root()->log, 1, 3);
+		UT_ASSERTeq(consume_all(queue, 0), 0);
+
+		n = fill(queue, 0);
+	}
+	UT_ASSERTeq(num_allocs(pop), allocs + 2);
+
+	auto queue = queue_type(*pop.root()->log, 1);
+	UT_ASSERTeq(consume_all(queue, 0), n);
+	UT_ASSERTeq(num_allocs(pop), allocs);
+
+	auto worker = queue.register_worker();
+	UT_ASSERT(worker.try_produce("0"));
+	UT_ASSERTeq(consume_all(queue, 0), 1);
+}
+
+/*
+ * check_message -- (internal) check that the message "thread number" has
+ * the next number for the thread
+ */
+static void
+check_message(std::vector<size_t> &next, pmem::obj::string_view str)
+{
+	auto msg = std::string(str.data(), str.size());
+	auto sep = msg.find(' ');
+
+	auto t = std::stoul(msg.substr(0, sep));
+	auto i = std::stoul(msg.substr(sep + 1));
+
+	UT_ASSERTeq(next[t], i);
+	next[t]++;
+}
+
+/*
+ * mt_test -- (internal) messages of concurrent producers are consumed in the
+ * order in which each of the producers stored them
+ */
+static void
+mt_test(pmem::obj::pool<root> &pop, size_t concurrency)
+{
+	const size_t n_messages = 500;
+
+	auto queue = queue_type(*pop.root()->log, concurrency, 4);
+	UT_ASSERTeq(consume_all(queue, 0), 0);
+
+	std::atomic<size_t> done(0);
+	std::vector<size_t> next(concurrency, 0);
+
+	parallel_exec(concurrency + 1, [&](size_t thread_id) {
+		if (thread_id == concurrency) {
+			auto consume = [&] {
+				return queue.try_consume_batch(
+					[&](queue_type::batch_type batch) {
+						for (auto str : batch)
+							check_message(next,
+								      str);
+					});
+			};
+
+			while (done.load() < concurrency)
+				consume();
+			while (consume())
+				;
+			return;
+		}
+
+		auto worker = queue.register_worker();
+		for (size_t i = 0; i < n_messages;) {
+			auto msg = std::to_string(thread_id) + " " +
+				std::to_string(i);
+			if (worker.try_produce(msg))
+				i++;
+		}
+		done++;
+	});
+
+	for (auto n : next)
+		UT_ASSERTeq(n, n_messages);
+}
+
+/*
+ * delete_test -- (internal) chained segments are freed together with the log
+ */
+static void
+delete_test(pmem::obj::pool<root> &pop)
+{
+	{
+		auto queue = queue_type(*pop.root()->log, 1, 3);
+		UT_ASSERTeq(consume_all(queue, 0), 0);
+
+		UT_ASSERT(fill(queue, 0) > 0);
+	}
+
+	pmem::obj::transaction::run(pop, [&] {
+		pmem::obj::delete_persistent<queue_type::pmem_log_type>(
+			pop.root()->log);
+	});
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	pmem::obj::pool<struct root> pop;
+
+	try {
+		pop = pmem::obj::pool<root>::create(std::string(path), LAYOUT,
+						    PMEMOBJ_MIN_POOL,
+						    S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	pmem::obj::transaction::run(pop, [&] {
+		pop.root()->log = pmem::obj::make_persistent<
+			queue_type::pmem_log_type>(QUEUE_SIZE);
+	});
+
+	growth_test(pop);
+	recovery_test(pop);
+	mt_test(pop, 4);
+	delete_test(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * sharded.cpp -- tests for pmem::obj::experimental::sharded_mpsc_queue
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <libpmemobj++/experimental/sharded_mpsc_queue.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#define LAYOUT "layout"
+
+using queue_type = pmem::obj::experimental::sharded_mpsc_queue;
+
+static constexpr size_t SHARDS = 4;
+static constexpr size_t SHARD_SIZE = 10000;
+
+struct root {
+	pmem::obj::persistent_ptr<queue_type::pmem_log_type> log;
+};
+
+struct entry {
+	uint64_t sequence;
+	std::string data;
+};
+
+/*
+ * consume -- (internal) consume ready messages, returns them in the order in
+ * which they were passed to the consumer
+ */
+static std::vector<entry>
+consume(queue_type &queue, bool ordered)
+{
+	std::vector<entry> entries;
+	auto f = [&](queue_type::batch_type batch) {
+		for (auto &m : batch) {
+			auto data = std::string(m.data().data(),
+						m.data().size());
+			entries.push_back({m.sequence(), data});
+		}
+	};
+
+	if (ordered)
+		queue.try_consume_ordered(f);
+	else
+		queue.try_consume_batch(f);
+
+	return entries;
+}
+
+/*
+ * basic_test -- (internal) workers are assigned to shards in a round-robin
+ * fashion, ordered consumer sorts messages from all the shards
+ */
+static void
+basic_test(pmem::obj::pool<root> &pop)
+{
+	queue_type queue(*pop.root()->log, 2);
+	UT_ASSERTeq(queue.shards(), SHARDS);
+	UT_ASSERT(consume(queue, false).empty());
+
+	std::vector<queue_type::worker> workers;
+	for (size_t i = 0; i < SHARDS; i++) {
+		workers.push_back(queue.register_worker());
+		UT_ASSERTeq(workers.back().shard(), i);
+	}
+
+	try {
+		queue.register_worker(SHARDS);
+		ASSERT_UNREACHABLE;
+	} catch (std::out_of_range &) {
+	}
+
+	/* messages of shard i have sequence numbers i, i + SHARDS, ... */
+	const uint64_t n = 100;
+	for (size_t i = SHARDS; i > 0; i--) {
+		for (uint64_t seq = i - 1; seq < n; seq += SHARDS)
+			UT_ASSERT(workers[i - 1].try_produce(
+				std::to_string(seq), seq));
+	}
+
+	auto entries = consume(queue, true);
+	UT_ASSERTeq(entries.size(), n);
+	for (uint64_t i = 0; i < n; i++) {
+		UT_ASSERTeq(entries[i].sequence, i);
+		UT_ASSERT(entries[i].data == std::to_string(i));
+	}
+
+	/* messages of each shard are passed in the order of production */
+	for (size_t i = 0; i < SHARDS; i++) {
+		for (uint64_t seq = i; seq < n; seq += SHARDS)
+			UT_ASSERT(workers[i].try_produce(std::to_string(seq),
+							 seq));
+	}
+
+	entries = consume(queue, false);
+	UT_ASSERTeq(entries.size(), n);
+	std::vector<uint64_t> next;
+	for (size_t i = 0; i < SHARDS; i++)
+		next.push_back(i);
+	for (auto &e : entries) {
+		auto shard = e.sequence % SHARDS;
+		UT_ASSERTeq(e.sequence, next[shard]);
+		next[shard] += SHARDS;
+	}
+
+	/* exception in the consumer aborts the consumption */
+	UT_ASSERT(workers[1].try_produce("a", 1));
+	UT_ASSERT(workers[0].try_produce("b", 0));
+	try {
+		queue.try_consume_ordered([&](queue_type::batch_type) {
+			throw std::runtime_error("abort");
+		});
+		ASSERT_UNREACHABLE;
+	} catch (std::runtime_error &) {
+	}
+
+	entries = consume(queue, true);
+	UT_ASSERTeq(entries.size(), 2);
+	UT_ASSERT(entries[0].data == "b");
+	UT_ASSERT(entries[1].data == "a");
+	UT_ASSERT(consume(queue, true).empty());
+}
+
+/*
+ * recovery_test -- (internal) messages of all the shards are recovered by
+ * a new instance of the queue
+ */
+static void
+recovery_test(pmem::obj::pool<root> &pop)
+{
+	const uint64_t n = 50;
+	{
+		queue_type queue(*pop.root()->log);
+		UT_ASSERT(consume(queue, false).empty());
+
+		for (uint64_t seq = 0; seq < n; seq++) {
+			auto worker = queue.register_worker(seq % SHARDS);
+			UT_ASSERT(worker.try_produce(std::to_string(seq), seq));
+		}
+	}
+
+	queue_type queue(*pop.root()->log);
+	auto entries = consume(queue, true);
+	UT_ASSERTeq(entries.size(), n);
+	for (uint64_t i = 0; i < n; i++)
+		UT_ASSERTeq(entries[i].sequence, i);
+}
+
+/*
+ * mt_test -- (internal) messages of concurrent producers are consumed
+ * exactly once, in the order in which each of the producers stored them
+ */
+static void
+mt_test(pmem::obj::pool<root> &pop, size_t concurrency)
+{
+	const uint64_t n = 1000;
+
+	queue_type queue(*pop.root()->log,
+			 (concurrency + SHARDS - 1) / SHARDS);
+	UT_ASSERT(consume(queue, false).empty());
+
+	std::atomic<size_t> done(0);
+	std::vector<uint64_t> next(concurrency, 0);
+
+	parallel_exec(concurrency + 1, [&](size_t thread_id) {
+		if (thread_id == concurrency) {
+			auto check = [&] {
+				auto entries = consume(queue, true);
+				for (size_t i = 0; i < entries.size(); i++) {
+					auto &e = entries[i];
+					auto t = std::stoul(e.data);
+					UT_ASSERTeq(e.sequence / concurrency,
+						    next[t]);
+					next[t]++;
+
+					if (i > 0)
+						UT_ASSERT(entries[i - 1]
+								  .sequence <=
+							  e.sequence);
+				}
+
+				return !entries.empty();
+			};
+
+			while (done.load() < concurrency)
+				check();
+			while (check())
+				;
+			return;
+		}
+
+		auto worker = queue.register_worker(thread_id % SHARDS);
+		for (uint64_t i = 0; i < n;) {
+			if (worker.try_produce(std::to_string(thread_id),
+					       i * concurrency + thread_id))
+				i++;
+		}
+		done++;
+	});
+
+	for (auto v : next)
+		UT_ASSERTeq(v, n);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	pmem::obj::pool<struct root> pop;
+
+	try {
+		pop = pmem::obj::pool<root>::create(std::string(path), LAYOUT,
+						    PMEMOBJ_MIN_POOL,
+						    S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	try {
+		pmem::obj::transaction::run(pop, [&] {
+			pop.root()->log = pmem::obj::make_persistent<
+				queue_type::pmem_log_type>(0U, SHARD_SIZE);
+		});
+		ASSERT_UNREACHABLE;
+	} catch (std::invalid_argument &) {
+	}
+
+	pmem::obj::transaction::run(pop, [&] {
+		pop.root()->log = pmem::obj::make_persistent<
+			queue_type::pmem_log_type>(SHARDS, SHARD_SIZE);
+	});
+
+	basic_test(pop);
+	recovery_test(pop);
+	mt_test(pop, 8);
+
+	pmem::obj::transaction::run(pop, [&] {
+		pmem::obj::delete_persistent<queue_type::pmem_log_type>(
+			pop.root()->log);
+	});
+	UT_ASSERTeq(num_allocs(pop), 0);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * typed.cpp -- tests for pmem::obj::experimental::typed_mpsc_queue
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <atomic>
+#include <vector>
+
+#include <libpmemobj++/experimental/typed_mpsc_queue.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#define LAYOUT "layout"
+
+struct record {
+	uint64_t id;
+	uint64_t thread;
+	uint32_t payload;
+};
+
+using queue_type = pmem::obj::experimental::typed_mpsc_queue<record>;
+
+static constexpr size_t QUEUE_SIZE = 16;
+
+struct root {
+	pmem::obj::persistent_ptr<queue_type::pmem_log_type> log;
+};
+
+static record
+make_record(uint64_t id, uint64_t thread = 0)
+{
+	return record{id, thread, static_cast<uint32_t>(id * 3)};
+}
+
+/*
+ * consume_all -- (internal) consume all ready records, check that batches
+ * are contiguous in the log and return ids of the records
+ */
+static std::vector<uint64_t>
+consume_all(queue_type &queue)
+{
+	std::vector<uint64_t> ids;
+	queue.try_consume_batch([&](queue_type::batch_type batch) {
+		UT_ASSERT(batch.size() > 0);
+		UT_ASSERTeq(batch.end() - batch.begin(),
+			    static_cast<ptrdiff_t>(batch.size()));
+
+		for (auto &r : batch) {
+			UT_ASSERTeq(r.payload, r.id * 3);
+			ids.push_back(r.id);
+		}
+	});
+
+	return ids;
+}
+
+static void
+check_ids(const std::vector<uint64_t> &ids, uint64_t first, uint64_t last)
+{
+	UT_ASSERTeq(ids.size(), last - first);
+	for (uint64_t i = first; i < last; i++)
+		UT_ASSERTeq(ids[i - first], i);
+}
+
+/*
+ * wraparound_test -- (internal) records are consumed in order, also when
+ * the log wraps around many times
+ */
+static void
+wraparound_test(pmem::obj::pool<root> &pop)
+{
+	auto queue = queue_type(*pop.root()->log, 1);
+	auto worker = queue.register_worker();
+
+	UT_ASSERT(!queue.try_consume_batch(
+		[&](queue_type::batch_type) { ASSERT_UNREACHABLE; }));
+
+	uint64_t id = 0;
+	for (size_t round = 0; round < 10 * QUEUE_SIZE; round++) {
+		size_t n = round % (QUEUE_SIZE - 1) + 1;
+
+		auto first = id;
+		for (size_t i = 0; i < n; i++)
+			UT_ASSERT(worker.try_produce(make_record(id++)));
+
+		check_ids(consume_all(queue), first, id);
+	}
+
+	UT_ASSERT(!queue.try_consume_batch(
+		[&](queue_type::batch_type) { ASSERT_UNREACHABLE; }));
+}
+
+/*
+ * batch_test -- (internal) batches are produced entirely or not at all
+ */
+static void
+batch_test(pmem::obj::pool<root> &pop)
+{
+	auto queue = queue_type(*pop.root()->log, 1);
+	auto worker = queue.register_worker();
+
+	std::vector<record> records;
+	for (uint64_t i = 0; i < QUEUE_SIZE; i++)
+		records.push_back(make_record(i));
+
+	/* at most QUEUE_SIZE - 1 records fit in the log */
+	UT_ASSERT(!worker.try_produce(records.data(), QUEUE_SIZE));
+	UT_ASSERT(worker.try_produce(records.data(), 0));
+	UT_ASSERT(worker.try_produce(records.data(), QUEUE_SIZE / 2));
+	UT_ASSERT(!worker.try_produce(records.data(), QUEUE_SIZE / 2));
+	UT_ASSERT(worker.try_produce(records.data() + QUEUE_SIZE / 2,
+				     QUEUE_SIZE / 2 - 1));
+	UT_ASSERT(!worker.try_produce(records[0]));
+
+	check_ids(consume_all(queue), 0, QUEUE_SIZE - 1);
+
+	UT_ASSERT(worker.try_produce(records.data(), QUEUE_SIZE - 1));
+	check_ids(consume_all(queue), 0, QUEUE_SIZE - 1);
+
+	/* exception in the consumer aborts the consumption */
+	UT_ASSERT(worker.try_produce(records.data(), 3));
+	try {
+		queue.try_consume_batch([&](queue_type::batch_type) {
+			throw std::runtime_error("abort");
+		});
+		ASSERT_UNREACHABLE;
+	} catch (std::runtime_error &) {
+	}
+	check_ids(consume_all(queue), 0, 3);
+}
+
+/*
+ * recovery_test -- (internal) produced, but not consumed records are
+ * recovered by a new instance of the queue, consumed ones are not
+ */
+static void
+recovery_test(pmem::obj::pool<root> &pop)
+{
+	uint64_t id = 1000;
+
+	for (size_t consumed = 0; consumed < QUEUE_SIZE + 3; consumed++) {
+		uint64_t first;
+		{
+			auto queue = queue_type(*pop.root()->log, 1);
+			auto worker = queue.register_worker();
+			consume_all(queue);
+
+			/* move consumer by 'consumed' slots */
+			for (size_t i = 0; i < consumed; i++)
+				UT_ASSERT(worker.try_produce(
+					make_record(id++)));
+			consume_all(queue);
+
+			first = id;
+			for (size_t i = 0; i < QUEUE_SIZE / 2; i++)
+				UT_ASSERT(worker.try_produce(
+					make_record(id++)));
+		}
+
+		auto queue = queue_type(*pop.root()->log, 1);
+		check_ids(consume_all(queue), first, id);
+
+		/* queue can be used after recovery */
+		auto worker = queue.register_worker();
+		first = id;
+		for (size_t i = 0; i < QUEUE_SIZE - 1; i++)
+			UT_ASSERT(worker.try_produce(make_record(id++)));
+		UT_ASSERT(!worker.try_produce(make_record(id)));
+		check_ids(consume_all(queue), first, id);
+	}
+}
+
+/*
+ * mt_test -- (internal) records of concurrent producers are consumed
+ * exactly once, in the order in which each of the producers stored them
+ */
+static void
+mt_test(pmem::obj::pool<root> &pop, size_t concurrency)
+{
+	const uint64_t n_records = 1000;
+
+	auto queue = queue_type(*pop.root()->log, concurrency);
+	consume_all(queue);
+
+	std::atomic<size_t> done(0);
+	std::vector<uint64_t> next(concurrency, 0);
+
+	parallel_exec(concurrency + 1, [&](size_t thread_id) {
+		if (thread_id == concurrency) {
+			auto consume = [&] {
+				return queue.try_consume_batch(
+					[&](queue_type::batch_type batch) {
+						for (auto &r : batch) {
+							UT_ASSERTeq(
+								next[r.thread],
+								r.id);
+							next[r.thread]++;
+						}
+					});
+			};
+
+			while (done.load() < concurrency)
+				consume();
+			while (consume())
+				;
+			return;
+		}
+
+		auto worker = queue.register_worker();
+		for (uint64_t i = 0; i < n_records;) {
+			if (worker.try_produce(make_record(i, thread_id)))
+				i++;
+		}
+		done++;
+	});
+
+	for (auto n : next)
+		UT_ASSERTeq(n, n_records);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	pmem::obj::pool<struct root> pop;
+
+	try {
+		pop = pmem::obj::pool<root>::create(std::string(path), LAYOUT,
+						    PMEMOBJ_MIN_POOL,
+						    S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	try {
+		pmem::obj::transaction::run(pop, [&] {
+			pop.root()->log = pmem::obj::make_persistent<
+				queue_type::pmem_log_type>(1U);
+		});
+		ASSERT_UNREACHABLE;
+	} catch (std::invalid_argument &) {
+	}
+
+	pmem::obj::transaction::run(pop, [&] {
+		pop.root()->log = pmem::obj::make_persistent<
+			queue_type::pmem_log_type>(QUEUE_SIZE);
+	});
+	UT_ASSERTeq(pop.root()->log->capacity(), QUEUE_SIZE);
+
+	wraparound_test(pop);
+	batch_test(pop);
+	recovery_test(pop);
+	mt_test(pop, 4);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
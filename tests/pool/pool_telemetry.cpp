@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * pool_telemetry.cpp -- cpp pool telemetry test
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/container/vector.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/make_persistent_atomic.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace nvobj = pmem::obj;
+
+namespace
+{
+
+struct node {
+	nvobj::p<uint64_t> val[8];
+};
+
+using vector_type = nvobj::vector<int>;
+
+struct root {
+	nvobj::persistent_ptr<node> n;
+	nvobj::persistent_ptr<vector_type> v;
+	nvobj::p<int> val;
+};
+
+/*
+ * test_disabled -- (internal) nothing is counted when telemetry is disabled
+ */
+void
+test_disabled(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	auto t = pop.telemetry();
+
+	UT_ASSERT(!t.enabled());
+
+	nvobj::transaction::run(pop, [&] {
+		r->n = nvobj::make_persistent<node>();
+		nvobj::delete_persistent<node>(r->n);
+		r->n = nullptr;
+	});
+
+	auto s = t.sample();
+	UT_ASSERTeq(s.tx_committed, 0);
+	UT_ASSERTeq(s.types.size(), 0);
+}
+
+/*
+ * test_counters -- (internal) test allocation and transaction counters
+ */
+void
+test_counters(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	auto t = pop.telemetry();
+
+	t.enable();
+	UT_ASSERT(t.enabled());
+
+	nvobj::transaction::run(pop, [&] {
+		r->n = nvobj::make_persistent<node>();
+		r->v = nvobj::make_persistent<vector_type>(10U, 1);
+	});
+
+	nvobj::transaction::run(pop, [&] { r->val = 5; });
+
+	try {
+		nvobj::transaction::run(pop, [&] {
+			r->val = 6;
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	auto s = t.sample();
+	UT_ASSERTeq(s.tx_committed, 2);
+	UT_ASSERTeq(s.tx_aborted, 1);
+	UT_ASSERT(s.snapshot_bytes >= 2 * sizeof(int));
+	UT_ASSERT(s.snapshot_bytes_per_tx() > 0);
+	UT_ASSERT(s.curr_allocated > 0);
+
+	auto n = s.for_type<node>();
+	UT_ASSERTeq(n.allocations, 1);
+	UT_ASSERTeq(n.frees, 0);
+	UT_ASSERT(n.allocated_bytes >= sizeof(node));
+
+	auto v = s.for_type<vector_type>();
+	UT_ASSERTeq(v.allocations, 1);
+
+	auto elems = s.for_type<int>();
+	UT_ASSERTeq(elems.allocations, 1);
+	UT_ASSERT(elems.live_bytes() >= 10 * sizeof(int));
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<node>(r->n);
+		nvobj::delete_persistent<vector_type>(r->v);
+		r->n = nullptr;
+		r->v = nullptr;
+	});
+
+	s = t.sample();
+	n = s.for_type<node>();
+	UT_ASSERTeq(n.frees, 1);
+	UT_ASSERTeq(n.live_bytes(), 0);
+	UT_ASSERTeq(s.for_type<int>().live_bytes(), 0);
+
+	nvobj::persistent_ptr<node> atomic_node;
+	nvobj::make_persistent_atomic<node>(pop, atomic_node);
+	UT_ASSERTeq(t.sample().for_type<node>().allocations, 2);
+	nvobj::delete_persistent_atomic<node>(atomic_node);
+	UT_ASSERTeq(t.sample().for_type<node>().frees, 2);
+
+	t.disable();
+	UT_ASSERT(!t.enabled());
+
+	nvobj::transaction::run(pop, [&] { r->val = 7; });
+	UT_ASSERTeq(t.sample().tx_committed, 3);
+}
+
+/*
+ * test_snapshot_bytes -- (internal) only bytes which reach the undo log are
+ * counted
+ */
+void
+test_snapshot_bytes(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	auto t = pop.telemetry();
+
+	nvobj::transaction::run(pop,
+				[&] { r->n = nvobj::make_persistent<node>(); });
+
+	t.enable();
+	auto before = t.sample().snapshot_bytes;
+
+	/* overlapping and repeated ranges are counted once */
+	nvobj::transaction::run(pop, [&] {
+		pmem::detail::conditional_add_to_tx(&r->n->val[0], 4);
+		pmem::detail::conditional_add_to_tx(&r->n->val[2], 4);
+		pmem::detail::conditional_add_to_tx(&r->n->val[1]);
+		r->n->val[0] = 1;
+		r->n->val[5] = 1;
+	});
+
+	auto s = t.sample();
+	UT_ASSERTeq(s.snapshot_bytes - before, 6 * sizeof(uint64_t));
+
+	/* ranges are counted again in the next transaction */
+	nvobj::transaction::run(pop, [&] { r->n->val[0] = 2; });
+	UT_ASSERTeq(t.sample().snapshot_bytes - s.snapshot_bytes,
+		    sizeof(uint64_t));
+
+	/* ranges added without a snapshot are not counted */
+	s = t.sample();
+	nvobj::transaction::run(pop, [&] {
+		pmem::detail::conditional_add_to_tx(
+			&r->n->val[0], 8, POBJ_XADD_NO_SNAPSHOT);
+	});
+	UT_ASSERTeq(t.sample().snapshot_bytes, s.snapshot_bytes);
+
+	/* snapshots are tracked only if telemetry was enabled when the
+	 * outermost transaction started */
+	t.disable();
+	s = t.sample();
+	nvobj::transaction::run(pop, [&] {
+		t.enable();
+		r->n->val[0] = 3;
+	});
+	UT_ASSERTeq(t.sample().snapshot_bytes, s.snapshot_bytes);
+	UT_ASSERTeq(t.sample().tx_committed, s.tx_committed + 1);
+
+	t.disable();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<node>(r->n);
+		r->n = nullptr;
+	});
+}
+
+/*
+ * test_threads -- (internal) allocations made by concurrent threads are all
+ * counted
+ */
+void
+test_threads(nvobj::pool<root> &pop)
+{
+	const size_t threads = 4;
+	const size_t allocs = 100;
+
+	auto t = pop.telemetry();
+	t.enable();
+
+	auto before = t.sample().for_type<node>();
+
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < threads; i++) {
+		workers.emplace_back([&] {
+			for (size_t j = 0; j < allocs; j++) {
+				nvobj::persistent_ptr<node> n;
+				nvobj::make_persistent_atomic<node>(pop, n);
+				nvobj::delete_persistent_atomic<node>(n);
+			}
+		});
+	}
+
+	/* sampling may be restarted concurrently */
+	for (size_t i = 0; i < threads; i++) {
+		workers.emplace_back([&] {
+			for (size_t j = 0; j < 10; j++) {
+				t.start_sampling(
+					std::chrono::milliseconds(1),
+					[](const nvobj::telemetry_snapshot &) {
+					});
+				t.sample();
+			}
+			t.stop_sampling();
+		});
+	}
+
+	for (auto &w : workers)
+		w.join();
+
+	auto n = t.sample().for_type<node>();
+	UT_ASSERTeq(n.allocations - before.allocations, threads * allocs);
+	UT_ASSERTeq(n.frees - before.frees, threads * allocs);
+
+	t.disable();
+
+	/* pool which was not opened by pmem::obj::pool */
+	nvobj::pool_telemetry invalid(nullptr);
+	try {
+		invalid.enabled();
+		UT_ASSERT(0);
+	} catch (pmem::pool_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+}
+
+/*
+ * test_sampling -- (internal) test periodic snapshot callback
+ */
+void
+test_sampling(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	auto t = pop.telemetry();
+	std::atomic<size_t> samples(0);
+
+	t.enable();
+	t.start_sampling(std::chrono::milliseconds(1),
+			 [&](const nvobj::telemetry_snapshot &s) {
+				 UT_ASSERT(s.tx_committed >= 3);
+				 samples++;
+			 });
+
+	while (samples.load() < 3)
+		nvobj::transaction::run(pop, [&] { r->val = r->val + 1; });
+
+	t.stop_sampling();
+
+	auto cnt = samples.load();
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	UT_ASSERTeq(samples.load(), cnt);
+
+	/* sampling is stopped on pool close */
+	t.start_sampling(std::chrono::milliseconds(1),
+			 [&](const nvobj::telemetry_snapshot &) {});
+}
+
+} /* namespace */
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	auto path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(path, "pool_telemetry",
+						PMEMOBJ_MIN_POOL * 2,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_disabled(pop);
+	test_counters(pop);
+	test_snapshot_bytes(pop);
+	test_threads(pop);
+	test_sampling(pop);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * rcu_ptr.cpp -- tests for pmem::obj::experimental::rcu_ptr
+ */
+
+#include "thread_helpers.hpp"
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/rcu_ptr.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/p.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <atomic>
+
+#define LAYOUT "cpp"
+
+namespace nvobj = pmem::obj;
+
+struct config {
+	config(uint64_t version) : version(version), doubled(2 * version)
+	{
+	}
+
+	nvobj::p<uint64_t> version;
+	nvobj::p<uint64_t> doubled;
+};
+
+using rcu_type = nvobj::experimental::rcu_ptr<config>;
+
+struct root {
+	nvobj::persistent_ptr<rcu_type> rcu;
+};
+
+/*
+ * basic_test -- (internal) versions are published, read and freed once
+ * retired
+ */
+static void
+basic_test(nvobj::pool<root> &pop)
+{
+	auto &rcu = *pop.root()->rcu;
+
+	/* retire a version in each epoch, to allocate all the limbo lists */
+	for (uint64_t i = 0; i < 3; i++)
+		rcu.emplace(i);
+	rcu.reset();
+	rcu.garbage_collect_force();
+
+	auto allocs = num_allocs(pop);
+	auto w = rcu.register_worker();
+
+	UT_ASSERT(!rcu);
+	rcu.read(w, [&](const config *c) { UT_ASSERTeq(c, nullptr); });
+
+	try {
+		rcu.update([](config &) { ASSERT_UNREACHABLE; });
+		ASSERT_UNREACHABLE;
+	} catch (std::logic_error &) {
+	}
+
+	rcu.emplace(1U);
+	UT_ASSERT(static_cast<bool>(rcu));
+	rcu.read(w, [&](const config *c) {
+		UT_ASSERTeq(c->version, 1);
+		UT_ASSERTeq(c->doubled, 2);
+	});
+
+	/* the old version is not modified by update */
+	w.critical([&] {
+		auto old = rcu.get();
+
+		rcu.update([](config &c) {
+			c.version = c.version + 1;
+			c.doubled = 2 * c.version;
+		});
+
+		UT_ASSERTeq(old->version, 1);
+		UT_ASSERTeq(rcu.get()->version, 2);
+		UT_ASSERTeq(rcu.get()->doubled, 4);
+	});
+
+	/* exception in update aborts it */
+	try {
+		rcu.update([](config &c) {
+			c.version = 100;
+			throw std::runtime_error("abort");
+		});
+		ASSERT_UNREACHABLE;
+	} catch (std::runtime_error &) {
+	}
+	UT_ASSERTeq(rcu.get()->version, 2);
+
+	rcu.garbage_collect_force();
+	UT_ASSERTeq(num_allocs(pop), allocs + 1);
+
+	rcu.reset();
+	UT_ASSERT(!rcu);
+	rcu.garbage_collect_force();
+	UT_ASSERTeq(num_allocs(pop), allocs);
+}
+
+/*
+ * tx_test -- (internal) modifications are refused inside a transaction
+ */
+static void
+tx_test(nvobj::pool<root> &pop)
+{
+	auto &rcu = *pop.root()->rcu;
+	rcu.emplace(1U);
+	auto allocs = num_allocs(pop);
+
+	nvobj::transaction::run(pop, [&] {
+		try {
+			rcu.emplace(2U);
+			ASSERT_UNREACHABLE;
+		} catch (pmem::transaction_scope_error &) {
+		}
+
+		try {
+			rcu.update([](config &) { ASSERT_UNREACHABLE; });
+			ASSERT_UNREACHABLE;
+		} catch (pmem::transaction_scope_error &) {
+		}
+
+		try {
+			rcu.reset();
+			ASSERT_UNREACHABLE;
+		} catch (pmem::transaction_scope_error &) {
+		}
+	});
+
+	UT_ASSERTeq(rcu.get()->version, 1);
+	UT_ASSERTeq(num_allocs(pop), allocs);
+
+	rcu.reset();
+	rcu.garbage_collect_force();
+}
+
+/*
+ * recovery_test -- (internal) versions which were retired, but not freed,
+ * before the restart are freed by runtime_initialize()
+ */
+static void
+recovery_test(nvobj::pool<root> &pop)
+{
+	auto &rcu = *pop.root()->rcu;
+	auto allocs = num_allocs(pop);
+
+	{
+		auto w = rcu.register_worker();
+
+		/* a reader in a critical section blocks the reclamation */
+		w.critical([&] {
+			for (uint64_t i = 0; i < 10; i++)
+				rcu.emplace(i);
+		});
+	}
+	UT_ASSERT(num_allocs(pop) > allocs + 1);
+
+	rcu.runtime_finalize();
+	rcu.runtime_initialize();
+
+	UT_ASSERTeq(num_allocs(pop), allocs + 1);
+	UT_ASSERTeq(rcu.get()->version, 9);
+}
+
+/*
+ * mt_test -- (internal) readers always see a consistent version, which is not
+ * older than the previously read one
+ */
+static void
+mt_test(nvobj::pool<root> &pop, size_t concurrency)
+{
+	const uint64_t updates = 1000;
+
+	auto &rcu = *pop.root()->rcu;
+	rcu.emplace(0U);
+
+	std::atomic<bool> done(false);
+
+	parallel_exec(concurrency + 1, [&](size_t thread_id) {
+		if (thread_id == concurrency) {
+			for (uint64_t i = 1; i <= updates; i++) {
+				rcu.update([](config &c) {
+					c.version = c.version + 1;
+					c.doubled = 2 * c.version;
+				});
+			}
+			done = true;
+			return;
+		}
+
+		auto w = rcu.register_worker();
+		uint64_t last = 0;
+		while (!done.load()) {
+			rcu.read(w, [&](const config *c) {
+				UT_ASSERTeq(c->doubled, 2 * c->version);
+				UT_ASSERT(c->version >= last);
+				last = c->version;
+			});
+		}
+	});
+
+	UT_ASSERTeq(rcu.get()->version, updates);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<root>::create(std::string(path), LAYOUT,
+						PMEMOBJ_MIN_POOL,
+						S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	nvobj::transaction::run(pop, [&] {
+		pop.root()->rcu = nvobj::make_persistent<rcu_type>();
+	});
+	pop.root()->rcu->runtime_initialize();
+
+	basic_test(pop);
+	tx_test(pop);
+	recovery_test(pop);
+	mt_test(pop, 4);
+
+	pop.root()->rcu->runtime_finalize();
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<rcu_type>(pop.root()->rcu);
+	});
+	UT_ASSERTeq(num_allocs(pop), 0);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
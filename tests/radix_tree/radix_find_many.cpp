@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/* Tests batched lookups (find_many) of radix tree */
+
+#include "radix.hpp"
+
+#include <algorithm>
+
+static const unsigned N_ELEMS = 1000;
+
+/*
+ * gen_queries -- (internal) returns keys to look for: existing and
+ * non-existing ones, duplicated and in random order
+ */
+template <typename Container>
+std::vector<decltype(key<Container>(0))>
+gen_queries()
+{
+	std::vector<decltype(key<Container>(0))> ret;
+
+	for (unsigned i = 0; i < 2 * N_ELEMS; i += 3)
+		ret.push_back(key<Container>(i));
+	for (unsigned i = 0; i < N_ELEMS; i += 7)
+		ret.push_back(key<Container>(i));
+
+	std::shuffle(ret.begin(), ret.end(), generator);
+
+	return ret;
+}
+
+template <typename Container, typename Keys, typename Result>
+void
+verify_result(nvobj::persistent_ptr<Container> &ptr, const Keys &keys,
+	      const Result &result)
+{
+	UT_ASSERTeq(keys.size(), result.size());
+
+	for (size_t i = 0; i < keys.size(); i++) {
+		UT_ASSERT(result[i] == ptr->find(keys[i]));
+		if (result[i] != ptr->end())
+			UT_ASSERT(result[i]->key() == keys[i]);
+	}
+}
+
+/*
+ * test_find_many -- (internal) batched lookups return the same elements as
+ * find() called for each key
+ */
+template <typename Container>
+void
+test_find_many(nvobj::pool<root> &pop, nvobj::persistent_ptr<Container> &ptr)
+{
+	init_container(pop, ptr, N_ELEMS);
+
+	auto keys = gen_queries<Container>();
+
+	auto result = ptr->find_many(keys.begin(), keys.end());
+	verify_result(ptr, keys, result);
+
+	const auto &cptr = *ptr;
+	auto cresult = cptr.find_many(keys.begin(), keys.end());
+	UT_ASSERTeq(cresult.size(), keys.size());
+	for (size_t i = 0; i < keys.size(); i++)
+		UT_ASSERT(cresult[i] == result[i]);
+
+	/* keys which are prefixes of each other */
+	ptr->erase(key<Container>(1));
+	ptr->erase(key<Container>(10));
+	result = ptr->find_many(keys.begin(), keys.end());
+	verify_result(ptr, keys, result);
+
+	UT_ASSERT(ptr->find_many(keys.begin(), keys.begin()).empty());
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<Container>(ptr);
+	});
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+/*
+ * test_find_many_mt -- (internal) batched lookups in a single critical
+ * section, concurrently with the writer
+ */
+template <typename Container>
+void
+test_find_many_mt(nvobj::pool<root> &pop,
+		  nvobj::persistent_ptr<Container> &ptr)
+{
+	const size_t n_readers = 4;
+
+	init_container(pop, ptr, N_ELEMS);
+	ptr->runtime_initialize_mt();
+
+	auto keys = gen_queries<Container>();
+
+	/* writer only overwrites values, the set of keys does not change */
+	std::vector<bool> exists;
+	for (auto &k : keys)
+		exists.push_back(ptr->find(k) != ptr->end());
+
+	auto writer = [&] {
+		for (unsigned i = 0; i < N_ELEMS; i++) {
+			ptr->insert_or_assign(key<Container>(i),
+					      value<Container>(i + 1));
+			ptr->garbage_collect();
+		}
+	};
+
+	auto reader = [&] {
+		auto w = ptr->register_worker();
+		for (int r = 0; r < 10; r++) {
+			w.critical([&] {
+				auto result = ptr->find_many(keys.begin(),
+							     keys.end());
+				for (size_t i = 0; i < keys.size(); i++) {
+					UT_ASSERTeq(result[i] != ptr->end(),
+						    exists[i]);
+					if (exists[i])
+						UT_ASSERT(result[i]->key() ==
+							  keys[i]);
+				}
+			});
+		}
+	};
+
+	std::vector<decltype(reader)> readers(n_readers, reader);
+	parallel_modify_read(writer, readers, n_readers);
+
+	ptr->runtime_finalize_mt();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<Container>(ptr);
+	});
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<struct root>::create(path, "radix_find_many",
+						       10 * PMEMOBJ_MIN_POOL,
+						       S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	init_random();
+
+	test_find_many(pop, pop.root()->radix_str);
+	test_find_many(pop, pop.root()->radix_int_int);
+
+	test_find_many_mt(pop, pop.root()->radix_str_mt);
+	test_find_many_mt(pop, pop.root()->radix_int_int_mt);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
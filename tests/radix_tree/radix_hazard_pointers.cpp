@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+#include "radix.hpp"
+
+/*
+ * radix_hazard_pointers -- test lookups on the radix_tree which are protected
+ * by hazard pointers instead of ebr critical sections.
+ */
+
+static size_t INITIAL_ELEMENTS = 512;
+
+template <typename Container>
+static void
+init_hazard_readers(nvobj::persistent_ptr<Container> &ptr)
+{
+	ptr->runtime_initialize_mt(new typename Container::ebr(), true);
+}
+
+template <typename Container>
+static void
+destroy_container(nvobj::pool<root> &pop,
+		  nvobj::persistent_ptr<Container> &ptr)
+{
+	ptr->garbage_collect_force();
+	ptr->runtime_finalize_mt();
+
+	nvobj::transaction::run(
+		pop, [&] { nvobj::delete_persistent<Container>(ptr); });
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+/* Lookups with hazard pointers return the same elements as the regular ones,
+ * also for keys which are prefixes of other keys. */
+static void
+test_lookups(nvobj::pool<root> &pop,
+	     nvobj::persistent_ptr<cntr_string_mt> &ptr)
+{
+	init_container(pop, ptr, INITIAL_ELEMENTS);
+	init_hazard_readers(ptr);
+
+	/* make some holes in the tree */
+	for (size_t i = 0; i < INITIAL_ELEMENTS; i += 3)
+		ptr->erase(key<cntr_string_mt>(i));
+
+	{
+		auto w = ptr->register_hazard_worker();
+		const cntr_string_mt &tree = *ptr;
+
+		std::vector<std::string> keys = {"", "0a", "1000", "9", "99",
+						 "999", "~"};
+		for (size_t i = 0; i < 2 * INITIAL_ELEMENTS; ++i)
+			keys.push_back(key<cntr_string_mt>(i));
+
+		for (auto &k : keys) {
+			UT_ASSERT(tree.find(k, w) == tree.find(k));
+			UT_ASSERT(tree.lower_bound(k, w) ==
+				  tree.lower_bound(k));
+		}
+	}
+
+	destroy_container(pop, ptr);
+}
+
+/* A stalled reader blocks freeing of the element it holds, but not of the
+ * rest of the garbage. */
+static void
+test_stalled_reader(nvobj::pool<root> &pop,
+		    nvobj::persistent_ptr<cntr_int_int_mt> &ptr)
+{
+	init_container(pop, ptr, INITIAL_ELEMENTS);
+	init_hazard_readers(ptr);
+
+	auto allocs_before_erase = num_allocs(pop);
+
+	{
+		auto w = ptr->register_hazard_worker();
+		const cntr_int_int_mt &tree = *ptr;
+
+		auto it = tree.find(key<cntr_int_int_mt>(0), w);
+		UT_ASSERT(it != tree.cend());
+
+		for (size_t i = 0; i < INITIAL_ELEMENTS; ++i)
+			ptr->erase(key<cntr_int_int_mt>(i));
+		ptr->garbage_collect_force();
+
+		UT_ASSERT(num_allocs(pop) < allocs_before_erase);
+		UT_ASSERTeq(it->key(), key<cntr_int_int_mt>(0));
+		UT_ASSERTeq(it->value(), value<cntr_int_int_mt>(0));
+
+		auto allocs = num_allocs(pop);
+		w.release_all();
+		ptr->garbage_collect_force();
+		UT_ASSERTeq(num_allocs(pop), allocs - 1);
+	}
+
+	destroy_container(pop, ptr);
+}
+
+/* Erase all elements and collect the garbage, while other threads look them
+ * up with hazard pointers. */
+static void
+test_erase_find(nvobj::pool<root> &pop,
+		nvobj::persistent_ptr<cntr_int_int_mt> &ptr)
+{
+	size_t threads = 4;
+	if (On_drd)
+		threads = 2;
+
+	init_container(pop, ptr, INITIAL_ELEMENTS);
+	init_hazard_readers(ptr);
+
+	auto erase_f = [&] {
+		for (size_t i = 0; i < INITIAL_ELEMENTS; ++i) {
+			ptr->erase(key<cntr_int_int_mt>(i));
+			ptr->garbage_collect();
+		}
+	};
+
+	auto readers_f = std::vector<std::function<void()>>{
+		[&] {
+			auto w = ptr->register_hazard_worker();
+			const cntr_int_int_mt &tree = *ptr;
+
+			for (size_t i = 0; i < INITIAL_ELEMENTS; ++i) {
+				auto k = key<cntr_int_int_mt>(i);
+				auto it = tree.find(k, w);
+				UT_ASSERT(it == tree.cend() ||
+					  it->value() ==
+						  value<cntr_int_int_mt>(i));
+			}
+		},
+		[&] {
+			auto w = ptr->register_hazard_worker();
+			const cntr_int_int_mt &tree = *ptr;
+
+			for (size_t i = 0; i < INITIAL_ELEMENTS; ++i) {
+				auto k = key<cntr_int_int_mt>(i);
+				auto it = tree.lower_bound(k, w);
+				UT_ASSERT(it == tree.cend() ||
+					  (it->key() >= k &&
+					   it->value() == it->key()));
+			}
+		},
+	};
+
+	parallel_modify_read(erase_f, readers_f, threads);
+
+	destroy_container(pop, ptr);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<struct root>::create(path,
+						       "radix_hazard_pointers",
+						       10 * PMEMOBJ_MIN_POOL,
+						       S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_lookups(pop, pop.root()->radix_str_mt);
+	test_stalled_reader(pop, pop.root()->radix_int_int_mt);
+	test_erase_find(pop, pop.root()->radix_int_int_mt);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * radix_layout.cpp -- checks that the persistent layout of radix_tree (and of
+ * its internal nodes, see static_asserts in radix_tree.hpp) does not change.
+ * New persistent state of radix_tree must fit into the existing members.
+ */
+
+#include "radix.hpp"
+
+#include <libpmemobj++/detail/persistent_limbo.hpp>
+
+template <typename Container>
+static void
+check_layout()
+{
+	/* layout of the limbo does not depend on the type of pointers */
+	constexpr size_t garbages_size =
+		sizeof(pmem::detail::persistent_limbo<int>);
+
+	/* root, size_ (which also holds the settings), garbages and runtime_
+	 * (which took the place of ebr_) */
+	static_assert(sizeof(Container) == 16 + garbages_size + 8,
+		      "Layout of radix_tree should not change.");
+}
+
+static void
+test()
+{
+	check_layout<cntr_int>();
+	check_layout<cntr_string>();
+	check_layout<cntr_int_int>();
+	check_layout<cntr_int_string>();
+	check_layout<cntr_inline_s_u8t>();
+	check_layout<cntr_int_mt>();
+	check_layout<cntr_string_mt>();
+	check_layout<cntr_int_int_mt>();
+	check_layout<cntr_int_string_mt>();
+	check_layout<cntr_inline_s_u8t_mt>();
+}
+
+int
+main()
+{
+	return run_test([&] { test(); });
+}
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/* Tests order statistics (count, rank and select) of radix tree */
+
+#include "radix.hpp"
+
+static const unsigned N_ELEMS = 500;
+
+/*
+ * verify -- (internal) check that count, rank and select are consistent
+ * with the iteration order
+ */
+template <typename Container>
+void
+verify(nvobj::persistent_ptr<Container> &ptr)
+{
+	const auto &cptr = *ptr;
+
+	size_t i = 0;
+	for (auto it = ptr->begin(); it != ptr->end(); ++it, ++i) {
+		UT_ASSERT(ptr->select(i) == it);
+		UT_ASSERT(cptr.select(i) == it);
+		UT_ASSERTeq(ptr->rank(it->key()), i);
+		UT_ASSERTeq(ptr->count(ptr->begin(), it), i);
+		UT_ASSERTeq(ptr->count(it, ptr->end()), ptr->size() - i);
+	}
+
+	UT_ASSERTeq(i, ptr->size());
+	UT_ASSERT(ptr->select(i) == ptr->end());
+	UT_ASSERT(ptr->select(i + 1) == ptr->end());
+	UT_ASSERTeq(ptr->count(ptr->begin(), ptr->end()), ptr->size());
+
+	/* keys which are not in the container */
+	for (unsigned j = 0; j < 2 * N_ELEMS; j += 7) {
+		auto k = key<Container>(j);
+		auto expected =
+			std::distance(ptr->begin(), ptr->lower_bound(k));
+		UT_ASSERTeq(ptr->rank(k), static_cast<size_t>(expected));
+	}
+}
+
+/*
+ * test_order_statistics -- (internal) counts are maintained by inserts and
+ * erases, results are the same with order statistics disabled
+ */
+template <typename Container>
+void
+test_order_statistics(nvobj::pool<root> &pop,
+		      nvobj::persistent_ptr<Container> &ptr)
+{
+	init_container(pop, ptr, N_ELEMS / 2);
+	UT_ASSERT(!ptr->order_statistics_enabled());
+	verify(ptr);
+
+	/* counts are calculated for the existing elements */
+	ptr->enable_order_statistics();
+	UT_ASSERT(ptr->order_statistics_enabled());
+	verify(ptr);
+
+	for (unsigned i = N_ELEMS / 2; i < N_ELEMS; i++)
+		ptr->try_emplace(key<Container>(i), value<Container>(i));
+	verify(ptr);
+
+	for (unsigned i = 0; i < N_ELEMS; i += 3)
+		ptr->erase(key<Container>(i));
+	verify(ptr);
+
+	/* in-place updates do not change counts */
+	for (unsigned i = 1; i < N_ELEMS; i += 3)
+		ptr->insert_or_assign(key<Container>(i),
+				      value<Container>(i + 1));
+	verify(ptr);
+
+	/* aborted transaction rolls back the counts */
+	try {
+		nvobj::transaction::run(pop, [&] {
+			ptr->erase(key<Container>(1));
+			ptr->try_emplace(key<Container>(N_ELEMS),
+					 value<Container>(0));
+			nvobj::transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+	verify(ptr);
+
+	/* counts are no longer maintained, but results are still correct */
+	ptr->disable_order_statistics();
+	UT_ASSERT(!ptr->order_statistics_enabled());
+	for (unsigned i = 0; i < N_ELEMS; i += 5)
+		ptr->insert_or_assign(key<Container>(i), value<Container>(i));
+	verify(ptr);
+
+	ptr->enable_order_statistics();
+	verify(ptr);
+
+	ptr->clear();
+	verify(ptr);
+
+	ptr->try_emplace(key<Container>(0), value<Container>(0));
+	verify(ptr);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<Container>(ptr);
+	});
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+/*
+ * test_prefix_count -- (internal) number of keys with the given prefix
+ */
+void
+test_prefix_count(nvobj::pool<root> &pop,
+		  nvobj::persistent_ptr<cntr_string> &ptr)
+{
+	init_container(pop, ptr, N_ELEMS);
+	ptr->enable_order_statistics();
+
+	for (char c = '1'; c <= '9'; c++) {
+		std::string prefix(1, c);
+		std::string next(1, static_cast<char>(c + 1));
+
+		size_t expected = 0;
+		for (unsigned i = 0; i < N_ELEMS; i++)
+			expected += std::to_string(i)[0] == c;
+
+		UT_ASSERTeq(ptr->count(ptr->lower_bound(prefix),
+				       ptr->lower_bound(next)),
+			    expected);
+		UT_ASSERTeq(ptr->rank(next) - ptr->rank(prefix), expected);
+	}
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<cntr_string>(ptr);
+	});
+}
+
+/*
+ * test_snapshot -- (internal) counts are maintained when nodes shared with
+ * a snapshot are copied
+ */
+template <typename Container>
+void
+test_snapshot(nvobj::pool<root> &pop, nvobj::persistent_ptr<Container> &ptr)
+{
+	init_container(pop, ptr, N_ELEMS);
+	ptr->runtime_initialize_mt();
+	ptr->enable_order_statistics();
+
+	{
+		auto snap = ptr->snapshot();
+
+		for (unsigned i = 0; i < N_ELEMS; i += 2)
+			ptr->erase(key<Container>(i));
+		for (unsigned i = N_ELEMS; i < 2 * N_ELEMS; i += 3)
+			ptr->try_emplace(key<Container>(i),
+					 value<Container>(i));
+		verify(ptr);
+
+		UT_ASSERTeq(snap.size(), N_ELEMS);
+	}
+
+	ptr->garbage_collect_force();
+	verify(ptr);
+
+	ptr->runtime_finalize_mt();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<Container>(ptr);
+	});
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<struct root>::create(
+			path, "radix_order_statistics", 10 * PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_order_statistics(pop, pop.root()->radix_str);
+	test_order_statistics(pop, pop.root()->radix_int_int);
+
+	test_prefix_count(pop, pop.root()->radix_str);
+
+	test_snapshot(pop, pop.root()->radix_str_mt);
+	test_snapshot(pop, pop.root()->radix_int_int_mt);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
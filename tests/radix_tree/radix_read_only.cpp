@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * radix_read_only.cpp -- test lookups on the radix_tree in concurrent mode
+ * in a pool opened with pool_base::open_read_only()
+ */
+
+#include "radix.hpp"
+
+#include <functional>
+
+static const unsigned N_ELEMS = 512;
+static const char *LAYOUT = "radix_read_only";
+
+static void
+assert_rejected(std::function<void()> f)
+{
+	try {
+		f();
+		UT_ASSERT(0);
+	} catch (pmem::transaction_scope_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+}
+
+/*
+ * test_lookups -- (internal) lookups, bounds and snapshots work without
+ * runtime_initialize_mt(), ebr critical sections or hazard pointers, and
+ * all modifications are rejected
+ */
+static void
+test_lookups(nvobj::pool<root> &pop, size_t threads)
+{
+	auto ptr = pop.root()->radix_str_mt;
+	UT_ASSERT(pop.is_read_only());
+
+	parallel_exec(threads, [&](size_t) {
+		verify_elements(
+			ptr, N_ELEMS,
+			[](unsigned i) { return key<cntr_string_mt>(i); },
+			[](unsigned i) { return value<cntr_string_mt>(i); });
+
+		UT_ASSERT(ptr->find(key<cntr_string_mt>(N_ELEMS)) ==
+			  ptr->end());
+	});
+
+	auto snap = ptr->snapshot();
+	UT_ASSERTeq(snap.size(), N_ELEMS);
+	for (unsigned i = 0; i < N_ELEMS; i++) {
+		auto it = snap.find(key<cntr_string_mt>(i));
+		UT_ASSERT(it != snap.end());
+		UT_ASSERT(nvobj::string_view(it->value())
+				  .compare(value<cntr_string_mt>(i)) == 0);
+	}
+	snap.release();
+
+	assert_rejected([&] {
+		ptr->emplace(key<cntr_string_mt>(N_ELEMS),
+			     value<cntr_string_mt>(N_ELEMS));
+	});
+	assert_rejected([&] {
+		ptr->insert_or_assign(key<cntr_string_mt>(0),
+				      value<cntr_string_mt>(1));
+	});
+	assert_rejected([&] {
+		/* would be appended in place, outside of a transaction */
+		auto v = value<cntr_string_mt>(0);
+		ptr->find(key<cntr_string_mt>(0)).assign_val(v + v);
+	});
+	assert_rejected([&] { ptr->erase(key<cntr_string_mt>(0)); });
+	assert_rejected([&] { ptr->clear(); });
+	assert_rejected([&] { ptr->garbage_collect(); });
+	assert_rejected([&] { ptr->garbage_collect_force(); });
+
+	UT_ASSERTeq(ptr->size(), N_ELEMS);
+	UT_ASSERT(ptr->find(key<cntr_string_mt>(0))->value() ==
+		  value<cntr_string_mt>(0));
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<struct root>::create(path, LAYOUT,
+						       10 * PMEMOBJ_MIN_POOL,
+						       S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	init_container(pop, pop.root()->radix_str_mt, N_ELEMS);
+	pop.close();
+
+	size_t threads = 4;
+	if (On_drd)
+		threads = 2;
+
+	pop = nvobj::pool<root>::open_read_only(path, LAYOUT);
+	test_lookups(pop, threads);
+	pop.close();
+
+	pop = nvobj::pool<root>::open(path, LAYOUT);
+	UT_ASSERT(!pop.is_read_only());
+
+	auto &ptr = pop.root()->radix_str_mt;
+	ptr->runtime_initialize_mt();
+	UT_ASSERTeq(ptr->erase(key<cntr_string_mt>(0)), 1U);
+	ptr->garbage_collect_force();
+	ptr->runtime_finalize_mt();
+
+	nvobj::transaction::run(
+		pop, [&] { nvobj::delete_persistent<cntr_string_mt>(ptr); });
+	UT_ASSERTeq(num_allocs(pop), 0);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
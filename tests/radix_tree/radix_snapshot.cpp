@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/* Tests copy-on-write snapshots of radix tree in concurrent mode */
+
+#include "radix.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+static const unsigned N_ELEMS = 500;
+
+template <typename Container>
+void
+init(nvobj::pool<root> &pop, nvobj::persistent_ptr<Container> &ptr)
+{
+	nvobj::transaction::run(pop, [&] {
+		ptr = nvobj::make_persistent<Container>();
+		for (unsigned i = 0; i < N_ELEMS; i++)
+			ptr->try_emplace(key<Container>(i),
+					 value<Container>(i));
+	});
+
+	ptr->runtime_initialize_mt();
+}
+
+template <typename Container>
+void
+destroy(nvobj::pool<root> &pop, nvobj::persistent_ptr<Container> &ptr)
+{
+	ptr->runtime_finalize_mt();
+
+	nvobj::transaction::run(
+		pop, [&] { nvobj::delete_persistent<Container>(ptr); });
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+/*
+ * verify_snapshot -- (internal) check that the snapshot consists of the
+ * given leaves (in the same order) and that all initial elements can be
+ * found
+ */
+template <typename Container>
+void
+verify_snapshot(const typename Container::snapshot_type &snap,
+		const std::vector<const void *> &leaves)
+{
+	UT_ASSERTeq(snap.size(), leaves.size());
+
+	size_t i = 0;
+	for (auto it = snap.begin(); it != snap.end(); ++it, ++i) {
+		UT_ASSERT(i < leaves.size());
+		UT_ASSERT(&*it == leaves[i]);
+	}
+	UT_ASSERTeq(i, leaves.size());
+
+	for (unsigned j = 0; j < N_ELEMS; j++) {
+		auto it = snap.find(key<Container>(j));
+		UT_ASSERT(it != snap.end());
+		UT_ASSERT(std::find(leaves.begin(), leaves.end(), &*it) !=
+			  leaves.end());
+		UT_ASSERTeq(snap.count(key<Container>(j)), 1);
+	}
+}
+
+template <typename Container>
+std::vector<const void *>
+leaves(nvobj::persistent_ptr<Container> &ptr)
+{
+	std::vector<const void *> ret;
+	for (auto it = ptr->cbegin(); it != ptr->cend(); ++it)
+		ret.push_back(&*it);
+
+	return ret;
+}
+
+/*
+ * test_snapshot -- (internal) modifications of the tree are not visible in
+ * the snapshot, memory is reclaimed after the snapshot is released
+ */
+template <typename Container>
+void
+test_snapshot(nvobj::pool<root> &pop, nvobj::persistent_ptr<Container> &ptr)
+{
+	init(pop, ptr);
+
+	auto before = leaves(ptr);
+	auto snap = ptr->snapshot();
+
+	for (unsigned i = 0; i < N_ELEMS; i += 2)
+		ptr->insert_or_assign(key<Container>(i),
+				      value<Container>(i + 1));
+	for (unsigned i = 1; i < N_ELEMS; i += 4)
+		ptr->erase(key<Container>(i));
+	for (unsigned i = N_ELEMS; i < 2 * N_ELEMS; i++)
+		ptr->try_emplace(key<Container>(i), value<Container>(i));
+
+	/* only nodes allocated after the snapshot may be freed */
+	auto allocs = num_allocs(pop);
+	ptr->garbage_collect_force();
+	UT_ASSERT(num_allocs(pop) <= allocs);
+
+	verify_snapshot<Container>(snap, before);
+	UT_ASSERT(snap.find(key<Container>(N_ELEMS)) == snap.end());
+	UT_ASSERTeq(snap.count(key<Container>(N_ELEMS)), 0);
+
+	for (unsigned i = 0; i < 2 * N_ELEMS; i++) {
+		auto it = ptr->find(key<Container>(i));
+		if (i < N_ELEMS && i % 4 == 1) {
+			UT_ASSERT(it == ptr->end());
+			continue;
+		}
+
+		UT_ASSERT(it->key() == key<Container>(i));
+		if (i < N_ELEMS && i % 2 == 0)
+			UT_ASSERT(it->value() == value<Container>(i + 1));
+		else
+			UT_ASSERT(it->value() == value<Container>(i));
+	}
+
+	/* a second snapshot sees the current state */
+	auto after = leaves(ptr);
+	{
+		auto snap2 = ptr->snapshot();
+		ptr->clear();
+		UT_ASSERTeq(ptr->size(), 0);
+
+		UT_ASSERTeq(snap2.size(), after.size());
+		size_t i = 0;
+		for (auto &e : snap2)
+			UT_ASSERT(&e == after[i++]);
+	}
+
+	verify_snapshot<Container>(snap, before);
+
+	snap.release();
+	UT_ASSERT(snap.empty());
+	UT_ASSERT(snap.begin() == snap.end());
+
+	ptr->garbage_collect_force();
+
+	/* old versions are freed after the snapshot is released */
+	UT_ASSERT(num_allocs(pop) < allocs);
+
+	destroy(pop, ptr);
+}
+
+/*
+ * test_oldest_snapshot -- (internal) garbage produced before the oldest
+ * alive snapshot was taken is freed, the rest is kept until that snapshot
+ * is released
+ */
+template <typename Container>
+void
+test_oldest_snapshot(nvobj::pool<root> &pop,
+		     nvobj::persistent_ptr<Container> &ptr)
+{
+	init(pop, ptr);
+
+	auto allocs = num_allocs(pop);
+
+	auto snap1 = ptr->snapshot();
+	for (unsigned i = 0; i < N_ELEMS; i++)
+		ptr->insert_or_assign(key<Container>(i),
+				      value<Container>(i + 1));
+
+	ptr->garbage_collect_force();
+	auto held1 = num_allocs(pop);
+	UT_ASSERT(held1 > allocs);
+
+	auto before = leaves(ptr);
+	auto snap2 = ptr->snapshot();
+	snap1.release();
+
+	for (unsigned i = 0; i < N_ELEMS; i++)
+		ptr->insert_or_assign(key<Container>(i),
+				      value<Container>(i + 2));
+
+	/* garbage held only by snap1 is freed */
+	auto all = num_allocs(pop);
+	ptr->garbage_collect_force();
+	UT_ASSERT(num_allocs(pop) < all);
+	UT_ASSERT(num_allocs(pop) > allocs);
+	verify_snapshot<Container>(snap2, before);
+
+	snap2.release();
+	ptr->garbage_collect_force();
+	UT_ASSERTeq(num_allocs(pop), allocs);
+
+	destroy(pop, ptr);
+}
+
+/*
+ * test_concurrent -- (internal) readers iterate over snapshots while the
+ * writer modifies the tree
+ */
+template <typename Container>
+void
+test_concurrent(nvobj::pool<root> &pop, nvobj::persistent_ptr<Container> &ptr)
+{
+	const size_t n_readers = 4;
+
+	init(pop, ptr);
+
+	auto before = leaves(ptr);
+	auto snap = ptr->snapshot();
+
+	std::atomic<bool> done(false);
+
+	std::vector<std::thread> readers;
+	for (size_t i = 0; i < n_readers; i++) {
+		readers.emplace_back([&] {
+			do {
+				verify_snapshot<Container>(snap, before);
+			} while (!done.load());
+		});
+	}
+
+	for (unsigned i = 0; i < N_ELEMS; i++) {
+		ptr->insert_or_assign(key<Container>(i),
+				      value<Container>(i + 1));
+		ptr->try_emplace(key<Container>(N_ELEMS + i),
+				 value<Container>(i));
+		if (i % 3 == 0)
+			ptr->erase(key<Container>(i));
+	}
+
+	done.store(true);
+	for (auto &t : readers)
+		t.join();
+
+	verify_snapshot<Container>(snap, before);
+
+	snap.release();
+	ptr->garbage_collect_force();
+
+	for (unsigned i = 0; i < N_ELEMS; i++) {
+		auto it = ptr->find(key<Container>(i));
+		if (i % 3 == 0)
+			UT_ASSERT(it == ptr->end());
+		else
+			UT_ASSERT(it->value() == value<Container>(i + 1));
+	}
+
+	destroy(pop, ptr);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<struct root>::create(path, "radix_snapshot",
+						       20 * PMEMOBJ_MIN_POOL,
+						       S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_snapshot(pop, pop.root()->radix_str_mt);
+	test_snapshot(pop, pop.root()->radix_int_int_mt);
+
+	test_oldest_snapshot(pop, pop.root()->radix_str_mt);
+	test_oldest_snapshot(pop, pop.root()->radix_int_int_mt);
+
+	test_concurrent(pop, pop.root()->radix_str_mt);
+	test_concurrent(pop, pop.root()->radix_int_int_mt);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/* Tests in-place growth of inline_string values of radix tree */
+
+#include "radix.hpp"
+
+static const unsigned N_APPENDS = 200;
+
+/*
+ * grow -- (internal) append one character to the value N_APPENDS times,
+ * returns number of reallocations of the leaf
+ */
+template <typename Container>
+unsigned
+grow(nvobj::persistent_ptr<Container> &ptr, unsigned k, std::string &v)
+{
+	unsigned reallocs = 0;
+
+	auto it = ptr->find(k);
+	for (unsigned i = 0; i < N_APPENDS; i++) {
+		const void *leaf = &*it;
+
+		v += static_cast<char>('a' + i % 26);
+		it.assign_val(v);
+
+		if (&*it != leaf)
+			reallocs++;
+
+		UT_ASSERT(nvobj::string_view(it->value()).compare(v) == 0);
+		UT_ASSERT(it->value().capacity() >= v.size());
+		UT_ASSERT(ptr->find(k) == it);
+	}
+
+	return reallocs;
+}
+
+/*
+ * test_value_growth -- (internal) values reallocated with slack grow in
+ * place until the capacity is exceeded
+ */
+void
+test_value_growth(nvobj::pool<root> &pop,
+		  nvobj::persistent_ptr<cntr_int_string> &ptr)
+{
+	nvobj::transaction::run(
+		pop, [&] { ptr = nvobj::make_persistent<cntr_int_string>(); });
+
+	UT_ASSERTeq(ptr->value_slack(), 0);
+
+	std::string v1 = "a", v2 = "a";
+	ptr->try_emplace(1U, v1);
+	ptr->try_emplace(2U, v2);
+
+	/* without slack every append reallocates the leaf */
+	UT_ASSERTeq(grow(ptr, 1, v1), N_APPENDS);
+
+	ptr->set_value_slack(100);
+	UT_ASSERTeq(ptr->value_slack(), 100);
+	UT_ASSERT(grow(ptr, 2, v2) < 10);
+
+	/* the setting shares the persistent size field with the count */
+	UT_ASSERTeq(ptr->size(), 2);
+	try {
+		ptr->set_value_slack(1U << 15);
+		UT_ASSERT(0);
+	} catch (std::invalid_argument &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+	UT_ASSERTeq(ptr->value_slack(), 100);
+
+	/* shrinking does not reallocate */
+	auto it = ptr->find(2);
+	const void *leaf = &*it;
+	it.assign_val("b");
+	UT_ASSERT(&*it == leaf);
+	UT_ASSERT(it->value().capacity() >= v2.size());
+
+	/* copy keeps the capacity */
+	auto capacity = it->value().capacity();
+	nvobj::persistent_ptr<cntr_int_string> copy;
+	nvobj::transaction::run(pop, [&] {
+		copy = nvobj::make_persistent<cntr_int_string>(*ptr);
+	});
+	UT_ASSERTeq(copy->find(2)->value().capacity(), capacity);
+	UT_ASSERT(nvobj::string_view(copy->find(1)->value()).compare(v1) ==
+		  0);
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<cntr_int_string>(copy);
+		nvobj::delete_persistent<cntr_int_string>(ptr);
+	});
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+/*
+ * test_append_mt -- (internal) in concurrent mode, appends which fit in the
+ * capacity are done in place, other assignments allocate a new leaf
+ */
+void
+test_append_mt(nvobj::pool<root> &pop,
+	       nvobj::persistent_ptr<cntr_int_string_mt> &ptr)
+{
+	nvobj::transaction::run(pop, [&] {
+		ptr = nvobj::make_persistent<cntr_int_string_mt>();
+	});
+	ptr->runtime_initialize_mt();
+	ptr->set_value_slack(100);
+
+	std::string v = "a";
+	ptr->try_emplace(1U, v);
+	UT_ASSERT(grow(ptr, 1, v) < 10);
+
+	/* not an append */
+	auto it = ptr->find(1);
+	const void *leaf = &*it;
+	it.assign_val("b");
+	UT_ASSERT(&*it != leaf);
+
+	/* value in a snapshot is not modified */
+	v = "b";
+	v += "c";
+	leaf = &*it;
+	{
+		auto snap = ptr->snapshot();
+
+		it.assign_val(v);
+		UT_ASSERT(&*it != leaf);
+		UT_ASSERT(nvobj::string_view(snap.find(1)->value())
+				  .compare("b") == 0);
+	}
+
+	ptr->garbage_collect_force();
+
+	/* readers see only complete values */
+	const size_t n_readers = 4;
+	const std::string expected = v + std::string(N_APPENDS, 'x');
+
+	auto writer = [&] {
+		auto it = ptr->find(1);
+		for (unsigned i = 0; i < N_APPENDS; i++) {
+			v += 'x';
+			it.assign_val(v);
+			ptr->garbage_collect();
+		}
+	};
+
+	auto reader = [&] {
+		auto w = ptr->register_worker();
+		for (unsigned i = 0; i < N_APPENDS; i++) {
+			w.critical([&] {
+				auto it = ptr->find(1);
+				auto value = nvobj::string_view(it->value());
+				UT_ASSERT(value.size() >= 2);
+				UT_ASSERT(value.compare(
+						  0, value.size(),
+						  expected.data(),
+						  value.size()) == 0);
+			});
+		}
+	};
+
+	std::vector<decltype(reader)> readers(n_readers, reader);
+	parallel_modify_read(writer, readers, n_readers);
+
+	UT_ASSERT(nvobj::string_view(ptr->find(1)->value()).compare(
+			  expected) == 0);
+
+	ptr->runtime_finalize_mt();
+
+	nvobj::transaction::run(pop, [&] {
+		nvobj::delete_persistent<cntr_int_string_mt>(ptr);
+	});
+
+	UT_ASSERTeq(num_allocs(pop), 0);
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	const char *path = argv[1];
+
+	nvobj::pool<root> pop;
+
+	try {
+		pop = nvobj::pool<struct root>::create(
+			path, "radix_value_growth", 10 * PMEMOBJ_MIN_POOL,
+			S_IWUSR | S_IRUSR);
+	} catch (pmem::pool_error &pe) {
+		UT_FATAL("!pool::create: %s %s", pe.what(), path);
+	}
+
+	test_value_growth(pop, pop.root()->radix_int_str);
+	test_append_mt(pop, pop.root()->radix_int_str_mt);
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}
@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: BSD-3-Clause
+/* Copyright 2021, Intel Corporation */
+
+/*
+ * transaction_log_buffers.cpp -- test for transaction log buffers
+ */
+
+#include "unittest.hpp"
+
+#include <libpmemobj++/experimental/tx_log_buffers.hpp>
+#include <libpmemobj++/make_persistent.hpp>
+#include <libpmemobj++/make_persistent_array.hpp>
+#include <libpmemobj++/persistent_ptr.hpp>
+#include <libpmemobj++/pool.hpp>
+#include <libpmemobj++/transaction.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace nvobj = pmem::obj;
+namespace nvobjex = pmem::obj::experimental;
+
+namespace
+{
+
+static constexpr size_t DATA_SIZE = 1 << 16;
+
+struct root {
+	nvobj::persistent_ptr<nvobjex::tx_log_buffers> buffers;
+	nvobj::persistent_ptr<char[]> data;
+};
+
+/*
+ * snapshot_data -- (internal) snapshot whole data with auto allocation of
+ * the undo log disabled
+ */
+void
+snapshot_data(nvobj::persistent_ptr<root> r, char val)
+{
+	nvobj::flat_transaction::log_auto_alloc(
+		nvobj::flat_transaction::log_type::snapshot, false);
+
+	nvobj::flat_transaction::snapshot(r->data.get(), DATA_SIZE);
+	std::memset(r->data.get(), val, DATA_SIZE);
+}
+
+/*
+ * test_no_buffer -- (internal) big snapshot fails without a buffer when
+ * log auto allocation is disabled
+ */
+void
+test_no_buffer(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+
+	try {
+		nvobj::flat_transaction::run(pop,
+					     [&] { snapshot_data(r, 1); });
+		UT_ASSERT(0);
+	} catch (pmem::transaction_error &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	for (size_t i = 0; i < DATA_SIZE; i++)
+		UT_ASSERTeq(r->data[static_cast<std::ptrdiff_t>(i)], 0);
+}
+
+/*
+ * test_buffer -- (internal) big snapshot fits in the appended buffer
+ */
+void
+test_buffer(nvobj::pool<root> &pop)
+{
+	auto r = pop.root();
+	auto size = nvobj::flat_transaction::log_snapshots_max_size(
+		{DATA_SIZE});
+
+	auto view = r->buffers->reserve(size);
+	UT_ASSERT(view.size >= size);
+
+	/* buffer is reused */
+	auto view2 = r->buffers->reserve(size);
+	UT_ASSERTeq(view.data, view2.data);
+
+	try {
+		nvobj::flat_transaction::manual tx(pop);
+		view.append();
+		snapshot_data(r, 2);
+		nvobj::flat_transaction::commit();
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	for (size_t i = 0; i < DATA_SIZE; i++)
+		UT_ASSERTeq(r->data[static_cast<std::ptrdiff_t>(i)], 2);
+
+	try {
+		r->buffers->run(pop, size, [&] {
+			snapshot_data(r, 3);
+			nvobj::flat_transaction::abort(EINVAL);
+		});
+		UT_ASSERT(0);
+	} catch (pmem::manual_tx_abort &) {
+	} catch (std::exception &e) {
+		UT_FATALexc(e);
+	}
+
+	for (size_t i = 0; i < DATA_SIZE; i++)
+		UT_ASSERTeq(r->data[static_cast<std::ptrdiff_t>(i)], 2);
+}
+
+/*
+ * test_threads -- (internal) each thread uses its own buffer
+ */
+void
+test_threads(nvobj::pool<root> &pop)
+{
+	const size_t threads = 4;
+	const size_t chunk = DATA_SIZE / threads;
+
+	auto r = pop.root();
+	auto size = nvobj::flat_transaction::log_snapshots_max_size({chunk});
+
+	parallel_exec(threads, [&](size_t id) {
+		for (int i = 0; i < 10; i++) {
+			r->buffers->run(pop, size, [&] {
+				nvobj::flat_transaction::log_auto_alloc(
+					nvobj::flat_transaction::log_type::
+						snapshot,
+					false);
+
+				auto ptr = r->data.get() + id * chunk;
+				nvobj::flat_transaction::snapshot(ptr, chunk);
+				std::memset(ptr, static_cast<char>(id), chunk);
+			});
+		}
+	});
+
+	for (size_t i = 0; i < DATA_SIZE; i++)
+		UT_ASSERTeq(r->data[static_cast<std::ptrdiff_t>(i)],
+			    static_cast<char>(i / chunk));
+
+	r->buffers->clear();
+}
+}
+
+static void
+test(int argc, char *argv[])
+{
+	if (argc != 2)
+		UT_FATAL("usage: %s file-name", argv[0]);
+
+	auto path = argv[1];
+	auto pop = nvobj::pool<root>::create(path, "transaction_log_buffers",
+					     PMEMOBJ_MIN_POOL * 4,
+					     S_IWUSR | S_IRUSR);
+
+	auto r = pop.root();
+	nvobj::flat_transaction::run(pop, [&] {
+		r->buffers = nvobj::make_persistent<nvobjex::tx_log_buffers>();
+		r->data = nvobj::make_persistent<char[]>(DATA_SIZE);
+	});
+
+	test_no_buffer(pop);
+	test_buffer(pop);
+	test_threads(pop);
+
+	nvobj::flat_transaction::run(pop, [&] {
+		nvobj::delete_persistent<nvobjex::tx_log_buffers>(r->buffers);
+		nvobj::delete_persistent<char[]>(r->data, DATA_SIZE);
+	});
+
+	pop.close();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return run_test([&] { test(argc, argv); });
+}